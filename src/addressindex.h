@@ -0,0 +1,213 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WISPR_ADDRESSINDEX_H
+#define WISPR_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+/** Default for -addressindex */
+static const bool DEFAULT_ADDRESSINDEX = false;
+
+/** Address types in the index keys */
+enum AddressIndexType {
+    ADDRESS_INDEX_NONE = 0,
+    //! pay to pubkey hash, and pay to pubkey under the hash of the key
+    ADDRESS_INDEX_PUBKEYHASH = 1,
+    ADDRESS_INDEX_SCRIPTHASH = 2,
+};
+
+/** The address type and hash an output pays to, if it is one the index knows */
+bool GetAddressIndexKey(const CScript& scriptPubKey, int& type, uint160& hashBytes);
+
+template <typename Stream>
+void SerializeHeightBE(Stream& s, int nHeight)
+{
+    // Big endian, so the keys of an address sort by height
+    unsigned char buf[4];
+    WriteBE32(buf, nHeight);
+    s.write((const char*)buf, sizeof(buf));
+}
+
+template <typename Stream>
+int UnserializeHeightBE(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, sizeof(buf));
+    return ReadBE32(buf);
+}
+
+/**
+ * An output received by or an input spent from an address, in the order
+ * the address saw them. The value is the amount, negative when spent.
+ */
+struct CAddressIndexKey {
+    unsigned char type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey() { SetNull(); }
+
+    CAddressIndexKey(int addressType, const uint160& addressHash, int height, unsigned int blockindex,
+                     const uint256& txid, unsigned int indexValue, bool isSpending)
+        : type(addressType), hashBytes(addressHash), blockHeight(height), txindex(blockindex),
+          txhash(txid), index(indexValue), spending(isSpending) {}
+
+    void SetNull()
+    {
+        type = 0;
+        hashBytes.SetNull();
+        blockHeight = 0;
+        txindex = 0;
+        txhash.SetNull();
+        index = 0;
+        spending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 66;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        SerializeHeightBE(s, blockHeight);
+        SerializeHeightBE(s, txindex);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+        ::Serialize(s, spending, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, type, nType, nVersion);
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = UnserializeHeightBE(s);
+        txindex = UnserializeHeightBE(s);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+        ::Unserialize(s, spending, nType, nVersion);
+    }
+};
+
+/** Seek key for the first CAddressIndexKey of an address, optionally from a height on */
+struct CAddressIndexIteratorKey {
+    unsigned char type;
+    uint160 hashBytes;
+    bool fHeight;
+    int blockHeight;
+
+    CAddressIndexIteratorKey(int addressType, const uint160& addressHash)
+        : type(addressType), hashBytes(addressHash), fHeight(false), blockHeight(0) {}
+    CAddressIndexIteratorKey(int addressType, const uint160& addressHash, int height)
+        : type(addressType), hashBytes(addressHash), fHeight(true), blockHeight(height) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return fHeight ? 25 : 21;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        if (fHeight)
+            SerializeHeightBE(s, blockHeight);
+    }
+};
+
+/** An unspent output of an address */
+struct CAddressUnspentKey {
+    unsigned char type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey() { SetNull(); }
+
+    CAddressUnspentKey(int addressType, const uint160& addressHash, const uint256& txid, unsigned int indexValue)
+        : type(addressType), hashBytes(addressHash), txhash(txid), index(indexValue) {}
+
+    void SetNull()
+    {
+        type = 0;
+        hashBytes.SetNull();
+        txhash.SetNull();
+        index = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 57;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, type, nType, nVersion);
+        hashBytes.Serialize(s, nType, nVersion);
+        txhash.Serialize(s, nType, nVersion);
+        ::Serialize(s, index, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        ::Unserialize(s, type, nType, nVersion);
+        hashBytes.Unserialize(s, nType, nVersion);
+        txhash.Unserialize(s, nType, nVersion);
+        ::Unserialize(s, index, nType, nVersion);
+    }
+};
+
+/** A null value erases the unspent output from the index */
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+
+    CAddressUnspentValue(CAmount sats, const CScript& scriptPubKey, int height)
+        : satoshis(sats), script(scriptPubKey), blockHeight(height) {}
+
+    CAddressUnspentValue() { SetNull(); }
+
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return satoshis == -1;
+    }
+};
+
+#endif // WISPR_ADDRESSINDEX_H
@@ -0,0 +1,111 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "utiltime.h"
+
+#include <univalue.h>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+benchmark::BenchRunner::BenchmarkMap& benchmark::BenchRunner::benchmarks()
+{
+    static std::map<std::string, benchmark::BenchFunction> benchmarks_map;
+    return benchmarks_map;
+}
+
+static double gettimedouble()
+{
+    return GetTimeMicros() * 0.000001;
+}
+
+benchmark::BenchRunner::BenchRunner(std::string name, benchmark::BenchFunction func)
+{
+    benchmarks().insert(std::make_pair(name, func));
+}
+
+UniValue benchmark::BenchRunner::RunAll(double elapsedTimeForOne, const std::string& strFilter)
+{
+    UniValue results(UniValue::VARR);
+    for (const auto& p : benchmarks()) {
+        if (p.first.find(strFilter) == std::string::npos)
+            continue;
+        // Progress goes to stderr, so stdout stays valid JSON
+        std::cerr << "Running " << p.first << std::endl;
+        State state(p.first, elapsedTimeForOne);
+        p.second(state);
+        Result result = state.GetResult();
+
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("name", result.name));
+        entry.push_back(Pair("iterations", (uint64_t)result.nIterations));
+        entry.push_back(Pair("min", result.dMin));
+        entry.push_back(Pair("median", result.dMedian));
+        entry.push_back(Pair("max", result.dMax));
+        entry.push_back(Pair("average", result.dAverage));
+        results.push_back(entry);
+    }
+    return results;
+}
+
+bool benchmark::State::KeepRunning()
+{
+    if (count & countMask) {
+        ++count;
+        return true;
+    }
+    double now;
+    if (count == 0) {
+        lastTime = beginTime = now = gettimedouble();
+    } else {
+        now = gettimedouble();
+        double elapsed = now - lastTime;
+        vSamples.push_back(elapsed * countMaskInv);
+        if (elapsed * 128 < maxElapsed) {
+            // If the execution was much too fast (1/128th of maxElapsed), increase the count mask by 8x and restart timing.
+            // The restart avoids including the overhead of this code in the measurement.
+            countMask = ((countMask << 3) | 7) & ((1LL << 60) - 1);
+            countMaskInv = 1. / (countMask + 1);
+            vSamples.clear();
+            return true;
+        }
+        if (elapsed * 16 < maxElapsed) {
+            uint64_t newCountMask = ((countMask << 1) | 1) & ((1LL << 60) - 1);
+            if ((count & newCountMask) == 0) {
+                countMask = newCountMask;
+                countMaskInv = 1. / (countMask + 1);
+            }
+        }
+    }
+    lastTime = now;
+    ++count;
+
+    if (now - beginTime < maxElapsed) return true; // Keep going
+
+    --count;
+    return false;
+}
+
+benchmark::Result benchmark::State::GetResult() const
+{
+    Result result;
+    result.name = name;
+    result.nIterations = count;
+    result.dMin = result.dMedian = result.dMax = result.dAverage = 0;
+    if (vSamples.empty() || count == 0)
+        return result;
+
+    std::vector<double> vSorted(vSamples);
+    std::sort(vSorted.begin(), vSorted.end());
+    result.dMin = vSorted.front();
+    result.dMax = vSorted.back();
+    size_t nMid = vSorted.size() / 2;
+    result.dMedian = vSorted.size() % 2 ? vSorted[nMid] : (vSorted[nMid - 1] + vSorted[nMid]) / 2;
+    result.dAverage = (lastTime - beginTime) / count;
+    return result;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WISPR_BENCH_BENCH_H
+#define WISPR_BENCH_BENCH_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+class UniValue;
+
+// Simple micro-benchmarking framework; API mostly matches a subset of the Google Benchmark
+// framework (see https://github.com/google/benchmark)
+// Why not use the Google Benchmark framework? Because adding Yet Another Dependency
+// (that uses cmake as its build system and has lots of features we don't need) isn't
+// worth it.
+
+/*
+ * Usage:
+
+static void CODE_TO_TIME(benchmark::State& state)
+{
+    ... do any setup needed...
+    while (state.KeepRunning()) {
+       ... do stuff you want to time...
+    }
+    ... do any cleanup needed...
+}
+
+BENCHMARK(CODE_TO_TIME);
+
+ */
+
+namespace benchmark
+{
+/** Timing of one benchmark, all times in seconds per iteration */
+struct Result {
+    std::string name;
+    uint64_t nIterations;
+    double dMin;
+    double dMedian;
+    double dMax;
+    double dAverage;
+};
+
+class State
+{
+    std::string name;
+    double maxElapsed;
+    double beginTime;
+    double lastTime;
+    //! per-iteration time of every timed batch since the batch size last grew
+    std::vector<double> vSamples;
+    uint64_t count;
+    uint64_t countMask;
+    double countMaskInv;
+
+public:
+    State(std::string nameIn, double maxElapsedIn) : name(nameIn), maxElapsed(maxElapsedIn), beginTime(0), lastTime(0), count(0), countMask(0), countMaskInv(1) {}
+    bool KeepRunning();
+    Result GetResult() const;
+};
+
+typedef boost::function<void(State&)> BenchFunction;
+
+class BenchRunner
+{
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& benchmarks();
+
+public:
+    BenchRunner(std::string name, BenchFunction func);
+
+    /** Run every benchmark whose name contains strFilter, return the results as a JSON array */
+    static UniValue RunAll(double elapsedTimeForOne, const std::string& strFilter);
+};
+}
+
+// BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // WISPR_BENCH_BENCH_H
@@ -0,0 +1,50 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "key.h"
+#include "script/sigcache.h"
+#include "util.h"
+
+#include <univalue.h>
+
+#include <iostream>
+
+static const double DEFAULT_BENCH_TIME = 1.0;
+
+int main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("-help")) {
+        std::cout << "Usage: bench_wispr [options]\n\n"
+                  << "Runs the micro-benchmarks and prints min/median/max seconds per iteration as JSON.\n\n"
+                  << "Options:\n"
+                  << "  -filter=<str>   Only run benchmarks whose name contains <str>\n"
+                  << "  -time=<n>       Seconds to spend on each benchmark (default: " << DEFAULT_BENCH_TIME << ")\n";
+        return 0;
+    }
+
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    ECC_Start();
+    ECCVerifyHandle verifyHandle;
+    SelectParams(CBaseChainParams::UNITTEST);
+    InitSignatureCache();
+
+    double dTime = DEFAULT_BENCH_TIME;
+    if (mapArgs.count("-time"))
+        dTime = std::max(0.01, atof(mapArgs["-time"].c_str()));
+
+    UniValue results = benchmark::BenchRunner::RunAll(dTime, GetArg("-filter", ""));
+    UniValue output(UniValue::VOBJ);
+    output.push_back(Pair("unit", "seconds"));
+    output.push_back(Pair("benchmarks", results));
+    std::cout << output.write(2) << std::endl;
+
+    ECC_Stop();
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "hash.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "timedata.h"
+
+static CScript RandomP2PKH()
+{
+    return GetScriptForDestination(CKeyID(Hash160(ToByteVector(GetRandHash()))));
+}
+
+static CTransaction RandomTransaction(unsigned int nInputs, unsigned int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(nInputs);
+    for (CTxIn& in : tx.vin) {
+        in.prevout = COutPoint(GetRandHash(), 0);
+        // Same size as a DER signature followed by a compressed pubkey
+        in.scriptSig = CScript() << std::vector<unsigned char>(72, 0x30) << std::vector<unsigned char>(33, 0x02);
+    }
+    tx.vout.resize(nOutputs);
+    for (CTxOut& out : tx.vout) {
+        out.nValue = 1 * COIN;
+        out.scriptPubKey = RandomP2PKH();
+    }
+    return CTransaction(tx);
+}
+
+/** A proof-of-stake block with nTx ordinary transactions, valid as far as CheckBlock can tell */
+static CBlock CreatePoSBlock(unsigned int nTx)
+{
+    CBlock block;
+    block.nVersion = Params().Zerocoin_HeaderVersion() - 1;
+    block.nTime = GetAdjustedTime();
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].SetEmpty();
+    block.vtx.push_back(CTransaction(coinbase));
+
+    CMutableTransaction coinstake(RandomTransaction(1, 2));
+    coinstake.vout[0].SetEmpty();
+    block.vtx.push_back(CTransaction(coinstake));
+
+    for (unsigned int i = 0; i < nTx; i++)
+        block.vtx.push_back(RandomTransaction(1 + i % 3, 2));
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void CheckBlockPoS(benchmark::State& state)
+{
+    CBlock block = CreatePoSBlock(1000);
+    bool fValid = true;
+    while (state.KeepRunning()) {
+        CValidationState validationState;
+        fValid &= CheckBlock(block, validationState, false, true);
+    }
+    assert(fValid);
+}
+
+static void SerializeBlock(benchmark::State& state)
+{
+    CBlock block = CreatePoSBlock(1000);
+    while (state.KeepRunning()) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << block;
+    }
+}
+
+static void DeserializeBlock(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CreatePoSBlock(1000);
+    while (state.KeepRunning()) {
+        CDataStream copy(stream);
+        CBlock block;
+        copy >> block;
+    }
+}
+
+static void SerializeTransaction(benchmark::State& state)
+{
+    CTransaction tx = RandomTransaction(2, 2);
+    while (state.KeepRunning()) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << tx;
+    }
+}
+
+static void DeserializeTransaction(benchmark::State& state)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << RandomTransaction(2, 2);
+    while (state.KeepRunning()) {
+        CDataStream copy(stream);
+        CTransaction tx;
+        copy >> tx;
+    }
+}
+
+BENCHMARK(CheckBlockPoS);
+BENCHMARK(SerializeBlock);
+BENCHMARK(DeserializeBlock);
+BENCHMARK(SerializeTransaction);
+BENCHMARK(DeserializeTransaction);
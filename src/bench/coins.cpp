@@ -0,0 +1,71 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "hash.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/standard.h"
+
+#include <vector>
+
+/** Add nCount single-input, two-output transactions to the view and return their ids */
+static std::vector<uint256> FillCoins(CCoinsViewCache& view, unsigned int nCount)
+{
+    std::vector<uint256> vTxid;
+    for (unsigned int i = 0; i < nCount; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(2);
+        for (CTxOut& out : tx.vout) {
+            out.nValue = 10 * COIN;
+            out.scriptPubKey = GetScriptForDestination(CKeyID(Hash160(ToByteVector(GetRandHash()))));
+        }
+        CTransaction txFinal(tx);
+        view.ModifyCoins(txFinal.GetHash())->FromTx(txFinal, i);
+        vTxid.push_back(txFinal.GetHash());
+    }
+    return vTxid;
+}
+
+// Lookups through a fresh child cache, as ConnectBlock does on top of pcoinsTip
+static void CoinsViewCacheFetch(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    CCoinsViewCache coinsTip(&coinsDummy);
+    std::vector<uint256> vTxid = FillCoins(coinsTip, 10000);
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&coinsTip);
+        for (unsigned int i = 0; i < 100; i++)
+            assert(view.AccessCoins(vTxid[n++ % vTxid.size()]));
+    }
+}
+
+// Spend 100 outputs in a child cache and write them back to the parent
+static void CoinsViewCacheFlush(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    CCoinsViewCache coinsTip(&coinsDummy);
+    std::vector<uint256> vTxid = FillCoins(coinsTip, 10000);
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&coinsTip);
+        for (unsigned int i = 0; i < 100; i++) {
+            CCoinsModifier coins = view.ModifyCoins(vTxid[n++ % vTxid.size()]);
+            // Alternate between spending and recreating the output so the set stays the same size
+            if (coins->IsAvailable(0))
+                coins->Spend(0);
+            else
+                coins->vout[0].nValue = 10 * COIN;
+        }
+        view.Flush();
+    }
+}
+
+BENCHMARK(CoinsViewCacheFetch);
+BENCHMARK(CoinsViewCacheFlush);
@@ -0,0 +1,33 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/scrypt.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+static void ScryptBlockHash(benchmark::State& state)
+{
+    CBlockHeader header;
+    header.nVersion = 1;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1546300800;
+    header.nBits = 0x1e0ffff0;
+    header.nNonce = 0;
+
+    // scrypt_blockhash reads the first 80 bytes, which is the pre-zerocoin header
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    assert(ss.size() >= 80);
+    while (state.KeepRunning()) {
+        scrypt_blockhash(&ss[0]);
+        ss[76]++; // bump the nonce so every iteration hashes a new header
+    }
+}
+
+BENCHMARK(ScryptBlockHash);
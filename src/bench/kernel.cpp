@@ -0,0 +1,114 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/wispr-config.h"
+#endif
+
+#include "bench.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "random.h"
+
+#ifdef ENABLE_WALLET
+#include "kernel.h"
+#include "stakeinput.h"
+#endif
+
+// Every iteration hashes one stake time window (STAKE_HASH_DRIFT seconds) for
+// 100 inputs, so kernels/s is 6000 divided by the median.
+static const int KERNEL_BENCH_INPUTS = 100;
+static const int KERNEL_BENCH_DRIFT = 60;
+
+/** The 48 byte prefix of a WSP kernel: modifier, block time and outpoint */
+static std::vector<unsigned char> RandomKernelPrefix()
+{
+    std::vector<unsigned char> prefix(48);
+    GetRandBytes(prefix.data(), prefix.size());
+    return prefix;
+}
+
+static void StakeKernelHashScalar(benchmark::State& state)
+{
+    std::vector<std::vector<unsigned char> > vPrefixes;
+    for (int i = 0; i < KERNEL_BENCH_INPUTS; i++)
+        vPrefixes.push_back(RandomKernelPrefix());
+
+    uint32_t nTime = 1546300800;
+    unsigned char hash[32];
+    while (state.KeepRunning()) {
+        for (const std::vector<unsigned char>& prefix : vPrefixes) {
+            for (int i = 0; i < KERNEL_BENCH_DRIFT; i++) {
+                unsigned char word[4];
+                WriteLE32(word, nTime + KERNEL_BENCH_DRIFT - i);
+                CSHA256().Write(prefix.data(), prefix.size()).Write(word, 4).Finalize(hash);
+                CSHA256().Write(hash, 32).Finalize(hash);
+            }
+        }
+        nTime += KERNEL_BENCH_DRIFT;
+    }
+}
+
+static void StakeKernelHashSweep(benchmark::State& state)
+{
+    std::vector<CSHA256DWordSweep> vSweeps;
+    for (int i = 0; i < KERNEL_BENCH_INPUTS; i++) {
+        std::vector<unsigned char> prefix = RandomKernelPrefix();
+        vSweeps.push_back(CSHA256DWordSweep(prefix.data(), prefix.size()));
+    }
+
+    uint32_t nTime = 1546300800;
+    std::vector<uint32_t> vTimes(KERNEL_BENCH_DRIFT);
+    std::vector<unsigned char> vHashes(KERNEL_BENCH_DRIFT * 32);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < KERNEL_BENCH_DRIFT; i++)
+            vTimes[i] = nTime + KERNEL_BENCH_DRIFT - i;
+        for (const CSHA256DWordSweep& sweep : vSweeps)
+            sweep.Hash(vHashes.data(), vTimes.data(), vTimes.size());
+        nTime += KERNEL_BENCH_DRIFT;
+    }
+}
+
+#ifdef ENABLE_WALLET
+/** Runs the wallet's kernel search over inputs that never meet the target, so every kernel is hashed */
+static void StakeKernelSearch(benchmark::State& state, int nThreads)
+{
+    std::vector<std::unique_ptr<CWspStake> > vInputs;
+    std::vector<CStakeKernel> vKernels;
+    for (int i = 0; i < KERNEL_BENCH_INPUTS; i++) {
+        CMutableTransaction tx;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 10000 * COIN;
+        tx.vout[0].scriptPubKey = CScript() << ToByteVector(GetRandHash()) << OP_CHECKSIG;
+        vInputs.emplace_back(new CWspStake());
+        vInputs.back()->SetInput(CTransaction(tx), 0);
+        vKernels.push_back(CStakeKernel(vInputs.back().get(), 1500000000, GetRand(std::numeric_limits<uint64_t>::max()), 0x03000001));
+    }
+
+    unsigned int nTime = 1546300800;
+    while (state.KeepRunning()) {
+        unsigned int nTimeTx = 0;
+        uint256 hashProofOfStake;
+        SearchStakeKernels(vKernels, 0, nTime, nThreads, nTimeTx, hashProofOfStake);
+        nTime += KERNEL_BENCH_DRIFT;
+    }
+}
+
+static void StakeKernelSearch1Thread(benchmark::State& state)
+{
+    StakeKernelSearch(state, 1);
+}
+
+static void StakeKernelSearch4Threads(benchmark::State& state)
+{
+    StakeKernelSearch(state, 4);
+}
+
+BENCHMARK(StakeKernelSearch1Thread);
+BENCHMARK(StakeKernelSearch4Threads);
+#endif
+
+BENCHMARK(StakeKernelHashScalar);
+BENCHMARK(StakeKernelHashSweep);
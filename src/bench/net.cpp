@@ -0,0 +1,88 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "hash.h"
+#include "net.h"
+#include "netbufferpool.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "version.h"
+
+#include <deque>
+#include <iostream>
+
+// Every iteration receives 100 "tx" messages and keeps the most recent 1000
+// payloads for relay, the way mapRelay does.
+static const int TX_FLOOD_MESSAGES = 100;
+static const size_t TX_FLOOD_RELAY = 1000;
+
+/** A transaction of the size a typical two-input payment has */
+static CTransaction RandomTransaction()
+{
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    for (CTxIn& txin : tx.vin) {
+        txin.prevout = COutPoint(GetRandHash(), 0);
+        txin.scriptSig = CScript() << std::vector<unsigned char>(72) << std::vector<unsigned char>(33);
+    }
+    tx.vout.resize(2);
+    for (CTxOut& txout : tx.vout) {
+        txout.nValue = GetRand(1000 * COIN);
+        txout.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return CTransaction(tx);
+}
+
+static void TxFloodReceive(benchmark::State& state, size_t nPoolBytes)
+{
+    CDataStream ssWire(SER_NETWORK, PROTOCOL_VERSION);
+    for (int i = 0; i < TX_FLOOD_MESSAGES; i++) {
+        CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+        ssTx << RandomTransaction();
+        CMessageHeader hdr("tx", ssTx.size());
+        uint256 hash = Hash(ssTx.begin(), ssTx.end());
+        memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+        ssWire << hdr;
+        ssWire.write(&ssTx[0], ssTx.size());
+    }
+
+    netBufferPool.SetMaxBytes(nPoolBytes);
+    CNetBufferStats statsBefore = netBufferPool.GetStats();
+    {
+        std::deque<std::shared_ptr<const CDataStream> > dRelay;
+        CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+        LOCK(node.cs_vRecvMsg);
+        while (state.KeepRunning()) {
+            node.ReceiveMsgBytes(&ssWire[0], ssWire.size());
+            for (CNetMessage& msg : node.vRecvMsg) {
+                CTransaction tx;
+                CSpanReader(&msg.vRecv[0], &msg.vRecv[0] + msg.vRecv.size(), SER_NETWORK, PROTOCOL_VERSION) >> tx;
+                dRelay.push_back(std::make_shared<const CDataStream>(msg.vRecv.begin(), msg.vRecv.end(), msg.vRecv.GetType(), msg.vRecv.GetVersion()));
+                if (dRelay.size() > TX_FLOOD_RELAY)
+                    dRelay.pop_front();
+            }
+            node.vRecvMsg.clear();
+        }
+    }
+    CNetBufferStats stats = netBufferPool.GetStats();
+    std::cerr << "  buffers acquired " << stats.nAcquired - statsBefore.nAcquired
+              << ", reused " << stats.nReused - statsBefore.nReused
+              << ", allocated " << stats.nAllocated - statsBefore.nAllocated << std::endl;
+    netBufferPool.SetMaxBytes(DEFAULT_NET_BUFFER_POOL_SIZE);
+}
+
+static void TxFloodReceivePooled(benchmark::State& state)
+{
+    TxFloodReceive(state, DEFAULT_NET_BUFFER_POOL_SIZE);
+}
+
+static void TxFloodReceiveUnpooled(benchmark::State& state)
+{
+    TxFloodReceive(state, 0);
+}
+
+BENCHMARK(TxFloodReceivePooled);
+BENCHMARK(TxFloodReceiveUnpooled);
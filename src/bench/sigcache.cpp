@@ -0,0 +1,63 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+#include <vector>
+
+static void SignedHashes(const CKey& key, unsigned int nCount, std::vector<uint256>& vHash, std::vector<std::vector<unsigned char> >& vSig)
+{
+    for (unsigned int i = 0; i < nCount; i++) {
+        vHash.push_back(GetRandHash());
+        vSig.push_back(std::vector<unsigned char>());
+        key.Sign(vHash.back(), vSig.back());
+    }
+}
+
+// A block transaction whose signature was already checked on mempool acceptance
+static void SigCacheHit(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    std::vector<uint256> vHash;
+    std::vector<std::vector<unsigned char> > vSig;
+    SignedHashes(key, 1000, vHash, vSig);
+
+    CTransaction tx;
+    for (unsigned int i = 0; i < vHash.size(); i++)
+        CachingTransactionSignatureChecker(&tx, 0, true).VerifySignature(vSig[i], pubkey, vHash[i]);
+
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        size_t i = n++ % vHash.size();
+        assert(CachingTransactionSignatureChecker(&tx, 0, false).VerifySignature(vSig[i], pubkey, vHash[i]));
+    }
+}
+
+// The same lookup when the cache does not have the entry, so the signature is verified
+static void SigCacheMiss(benchmark::State& state)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    std::vector<uint256> vHash;
+    std::vector<std::vector<unsigned char> > vSig;
+    SignedHashes(key, 100, vHash, vSig);
+
+    CTransaction tx;
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        size_t i = n++ % vHash.size();
+        assert(CachingTransactionSignatureChecker(&tx, 0, false).VerifySignature(vSig[i], pubkey, vHash[i]));
+    }
+}
+
+BENCHMARK(SigCacheHit);
+BENCHMARK(SigCacheMiss);
@@ -0,0 +1,53 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "libzerocoin/Accumulator.h"
+#include "libzerocoin/Coin.h"
+#include "libzerocoin/CoinSpend.h"
+#include "libzerocoin/Denominations.h"
+
+#include <vector>
+
+static void ZerocoinAccumulate(benchmark::State& state)
+{
+    libzerocoin::ZerocoinParams* ZCParams = Params().Zerocoin_Params(false);
+    libzerocoin::CoinDenomination denom = libzerocoin::CoinDenomination::ZQ_ONE;
+    std::vector<libzerocoin::PublicCoin> vPubCoins;
+    for (unsigned int i = 0; i < 10; i++)
+        vPubCoins.push_back(libzerocoin::PrivateCoin(ZCParams, denom).getPublicCoin());
+
+    libzerocoin::Accumulator acc(&ZCParams->accumulatorParams, denom);
+    size_t n = 0;
+    while (state.KeepRunning())
+        acc += vPubCoins[n++ % vPubCoins.size()];
+}
+
+static void ZerocoinSpendVerify(benchmark::State& state)
+{
+    libzerocoin::ZerocoinParams* ZCParams = Params().Zerocoin_Params(false);
+    libzerocoin::CoinDenomination denom = libzerocoin::CoinDenomination::ZQ_ONE;
+    std::vector<libzerocoin::PrivateCoin> vCoins;
+    for (unsigned int i = 0; i < 3; i++)
+        vCoins.push_back(libzerocoin::PrivateCoin(ZCParams, denom));
+
+    libzerocoin::Accumulator acc(&ZCParams->accumulatorParams, denom);
+    libzerocoin::AccumulatorWitness accWitness(ZCParams, acc, vCoins[0].getPublicCoin());
+    for (unsigned int i = 0; i < vCoins.size(); i++) {
+        acc += vCoins[i].getPublicCoin();
+        if (i != 0)
+            accWitness += vCoins[i].getPublicCoin();
+    }
+    libzerocoin::CoinSpend spend(ZCParams, ZCParams, vCoins[0], acc, 0, accWitness, 0, libzerocoin::SpendType::SPEND);
+
+    bool fValid = true;
+    while (state.KeepRunning())
+        fValid &= spend.Verify(acc, true);
+    assert(fValid);
+}
+
+BENCHMARK(ZerocoinAccumulate);
+BENCHMARK(ZerocoinSpendVerify);
@@ -0,0 +1,162 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "util.h"
+
+#include <string.h>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+CBlockCache hotBlocks(DEFAULT_BLOCK_CACHE_SIZE << 20);
+CBlockFileMapper mappedBlockFiles;
+
+CBlockCache::CBlockCache(size_t nMaxBytesIn) : nMaxBytes(nMaxBytesIn), nBytes(0), nHits(0), nMisses(0)
+{
+}
+
+void CBlockCache::SetMaxSize(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    Trim();
+}
+
+CBlockCache::BlockData CBlockCache::Get(const uint256& hash)
+{
+    LOCK(cs);
+    std::map<uint256, std::list<std::pair<uint256, BlockData> >::iterator>::iterator it = mapBlocks.find(hash);
+    if (it == mapBlocks.end()) {
+        nMisses++;
+        return BlockData();
+    }
+    nHits++;
+    lruBlocks.splice(lruBlocks.begin(), lruBlocks, it->second);
+    return it->second->second;
+}
+
+void CBlockCache::Add(const uint256& hash, const BlockData& data)
+{
+    LOCK(cs);
+    // Never let one block push out everything else
+    if (!data || data->size() > nMaxBytes / 2 || mapBlocks.count(hash))
+        return;
+
+    lruBlocks.push_front(std::make_pair(hash, data));
+    mapBlocks.insert(std::make_pair(hash, lruBlocks.begin()));
+    nBytes += data->size();
+    Trim();
+}
+
+void CBlockCache::Clear()
+{
+    LOCK(cs);
+    lruBlocks.clear();
+    mapBlocks.clear();
+    nBytes = 0;
+}
+
+void CBlockCache::Trim()
+{
+    AssertLockHeld(cs);
+    while (nBytes > nMaxBytes && !lruBlocks.empty()) {
+        nBytes -= lruBlocks.back().second->size();
+        mapBlocks.erase(lruBlocks.back().first);
+        lruBlocks.pop_back();
+    }
+}
+
+size_t CBlockCache::GetBytes()
+{
+    LOCK(cs);
+    return nBytes;
+}
+
+size_t CBlockCache::GetCount()
+{
+    LOCK(cs);
+    return mapBlocks.size();
+}
+
+uint64_t CBlockCache::GetHits()
+{
+    LOCK(cs);
+    return nHits;
+}
+
+uint64_t CBlockCache::GetMisses()
+{
+    LOCK(cs);
+    return nMisses;
+}
+
+CBlockFileMapper::CBlockFileMapper() : fEnabled(false)
+{
+}
+
+void CBlockFileMapper::SetEnabled(bool fEnabledIn)
+{
+    LOCK(cs);
+    fEnabled = fEnabledIn;
+    if (!fEnabled)
+        mapFiles.clear();
+}
+
+std::shared_ptr<const boost::interprocess::mapped_region> CBlockFileMapper::MapFile(int nFile, size_t nMinSize)
+{
+    LOCK(cs);
+    std::map<int, std::shared_ptr<const boost::interprocess::mapped_region> >::iterator it = mapFiles.find(nFile);
+    if (it != mapFiles.end() && it->second->get_size() >= nMinSize)
+        return it->second;
+
+    // Not mapped yet, or the file grew since: map it again as a whole
+    std::string strPath = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk").string();
+    try {
+        boost::interprocess::file_mapping file(strPath.c_str(), boost::interprocess::read_only);
+        std::shared_ptr<const boost::interprocess::mapped_region> region(new boost::interprocess::mapped_region(file, boost::interprocess::read_only));
+        mapFiles[nFile] = region;
+        if (region->get_size() < nMinSize)
+            return std::shared_ptr<const boost::interprocess::mapped_region>();
+        return region;
+    } catch (const boost::interprocess::interprocess_exception& e) {
+        LogPrint("db", "%s : cannot map %s: %s\n", __func__, strPath, e.what());
+        return std::shared_ptr<const boost::interprocess::mapped_region>();
+    }
+}
+
+bool CBlockFileMapper::MapBlock(const CDiskBlockPos& pos, CMappedBlock& block)
+{
+    // WriteBlockToDisk puts the network magic and the block size in front of the block
+    if (!fEnabled || pos.IsNull() || pos.nPos < 8)
+        return false;
+
+    std::shared_ptr<const boost::interprocess::mapped_region> region = MapFile(pos.nFile, pos.nPos);
+    if (!region)
+        return false;
+
+    const char* pfile = static_cast<const char*>(region->get_address());
+    if (memcmp(pfile + pos.nPos - 8, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return false;
+    unsigned int nSize = ReadLE32((const unsigned char*)pfile + pos.nPos - 4);
+    if (nSize > MAX_BLOCK_SIZE_CURRENT)
+        return false;
+
+    if (region->get_size() < (size_t)pos.nPos + nSize) {
+        region = MapFile(pos.nFile, (size_t)pos.nPos + nSize);
+        if (!region)
+            return false;
+        pfile = static_cast<const char*>(region->get_address());
+    }
+
+    block.region = region;
+    block.pbegin = pfile + pos.nPos;
+    block.nSize = nSize;
+    return true;
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WISPR_BLOCKCACHE_H
+#define WISPR_BLOCKCACHE_H
+
+#include "streams.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <list>
+#include <map>
+#include <memory>
+
+struct CDiskBlockPos;
+
+namespace boost
+{
+namespace interprocess
+{
+class mapped_region;
+}
+} // namespace boost
+
+/** -blockcachesize default, in MiB */
+static const int64_t DEFAULT_BLOCK_CACHE_SIZE = 16;
+/** -blockmmap default */
+static const bool DEFAULT_BLOCK_MMAP = false;
+
+/**
+ * Serialized copies of recently connected and recently requested blocks.
+ *
+ * A new block is asked for by many peers within seconds. Keeping its bytes
+ * around answers those getdata requests without opening the block file or
+ * deserializing the block: the stream is pushed to each peer as it is.
+ */
+class CBlockCache
+{
+public:
+    typedef std::shared_ptr<const CDataStream> BlockData;
+
+    explicit CBlockCache(size_t nMaxBytesIn);
+
+    /** Change the size limit, evicting blocks if needed; 0 disables the cache */
+    void SetMaxSize(size_t nMaxBytesIn);
+
+    /** The serialized block, or an empty pointer if it is not cached */
+    BlockData Get(const uint256& hash);
+    void Add(const uint256& hash, const BlockData& data);
+    void Clear();
+
+    size_t GetBytes();
+    size_t GetCount();
+    uint64_t GetHits();
+    uint64_t GetMisses();
+
+private:
+    CCriticalSection cs;
+    size_t nMaxBytes;
+    size_t nBytes;
+    uint64_t nHits;
+    uint64_t nMisses;
+    // most recently used first
+    std::list<std::pair<uint256, BlockData> > lruBlocks;
+    std::map<uint256, std::list<std::pair<uint256, BlockData> >::iterator> mapBlocks;
+
+    void Trim();
+};
+
+/** A block inside a memory mapped block file; the mapping stays valid while this exists */
+class CMappedBlock
+{
+public:
+    std::shared_ptr<const boost::interprocess::mapped_region> region;
+    const char* pbegin;
+    unsigned int nSize;
+
+    CMappedBlock() : pbegin(nullptr), nSize(0) {}
+};
+
+/**
+ * Read-only memory maps of the blk?????.dat files.
+ *
+ * Each file is mapped whole, and mapped again once blocks are appended past
+ * the end of the current mapping. Readers hold on to the mapping they were
+ * given, so an older one is only unmapped after the last reader is done.
+ */
+class CBlockFileMapper
+{
+public:
+    CBlockFileMapper();
+
+    void SetEnabled(bool fEnabledIn);
+    bool IsEnabled() const { return fEnabled; }
+
+    /** Map the block written by WriteBlockToDisk at pos; false if that fails, so callers can fall back to fread */
+    bool MapBlock(const CDiskBlockPos& pos, CMappedBlock& block);
+
+private:
+    CCriticalSection cs;
+    bool fEnabled;
+    std::map<int, std::shared_ptr<const boost::interprocess::mapped_region> > mapFiles;
+
+    std::shared_ptr<const boost::interprocess::mapped_region> MapFile(int nFile, size_t nMinSize);
+};
+
+extern CBlockCache hotBlocks;
+extern CBlockFileMapper mappedBlockFiles;
+
+#endif // WISPR_BLOCKCACHE_H
@@ -0,0 +1,259 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "blocksignature.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "protocol.h"
+#include "streams.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/bind.hpp>
+
+void PrepareImportBlock(CImportBlock& item)
+{
+    item.fPrechecked = false;
+    try {
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        CSpanReader(item.vData.data(), item.vData.data() + item.vData.size(), SER_DISK, CLIENT_VERSION) >> *pblock;
+        item.hash = pblock->GetHash();
+        item.pblock = pblock;
+    } catch (const std::exception& e) {
+        item.strError = e.what();
+    }
+    std::vector<char>().swap(item.vData);
+    if (!item.pblock)
+        return;
+
+    // CheckBlock itself depends on the chain, so only the expensive parts
+    // that don't are done here; ProcessNewBlock skips them afterwards.
+    // The key of a zWSP stake comes from its coin spend, whose checks read
+    // the chain, so those blocks are left to the normal path under cs_main.
+    const CBlock& block = *item.pblock;
+    if (block.IsProofOfStake() && block.vtx[1].vin[0].IsZerocoinSpend())
+        return;
+    try {
+        bool fMutated = false;
+        item.fPrechecked = block.BuildMerkleTree(&fMutated) == block.hashMerkleRoot && !fMutated &&
+                           CheckBlockSignature(block);
+    } catch (const std::exception& e) {
+        LogPrintf("%s : precheck of block %s failed - %s\n", __func__, item.hash.GetHex(), e.what());
+        item.fPrechecked = false;
+    }
+}
+
+CBlockImportPipeline::CBlockImportPipeline(FILE* fileIn, int nThreads) : file(fileIn), nNextSeq(0), nNextOut(0), nEpoch(0), nQueuedBlocks(0), nQueuedBytes(0), fReaderDone(false), fReaderExited(false), fRewind(false), nRewindPos(0), fStop(false)
+{
+    stats.nBlocks = stats.nBytes = stats.nRewinds = 0;
+    stats.nReaderWaitMillis = stats.nConnectWaitMillis = 0;
+    threads.create_thread(boost::bind(&CBlockImportPipeline::ThreadRead, this));
+    for (int i = 0; i < std::max(nThreads, 1); i++)
+        threads.create_thread(boost::bind(&CBlockImportPipeline::ThreadCheck, this));
+}
+
+CBlockImportPipeline::~CBlockImportPipeline()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    condReader.notify_all();
+    condWorker.notify_all();
+    threads.join_all();
+    for (CImportBlock* item : vPending)
+        delete item;
+    for (std::map<uint64_t, CImportBlock*>::iterator it = mapReady.begin(); it != mapReady.end(); it++)
+        delete it->second;
+}
+
+bool CBlockImportPipeline::IsFull() const
+{
+    return nQueuedBlocks >= MAX_IMPORT_QUEUE_BLOCKS || nQueuedBytes >= MAX_IMPORT_QUEUE_BYTES;
+}
+
+void CBlockImportPipeline::Drop(CImportBlock* item)
+{
+    nQueuedBlocks--;
+    nQueuedBytes -= item->nSize;
+    delete item;
+    condReader.notify_one();
+}
+
+void CBlockImportPipeline::ThreadRead()
+{
+    RenameThread("wispr-importread");
+    try {
+        // This takes over file and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(file, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        uint64_t nEpochRead = 0;
+        bool fEnd = false;
+        while (true) {
+            bool fSeek = false;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (!fRewind && (fEnd || blkdat.eof())) {
+                    fReaderDone = true;
+                    condConsumer.notify_all();
+                }
+                int64_t nStart = GetTimeMillis();
+                bool fWaitFull = !fReaderDone;
+                while (!fStop && !fRewind && (fReaderDone || IsFull()))
+                    condReader.wait(lock);
+                if (fWaitFull)
+                    stats.nReaderWaitMillis += GetTimeMillis() - nStart;
+                if (fStop)
+                    return;
+                if (fRewind) {
+                    fRewind = false;
+                    fReaderDone = false;
+                    fEnd = false;
+                    fSeek = true;
+                    nRewind = nRewindPos;
+                    nEpochRead = nEpoch;
+                }
+            }
+
+            // A rewind can reach back further than the buffer holds
+            if (!blkdat.SetPos(nRewind) && fSeek && !blkdat.Seek(nRewind)) {
+                fEnd = true;
+                continue;
+            }
+            nRewind++;         // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            std::unique_ptr<CImportBlock> item(new CImportBlock());
+            try {
+                // locate a header
+                unsigned char buf[MESSAGE_START_SIZE];
+                blkdat.FindByte(Params().MessageStart()[0]);
+                item->nStartPos = blkdat.GetPos();
+                nRewind = item->nStartPos + 1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> item->nSize;
+                if (item->nSize < 80 || item->nSize > MAX_BLOCK_SIZE_CURRENT)
+                    continue;
+            } catch (const std::exception&) {
+                // no valid block header found; don't complain
+                fEnd = true;
+                continue;
+            }
+            try {
+                // read block
+                item->nPos = blkdat.GetPos();
+                blkdat.SetLimit(item->nPos + item->nSize);
+                item->vData.resize(item->nSize);
+                blkdat.read(&item->vData[0], item->nSize);
+                nRewind = blkdat.GetPos();
+            } catch (const std::exception& e) {
+                LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, e.what());
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fStop)
+                return;
+            // Read before a rewind that has not been picked up yet
+            if (fRewind || nEpochRead != nEpoch)
+                continue;
+            item->nSeq = nNextSeq++;
+            item->nEpoch = nEpoch;
+            item->fPrechecked = false;
+            nQueuedBlocks++;
+            nQueuedBytes += item->nSize;
+            stats.nBlocks++;
+            stats.nBytes += item->nSize;
+            vPending.push_back(item.release());
+            condWorker.notify_one();
+        }
+    } catch (const std::exception& e) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        strReadError = e.what();
+        fReaderExited = true;
+        condConsumer.notify_all();
+    }
+}
+
+void CBlockImportPipeline::ThreadCheck()
+{
+    RenameThread("wispr-importchk");
+    while (true) {
+        CImportBlock* item;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fStop && vPending.empty())
+                condWorker.wait(lock);
+            if (fStop)
+                return;
+            item = vPending.front();
+            vPending.pop_front();
+        }
+
+        PrepareImportBlock(*item);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (item->nEpoch != nEpoch) {
+            Drop(item);
+            continue;
+        }
+        mapReady[item->nSeq] = item;
+        if (item->nSeq == nNextOut)
+            condConsumer.notify_all();
+    }
+}
+
+bool CBlockImportPipeline::Next(std::unique_ptr<CImportBlock>& item)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    int64_t nStart = GetTimeMillis();
+    std::map<uint64_t, CImportBlock*>::iterator it;
+    while ((it = mapReady.find(nNextOut)) == mapReady.end()) {
+        if (nNextOut == nNextSeq && (fReaderExited || (fReaderDone && !fRewind)))
+            return false;
+        condConsumer.wait(lock);
+    }
+    stats.nConnectWaitMillis += GetTimeMillis() - nStart;
+    item.reset(it->second);
+    mapReady.erase(it);
+    nNextOut++;
+    nQueuedBlocks--;
+    nQueuedBytes -= item->nSize;
+    condReader.notify_one();
+    return true;
+}
+
+void CBlockImportPipeline::Rewind(const CImportBlock& item)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nEpoch++;
+    fRewind = true;
+    nRewindPos = item.nStartPos + 1;
+    // Blocks still with a worker are dropped when it is done with them
+    for (CImportBlock* pending : vPending)
+        Drop(pending);
+    vPending.clear();
+    for (std::map<uint64_t, CImportBlock*>::iterator it = mapReady.begin(); it != mapReady.end(); it++)
+        Drop(it->second);
+    mapReady.clear();
+    nNextOut = nNextSeq;
+    stats.nRewinds++;
+    condReader.notify_one();
+}
+
+std::string CBlockImportPipeline::GetReadError()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return strReadError;
+}
+
+CBlockImportStats CBlockImportPipeline::GetStats()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return stats;
+}
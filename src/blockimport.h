@@ -0,0 +1,140 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WISPR_BLOCKIMPORT_H
+#define WISPR_BLOCKIMPORT_H
+
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** Default for -importthreads, the threads deserializing and checking blocks during -reindex and -loadblock (0 = auto) */
+static const int DEFAULT_IMPORT_THREADS = 0;
+/** Maximum number of import threads */
+static const int MAX_IMPORT_THREADS = 16;
+/** Serialized bytes of the blocks read ahead of the one being connected */
+static const size_t MAX_IMPORT_QUEUE_BYTES = 32 << 20;
+/** Number of blocks read ahead of the one being connected */
+static const size_t MAX_IMPORT_QUEUE_BLOCKS = 1024;
+/** Serialized bytes of out of order blocks kept in memory until their parent shows up */
+static const size_t MAX_IMPORT_UNKNOWN_PARENT_BYTES = 32 << 20;
+
+/** A block found in a block file, and what the check stage found out about it */
+struct CImportBlock {
+    //! position in file order
+    uint64_t nSeq;
+    //! rewind generation the block was read in
+    uint64_t nEpoch;
+    //! file offset of the message start in front of the block
+    uint64_t nStartPos;
+    //! file offset of the serialized block
+    uint64_t nPos;
+    unsigned int nSize;
+    //! serialized block, released once it is deserialized
+    std::vector<char> vData;
+    //! null if the data does not deserialize as a block
+    std::shared_ptr<CBlock> pblock;
+    std::string strError;
+    uint256 hash;
+    //! merkle root and block signature are valid
+    bool fPrechecked;
+};
+
+struct CBlockImportStats {
+    uint64_t nBlocks;
+    uint64_t nBytes;
+    uint64_t nRewinds;
+    //! time the reader spent waiting for room in the queue
+    int64_t nReaderWaitMillis;
+    //! time the connect stage spent waiting for the next block
+    int64_t nConnectWaitMillis;
+};
+
+/**
+ * Reads the blocks of a block file in three stages. One thread scans the
+ * file for blocks, worker threads deserialize them and run the checks that
+ * need no chain context, and the thread calling Next() receives them in
+ * file order to connect them. The stages are connected by a queue bounded
+ * by MAX_IMPORT_QUEUE_BLOCKS and MAX_IMPORT_QUEUE_BYTES.
+ */
+class CBlockImportPipeline
+{
+private:
+    // Disallow copies
+    CBlockImportPipeline(const CBlockImportPipeline&);
+    CBlockImportPipeline& operator=(const CBlockImportPipeline&);
+
+    FILE* file;
+
+    boost::mutex mutex;
+    //! The reader blocks on this when the queue is full or the file is done
+    boost::condition_variable condReader;
+    //! Workers block on this when there is nothing to check
+    boost::condition_variable condWorker;
+    //! Next() blocks on this until the next block is checked
+    boost::condition_variable condConsumer;
+
+    //! read blocks waiting for a worker
+    std::deque<CImportBlock*> vPending;
+    //! checked blocks waiting for Next(), by sequence number
+    std::map<uint64_t, CImportBlock*> mapReady;
+    uint64_t nNextSeq;
+    uint64_t nNextOut;
+    uint64_t nEpoch;
+    size_t nQueuedBlocks;
+    size_t nQueuedBytes;
+    //! the reader found no more blocks
+    bool fReaderDone;
+    //! the reader stopped on an error
+    bool fReaderExited;
+    bool fRewind;
+    uint64_t nRewindPos;
+    bool fStop;
+    std::string strReadError;
+    CBlockImportStats stats;
+
+    boost::thread_group threads;
+
+    bool IsFull() const;
+    void Drop(CImportBlock* item);
+    void ThreadRead();
+    void ThreadCheck();
+
+public:
+    //! Takes over fileIn and closes it when reading is done
+    CBlockImportPipeline(FILE* fileIn, int nThreads);
+    ~CBlockImportPipeline();
+
+    /**
+     * Wait for the next block in file order. Returns false when the file
+     * has no more blocks.
+     */
+    bool Next(std::unique_ptr<CImportBlock>& item);
+
+    /**
+     * The block last returned by Next() did not deserialize: drop what was
+     * read after it and scan again from the byte after its message start.
+     */
+    void Rewind(const CImportBlock& item);
+
+    //! Error that stopped the reader, empty if it reached the end of the file
+    std::string GetReadError();
+    CBlockImportStats GetStats();
+};
+
+/** Deserialize and check a block read from a block file, without chain context */
+void PrepareImportBlock(CImportBlock& item);
+
+#endif // WISPR_BLOCKIMPORT_H
@@ -61,6 +61,27 @@ const CBlockIndex* CChain::FindFork(const CBlockIndex* pindex) const
     return pindex;
 }
 
+void CBlockIndexArena::Clear()
+{
+    for (size_t nSlab = 0; nSlab < vSlabs.size(); nSlab++) {
+        size_t nEntries = nSlab + 1 == vSlabs.size() ? nUsed : SLAB_ENTRIES;
+        for (size_t i = 0; i < nEntries; i++)
+            vSlabs[nSlab][i].~CBlockIndex();
+        ::operator delete(vSlabs[nSlab]);
+    }
+    vSlabs.clear();
+    nUsed = SLAB_ENTRIES;
+}
+
+void* CBlockIndexArena::NextEntry()
+{
+    if (nUsed == SLAB_ENTRIES) {
+        vSlabs.push_back(static_cast<CBlockIndex*>(::operator new(SLAB_ENTRIES * sizeof(CBlockIndex))));
+        nUsed = 0;
+    }
+    return &vSlabs.back()[nUsed++];
+}
+
 uint256 CBlockIndex::GetBlockTrust() const
 {
     uint256 bnTarget;
@@ -14,6 +14,8 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <new>
+#include <stdexcept>
 #include <vector>
 
 
@@ -98,6 +100,136 @@ enum BlockStatus {
     BLOCK_FAILED_MASK = BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 };
 
+/**
+ * Zerocoin supply of each denomination, stored inline in zerocoinDenomList
+ * order. Serialized like the std::map<CoinDenomination, int64_t> it replaces.
+ */
+class CZerocoinSupply
+{
+private:
+    int64_t vSupply[libzerocoin::ZEROCOIN_DENOM_COUNT];
+
+    static int Index(libzerocoin::CoinDenomination denom)
+    {
+        int nIndex = libzerocoin::ZerocoinDenominationToIndex(denom);
+        if (nIndex < 0)
+            throw std::out_of_range("CZerocoinSupply : invalid denomination");
+        return nIndex;
+    }
+
+public:
+    CZerocoinSupply() { SetNull(); }
+
+    void SetNull()
+    {
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOM_COUNT; i++)
+            vSupply[i] = 0;
+    }
+
+    int64_t& at(libzerocoin::CoinDenomination denom) { return vSupply[Index(denom)]; }
+    const int64_t& at(libzerocoin::CoinDenomination denom) const { return vSupply[Index(denom)]; }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(libzerocoin::ZEROCOIN_DENOM_COUNT) + libzerocoin::ZEROCOIN_DENOM_COUNT * (sizeof(int) + sizeof(int64_t));
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, libzerocoin::ZEROCOIN_DENOM_COUNT);
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOM_COUNT; i++) {
+            ::Serialize(s, libzerocoin::zerocoinDenomList[i], nType, nVersion);
+            ::Serialize(s, vSupply[i], nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        SetNull();
+        uint64_t nSize = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSize; i++) {
+            libzerocoin::CoinDenomination denom;
+            int64_t nSupply;
+            ::Unserialize(s, denom, nType, nVersion);
+            ::Unserialize(s, nSupply, nType, nVersion);
+            int nIndex = libzerocoin::ZerocoinDenominationToIndex(denom);
+            if (nIndex >= 0)
+                vSupply[nIndex] = nSupply;
+        }
+    }
+};
+
+/**
+ * Number of zerocoin mints of each denomination in a block. A mint output
+ * carries a 2048 bit commitment, so a block can't hold 65536 of them.
+ * Serialized like the std::vector<CoinDenomination> it replaces, with the
+ * denominations in zerocoinDenomList order.
+ */
+class CZerocoinMintCounts
+{
+private:
+    uint16_t vCount[libzerocoin::ZEROCOIN_DENOM_COUNT];
+
+public:
+    CZerocoinMintCounts() { SetNull(); }
+
+    void SetNull()
+    {
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOM_COUNT; i++)
+            vCount[i] = 0;
+    }
+
+    void Add(libzerocoin::CoinDenomination denom)
+    {
+        int nIndex = libzerocoin::ZerocoinDenominationToIndex(denom);
+        if (nIndex >= 0)
+            vCount[nIndex]++;
+    }
+
+    int Count(libzerocoin::CoinDenomination denom) const
+    {
+        int nIndex = libzerocoin::ZerocoinDenominationToIndex(denom);
+        return nIndex < 0 ? 0 : vCount[nIndex];
+    }
+
+    int Total() const
+    {
+        int nTotal = 0;
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOM_COUNT; i++)
+            nTotal += vCount[i];
+        return nTotal;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return GetSizeOfCompactSize(Total()) + Total() * sizeof(int);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, Total());
+        for (int i = 0; i < libzerocoin::ZEROCOIN_DENOM_COUNT; i++) {
+            for (int j = 0; j < vCount[i]; j++)
+                ::Serialize(s, libzerocoin::zerocoinDenomList[i], nType, nVersion);
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        SetNull();
+        uint64_t nSize = ReadCompactSize(s);
+        for (uint64_t i = 0; i < nSize; i++) {
+            libzerocoin::CoinDenomination denom;
+            ::Unserialize(s, denom, nType, nVersion);
+            Add(denom);
+        }
+    }
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -178,8 +310,8 @@ public:
     uint32_t nSequenceId;
 
     //! zerocoin specific fields
-    std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
-    std::vector<libzerocoin::CoinDenomination> vMintDenominationsInBlock;
+    CZerocoinSupply zerocoinSupply;
+    CZerocoinMintCounts mintsInBlock;
 
     void SetNull()
     {
@@ -212,10 +344,8 @@ public:
         nNonce = 0;
         nAccumulatorCheckpoint = 0;
         // Start supply of each denomination with 0s
-        for (auto& denom : libzerocoin::zerocoinDenomList) {
-            mapZerocoinSupply.insert(std::make_pair(denom, 0));
-        }
-        vMintDenominationsInBlock.clear();
+        zerocoinSupply.SetNull();
+        mintsInBlock.SetNull();
     }
 
     CBlockIndex()
@@ -305,7 +435,7 @@ public:
      */
     int64_t GetZcMints(libzerocoin::CoinDenomination denom) const
     {
-        return mapZerocoinSupply.at(denom);
+        return zerocoinSupply.at(denom);
     }
 
     /**
@@ -320,7 +450,7 @@ public:
 
     bool MintedDenomination(libzerocoin::CoinDenomination denom) const
     {
-        return std::find(vMintDenominationsInBlock.begin(), vMintDenominationsInBlock.end(), denom) != vMintDenominationsInBlock.end();
+        return mintsInBlock.Count(denom) > 0;
     }
 
     uint256 GetBlockHash() const
@@ -502,8 +632,8 @@ public:
         READWRITE(nNonce);
         if(this->nVersion > 7) {
             READWRITE(nAccumulatorCheckpoint);
-            READWRITE(mapZerocoinSupply);
-            READWRITE(vMintDenominationsInBlock);
+            READWRITE(zerocoinSupply);
+            READWRITE(mintsInBlock);
         }else{
             READWRITE(bnStakeModifierV2);
         }
@@ -547,6 +677,39 @@ public:
     }
 };
 
+/**
+ * Owns the CBlockIndex entries of mapBlockIndex. Entries are placed back to
+ * back in slabs instead of being allocated one by one, which saves the
+ * allocator overhead of every entry and keeps entries created together
+ * (e.g. while loading the block index) close in memory. Entries are never
+ * freed individually; they all go away in Clear(). Callers hold cs_main.
+ */
+class CBlockIndexArena
+{
+public:
+    CBlockIndexArena() : nUsed(SLAB_ENTRIES) {}
+    ~CBlockIndexArena() { Clear(); }
+
+    CBlockIndex* Allocate() { return new (NextEntry()) CBlockIndex(); }
+    CBlockIndex* Allocate(const CBlock& block) { return new (NextEntry()) CBlockIndex(block); }
+
+    /** Destroy all entries and free the slabs */
+    void Clear();
+
+    size_t Size() const { return vSlabs.empty() ? 0 : (vSlabs.size() - 1) * SLAB_ENTRIES + nUsed; }
+    size_t Slabs() const { return vSlabs.size(); }
+    size_t DynamicMemoryUsage() const { return vSlabs.size() * SLAB_ENTRIES * sizeof(CBlockIndex) + vSlabs.capacity() * sizeof(CBlockIndex*); }
+
+private:
+    static const size_t SLAB_ENTRIES = 4096;
+
+    std::vector<CBlockIndex*> vSlabs;
+    //! entries handed out from the last slab
+    size_t nUsed;
+
+    void* NextEntry();
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain
 {
@@ -5,7 +5,9 @@
 
 #include "coins.h"
 
+#include "clientversion.h"
 #include "random.h"
+#include "streams.h"
 
 #include <assert.h>
 
@@ -130,6 +132,19 @@ CCoinsModifier CCoinsViewCache::ModifyCoins(const uint256& txid)
     return CCoinsModifier(*this, ret.first);
 }
 
+CCoinsModifier CCoinsViewCache::ModifyNewCoins(const uint256& txid)
+{
+    assert(!hasModifier);
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    if (ret.second) {
+        // Not in this cache, so not spent or pruned here either: whatever the
+        // parent view might hold for this txid has no unspent outputs.
+        ret.first->second.flags = CCoinsCacheEntry::FRESH;
+    }
+    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
+    return CCoinsModifier(*this, ret.first);
+}
+
 const CCoins* CCoinsViewCache::AccessCoins(const uint256& txid) const
 {
     CCoinsMap::const_iterator it = FetchCoins(txid);
@@ -189,6 +204,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlockIn
                     // A normal modification.
                     itUs->second.coins.swap(it->second.coins);
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.nDirtyOutputs |= it->second.nDirtyOutputs;
                 }
             }
         }
@@ -268,14 +284,58 @@ CCoinsModifier::CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_)
 {
     assert(!cache.hasModifier);
     cache.hasModifier = true;
+    const CCoins& coins = it->second.coins;
+    vWasAvailable.resize(coins.vout.size());
+    for (unsigned int i = 0; i < coins.vout.size(); i++)
+        vWasAvailable[i] = !coins.vout[i].IsNull();
+    nHeightBefore = coins.nHeight;
+    nVersionBefore = coins.nVersion;
 }
 
 CCoinsModifier::~CCoinsModifier()
 {
     assert(cache.hasModifier);
     cache.hasModifier = false;
-    it->second.coins.Cleanup();
-    if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
+    CCoinsCacheEntry& entry = it->second;
+    entry.coins.Cleanup();
+    if ((entry.flags & CCoinsCacheEntry::FRESH) && entry.coins.IsPruned()) {
         cache.cacheCoins.erase(it);
+        return;
     }
+
+    // Outputs only ever get spent or restored in place, so comparing which
+    // ones are available tells which records the database has to touch. A
+    // changed header means the whole transaction was replaced.
+    if (entry.coins.nHeight != nHeightBefore || entry.coins.nVersion != nVersionBefore) {
+        entry.nDirtyOutputs = ~(uint64_t)0;
+        return;
+    }
+    size_t nOutputs = std::max(vWasAvailable.size(), entry.coins.vout.size());
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        bool fWasAvailable = i < vWasAvailable.size() && vWasAvailable[i];
+        bool fAvailable = i < entry.coins.vout.size() && !entry.coins.vout[i].IsNull();
+        if (fWasAvailable != fAvailable)
+            entry.MarkOutputDirty(i);
+    }
+}
+
+void CUtxoStats::AddCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    // The element is the chainstate record of the output without its prefix
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << outpoint << coin;
+    muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs++;
+    nSerializedSize += 1 + ss.size();
+    nTotalAmount += coin.out.nValue;
+}
+
+void CUtxoStats::RemoveCoin(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << outpoint << coin;
+    muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    nTransactionOutputs--;
+    nSerializedSize -= 1 + ss.size();
+    nTotalAmount -= coin.out.nValue;
 }
@@ -8,11 +8,13 @@
 #define BITCOIN_COINS_H
 
 #include "compressor.h"
+#include "crypto/muhash.h"
 #include "script/standard.h"
 #include "serialize.h"
 #include "uint256.h"
 #include "undo.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <stdint.h>
 
@@ -285,6 +287,51 @@ public:
     }
 };
 
+/**
+ * A single unspent transaction output together with the metadata of the
+ * transaction that created it. This is how the coin database stores the UTXO
+ * set, one record per outpoint, so spending an output touches only its own
+ * record instead of rewriting every remaining output of the transaction.
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nHeight * 4 + fCoinStake * 2 + fCoinBase)
+ * - the CTxOut (via CTxOutCompressor)
+ */
+class Coin
+{
+public:
+    CTxOut out;
+    int nHeight;
+    int nVersion;
+    bool fCoinBase;
+    bool fCoinStake;
+
+    Coin() : nHeight(0), nVersion(0), fCoinBase(false), fCoinStake(false) {}
+
+    //! output nPos of coins, which must be unspent
+    Coin(const CCoins& coins, unsigned int nPos) : out(coins.vout[nPos]), nHeight(coins.nHeight), nVersion(coins.nVersion), fCoinBase(coins.fCoinBase), fCoinStake(coins.fCoinStake)
+    {
+        assert(!out.IsNull());
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        uint32_t nCode = nHeight * 4 + (fCoinStake ? 2 : 0) + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(this->nVersion));
+        READWRITE(VARINT(nCode));
+        READWRITE(REF(CTxOutCompressor(out)));
+        if (ser_action.ForRead()) {
+            nHeight = nCode >> 2;
+            fCoinStake = nCode & 2;
+            fCoinBase = nCode & 1;
+        }
+    }
+};
+
 class CCoinsKeyHasher
 {
 private:
@@ -307,13 +354,17 @@ public:
 struct CCoinsCacheEntry {
     CCoins coins; // The actual cached data.
     unsigned char flags;
+    uint64_t nDirtyOutputs; // Outputs that may differ from the parent view; bit 63 covers every output from 63 on.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
     };
 
-    CCoinsCacheEntry() : coins(), flags(0) {}
+    CCoinsCacheEntry() : coins(), flags(0), nDirtyOutputs(0) {}
+
+    void MarkOutputDirty(unsigned int nPos) { nDirtyOutputs |= (uint64_t)1 << std::min(nPos, 63u); }
+    bool IsOutputDirty(unsigned int nPos) const { return nDirtyOutputs & ((uint64_t)1 << std::min(nPos, 63u)); }
 };
 
 typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
@@ -330,6 +381,48 @@ struct CCoinsStats {
     CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
 };
 
+/**
+ * Rolling hash and totals of the unspent output set as of hashBlock. The
+ * block tree database keeps one per block, each updated from its parent's
+ * with the outputs the block creates and spends.
+ */
+class CUtxoStats
+{
+public:
+    //! not serialized, the database key
+    uint256 hashBlock;
+    //! set of the serialized outpoint and Coin of every unspent output
+    MuHash3072 muhash;
+    //! transactions with unspent outputs
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    //! size of the chainstate records of the outputs
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+
+    CUtxoStats() : hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    void AddCoin(const COutPoint& outpoint, const Coin& coin);
+    void RemoveCoin(const COutPoint& outpoint, const Coin& coin);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        unsigned char buf[MuHash3072::SERIALIZED_SIZE];
+        if (!ser_action.ForRead())
+            muhash.ToBytes(buf);
+        READWRITE(FLATDATA(buf));
+        if (ser_action.ForRead())
+            muhash.FromBytes(buf);
+    }
+};
+
 
 /** Abstract view on the open txout dataset. */
 class CCoinsView
@@ -398,6 +491,10 @@ class CCoinsModifier
 private:
     CCoinsViewCache& cache;
     CCoinsMap::iterator it;
+    //! State of the entry before modification, to find the outputs that changed
+    std::vector<bool> vWasAvailable;
+    int nHeightBefore;
+    int nVersionBefore;
     CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_);
 
 public:
@@ -446,6 +543,14 @@ public:
      */
     CCoinsModifier ModifyCoins(const uint256& txid);
 
+    /**
+     * Like ModifyCoins, but for a transaction that is known not to have any
+     * unspent outputs in the parent view (anything but a coinbase, as txids
+     * are unique otherwise). Skips the lookup in the parent view, which for
+     * a new transaction would always be a database miss.
+     */
+    CCoinsModifier ModifyNewCoins(const uint256& txid);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
@@ -0,0 +1,72 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <cstdint>
+#include <cstdlib>
+
+/** A number modulo the prime 2^3072 - 1103717, in 32-bit little endian limbs */
+class Num3072
+{
+private:
+    void FullReduce();
+    bool IsOverflow() const;
+
+public:
+    static const size_t BYTE_SIZE = 384;
+    static const int LIMBS = 96;
+
+    uint32_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    //! Little endian, need not be reduced
+    explicit Num3072(const unsigned char data[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    Num3072 GetInverse() const;
+    //! Little endian, fully reduced
+    void ToBytes(unsigned char out[BYTE_SIZE]);
+};
+
+/**
+ * A hash of a set of byte strings that can be updated one element at a time,
+ * in any order. Every element is hashed to a number modulo a 3072-bit prime,
+ * and the set hash is the product of those numbers. Removals multiply into a
+ * separate denominator so they cost no more than insertions; the one
+ * division needed is left to Finalize().
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+    static const size_t SERIALIZED_SIZE = 2 * Num3072::BYTE_SIZE;
+
+    //! The hash of the empty set
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    //! Union and difference of the sets
+    MuHash3072& operator*=(const MuHash3072& mul);
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    //! The 32-byte hash of the set. Slow: it takes a modular inverse
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+
+    void ToBytes(unsigned char out[SERIALIZED_SIZE]);
+    void FromBytes(const unsigned char in[SERIALIZED_SIZE]);
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
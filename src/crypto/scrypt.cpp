@@ -27,14 +27,37 @@
  * online backup system.
  */
 
+#if defined(HAVE_CONFIG_H)
+#include "config/wispr-config.h"
+#endif
+
 #include "crypto/scrypt.h"
 #include "utilstrencodings.h"
 #include <openssl/sha.h>
 #include <string>
+#include <vector>
 
 #include <string.h>
 #include <stdint.h>
 
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(__SSE2__)
+namespace scrypt_sse2
+{
+void scrypt_core_4way(uint32_t* X, uint32_t* V);
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace scrypt_avx2
+{
+void scrypt_core_8way(uint32_t* X, uint32_t* V);
+}
+#endif
+
 #ifndef __FreeBSD__
 static inline void be32enc(void *pp, uint32_t x)
 {
@@ -550,3 +573,92 @@ uint256 scrypt_blockhash(const void *input) {
     return scrypt_nosalt(input, 80, scratchpad);
 }
 
+namespace
+{
+typedef void (*ScryptCoreMultiFn)(uint32_t* X, uint32_t* V);
+
+/** A multi-lane scrypt_core: nLanes independent hashes per call (nLanes == 1 is the scalar path) */
+struct ScryptImplementation {
+    const char* name;
+    size_t nLanes;
+    ScryptCoreMultiFn core;
+};
+
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** AVX2 needs both the CPU feature bit and the OS saving the YMM state (XCR0 bits 1 and 2) */
+bool AVX2Enabled()
+{
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, nullptr) < 7)
+        return false;
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (!((ecx >> 27) & 1))
+        return false;
+    uint32_t xcr0, xcr0_high;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+    if ((xcr0 & 6) != 6)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 5) & 1;
+}
+#endif
+
+ScryptImplementation ScryptDetect(size_t nMaxLanes)
+{
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    if (nMaxLanes >= 8 && AVX2Enabled()) {
+        ScryptImplementation impl = {"avx2(8way)", 8, scrypt_avx2::scrypt_core_8way};
+        return impl;
+    }
+#endif
+#if defined(__SSE2__)
+    if (nMaxLanes >= 4) {
+        ScryptImplementation impl = {"sse2(4way)", 4, scrypt_sse2::scrypt_core_4way};
+        return impl;
+    }
+#endif
+    ScryptImplementation impl = {"generic", 1, nullptr};
+    return impl;
+}
+
+ScryptImplementation& ScryptActive()
+{
+    static ScryptImplementation impl = ScryptDetect((size_t)-1);
+    return impl;
+}
+} // namespace
+
+std::string scrypt_select_implementation(size_t nMaxLanes)
+{
+    ScryptActive() = ScryptDetect(nMaxLanes);
+    return ScryptActive().name;
+}
+
+std::string scrypt_implementation()
+{
+    return ScryptActive().name;
+}
+
+void scrypt_blockhash_batch(const void* const* inputs, uint256* outputs, size_t count)
+{
+    const ScryptImplementation impl = ScryptActive();
+    size_t i = 0;
+
+    if (impl.nLanes > 1 && count >= impl.nLanes) {
+        std::vector<unsigned char> scratchpad(impl.nLanes * (SCRYPT_BUFFER_SIZE - 63) + 63);
+        uint32_t* V = (uint32_t*)(((uintptr_t)(&scratchpad[0]) + 63) & ~(uintptr_t)(63));
+        std::vector<uint32_t> X(32 * impl.nLanes);
+
+        for (; i + impl.nLanes <= count; i += impl.nLanes) {
+            for (size_t l = 0; l < impl.nLanes; l++)
+                PBKDF2_SHA256((const uint8_t*)inputs[i + l], 80, (const uint8_t*)inputs[i + l], 80, 1, (uint8_t*)&X[32 * l], 128);
+            impl.core(&X[0], V);
+            for (size_t l = 0; l < impl.nLanes; l++)
+                PBKDF2_SHA256((const uint8_t*)inputs[i + l], 80, (uint8_t*)&X[32 * l], 128, 1, outputs[i + l].begin(), 32);
+        }
+    }
+
+    // Leftovers that do not fill a whole group go through the scalar core
+    for (; i < count; i++)
+        outputs[i] = scrypt_blockhash(inputs[i]);
+}
@@ -16,4 +16,22 @@ uint256 scrypt_hash(const void *input, size_t inputlen);
 
 uint256 scrypt_blockhash(const void *input);
 
+/**
+ * Compute outputs[i] = scrypt_blockhash(inputs[i]) for count 80-byte inputs.
+ * Hashes are processed several at a time by the widest SIMD scrypt core the
+ * CPU supports (see scrypt_implementation()); results are identical to the
+ * scalar path.
+ */
+void scrypt_blockhash_batch(const void* const* inputs, uint256* outputs, size_t count);
+
+/** Name of the scrypt core used by scrypt_blockhash_batch, detected on first use */
+std::string scrypt_implementation();
+
+/**
+ * Re-run detection allowing at most nMaxLanes hashes per core call (1 selects
+ * the scalar core) and return the name of the selected implementation.
+ * Not thread safe; intended for tests and benchmarks.
+ */
+std::string scrypt_select_implementation(size_t nMaxLanes);
+
 #endif
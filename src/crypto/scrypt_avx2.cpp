@@ -0,0 +1,94 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 8-way AVX2 scrypt_core (N=1024, r=1) used by scrypt_blockhash_batch.
+// This file is built with AVX2 code generation enabled; it is only called
+// after scrypt.cpp has confirmed at runtime that the CPU and OS support AVX2.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/wispr-config.h"
+#endif
+
+#include <stdint.h>
+
+#if defined(ENABLE_AVX2) && defined(__AVX2__)
+#include <immintrin.h>
+
+namespace scrypt_avx2
+{
+#define ROTL(a, b) _mm256_or_si256(_mm256_slli_epi32(a, b), _mm256_srli_epi32(a, 32 - (b)))
+#define STEP(d, a, b, r) x[d] = _mm256_xor_si256(x[d], ROTL(_mm256_add_epi32(x[a], x[b]), r))
+
+/** Eight interleaved copies of xor_salsa8: lane i of every vector belongs to hash i */
+static inline void xor_salsa8(__m256i B[16], const __m256i Bx[16])
+{
+    __m256i x[16];
+    for (int i = 0; i < 16; i++)
+        x[i] = B[i] = _mm256_xor_si256(B[i], Bx[i]);
+
+    for (int i = 0; i < 8; i += 2) {
+        /* Operate on columns. */
+        STEP(4, 0, 12, 7);   STEP(9, 5, 1, 7);    STEP(14, 10, 6, 7);  STEP(3, 15, 11, 7);
+        STEP(8, 4, 0, 9);    STEP(13, 9, 5, 9);   STEP(2, 14, 10, 9);  STEP(7, 3, 15, 9);
+        STEP(12, 8, 4, 13);  STEP(1, 13, 9, 13);  STEP(6, 2, 14, 13);  STEP(11, 7, 3, 13);
+        STEP(0, 12, 8, 18);  STEP(5, 1, 13, 18);  STEP(10, 6, 2, 18);  STEP(15, 11, 7, 18);
+
+        /* Operate on rows. */
+        STEP(1, 0, 3, 7);    STEP(6, 5, 4, 7);    STEP(11, 10, 9, 7);  STEP(12, 15, 14, 7);
+        STEP(2, 1, 0, 9);    STEP(7, 6, 5, 9);    STEP(8, 11, 10, 9);  STEP(13, 12, 15, 9);
+        STEP(3, 2, 1, 13);   STEP(4, 7, 6, 13);   STEP(9, 8, 11, 13);  STEP(14, 13, 12, 13);
+        STEP(0, 3, 2, 18);   STEP(5, 4, 7, 18);   STEP(10, 9, 8, 18);  STEP(15, 14, 13, 18);
+    }
+
+    for (int i = 0; i < 16; i++)
+        B[i] = _mm256_add_epi32(B[i], x[i]);
+}
+
+#undef STEP
+#undef ROTL
+
+/**
+ * X holds eight consecutive 32-word scrypt states, V is a 32-byte aligned
+ * scratchpad of 8 * 128 KiB. The scratchpad is stored interleaved, so word k
+ * of entry j for lane l lives at V[(j * 32 + k) * 8 + l].
+ */
+void scrypt_core_8way(uint32_t* X, uint32_t* V)
+{
+    __m256i Y[32];
+    __m256i* W = (__m256i*)V;
+    const __m256i lanes = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i mask = _mm256_set1_epi32(1023);
+    const int* Vi = (const int*)V;
+
+    for (int k = 0; k < 32; k++)
+        Y[k] = _mm256_set_epi32(X[224 + k], X[192 + k], X[160 + k], X[128 + k], X[96 + k], X[64 + k], X[32 + k], X[k]);
+
+    for (int i = 0; i < 1024; i++) {
+        for (int k = 0; k < 32; k++)
+            _mm256_store_si256(&W[i * 32 + k], Y[k]);
+        xor_salsa8(&Y[0], &Y[16]);
+        xor_salsa8(&Y[16], &Y[0]);
+    }
+
+    for (int i = 0; i < 1024; i++) {
+        // index of word 0 of entry j for each lane: j * 256 + lane
+        __m256i idx = _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(Y[16], mask), 8), lanes);
+        for (int k = 0; k < 32; k++) {
+            Y[k] = _mm256_xor_si256(Y[k], _mm256_i32gather_epi32(Vi, idx, 4));
+            idx = _mm256_add_epi32(idx, _mm256_set1_epi32(8));
+        }
+        xor_salsa8(&Y[0], &Y[16]);
+        xor_salsa8(&Y[16], &Y[0]);
+    }
+
+    uint32_t lane[8];
+    for (int k = 0; k < 32; k++) {
+        _mm256_storeu_si256((__m256i*)lane, Y[k]);
+        for (int l = 0; l < 8; l++)
+            X[l * 32 + k] = lane[l];
+    }
+}
+} // namespace scrypt_avx2
+
+#endif
@@ -0,0 +1,86 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 4-way SSE2 scrypt_core (N=1024, r=1) used by scrypt_blockhash_batch.
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+namespace scrypt_sse2
+{
+#define ROTL(a, b) _mm_or_si128(_mm_slli_epi32(a, b), _mm_srli_epi32(a, 32 - (b)))
+#define STEP(d, a, b, r) x[d] = _mm_xor_si128(x[d], ROTL(_mm_add_epi32(x[a], x[b]), r))
+
+/** Four interleaved copies of xor_salsa8: lane i of every vector belongs to hash i */
+static inline void xor_salsa8(__m128i B[16], const __m128i Bx[16])
+{
+    __m128i x[16];
+    for (int i = 0; i < 16; i++)
+        x[i] = B[i] = _mm_xor_si128(B[i], Bx[i]);
+
+    for (int i = 0; i < 8; i += 2) {
+        /* Operate on columns. */
+        STEP(4, 0, 12, 7);   STEP(9, 5, 1, 7);    STEP(14, 10, 6, 7);  STEP(3, 15, 11, 7);
+        STEP(8, 4, 0, 9);    STEP(13, 9, 5, 9);   STEP(2, 14, 10, 9);  STEP(7, 3, 15, 9);
+        STEP(12, 8, 4, 13);  STEP(1, 13, 9, 13);  STEP(6, 2, 14, 13);  STEP(11, 7, 3, 13);
+        STEP(0, 12, 8, 18);  STEP(5, 1, 13, 18);  STEP(10, 6, 2, 18);  STEP(15, 11, 7, 18);
+
+        /* Operate on rows. */
+        STEP(1, 0, 3, 7);    STEP(6, 5, 4, 7);    STEP(11, 10, 9, 7);  STEP(12, 15, 14, 7);
+        STEP(2, 1, 0, 9);    STEP(7, 6, 5, 9);    STEP(8, 11, 10, 9);  STEP(13, 12, 15, 9);
+        STEP(3, 2, 1, 13);   STEP(4, 7, 6, 13);   STEP(9, 8, 11, 13);  STEP(14, 13, 12, 13);
+        STEP(0, 3, 2, 18);   STEP(5, 4, 7, 18);   STEP(10, 9, 8, 18);  STEP(15, 14, 13, 18);
+    }
+
+    for (int i = 0; i < 16; i++)
+        B[i] = _mm_add_epi32(B[i], x[i]);
+}
+
+#undef STEP
+#undef ROTL
+
+/**
+ * X holds four consecutive 32-word scrypt states, V is a 16-byte aligned
+ * scratchpad of 4 * 128 KiB. The scratchpad is stored interleaved, so word k
+ * of entry j for lane l lives at V[(j * 32 + k) * 4 + l].
+ */
+void scrypt_core_4way(uint32_t* X, uint32_t* V)
+{
+    __m128i Y[32];
+    __m128i* W = (__m128i*)V;
+    uint32_t lane[4];
+
+    for (int k = 0; k < 32; k++)
+        Y[k] = _mm_set_epi32(X[96 + k], X[64 + k], X[32 + k], X[k]);
+
+    for (int i = 0; i < 1024; i++) {
+        for (int k = 0; k < 32; k++)
+            _mm_store_si128(&W[i * 32 + k], Y[k]);
+        xor_salsa8(&Y[0], &Y[16]);
+        xor_salsa8(&Y[16], &Y[0]);
+    }
+
+    for (int i = 0; i < 1024; i++) {
+        _mm_storeu_si128((__m128i*)lane, Y[16]);
+        const uint32_t* V0 = &V[(lane[0] & 1023) * 128 + 0];
+        const uint32_t* V1 = &V[(lane[1] & 1023) * 128 + 1];
+        const uint32_t* V2 = &V[(lane[2] & 1023) * 128 + 2];
+        const uint32_t* V3 = &V[(lane[3] & 1023) * 128 + 3];
+        for (int k = 0; k < 32; k++)
+            Y[k] = _mm_xor_si128(Y[k], _mm_set_epi32(V3[k * 4], V2[k * 4], V1[k * 4], V0[k * 4]));
+        xor_salsa8(&Y[0], &Y[16]);
+        xor_salsa8(&Y[16], &Y[0]);
+    }
+
+    for (int k = 0; k < 32; k++) {
+        _mm_storeu_si128((__m128i*)lane, Y[k]);
+        for (int l = 0; l < 4; l++)
+            X[l * 32 + k] = lane[l];
+    }
+}
+} // namespace scrypt_sse2
+
+#endif
@@ -2,12 +2,36 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/wispr-config.h"
+#endif
+
 #include "crypto/sha256.h"
 
 #include "crypto/common.h"
 
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(__SSE2__)
+namespace sha256_sse2
+{
+void SweepDouble4(unsigned char* out, const uint32_t mid[8], const uint32_t block[16], int nVarWord, const uint32_t vals[4]);
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace sha256_avx2
+{
+void SweepDouble8(unsigned char* out, const uint32_t mid[8], const uint32_t block[16], int nVarWord, const uint32_t vals[8]);
+}
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -127,7 +151,118 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/** Rounds nFirst..nLast-1 of a transformation whose message schedule w is already expanded */
+void inline Rounds(uint32_t* s, const uint32_t* w, int nFirst, int nLast)
+{
+    uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = nFirst; i < nLast; i++) {
+        uint32_t t1 = h + Sigma1(e) + Ch(e, f, g) + K[i] + w[i];
+        uint32_t t2 = Sigma0(a) + Maj(a, b, c);
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    s[0] = a; s[1] = b; s[2] = c; s[3] = d; s[4] = e; s[5] = f; s[6] = g; s[7] = h;
+}
+
+/** The message word holding an integer that was serialized little-endian */
+uint32_t inline SwapWord(uint32_t x)
+{
+    unsigned char buf[4];
+    WriteLE32(buf, x);
+    return ReadBE32(buf);
+}
+
+void inline Expand(uint32_t* w)
+{
+    for (int i = 16; i < 64; i++)
+        w[i] = sigma1(w[i - 2]) + w[i - 7] + sigma0(w[i - 15]) + w[i - 16];
+}
+
+/** Scalar version of the multi-lane sweeps: double SHA-256 with word nVarWord set to val */
+void SweepDouble1(unsigned char* out, const uint32_t mid[8], const uint32_t block[16], int nVarWord, uint32_t val)
+{
+    uint32_t w[64], s[8], iv[8];
+    Initialize(iv);
+    memcpy(w, block, 64);
+    w[nVarWord] = val;
+    Expand(w);
+    memcpy(s, mid, 32);
+    Rounds(s, w, nVarWord, 64);
+    for (int i = 0; i < 8; i++)
+        w[i] = s[i] + iv[i];
+    w[8] = 0x80000000;
+    memset(w + 9, 0, 6 * 4);
+    w[15] = 256;
+    Expand(w);
+    memcpy(s, iv, 32);
+    Rounds(s, w, 0, 64);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + i * 4, s[i] + iv[i]);
+}
+
 } // namespace sha256
+
+typedef void (*SweepDoubleMultiFn)(unsigned char* out, const uint32_t mid[8], const uint32_t block[16], int nVarWord, const uint32_t* vals);
+
+/** A multi-lane double SHA-256: nLanes messages per call (nLanes == 1 is the scalar path) */
+struct SweepImplementation {
+    const char* name;
+    size_t nLanes;
+    SweepDoubleMultiFn sweep;
+};
+
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** AVX2 needs both the CPU feature bit and the OS saving the YMM state (XCR0 bits 1 and 2) */
+bool AVX2Enabled()
+{
+    uint32_t eax, ebx, ecx, edx;
+    if (__get_cpuid_max(0, nullptr) < 7)
+        return false;
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (!((ecx >> 27) & 1))
+        return false;
+    uint32_t xcr0, xcr0_high;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+    if ((xcr0 & 6) != 6)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 5) & 1;
+}
+#endif
+
+SweepImplementation SweepDetect(size_t nMaxLanes)
+{
+#if defined(ENABLE_AVX2) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    if (nMaxLanes >= 8 && AVX2Enabled()) {
+        SweepImplementation impl = {"avx2(8way)", 8, sha256_avx2::SweepDouble8};
+        return impl;
+    }
+#endif
+#if defined(__SSE2__)
+    if (nMaxLanes >= 4) {
+        SweepImplementation impl = {"sse2(4way)", 4, sha256_sse2::SweepDouble4};
+        return impl;
+    }
+#endif
+    SweepImplementation impl = {"generic", 1, nullptr};
+    return impl;
+}
+
+SweepImplementation& SweepActive()
+{
+    static SweepImplementation impl = SweepDetect((size_t)-1);
+    return impl;
+}
 } // namespace
 
 
@@ -187,3 +322,60 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+////// Double SHA-256 sweep over the last word of a one-block message
+
+CSHA256DWordSweep::CSHA256DWordSweep(const unsigned char* prefix, size_t nPrefixLen)
+{
+    assert(IsSupported(nPrefixLen));
+    unsigned char buf[64] = {0};
+    memcpy(buf, prefix, nPrefixLen);
+    buf[nPrefixLen + 4] = 0x80;
+    WriteBE64(buf + 56, (nPrefixLen + 4) << 3);
+    for (int i = 0; i < 16; i++)
+        block[i] = ReadBE32(buf + i * 4);
+
+    nVarWord = nPrefixLen / 4;
+    uint32_t w[64];
+    memcpy(w, block, 64);
+    sha256::Initialize(mid);
+    sha256::Rounds(mid, w, 0, nVarWord);
+}
+
+void CSHA256DWordSweep::Hash(unsigned char* out, const uint32_t* values, size_t count) const
+{
+    const SweepImplementation impl = SweepActive();
+    size_t i = 0;
+
+    // The integer is serialized little-endian, the message words are read big-endian
+    if (impl.nLanes > 1) {
+        uint32_t vals[8];
+        unsigned char tmp[8 * 32];
+        for (; i < count; i += impl.nLanes) {
+            size_t nBatch = std::min(impl.nLanes, count - i);
+            for (size_t l = 0; l < impl.nLanes; l++)
+                vals[l] = sha256::SwapWord(values[i + std::min(l, nBatch - 1)]);
+            if (nBatch == impl.nLanes) {
+                impl.sweep(out + i * 32, mid, block, nVarWord, vals);
+            } else {
+                impl.sweep(tmp, mid, block, nVarWord, vals);
+                memcpy(out + i * 32, tmp, nBatch * 32);
+            }
+        }
+        return;
+    }
+
+    for (; i < count; i++)
+        sha256::SweepDouble1(out + i * 32, mid, block, nVarWord, sha256::SwapWord(values[i]));
+}
+
+std::string SHA256DSweepSelectImplementation(size_t nMaxLanes)
+{
+    SweepActive() = SweepDetect(nMaxLanes);
+    return SweepActive().name;
+}
+
+std::string SHA256DSweepImplementation()
+{
+    return SweepActive().name;
+}
@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,38 @@ public:
     CSHA256& Reset();
 };
 
+/**
+ * Double SHA-256 of one-block messages (at most 55 bytes) that share a prefix
+ * and end in a varying 32-bit little-endian integer, such as a stake kernel and
+ * its timestamp. The padded block and the rounds over the prefix are computed
+ * once; Hash() then runs several messages per call on the widest SIMD
+ * implementation the CPU supports.
+ */
+class CSHA256DWordSweep
+{
+private:
+    uint32_t block[16];
+    uint32_t mid[8];
+    int nVarWord;
+
+public:
+    //! The prefix length must be a multiple of 4 and leave room for the integer and padding
+    static bool IsSupported(size_t nPrefixLen) { return nPrefixLen % 4 == 0 && nPrefixLen + 4 <= 55; }
+
+    CSHA256DWordSweep(const unsigned char* prefix, size_t nPrefixLen);
+
+    /** Write the 32-byte double SHA-256 of prefix || values[i] to out + 32 * i for count values */
+    void Hash(unsigned char* out, const uint32_t* values, size_t count) const;
+};
+
+/** Name of the implementation used by CSHA256DWordSweep, detected on first use */
+std::string SHA256DSweepImplementation();
+
+/**
+ * Re-run detection allowing at most nMaxLanes messages per call (1 selects
+ * the scalar code) and return the name of the selected implementation.
+ * Not thread safe; intended for tests and benchmarks.
+ */
+std::string SHA256DSweepSelectImplementation(size_t nMaxLanes);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
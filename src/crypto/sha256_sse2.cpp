@@ -0,0 +1,103 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// 4-way SSE2 double SHA-256 used by CSHA256DWordSweep.
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+namespace sha256_sse2
+{
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static const uint32_t IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+#define ADD(a, b) _mm_add_epi32(a, b)
+#define XOR(a, b) _mm_xor_si128(a, b)
+#define ROTR(x, n) _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - (n)))
+#define SIGMA0(x) XOR(XOR(ROTR(x, 2), ROTR(x, 13)), ROTR(x, 22))
+#define SIGMA1(x) XOR(XOR(ROTR(x, 6), ROTR(x, 11)), ROTR(x, 25))
+#define sigma0(x) XOR(XOR(ROTR(x, 7), ROTR(x, 18)), _mm_srli_epi32(x, 3))
+#define sigma1(x) XOR(XOR(ROTR(x, 17), ROTR(x, 19)), _mm_srli_epi32(x, 10))
+#define CH(e, f, g) XOR(g, _mm_and_si128(e, XOR(f, g)))
+#define MAJ(a, b, c) _mm_or_si128(_mm_and_si128(a, b), _mm_and_si128(c, _mm_or_si128(a, b)))
+
+/** Rounds nFirst..63 over the expanded message w, then add the chaining value iv */
+static inline void Compress(__m128i s[8], const __m128i iv[8], __m128i w[64], int nFirst)
+{
+    for (int i = 16; i < 64; i++)
+        w[i] = ADD(ADD(sigma1(w[i - 2]), w[i - 7]), ADD(sigma0(w[i - 15]), w[i - 16]));
+
+    __m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = nFirst; i < 64; i++) {
+        __m128i t1 = ADD(ADD(ADD(h, SIGMA1(e)), ADD(CH(e, f, g), _mm_set1_epi32(K[i]))), w[i]);
+        __m128i t2 = ADD(SIGMA0(a), MAJ(a, b, c));
+        h = g; g = f; f = e; e = ADD(d, t1);
+        d = c; c = b; b = a; a = ADD(t1, t2);
+    }
+    s[0] = ADD(a, iv[0]); s[1] = ADD(b, iv[1]); s[2] = ADD(c, iv[2]); s[3] = ADD(d, iv[3]);
+    s[4] = ADD(e, iv[4]); s[5] = ADD(f, iv[5]); s[6] = ADD(g, iv[6]); s[7] = ADD(h, iv[7]);
+}
+
+/**
+ * Double SHA-256 of four one-block messages that differ only in word nVarWord.
+ * mid is the state after rounds 0..nVarWord-1, block the big-endian message
+ * words and vals the four big-endian values of the varying word.
+ */
+void SweepDouble4(unsigned char* out, const uint32_t mid[8], const uint32_t block[16], int nVarWord, const uint32_t vals[4])
+{
+    __m128i w[64], s[8], iv[8];
+    for (int i = 0; i < 16; i++)
+        w[i] = _mm_set1_epi32(block[i]);
+    w[nVarWord] = _mm_set_epi32(vals[3], vals[2], vals[1], vals[0]);
+    for (int i = 0; i < 8; i++) {
+        s[i] = _mm_set1_epi32(mid[i]);
+        iv[i] = _mm_set1_epi32(IV[i]);
+    }
+    Compress(s, iv, w, nVarWord);
+
+    // Second hash: the 32-byte digest padded to one block
+    for (int i = 0; i < 8; i++)
+        w[i] = s[i];
+    w[8] = _mm_set1_epi32(0x80000000);
+    for (int i = 9; i < 15; i++)
+        w[i] = _mm_setzero_si128();
+    w[15] = _mm_set1_epi32(256);
+    for (int i = 0; i < 8; i++)
+        s[i] = iv[i];
+    Compress(s, iv, w, 0);
+
+    uint32_t lanes[4];
+    for (int i = 0; i < 8; i++) {
+        _mm_storeu_si128((__m128i*)lanes, s[i]);
+        for (int l = 0; l < 4; l++) {
+            unsigned char* p = out + l * 32 + i * 4;
+            p[0] = lanes[l] >> 24; p[1] = lanes[l] >> 16; p[2] = lanes[l] >> 8; p[3] = lanes[l];
+        }
+    }
+}
+
+#undef MAJ
+#undef CH
+#undef sigma1
+#undef sigma0
+#undef SIGMA1
+#undef SIGMA0
+#undef ROTR
+#undef XOR
+#undef ADD
+} // namespace sha256_sse2
+
+#endif // __SSE2__
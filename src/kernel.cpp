@@ -4,7 +4,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/assign/list_of.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
+#include <atomic>
+
+#include "crypto/sha256.h"
 #include "db.h"
 #include "kernel.h"
 #include "spork.h"
@@ -17,6 +22,7 @@
 
 
 bool fTestNet = false; //Params().NetworkID() == CBaseChainParams::TESTNET;
+int nStakeThreads = DEFAULT_STAKE_THREADS;
 
 // Modifier interval: time to elapse before new modifier is computed
 // Set to 3-hour for production network and 20-minute for test network
@@ -384,43 +390,146 @@ bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockF
                          __func__, nTimeBlockFrom, GetStakeMinAge(), nTimeTx);
     }
 
-    //grab difficulty
-    uint256 bnTargetPerCoinDay;
-    bnTargetPerCoinDay.SetCompact(nBits);
-
     //grab stake modifier
     uint64_t nStakeModifier = 0;
     if (!stakeInput->GetModifier(nStakeModifier))
         return error("%s : failed to get kernel stake modifier", __func__);
 
-    bool fSuccess = false;
-    unsigned int nTryTime = 0;
-    int nHeightStart = chainActive.Height();
-    int nHashDrift = 60;
-    CDataStream ssUniqueID = stakeInput->GetUniqueness();
-    CAmount nValueIn = stakeInput->GetValue();
-    for (int i = 0; i < nHashDrift; i++) //iterate the hashing
+    std::vector<CStakeKernel> vKernels;
+    vKernels.push_back(CStakeKernel(stakeInput, nTimeBlockFrom, nStakeModifier, nBits));
+    bool fSuccess = SearchStakeKernels(vKernels, 0, nTimeTx, 1, nTimeTx, hashProofOfStake) == 0;
+
+    mapHashedBlocks.clear();
+    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+    return fSuccess;
+}
+
+CStakeKernel::CStakeKernel(CStakeInput* stakeInputIn, unsigned int nTimeBlockFromIn, uint64_t nStakeModifierIn, unsigned int nBits) :
+    stakeInput(stakeInputIn), nTimeBlockFrom(nTimeBlockFromIn), nStakeModifier(nStakeModifierIn),
+    ssUniqueID(stakeInputIn->GetUniqueness()), nValueIn(stakeInputIn->GetValue())
+{
+    bnTargetPerCoinDay.SetCompact(nBits);
+    // Same weighting as stakeTargetHit
+    bnWeightedTarget = (uint256(nValueIn) / 100) * bnTargetPerCoinDay;
+
+    // Everything CheckStakeV2 hashes before the timestamp
+    CDataStream ss(SER_GETHASH, 0);
+    ss << nStakeModifier << nTimeBlockFrom << ssUniqueID;
+    if (CSHA256DWordSweep::IsSupported(ss.size()))
+        sweep.reset(new CSHA256DWordSweep((const unsigned char*)&ss[0], ss.size()));
+}
+
+bool CStakeKernel::Search(unsigned int nTimeTx, int nHashDrift, unsigned int& nTimeTxRet, uint256& hashProofOfStake) const
+{
+    if (Params().NetworkID() != CBaseChainParams::REGTEST && nTimeBlockFrom + GetStakeMinAge() > nTimeTx)
+        return false;
+
+    if (!sweep) {
+        for (int i = 0; i < nHashDrift; i++) {
+            unsigned int nTryTime = nTimeTx + nHashDrift - i;
+            if (CheckStakeV2(ssUniqueID, nValueIn, nStakeModifier, bnTargetPerCoinDay, nTimeBlockFrom, nTryTime, hashProofOfStake)) {
+                nTimeTxRet = nTryTime;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<uint32_t> vTimes(nHashDrift);
+    for (int i = 0; i < nHashDrift; i++)
+        vTimes[i] = nTimeTx + nHashDrift - i;
+    std::vector<unsigned char> vHashes(nHashDrift * 32);
+    sweep->Hash(vHashes.data(), vTimes.data(), vTimes.size());
+
+    for (int i = 0; i < nHashDrift; i++) {
+        uint256 hash;
+        memcpy(hash.begin(), &vHashes[i * 32], 32);
+        if (hash < bnWeightedTarget) {
+            nTimeTxRet = vTimes[i];
+            hashProofOfStake = hash;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace
+{
+/** First kernel found by one search thread */
+struct StakeSearchResult {
+    size_t nIndex;
+    unsigned int nTimeTx;
+    uint256 hashProofOfStake;
+};
+
+/** Searches every nStride-th kernel; stops when a lower index was found by another thread or a block arrives */
+class CStakeSearchWorker
+{
+public:
+    const std::vector<CStakeKernel>& vKernels;
+    size_t nStart;
+    size_t nStride;
+    unsigned int nTimeTx;
+    int nHeightStart;
+    std::atomic<size_t>& nFound;
+    StakeSearchResult& result;
+
+    CStakeSearchWorker(const std::vector<CStakeKernel>& vKernelsIn, size_t nStartIn, size_t nStrideIn, unsigned int nTimeTxIn,
+                       int nHeightStartIn, std::atomic<size_t>& nFoundIn, StakeSearchResult& resultIn) :
+        vKernels(vKernelsIn), nStart(nStartIn), nStride(nStrideIn), nTimeTx(nTimeTxIn),
+        nHeightStart(nHeightStartIn), nFound(nFoundIn), result(resultIn) {}
+
+    void operator()()
     {
-        //new block came in, move on
-        if (chainActive.Height() != nHeightStart)
-            break;
+        for (size_t i = nStart; i < vKernels.size() && i < nFound.load(); i += nStride) {
+            //new block came in, move on
+            if (chainActive.Height() != nHeightStart)
+                return;
+
+            if (!vKernels[i].Search(nTimeTx, STAKE_HASH_DRIFT, result.nTimeTx, result.hashProofOfStake))
+                continue;
+
+            result.nIndex = i;
+            size_t nPrev = nFound.load();
+            while (i < nPrev && !nFound.compare_exchange_weak(nPrev, i)) {}
+            return;
+        }
+    }
+};
+} // namespace
 
-        //hash this iteration
-        nTryTime = nTimeTx + nHashDrift - i;
+int SearchStakeKernels(const std::vector<CStakeKernel>& vKernels, size_t nFirst, unsigned int nTimeTx, int nThreads,
+                       unsigned int& nTimeTxRet, uint256& hashProofOfStake)
+{
+    if (nFirst >= vKernels.size())
+        return -1;
 
-        // if stake hash does not meet the target then continue to next iteration
-        if (!CheckStakeV2(ssUniqueID, nValueIn, nStakeModifier, bnTargetPerCoinDay, nTimeBlockFrom, nTryTime, hashProofOfStake))
-            continue;
+    const size_t nNone = std::numeric_limits<size_t>::max();
+    std::atomic<size_t> nFound(nNone);
+    int nHeightStart = chainActive.Height();
+    nThreads = std::max(1, std::min(nThreads, (int)(vKernels.size() - nFirst)));
+    std::vector<StakeSearchResult> vResults(nThreads);
+    for (StakeSearchResult& result : vResults)
+        result.nIndex = nNone;
 
-        fSuccess = true; // if we make it this far then we have successfully created a stake hash
-        //LogPrintf("%s : hashproof=%s\n", __func__, hashProofOfStake.GetHex());
-        nTimeTx = nTryTime;
-        break;
+    if (nThreads == 1) {
+        CStakeSearchWorker(vKernels, nFirst, 1, nTimeTx, nHeightStart, nFound, vResults[0])();
+    } else {
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(CStakeSearchWorker(vKernels, nFirst + i, nThreads, nTimeTx, nHeightStart, nFound, vResults[i]));
+        threadGroup.join_all();
     }
 
-    mapHashedBlocks.clear();
-    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
-    return fSuccess;
+    // Kernels after the first hit may also have been hashed; only the first one counts
+    for (const StakeSearchResult& result : vResults) {
+        if (result.nIndex == nFound.load()) {
+            nTimeTxRet = result.nTimeTx;
+            hashProofOfStake = result.hashProofOfStake;
+            return (int)result.nIndex;
+        }
+    }
+    return -1;
 }
 
 bool ContextualCheckZerocoinStake(int nPreviousBlockHeight, CStakeInput* stake)
@@ -9,6 +9,10 @@
 #include "main.h"
 #include "stakeinput.h"
 
+#include <memory>
+
+class CSHA256DWordSweep;
+
 
 // To decrease granularity of timestamp
 // Supposed to be 2^n-1
@@ -22,6 +26,14 @@ extern unsigned int nModifierInterval;
 extern unsigned int getIntervalVersion(bool fTestNet);
 extern unsigned int GetStakeMinAge();
 
+//! -stakethreads default
+static const int DEFAULT_STAKE_THREADS = 1;
+//! Maximum number of threads searching stake kernels
+static const int MAX_STAKE_THREADS = 16;
+//! Seconds ahead of the current time that a stake kernel is hashed for
+static const int STAKE_HASH_DRIFT = 60;
+extern int nStakeThreads;
+
 // MODIFIER_INTERVAL_RATIO:
 // ratio of group interval length between the last group and the first group
 static const int MODIFIER_INTERVAL_RATIO = 3;
@@ -38,6 +50,43 @@ bool stakeTargetHit(const uint256& hashProofOfStake, const int64_t& nValueIn, co
 bool stakeTargetHitOld(uint256 hashProofOfStake, uint256 bnTargetPerCoinDay);
 bool Stake(CStakeInput* stakeInput, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int& nTimeTx, uint256& hashProofOfStake);
 
+/**
+ * A stake input prepared for hashing: the modifier, block time and uniqueness
+ * are serialized once and the target is weighted by the input value once, so
+ * trying a timestamp only costs the hash itself.
+ */
+class CStakeKernel
+{
+public:
+    CStakeInput* stakeInput;
+    unsigned int nTimeBlockFrom;
+
+    CStakeKernel(CStakeInput* stakeInputIn, unsigned int nTimeBlockFromIn, uint64_t nStakeModifierIn, unsigned int nBits);
+
+    /**
+     * Try nTimeTx + nHashDrift down to nTimeTx + 1 and stop at the first kernel
+     * hash that meets the target, as Stake() does one timestamp at a time.
+     */
+    bool Search(unsigned int nTimeTx, int nHashDrift, unsigned int& nTimeTxRet, uint256& hashProofOfStake) const;
+
+private:
+    uint64_t nStakeModifier;
+    CDataStream ssUniqueID;
+    CAmount nValueIn;
+    uint256 bnTargetPerCoinDay;
+    uint256 bnWeightedTarget;
+    //! null when the kernel does not fit the one-block sweep; CheckStakeV2 is used instead
+    std::shared_ptr<const CSHA256DWordSweep> sweep;
+};
+
+/**
+ * Search vKernels from index nFirst for the first kernel (in vector order) that
+ * meets its target, spreading the inputs over nThreads threads. The search
+ * stops early when a new block arrives. Returns the index found, or -1.
+ */
+int SearchStakeKernels(const std::vector<CStakeKernel>& vKernels, size_t nFirst, unsigned int nTimeTx, int nThreads,
+                       unsigned int& nTimeTxRet, uint256& hashProofOfStake);
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake, std::unique_ptr<CStakeInput>& stake, int nPreviousBlockHeight);
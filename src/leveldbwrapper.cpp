@@ -4,7 +4,11 @@
 
 #include "leveldbwrapper.h"
 
+#include "sync.h"
 #include "util.h"
+#include "utilstrencodings.h"
+
+#include <map>
 
 #include <boost/filesystem.hpp>
 
@@ -27,14 +31,74 @@ void HandleError(const leveldb::Status& status)
     throw leveldb_error("Unknown database error");
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+CLevelDBTuning::CLevelDBTuning(size_t nCacheSize)
+{
+    nBlockCache = nCacheSize / 2;
+    nWriteBuffer = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    nMaxOpenFiles = DEFAULT_LEVELDB_MAX_OPEN_FILES;
+    nBloomBits = DEFAULT_LEVELDB_BLOOM_BITS;
+    fCompression = DEFAULT_LEVELDB_COMPRESSION;
+}
+
+/** Look up a -db* argument for the database strName; "<name>:<value>" wins over a plain value */
+static bool GetLevelDBArg(const std::string& strArg, const std::string& strName, int64_t& nValue)
+{
+    std::map<std::string, std::vector<std::string> >::const_iterator it = mapMultiArgs.find(strArg);
+    if (it == mapMultiArgs.end())
+        return false;
+    bool fFound = false;
+    for (const std::string& strValue : it->second) {
+        if (strValue.find(':') == std::string::npos) {
+            nValue = atoi64(strValue);
+            fFound = true;
+        }
+    }
+    std::string strPrefix = strName + ":";
+    for (const std::string& strValue : it->second) {
+        if (!strName.empty() && strValue.compare(0, strPrefix.size(), strPrefix) == 0) {
+            nValue = atoi64(strValue.substr(strPrefix.size()));
+            fFound = true;
+        }
+    }
+    return fFound;
+}
+
+CLevelDBTuning GetLevelDBTuning(const std::string& strName, size_t nCacheSize)
+{
+    CLevelDBTuning tuning(nCacheSize);
+    int64_t nValue;
+    if (GetLevelDBArg("-dbblockcache", strName, nValue))
+        tuning.nBlockCache = std::max<int64_t>(nValue, 0) << 20;
+    if (GetLevelDBArg("-dbwritebuffer", strName, nValue))
+        tuning.nWriteBuffer = std::max<int64_t>(nValue, 0) << 20;
+    if (GetLevelDBArg("-dbmaxopenfiles", strName, nValue))
+        tuning.nMaxOpenFiles = std::max<int64_t>(std::min<int64_t>(nValue, 50000), DEFAULT_LEVELDB_MAX_OPEN_FILES);
+    if (GetLevelDBArg("-dbbloombits", strName, nValue))
+        tuning.nBloomBits = std::max<int64_t>(std::min<int64_t>(nValue, 64), 0);
+    if (GetLevelDBArg("-dbcompression", strName, nValue))
+        tuning.fCompression = nValue != 0;
+    return tuning;
+}
+
+//! Open named databases, for getdbinfo and compactdb
+static CCriticalSection cs_namedDBs;
+static std::map<std::string, CLevelDBWrapper*> mapNamedDBs;
+
+void ForEachLevelDB(const boost::function<void(CLevelDBWrapper&)>& func)
+{
+    LOCK(cs_namedDBs);
+    for (const std::pair<const std::string, CLevelDBWrapper*>& entry : mapNamedDBs)
+        func(*entry.second);
+}
+
+static leveldb::Options GetOptions(const CLevelDBTuning& tuning)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.block_cache = leveldb::NewLRUCache(tuning.nBlockCache);
+    options.write_buffer_size = tuning.nWriteBuffer;
+    options.filter_policy = tuning.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(tuning.nBloomBits) : nullptr;
+    options.compression = tuning.fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = tuning.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -43,14 +107,28 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& pathIn, size_t nCacheSize, bool fMemory, bool fWipe) : path(pathIn), tuning(nCacheSize)
+{
+    Open(fMemory, fWipe);
+}
+
+CLevelDBWrapper::CLevelDBWrapper(const std::string& strNameIn, const boost::filesystem::path& pathIn, size_t nCacheSize, bool fMemory, bool fWipe) : strName(strNameIn), path(pathIn), tuning(GetLevelDBTuning(strNameIn, nCacheSize))
+{
+    Open(fMemory, fWipe);
+    LogPrintf("LevelDB %s: block cache %d, write buffer %d, max open files %d, bloom bits %d, compression %d\n", strName,
+        tuning.nBlockCache, tuning.nWriteBuffer, tuning.nMaxOpenFiles, tuning.nBloomBits, tuning.fCompression);
+    LOCK(cs_namedDBs);
+    mapNamedDBs[strName] = this;
+}
+
+void CLevelDBWrapper::Open(bool fMemory, bool fWipe)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(tuning);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -70,6 +148,12 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path& path, size_t nCa
 
 CLevelDBWrapper::~CLevelDBWrapper()
 {
+    if (!strName.empty()) {
+        LOCK(cs_namedDBs);
+        std::map<std::string, CLevelDBWrapper*>::iterator it = mapNamedDBs.find(strName);
+        if (it != mapNamedDBs.end() && it->second == this)
+            mapNamedDBs.erase(it);
+    }
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -86,3 +170,28 @@ bool CLevelDBWrapper::WriteBatch(CLevelDBBatch& batch, bool fSync)
     HandleError(status);
     return true;
 }
+
+std::string CLevelDBWrapper::GetProperty(const std::string& strProperty) const
+{
+    std::string strValue;
+    if (!pdb->GetProperty(strProperty, &strValue))
+        return "";
+    return strValue;
+}
+
+uint64_t CLevelDBWrapper::GetApproximateSize() const
+{
+    // All keys start with a type character, so this covers everything
+    leveldb::Range range("", "\xff\xff\xff\xff");
+    uint64_t nSize = 0;
+    pdb->GetApproximateSizes(&range, 1, &nSize);
+    return nSize;
+}
+
+void CLevelDBWrapper::CompactFull()
+{
+    LogPrintf("Compacting LevelDB in %s\n", path.string());
+    int64_t nStart = GetTimeMillis();
+    pdb->CompactRange(nullptr, nullptr);
+    LogPrintf("Compacted LevelDB in %s in %dms\n", path.string(), GetTimeMillis() - nStart);
+}
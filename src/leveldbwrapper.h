@@ -12,6 +12,7 @@
 #include "version.h"
 
 #include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
 
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
@@ -24,6 +25,34 @@ public:
 
 void HandleError(const leveldb::Status& status);
 
+static const int DEFAULT_LEVELDB_MAX_OPEN_FILES = 64;
+static const int DEFAULT_LEVELDB_BLOOM_BITS = 10;
+static const bool DEFAULT_LEVELDB_COMPRESSION = false;
+
+/** Options of one LevelDB database that can be changed with the -db* arguments */
+struct CLevelDBTuning {
+    //! bytes of uncompressed blocks cached in memory
+    size_t nBlockCache;
+    //! bytes of writes buffered before they go to a table file; two buffers may be in use at a time
+    size_t nWriteBuffer;
+    int nMaxOpenFiles;
+    //! bits per key of the bloom filter, 0 for none
+    int nBloomBits;
+    //! Snappy compression; has no effect if LevelDB is built without Snappy
+    bool fCompression;
+
+    //! The defaults for a database with nCacheSize bytes of cache
+    explicit CLevelDBTuning(size_t nCacheSize);
+};
+
+/**
+ * Tuning of the database called strName: the defaults for nCacheSize, with
+ * any -dbblockcache, -dbwritebuffer, -dbmaxopenfiles, -dbbloombits and
+ * -dbcompression values applied. A plain value applies to every database,
+ * "<name>:<value>" to one of them only.
+ */
+CLevelDBTuning GetLevelDBTuning(const std::string& strName, size_t nCacheSize);
+
 /** Batch of changes queued to be written to a CLevelDBWrapper */
 class CLevelDBBatch
 {
@@ -31,8 +60,11 @@ class CLevelDBBatch
 
 private:
     leveldb::WriteBatch batch;
+    size_t nSizeEstimate;
 
 public:
+    CLevelDBBatch() : nSizeEstimate(0) {}
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -47,6 +79,7 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        nSizeEstimate += ssKey.size() + ssValue.size();
     }
 
     template <typename K>
@@ -58,7 +91,17 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        nSizeEstimate += ssKey.size();
+    }
+
+    void Clear()
+    {
+        batch.Clear();
+        nSizeEstimate = 0;
     }
+
+    //! Bytes of keys and values in the batch
+    size_t SizeEstimate() const { return nSizeEstimate; }
 };
 
 class CLevelDBWrapper
@@ -85,8 +128,18 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! name the database is tuned and reported by, empty if unnamed
+    std::string strName;
+    boost::filesystem::path path;
+    CLevelDBTuning tuning;
+
+    void Open(bool fMemory, bool fWipe);
+
 public:
+    /** Open an unnamed database with the default tuning for nCacheSize */
     CLevelDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    /** Open a database tuned by GetLevelDBTuning(strName, nCacheSize) and listed by getdbinfo */
+    CLevelDBWrapper(const std::string& strName, const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
     ~CLevelDBWrapper();
 
     template <typename K, typename V>
@@ -168,6 +221,20 @@ public:
     {
         return pdb->NewIterator(iteroptions);
     }
+
+    const std::string& GetName() const { return strName; }
+    const boost::filesystem::path& GetPath() const { return path; }
+    const CLevelDBTuning& GetTuning() const { return tuning; }
+
+    /** Value of a LevelDB property such as "leveldb.stats", empty if unknown */
+    std::string GetProperty(const std::string& strProperty) const;
+    /** Approximate bytes on disk used by all keys */
+    uint64_t GetApproximateSize() const;
+    /** Compact the whole key range, dropping deleted and overwritten entries */
+    void CompactFull();
 };
 
+/** Call func for every open named database, in name order. None of them is closed meanwhile. */
+void ForEachLevelDB(const boost::function<void(CLevelDBWrapper&)>& func);
+
 #endif // BITCOIN_LEVELDBWRAPPER_H
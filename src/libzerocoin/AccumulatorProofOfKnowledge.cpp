@@ -118,14 +118,19 @@ bool AccumulatorProofOfKnowledge:: Verify(const libzerocoin::Accumulator& a, con
 
 	CBigNum c = CBigNum(hasher.GetHash()); //this hash should be of length k_prime bits
 
-	CBigNum st_1_prime = (valueOfCommitmentToCoin.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * sg.pow_mod(s_alpha, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_phi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_2_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * ((valueOfCommitmentToCoin * sg.inverse(params->accumulatorPoKCommitmentGroup.modulus)).pow_mod(s_gamma, params->accumulatorPoKCommitmentGroup.modulus)) * sh.pow_mod(s_psi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-	CBigNum st_3_prime = (sg.pow_mod(c, params->accumulatorPoKCommitmentGroup.modulus) * (sg * valueOfCommitmentToCoin).pow_mod(s_sigma, params->accumulatorPoKCommitmentGroup.modulus) * sh.pow_mod(s_xi, params->accumulatorPoKCommitmentGroup.modulus)) % params->accumulatorPoKCommitmentGroup.modulus;
-
-	CBigNum t_1_prime = (C_r.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_zeta, params->accumulatorModulus) * g_n.pow_mod(s_epsilon, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_2_prime = (C_e.pow_mod(c, params->accumulatorModulus) * h_n.pow_mod(s_eta, params->accumulatorModulus) * g_n.pow_mod(s_alpha, params->accumulatorModulus)) % params->accumulatorModulus;
-	CBigNum t_3_prime = ((a.getValue()).pow_mod(c, params->accumulatorModulus) * C_u.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
-	CBigNum t_4_prime = (C_r.pow_mod(s_alpha, params->accumulatorModulus) * ((h_n.inverse(params->accumulatorModulus)).pow_mod(s_delta, params->accumulatorModulus)) * ((g_n.inverse(params->accumulatorModulus)).pow_mod(s_beta, params->accumulatorModulus))) % params->accumulatorModulus;
+	// The generators are raised with precomputed powers, see FixedBasePowMod. All
+	// exponents here are public, so the variable time methods are fine.
+	const CBigNum& pokModulus = params->accumulatorPoKCommitmentGroup.modulus;
+	const CBigNum& qrnModulus = params->accumulatorModulus;
+	CBigNum st_1_prime = valueOfCommitmentToCoin.pow_mod(c, pokModulus).mul_mod(FixedBasePowMod(sg, s_alpha, pokModulus), pokModulus).mul_mod(FixedBasePowMod(sh, s_phi, pokModulus), pokModulus);
+	CBigNum st_2_prime = FixedBasePowMod(sg, c, pokModulus).mul_mod((valueOfCommitmentToCoin * sg.inverse(pokModulus)).pow_mod(s_gamma, pokModulus), pokModulus).mul_mod(FixedBasePowMod(sh, s_psi, pokModulus), pokModulus);
+	CBigNum st_3_prime = FixedBasePowMod(sg, c, pokModulus).mul_mod((sg * valueOfCommitmentToCoin).pow_mod(s_sigma, pokModulus), pokModulus).mul_mod(FixedBasePowMod(sh, s_xi, pokModulus), pokModulus);
+
+	// (h_n^-1)^x is computed as h_n^-x, which gives the same value
+	CBigNum t_1_prime = C_r.pow_mod(c, qrnModulus).mul_mod(FixedBasePowMod(h_n, s_zeta, qrnModulus), qrnModulus).mul_mod(FixedBasePowMod(g_n, s_epsilon, qrnModulus), qrnModulus);
+	CBigNum t_2_prime = C_e.pow_mod(c, qrnModulus).mul_mod(FixedBasePowMod(h_n, s_eta, qrnModulus), qrnModulus).mul_mod(FixedBasePowMod(g_n, s_alpha, qrnModulus), qrnModulus);
+	CBigNum t_3_prime = (a.getValue()).mul_pow_mod(c, C_u, s_alpha, qrnModulus).mul_mod(FixedBasePowMod(h_n, -s_beta, qrnModulus), qrnModulus);
+	CBigNum t_4_prime = C_r.pow_mod(s_alpha, qrnModulus).mul_mod(FixedBasePowMod(h_n, -s_delta, qrnModulus), qrnModulus).mul_mod(FixedBasePowMod(g_n, -s_beta, qrnModulus), qrnModulus);
 
 	bool result_st1 = (st_1 == st_1_prime);
 	bool result_st2 = (st_2 == st_2_prime);
@@ -49,6 +49,25 @@ int64_t ZerocoinDenominationToInt(const libzerocoin::CoinDenomination& denominat
     return Value;
 }
 
+int ZerocoinDenominationToIndex(const libzerocoin::CoinDenomination& denomination)
+{
+    int nIndex = -1;
+    switch (denomination) {
+    case libzerocoin::CoinDenomination::ZQ_ONE: nIndex = 0; break;
+    case libzerocoin::CoinDenomination::ZQ_FIVE: nIndex = 1; break;
+    case libzerocoin::CoinDenomination::ZQ_TEN: nIndex = 2; break;
+    case libzerocoin::CoinDenomination::ZQ_FIFTY: nIndex = 3; break;
+    case libzerocoin::CoinDenomination::ZQ_ONE_HUNDRED: nIndex = 4; break;
+    case libzerocoin::CoinDenomination::ZQ_FIVE_HUNDRED: nIndex = 5; break;
+    case libzerocoin::CoinDenomination::ZQ_ONE_THOUSAND: nIndex = 6; break;
+    case libzerocoin::CoinDenomination::ZQ_FIVE_THOUSAND: nIndex = 7; break;
+    default:
+        // Error Case
+        nIndex = -1; break;
+    }
+    return nIndex;
+}
+
 CoinDenomination AmountToZerocoinDenomination(CAmount amount)
 {
     // Check to make sure amount is an exact integer number of COINS
@@ -14,6 +14,10 @@
 #include "Params.h"
 #include "ParamGeneration.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 namespace libzerocoin {
 
 ZerocoinParams::ZerocoinParams(const CBigNum& N, uint32_t securityLevel) {
@@ -45,4 +49,26 @@ CBigNum IntegerGroupParams::randomElement() const {
 	return this->g.pow_mod(CBigNum::randBignum(this->groupOrder),this->modulus);
 }
 
+static std::mutex csFixedBases;
+static std::map<std::pair<CBigNum, CBigNum>, std::shared_ptr<const CBigNumFixedBase> > mapFixedBases;
+
+CBigNum FixedBasePowMod(const CBigNum& base, const CBigNum& e, const CBigNum& modulus) {
+	unsigned int nBits = e.bitSize();
+	unsigned int nLimit = modulus.bitSize() + FIXED_BASE_EXTRA_BITS;
+	if (nBits > nLimit)
+		return base.pow_mod(e, modulus);
+
+	std::shared_ptr<const CBigNumFixedBase> table;
+	{
+		std::lock_guard<std::mutex> lock(csFixedBases);
+		std::shared_ptr<const CBigNumFixedBase>& entry = mapFixedBases[std::make_pair(base, modulus)];
+		// Start with room for exponents the size of the modulus, the proofs
+		// whose responses are larger grow it once up to the limit
+		if (!entry || entry->getMaxBits() < nBits)
+			entry = std::make_shared<const CBigNumFixedBase>(base, modulus, nBits > (unsigned int)modulus.bitSize() ? nLimit : modulus.bitSize());
+		table = entry;
+	}
+	return table->pow_mod(e);
+}
+
 } /* namespace libzerocoin */
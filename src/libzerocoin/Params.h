@@ -215,6 +215,14 @@ public:
 	}
 };
 
+/**
+ * base^e mod modulus for a public exponent e, using powers of base that are
+ * precomputed on first use and kept for later proofs. Only meant for the
+ * generators of the parameters, so that the tables are built once per
+ * ZerocoinParams. The result is identical to base.pow_mod(e, modulus).
+ */
+CBigNum FixedBasePowMod(const CBigNum& base, const CBigNum& e, const CBigNum& modulus);
+
 } /* namespace libzerocoin */
 
 #endif /* PARAMS_H_ */
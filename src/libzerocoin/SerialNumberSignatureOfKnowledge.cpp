@@ -147,23 +147,27 @@ bool SerialNumberSignatureOfKnowledge::Verify(const CBigNum& coinSerialNumber, c
     std::vector<CBigNum> tprime(params->zkp_iterations);
     unsigned char *hashbytes = (unsigned char*) &this->hash;
 
+    // Same values as challengeCalculation(), but the generators are raised with
+    // precomputed powers (see FixedBasePowMod) and a^serial is only computed once.
+    // All exponents here are public, so the variable time methods are fine.
+    const CBigNum& modulus = params->serialNumberSoKCommitmentGroup.modulus;
+    const CBigNum& groupOrder = params->serialNumberSoKCommitmentGroup.groupOrder;
+
     try {
+        CBigNum aSerial = FixedBasePowMod(a, coinSerialNumber, groupOrder);
         for (uint32_t i = 0; i < params->zkp_iterations; i++) {
             int bit = i % 8;
             int byte = i / 8;
             bool challenge_bit = ((hashbytes[byte] >> bit) & 0x01);
             if (challenge_bit) {
                 CBigNum bn = SeedTo1024(sprime[i].getuint256());
-                if (bn > params->serialNumberSoKCommitmentGroup.groupOrder && isInParamsValidationRange)
+                if (bn > groupOrder && isInParamsValidationRange)
                     return error("SoK Verify() :: sprime in pos %d not in valid range", i);
-                tprime[i] = challengeCalculation(coinSerialNumber, s_notprime[i], bn);
+                CBigNum exponent = aSerial.mul_mod(FixedBasePowMod(b, s_notprime[i], groupOrder), groupOrder);
+                tprime[i] = FixedBasePowMod(g, exponent, modulus).mul_mod(FixedBasePowMod(h, bn, modulus), modulus);
             } else {
-                CBigNum exp = b.pow_mod(s_notprime[i], params->serialNumberSoKCommitmentGroup.groupOrder);
-                tprime[i] = ((valueOfCommitmentToCoin.pow_mod(exp, params->serialNumberSoKCommitmentGroup.modulus) %
-                              params->serialNumberSoKCommitmentGroup.modulus) *
-                             (h.pow_mod(sprime[i], params->serialNumberSoKCommitmentGroup.modulus) %
-                              params->serialNumberSoKCommitmentGroup.modulus)) %
-                            params->serialNumberSoKCommitmentGroup.modulus;
+                CBigNum exp = FixedBasePowMod(b, s_notprime[i], groupOrder);
+                tprime[i] = valueOfCommitmentToCoin.pow_mod(exp, modulus).mul_mod(FixedBasePowMod(h, sprime[i], modulus), modulus);
             }
         }
         for (uint32_t i = 0; i < params->zkp_iterations; i++) {
@@ -31,6 +31,11 @@
 #define ZEROCOIN_ACCUMULATOR_PROOF          "ACCUMULATOR_PROOF"
 #define ZEROCOIN_SERIALNUMBER_PROOF         "SERIALNUMBER_PROOF"
 
+// Exponents up to this many bits above the size of the modulus use precomputed
+// powers of the fixed bases when verifying proofs. Larger ones are computed
+// directly, so a proof with oversized responses cannot grow the tables.
+#define FIXED_BASE_EXTRA_BITS               1024
+
 // Activate multithreaded mode for proof verification
 #define ZEROCOIN_THREADING 1
 
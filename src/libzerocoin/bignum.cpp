@@ -6,6 +6,8 @@
 
 #include "bignum.h"
 
+#include <algorithm>
+
 #if defined(USE_NUM_GMP)
 #include "bignum_gmp.cpp"
 #endif
@@ -61,3 +63,100 @@ const CBigNum CBigNum::operator--(int)
     --(*this);
     return ret;
 }
+
+CBigNum CBigNum::mul_pow_mod(const CBigNum& e, const CBigNum& b, const CBigNum& f, const CBigNum& m) const
+{
+    // g^-x = (g^-1)^x
+    if (e < CBigNum(0))
+        return this->inverse(m).mul_pow_mod(-e, b, f, m);
+    if (f < CBigNum(0))
+        return this->mul_pow_mod(e, b.inverse(m), -f, m);
+
+    // Fixed windows of 4 bits, each with a table of the 16 powers of its base
+    static const unsigned int WINDOW_BITS = 4;
+    CBigNum vThis[1 << WINDOW_BITS];
+    CBigNum vB[1 << WINDOW_BITS];
+    vThis[0] = vB[0] = CBigNum(1) % m;
+    vThis[1] = *this % m;
+    vB[1] = b % m;
+    for (unsigned int i = 2; i < (1U << WINDOW_BITS); i++) {
+        vThis[i] = vThis[i - 1].mul_mod(vThis[1], m);
+        vB[i] = vB[i - 1].mul_mod(vB[1], m);
+    }
+
+    unsigned int nBits = std::max(e.bitSize(), f.bitSize());
+    CBigNum ret = vThis[0];
+    bool fStarted = false;
+    for (int i = (nBits + WINDOW_BITS - 1) / WINDOW_BITS - 1; i >= 0; i--) {
+        if (fStarted) {
+            for (unsigned int j = 0; j < WINDOW_BITS; j++)
+                ret = ret.mul_mod(ret, m);
+        }
+        unsigned int nDigitThis = 0;
+        unsigned int nDigitB = 0;
+        for (unsigned int j = 0; j < WINDOW_BITS; j++) {
+            nDigitThis |= (unsigned int)e.isBitSet(i * WINDOW_BITS + j) << j;
+            nDigitB |= (unsigned int)f.isBitSet(i * WINDOW_BITS + j) << j;
+        }
+        if (nDigitThis) {
+            ret = ret.mul_mod(vThis[nDigitThis], m);
+            fStarted = true;
+        }
+        if (nDigitB) {
+            ret = ret.mul_mod(vB[nDigitB], m);
+            fStarted = true;
+        }
+    }
+    return ret;
+}
+
+CBigNumFixedBase::CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, unsigned int nMaxBits) : base(baseIn), modulus(modulusIn)
+{
+    // An exponentiation takes a multiplication per window and two per digit
+    // value, pick the window size with the fewest
+    nWindowBits = 1;
+    for (unsigned int w = 2; w <= 16; w++) {
+        if ((nMaxBits + w - 1) / w + (2U << w) < (nMaxBits + nWindowBits - 1) / nWindowBits + (2U << nWindowBits))
+            nWindowBits = w;
+    }
+
+    vPowers.resize(std::max((nMaxBits + nWindowBits - 1) / nWindowBits, 1U));
+    vPowers[0] = base % modulus;
+    for (unsigned int i = 1; i < vPowers.size(); i++) {
+        vPowers[i] = vPowers[i - 1];
+        for (unsigned int j = 0; j < nWindowBits; j++)
+            vPowers[i] = vPowers[i].mul_mod(vPowers[i], modulus);
+    }
+}
+
+CBigNum CBigNumFixedBase::pow_mod(const CBigNum& e) const
+{
+    // g^-x = (g^x)^-1
+    if (e < CBigNum(0))
+        return pow_mod(-e).inverse(modulus);
+    unsigned int nBits = e.bitSize();
+    if (nBits > getMaxBits())
+        return base.pow_mod(e, modulus);
+
+    unsigned int nWindows = (nBits + nWindowBits - 1) / nWindowBits;
+    std::vector<unsigned int> vDigits(nWindows);
+    unsigned int nMaxDigit = 0;
+    for (unsigned int i = 0; i < nWindows; i++) {
+        for (unsigned int j = 0; j < nWindowBits; j++)
+            vDigits[i] |= (unsigned int)e.isBitSet(i * nWindowBits + j) << j;
+        nMaxDigit = std::max(nMaxDigit, vDigits[i]);
+    }
+
+    // The product of the powers whose digit is at least d, multiplied into
+    // the result once for every d, raises each power to its digit
+    CBigNum acc = CBigNum(1) % modulus;
+    CBigNum ret = acc;
+    for (unsigned int d = nMaxDigit; d > 0; d--) {
+        for (unsigned int i = 0; i < nWindows; i++) {
+            if (vDigits[i] == d)
+                acc = acc.mul_mod(vPowers[i], modulus);
+        }
+        ret = ret.mul_mod(acc, modulus);
+    }
+    return ret;
+}
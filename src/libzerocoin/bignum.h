@@ -145,6 +145,17 @@ public:
      */
     CBigNum pow_mod(const CBigNum& e, const CBigNum& m) const;
 
+    /**
+     * simultaneous modular exponentiation: (this^e * b^f) mod m, sharing the
+     * squarings of both (Shamir's trick). Not constant time, so only for
+     * public exponents such as those of a proof being verified.
+     * @param e exponent of this
+     * @param b second base
+     * @param f exponent of b
+     * @param m modulus
+     */
+    CBigNum mul_pow_mod(const CBigNum& e, const CBigNum& b, const CBigNum& f, const CBigNum& m) const;
+
     /**
     * Calculates the inverse of this element mod m.
     * i.e. i such this*i = 1 mod m
@@ -182,6 +193,12 @@ public:
 #endif
 
     bool isOne() const;
+
+    /**
+     * Tests a bit of a non-negative number
+     * @param n the bit position, 0 being the least significant bit
+     */
+    bool isBitSet(unsigned int n) const;
     bool operator!() const;
     CBigNum& operator+=(const CBigNum& b);
     CBigNum& operator-=(const CBigNum& b);
@@ -210,6 +227,37 @@ public:
     friend inline bool operator>(const CBigNum& a, const CBigNum& b);
 };
 
+/**
+ * Powers of a fixed base modulo a fixed modulus, precomputed so that an
+ * exponentiation needs no squarings, only about one multiplication per
+ * window of the exponent (Yao's method). Not constant time, so only for
+ * public exponents such as those of a proof being verified.
+ */
+class CBigNumFixedBase
+{
+    CBigNum base;
+    CBigNum modulus;
+    unsigned int nWindowBits;
+    //! base^(2^(nWindowBits*i)) mod modulus
+    std::vector<CBigNum> vPowers;
+
+public:
+    /**
+     * @param baseIn the base
+     * @param modulusIn the modulus
+     * @param nMaxBits exponents up to this size use the table
+     */
+    CBigNumFixedBase(const CBigNum& baseIn, const CBigNum& modulusIn, unsigned int nMaxBits);
+
+    unsigned int getMaxBits() const { return nWindowBits * vPowers.size(); }
+
+    /**
+     * modular exponentiation: base^e mod modulus, identical to base.pow_mod(e, modulus)
+     * @param e exponent
+     */
+    CBigNum pow_mod(const CBigNum& e) const;
+};
+
 #if defined(USE_NUM_OPENSSL)
 class CAutoBN_CTX
 {
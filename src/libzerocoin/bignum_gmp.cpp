@@ -305,6 +305,11 @@ bool CBigNum::isOne() const
     return mpz_cmp(bn, CBigNum(1).bn) == 0;
 }
 
+bool CBigNum::isBitSet(unsigned int n) const
+{
+    return mpz_tstbit(bn, n);
+}
+
 bool CBigNum::operator!() const
 {
     return mpz_cmp(bn, CBigNum(0).bn) == 0;
@@ -449,6 +449,11 @@ bool CBigNum::isOne() const
     return BN_is_one(bn);
 }
 
+bool CBigNum::isBitSet(unsigned int n) const
+{
+    return BN_is_bit_set(bn, n);
+}
+
 bool CBigNum::operator!() const
 {
     return BN_is_zero(bn);
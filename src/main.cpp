@@ -9,8 +9,11 @@
 
 #include "zpiv/accumulators.h"
 #include "zpiv/accumulatormap.h"
+#include "addressindex.h"
 #include "addrman.h"
 #include "alert.h"
+#include "blockcache.h"
+#include "blockimport.h"
 #include "blocksignature.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -60,6 +63,7 @@
 
 CCriticalSection cs_main;
 
+CBlockIndexArena blockIndexArena;
 BlockMap mapBlockIndex;
 std::map<uint256, uint256> mapProofOfStake;
 std::map<unsigned int, unsigned int> mapHashedBlocks;
@@ -72,10 +76,14 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
+bool fSpentIndex = DEFAULT_SPENTINDEX;
+bool fTimestampIndex = DEFAULT_TIMESTAMPINDEX;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
 bool fVerifyingBlocks = false;
 unsigned int nCoinCacheSize = 5000;
+bool fAsyncFlush = DEFAULT_ASYNC_FLUSH;
 bool fAlerts = DEFAULT_ALERTS;
 bool fClearSpendCache = false;
 
@@ -614,10 +622,54 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = nullptr;
+CCoinsViewBackgroundFlush* pcoinsflush = nullptr;
 CBlockTreeDB* pblocktree = nullptr;
 CZerocoinDB* zerocoinDB = nullptr;
 CSporkDB* pSporkDB = nullptr;
 
+/** Stats of the unspent output set after the block last connected or disconnected */
+static CUtxoStats utxoStatsTip;
+
+bool GetUtxoStats(const CBlockIndex* pindex, CUtxoStats& stats)
+{
+    AssertLockHeld(cs_main);
+    if (utxoStatsTip.hashBlock == pindex->GetBlockHash()) {
+        stats = utxoStatsTip;
+        return true;
+    }
+    // The outputs of the genesis block are not spendable
+    if (pindex->pprev == nullptr) {
+        stats = CUtxoStats();
+        stats.hashBlock = pindex->GetBlockHash();
+        return true;
+    }
+    return pblocktree->ReadUtxoStats(pindex->GetBlockHash(), stats);
+}
+
+bool LoadUtxoStats(CCoinsViewDB* coinsdb)
+{
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(coinsdb->GetBestBlock());
+    if (mi == mapBlockIndex.end()) {
+        utxoStatsTip = CUtxoStats();
+        return true;
+    }
+    if (GetUtxoStats(mi->second, utxoStatsTip))
+        return true;
+
+    // The chainstate is older than the stats, hash it once
+    LogPrintf("%s : computing unspent output set stats at height %d...\n", __func__, mi->second->nHeight);
+    int64_t nStart = GetTimeMillis();
+    CUtxoStats stats;
+    if (!coinsdb->ComputeUtxoStats(stats))
+        return error("%s : failed to read the chainstate", __func__);
+    if (!pblocktree->WriteUtxoStats(stats.hashBlock, stats))
+        return error("%s : failed to write unspent output set stats", __func__);
+    utxoStatsTip = stats;
+    LogPrintf("%s : %u outputs hashed in %dms\n", __func__, stats.nTransactionOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // mapOrphanTransactions
@@ -1015,6 +1067,11 @@ bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::Coi
         return false;
     }
 
+    return CheckZerocoinSpendSerialNotInChain(spend);
+}
+
+bool CheckZerocoinSpendSerialNotInChain(const libzerocoin::CoinSpend* spend)
+{
     //Reject serial's that are already in the blockchain
     int nHeightTx = 0;
     if (IsSerialInBlockchain(spend->getCoinSerialNumber(), nHeightTx))
@@ -1072,7 +1129,7 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
 }
 
 
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack)
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack, std::vector<CZerocoinSpendCheck>* pvChecks)
 {
     //max needed non-mint outputs should be 2 - one for redemption address and a possible 2nd for change
     if (tx.vout.size() > 2) {
@@ -1134,7 +1191,14 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
         if (isPublicSpend) {
             libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
             PublicCoinSpend ret(params);
-            if (!ZWSPModule::validateInput(txin, prevOut, tx, ret)){
+            if (pvChecks) {
+                // Leave the commitment and signature to the check queue
+                if (!ZWSPModule::checkInput(txin, prevOut, tx, ret))
+                    return state.DoS(100, error("CheckZerocoinSpend(): public zerocoin spend did not verify"));
+                CZerocoinSpendCheck check(tx, ret);
+                pvChecks->push_back(CZerocoinSpendCheck());
+                check.swap(pvChecks->back());
+            } else if (!ZWSPModule::validateInput(txin, prevOut, tx, ret)){
                 return state.DoS(100, error("CheckZerocoinSpend(): public zerocoin spend did not verify"));
             }
         } else
@@ -1151,7 +1215,11 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
                                     newSpend.getDenomination(), bnAccumulatorValue);
 
                 //Check that the coin has been accumulated
-                if(!newSpend.Verify(accumulator, !fFakeSerialAttack))
+                if (pvChecks) {
+                    CZerocoinSpendCheck check(tx, newSpend, accumulator, !fFakeSerialAttack);
+                    pvChecks->push_back(CZerocoinSpendCheck());
+                    check.swap(pvChecks->back());
+                } else if(!newSpend.Verify(accumulator, !fFakeSerialAttack))
                         return state.DoS(100, error("CheckZerocoinSpend(): zerocoin spend did not verify"));
             }
 
@@ -1172,7 +1240,7 @@ bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidati
     return fValidated;
 }
 
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack)
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks)
 {
     // Basic checks that don't depend on any context
     if (tx.vin.empty())
@@ -1242,7 +1310,7 @@ bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fReject
 
             // Do not require signature verification if this is initial sync and a block over 24 hours old
             bool fVerifySignature = !IsInitialBlockDownload() && (GetTime() - chainActive.Tip()->GetBlockTime() < (60*60*24));
-            if (!CheckZerocoinSpend(tx, fVerifySignature, state, fFakeSerialAttack))
+            if (!CheckZerocoinSpend(tx, fVerifySignature, state, fFakeSerialAttack, pvZerocoinChecks))
                 return state.DoS(100, error("CheckTransaction() : invalid zerocoin spend"));
         }
     }
@@ -1610,7 +1678,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
         pool.addUnchecked(hash, entry);
     }
 
-    SyncWithWallets(tx, nullptr);
+    SyncWithWallets(std::make_shared<const CTransaction>(tx), nullptr);
 
     //Track zerocoinspends and ensure that they are given priority to make it into the blockchain
     if (tx.HasZerocoinSpendInputs())
@@ -1822,6 +1890,47 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
     return true;
 }
 
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int nStart, int nEnd)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, nStart, nEnd))
+        return error("%s : unable to get txids for address", __func__);
+
+    return true;
+}
+
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("%s : unable to get txids for address", __func__);
+
+    return true;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+bool GetTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& vHashes)
+{
+    if (!fTimestampIndex)
+        return error("%s : timestamp index not enabled", __func__);
+
+    if (!pblocktree->ReadTimestampIndex(nHigh, nLow, vHashes))
+        return error("%s : unable to get hashes for timestamps", __func__);
+
+    return true;
+}
+
 bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state, CTxOut& out)
 {
     CTransaction txPrev;
@@ -1851,16 +1960,28 @@ bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
                 CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+                CMappedBlock mapped;
+                if (mappedBlockFiles.MapBlock(postx, mapped)) {
+                    try {
+                        CSpanReader reader(mapped.pbegin, mapped.pbegin + mapped.nSize, SER_DISK, CLIENT_VERSION);
+                        reader >> header;
+                        reader.ignore(postx.nTxOffset);
+                        reader >> txOut;
+                    } catch (std::exception& e) {
+                        return error("%s : Deserialize error - %s", __func__, e.what());
+                    }
+                } else {
+                    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                    if (file.IsNull())
+                        return error("%s: OpenBlockFile failed", __func__);
+                    try {
+                        file >> header;
+                        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                        file >> txOut;
+                    } catch (std::exception& e) {
+                        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+                    }
                 }
                 hashBlock = header.GetHash();
                 if (txOut.GetHash() != hash)
@@ -1932,16 +2053,27 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    CMappedBlock mapped;
+    if (mappedBlockFiles.MapBlock(pos, mapped)) {
+        // Deserialize straight from the mapped file
+        try {
+            CSpanReader reader(mapped.pbegin, mapped.pbegin + mapped.nSize, SER_DISK, CLIENT_VERSION);
+            reader >> block;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk : OpenBlockFile failed");
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (std::exception& e) {
-        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        // Read block
+        try {
+            filein >> block;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Check the header
@@ -1953,6 +2085,41 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
     return true;
 }
 
+bool ReadRawBlockFromDisk(CDataStream& ss, const CDiskBlockPos& pos)
+{
+    ss.clear();
+
+    CMappedBlock mapped;
+    if (mappedBlockFiles.MapBlock(pos, mapped)) {
+        ss.write(mapped.pbegin, mapped.nSize);
+        return true;
+    }
+
+    if (pos.nPos < 8)
+        return error("%s : invalid block position %d:%u", __func__, pos.nFile, pos.nPos);
+
+    // Open history file at the index header written by WriteBlockToDisk
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - 8), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    try {
+        unsigned char pchMessageStart[MESSAGE_START_SIZE];
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return error("%s : block magic mismatch at %d:%u", __func__, pos.nFile, pos.nPos);
+        if (nSize > MAX_BLOCK_SIZE_CURRENT)
+            return error("%s : block size %u too large at %d:%u", __func__, nSize, pos.nFile, pos.nPos);
+        ss.resize(nSize);
+        filein.read(&ss[0], nSize);
+    } catch (std::exception& e) {
+        return error("%s : I/O error - %s", __func__, e.what());
+    }
+
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
@@ -2205,7 +2372,10 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
     }
 
     // add outputs
-    inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    if (tx.IsCoinBase())
+        inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    else
+        inputs.ModifyNewCoins(tx.GetHash())->FromTx(tx, nHeight);
 }
 
 bool CScriptCheck::operator()()
@@ -2217,6 +2387,38 @@ bool CScriptCheck::operator()()
     return true;
 }
 
+CZerocoinSpendCheck::CZerocoinSpendCheck(const CTransaction& txToIn, const libzerocoin::CoinSpend& spendIn, const libzerocoin::Accumulator& accumulatorIn, bool fVerifyParamsIn) : spend(new libzerocoin::CoinSpend(spendIn)),
+                                                                                                                                                                                  accumulator(new libzerocoin::Accumulator(accumulatorIn)), fVerifyParams(fVerifyParamsIn), ptxTo(&txToIn), pindex(nullptr) {}
+
+CZerocoinSpendCheck::CZerocoinSpendCheck(const CTransaction& txToIn, const PublicCoinSpend& spendIn) : publicSpend(new PublicCoinSpend(spendIn)), fVerifyParams(false), ptxTo(&txToIn), pindex(nullptr) {}
+
+CZerocoinSpendCheck::CZerocoinSpendCheck(const CTransaction& txToIn, const libzerocoin::CoinSpend& spendIn, CBlockIndex* pindexIn, const uint256& hashBlockIn) : spend(new libzerocoin::CoinSpend(spendIn)),
+                                                                                                                                                              fVerifyParams(false), ptxTo(&txToIn), pindex(pindexIn), hashBlock(hashBlockIn) {}
+
+// Public spends override signatureHash(), so they must not be sliced into a CoinSpend
+CZerocoinSpendCheck::CZerocoinSpendCheck(const CTransaction& txToIn, const PublicCoinSpend& spendIn, CBlockIndex* pindexIn, const uint256& hashBlockIn) : spend(new PublicCoinSpend(spendIn)),
+                                                                                                                                                         fVerifyParams(false), ptxTo(&txToIn), pindex(pindexIn), hashBlock(hashBlockIn) {}
+
+bool CZerocoinSpendCheck::operator()()
+{
+    // This runs on a CCheckQueue worker, where an exception from a malformed
+    // spend would bring the node down, so it is reported as a failed check
+    try {
+        if (pindex)
+            return ContextualCheckZerocoinSpendNoSerialCheck(*ptxTo, spend.get(), pindex, hashBlock);
+        if (publicSpend) {
+            if (!publicSpend->validate())
+                return ::error("CZerocoinSpendCheck(): public zerocoin spend in %s did not verify", ptxTo->GetHash().ToString());
+            return true;
+        }
+        if (!spend->Verify(*accumulator, fVerifyParams))
+            return ::error("CZerocoinSpendCheck(): zerocoin spend in %s did not verify", ptxTo->GetHash().ToString());
+    } catch (const std::exception& e) {
+        return ::error("CZerocoinSpendCheck(): zerocoin spend in %s threw - %s", ptxTo->GetHash().ToString(), e.what());
+    }
+    return true;
+}
+
 CBitcoinAddress addressExp1("WfJehDzxfR7hMDdvgadn6ppZF7BLHTGmDW");
 CBitcoinAddress addressExp2("WhNMBaseKkCM2VtHN1BURZNGmGwJzQTB2Z");
 
@@ -2404,6 +2606,33 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
+bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+{
+    bool fClean = true;
+
+    CCoinsModifier coins = view.ModifyCoins(out.hash);
+    if (undo.nHeight != 0) {
+        // undo data contains height: this is the last output of the prevout tx being spent
+        if (!coins->IsPruned())
+            fClean = fClean && error("%s : undo data overwriting existing transaction", __func__);
+        coins->Clear();
+        coins->fCoinBase = undo.fCoinBase;
+        coins->fCoinStake = undo.fCoinStake;
+        coins->nHeight = undo.nHeight;
+        coins->nVersion = undo.nVersion;
+    } else {
+        if (coins->IsPruned())
+            fClean = fClean && error("%s : undo data adding output to missing transaction", __func__);
+    }
+    if (coins->IsAvailable(out.n))
+        fClean = fClean && error("%s : undo data overwriting existing output", __func__);
+    if (coins->vout.size() < out.n + 1)
+        coins->vout.resize(out.n + 1);
+    coins->vout[out.n] = undo.txout;
+
+    return fClean;
+}
+
 bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
@@ -2415,6 +2644,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
     bool fClean = true;
 
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    CUtxoStats utxoStats;
+    bool fUtxoStats = GetUtxoStats(pindex, utxoStats);
+
     CBlockUndo blockUndo;
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull())
@@ -2504,10 +2739,30 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             if (*outs != outsBlock)
                 fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
 
+            if (fUtxoStats && !outs->IsPruned()) {
+                utxoStats.nTransactions--;
+                for (unsigned int k = 0; k < outs->vout.size(); k++) {
+                    if (outs->IsAvailable(k))
+                        utxoStats.RemoveCoin(COutPoint(hash, k), Coin(*outs, k));
+                }
+            }
+
             // remove outputs
             outs->Clear();
         }
 
+        if (fAddressIndex) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut& out = tx.vout[k];
+                int addressType;
+                uint160 addressHash;
+                if (!GetAddressIndexKey(out.scriptPubKey, addressType, addressHash))
+                    continue;
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, addressHash, pindex->nHeight, i, hash, k, false), out.nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, addressHash, hash, k), CAddressUnspentValue()));
+            }
+        }
+
         // restore inputs
         if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) { // not coinbases or zerocoinspend because they dont have traditional inputs
             const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
@@ -2516,24 +2771,26 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint& out = tx.vin[j].prevout;
                 const CTxInUndo& undo = txundo.vprevout[j];
-                CCoinsModifier coins = view.ModifyCoins(out.hash);
-                if (undo.nHeight != 0) {
-                    // undo data contains height: this is the last output of the prevout tx being spent
-                    if (!coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
-                    coins->Clear();
-                    coins->fCoinBase = undo.fCoinBase;
-                    coins->nHeight = undo.nHeight;
-                    coins->nVersion = undo.nVersion;
-                } else {
-                    if (coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
+                if (!ApplyTxInUndo(undo, view, out))
+                    fClean = false;
+                const CCoins* coins = view.AccessCoins(out.hash);
+
+                if (fUtxoStats) {
+                    if (undo.nHeight != 0)
+                        utxoStats.nTransactions++;
+                    utxoStats.AddCoin(out, Coin(*coins, out.n));
+                }
+
+                if (fAddressIndex || fSpentIndex) {
+                    int addressType;
+                    uint160 addressHash;
+                    if (fAddressIndex && GetAddressIndexKey(undo.txout.scriptPubKey, addressType, addressHash)) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, addressHash, pindex->nHeight, i, hash, j, true), undo.txout.nValue * -1));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, addressHash, out.hash, out.n), CAddressUnspentValue(undo.txout.nValue, undo.txout.scriptPubKey, coins->nHeight)));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
                 }
-                if (coins->IsAvailable(out.n))
-                    fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
-                if (coins->vout.size() < out.n + 1)
-                    coins->vout.resize(out.n + 1);
-                coins->vout[out.n] = undo.txout;
             }
         }
     }
@@ -2542,6 +2799,21 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
     if (!fVerifyingBlocks) {
+        if (fAddressIndex) {
+            if (!pblocktree->EraseAddressIndex(addressIndex))
+                return state.Abort("Failed to delete address index");
+            if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+                return state.Abort("Failed to write address unspent index");
+        }
+
+        if (fSpentIndex)
+            if (!pblocktree->UpdateSpentIndex(spentIndex))
+                return state.Abort("Failed to write spent index");
+
+        if (fTimestampIndex)
+            if (!pblocktree->EraseTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
+                return state.Abort("Failed to delete timestamp index");
+
         //if block is an accumulator checkpoint block, remove checkpoint and checksums from db
         uint256 nCheckpoint = pindex->nAccumulatorCheckpoint;
         if(nCheckpoint != pindex->pprev->nAccumulatorCheckpoint) {
@@ -2550,6 +2822,11 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         }
     }
 
+    if (fUtxoStats && fClean) {
+        utxoStats.hashBlock = pindex->pprev->GetBlockHash();
+        utxoStatsTip = utxoStats;
+    }
+
     if (pfClean) {
         *pfClean = fClean;
         return true;
@@ -2591,6 +2868,21 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Zerocoin spend proofs take milliseconds each, so they get their own queue with
+ * small batches. CheckBlock also runs outside cs_main; whoever cannot take
+ * zerocoinspendcheckmutex verifies its spends inline instead. The mutex is not
+ * recursive, so a nested caller falls back to inline checks as well.
+ */
+static CCheckQueue<CZerocoinSpendCheck> zerocoinspendcheckqueue(4);
+static boost::mutex zerocoinspendcheckmutex;
+
+void ThreadZerocoinSpendCheck()
+{
+    RenameThread("wispr-zcspendch");
+    zerocoinspendcheckqueue.Thread();
+}
+
 void AddWrappedSerialsInflation()
 {
     CBlockIndex* pindex = chainActive[Params().Zerocoin_Block_EndFakeSerial()];
@@ -2607,7 +2899,7 @@ void AddWrappedSerialsInflation()
 
         // Add inflated denominations to block index mapSupply
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+            pindex->zerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
         }
         // Update current block index to disk
         assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
@@ -2639,10 +2931,9 @@ void RecalculateZWSPMinted()
         std::list<CZerocoinMint> listMints;
         BlockToZerocoinMintList(block, listMints, true);
 
-        std::vector<libzerocoin::CoinDenomination> vDenomsBefore = pindex->vMintDenominationsInBlock;
-        pindex->vMintDenominationsInBlock.clear();
+        pindex->mintsInBlock.SetNull();
         for (auto mint : listMints)
-            pindex->vMintDenominationsInBlock.emplace_back(mint.GetDenomination());
+            pindex->mintsInBlock.Add(mint.GetDenomination());
 
         if (pindex->nHeight < chainActive.Height())
             pindex = chainActive.Next(pindex);
@@ -2670,22 +2961,21 @@ void RecalculateZWSPSpent()
         std::list<libzerocoin::CoinDenomination> listDenomsSpent = ZerocoinSpendListFromBlock(block, true);
 
         //Reset the supply to previous block
-        pindex->mapZerocoinSupply = pindex->pprev->mapZerocoinSupply;
+        pindex->zerocoinSupply = pindex->pprev->zerocoinSupply;
 
         //Add mints to zWSP supply
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            long nDenomAdded = count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
-            pindex->mapZerocoinSupply.at(denom) += nDenomAdded;
+            pindex->zerocoinSupply.at(denom) += pindex->mintsInBlock.Count(denom);
         }
 
         //Remove spends from zWSP supply
         for (auto denom : listDenomsSpent)
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->zerocoinSupply.at(denom)--;
 
         // Add inflation from Wrapped Serials if block is Zerocoin_Block_EndFakeSerial()
         if (pindex->nHeight == Params().Zerocoin_Block_EndFakeSerial() + 1)
             for (auto denom : libzerocoin::zerocoinDenomList) {
-                pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+                pindex->zerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
             }
 
         //Rewrite money supply
@@ -2823,19 +3113,19 @@ bool UpdateZWSPSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
     // Initialize zerocoin supply to the supply from previous block
     if (pindex->pprev && pindex->pprev->GetBlockHeader().nVersion > 7) {
         for (auto& denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) = pindex->pprev->GetZcMints(denom);
+            pindex->zerocoinSupply.at(denom) = pindex->pprev->GetZcMints(denom);
         }
     }
 
     // Track zerocoin money supply
     CAmount nAmountZerocoinSpent = 0;
-    pindex->vMintDenominationsInBlock.clear();
+    pindex->mintsInBlock.SetNull();
     if (pindex->pprev) {
         std::set<uint256> setAddedToWallet;
         for (auto& m : listMints) {
             libzerocoin::CoinDenomination denom = m.GetDenomination();
-            pindex->vMintDenominationsInBlock.push_back(m.GetDenomination());
-            pindex->mapZerocoinSupply.at(denom)++;
+            pindex->mintsInBlock.Add(m.GetDenomination());
+            pindex->zerocoinSupply.at(denom)++;
 
             //Remove any of our own mints from the mintpool
             if (!fJustCheck && pwalletMain) {
@@ -2860,7 +3150,7 @@ bool UpdateZWSPSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
         }
 
         for (auto& denom : listSpends) {
-            pindex->mapZerocoinSupply.at(denom)--;
+            pindex->zerocoinSupply.at(denom)--;
             nAmountZerocoinSpent += libzerocoin::ZerocoinDenominationToAmount(denom);
 
             // zerocoin failsafe
@@ -2870,14 +3160,14 @@ bool UpdateZWSPSupply(const CBlock& block, CBlockIndex* pindex, bool fJustCheck)
     }
 
     for (auto& denom : libzerocoin::zerocoinDenomList)
-        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->mapZerocoinSupply.at(denom));
+        LogPrint("zero", "%s coins for denomination %d pubcoin %s\n", __func__, denom, pindex->zerocoinSupply.at(denom));
 
     // Update Wrapped Serials amount
     // A one-time event where only the zWSP supply was off (due to serial duplication off-chain on main net)
     if (Params().NetworkID() == CBaseChainParams::MAIN && pindex->nHeight == Params().Zerocoin_Block_EndFakeSerial() + 1
             && pindex->GetZerocoinSupply() < Params().GetSupplyBeforeFakeSerial() + GetWrapppedSerialInflationAmount()) {
         for (auto denom : libzerocoin::zerocoinDenomList) {
-            pindex->mapZerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
+            pindex->zerocoinSupply.at(denom) += GetWrapppedSerialInflation(denom);
         }
     }
     return true;
@@ -2950,6 +3240,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    boost::unique_lock<boost::mutex> lockZerocoinChecks(zerocoinspendcheckmutex, boost::try_to_lock);
+    bool fDeferZerocoinChecks = lockZerocoinChecks.owns_lock() && nScriptCheckThreads;
+    CCheckQueueControl<CZerocoinSpendCheck> zerocoinControl(fDeferZerocoinChecks ? &zerocoinspendcheckqueue : nullptr);
 
     int64_t nTimeStart = GetTimeMicros();
     CAmount nFees = 0;
@@ -2966,6 +3259,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CAmount nValueIn = 0;
     unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
     std::vector<uint256> vSpendsInBlock;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    CUtxoStats utxoStats;
+    bool fUtxoStats = !fJustCheck && GetUtxoStats(pindex->pprev, utxoStats);
     uint256 hashBlock = block.GetHash();
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = block.vtx[i];
@@ -3014,14 +3312,24 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                     nValueIn += publicSpend.getDenomination() * COIN;
                     //queue for db write after the 'justcheck' section has concluded
                     vSpends.emplace_back(std::make_pair(publicSpend, tx.GetHash()));
-                    if (!ContextualCheckZerocoinSpend(tx, &publicSpend, pindex, hashBlock))
+                    if (fDeferZerocoinChecks) {
+                        if (!CheckZerocoinSpendSerialNotInChain(&publicSpend))
+                            return state.DoS(100, error("%s: failed to add block %s with invalid public zc spend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
+                        std::vector<CZerocoinSpendCheck> vChecks(1, CZerocoinSpendCheck(tx, publicSpend, pindex, hashBlock));
+                        zerocoinControl.Add(vChecks);
+                    } else if (!ContextualCheckZerocoinSpend(tx, &publicSpend, pindex, hashBlock))
                         return state.DoS(100, error("%s: failed to add block %s with invalid public zc spend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
                 } else {
                     libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
                     nValueIn += spend.getDenomination() * COIN;
                     //queue for db write after the 'justcheck' section has concluded
                     vSpends.emplace_back(std::make_pair(spend, tx.GetHash()));
-                    if (!ContextualCheckZerocoinSpend(tx, &spend, pindex, hashBlock))
+                    if (fDeferZerocoinChecks) {
+                        if (!CheckZerocoinSpendSerialNotInChain(&spend))
+                            return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
+                        std::vector<CZerocoinSpendCheck> vChecks(1, CZerocoinSpendCheck(tx, spend, pindex, hashBlock));
+                        zerocoinControl.Add(vChecks);
+                    } else if (!ContextualCheckZerocoinSpend(tx, &spend, pindex, hashBlock))
                         return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
                 }
             }
@@ -3094,12 +3402,74 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
         nValueOut += tx.GetValueOut();
 
+        if (fUtxoStats && !tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
+            for (const CTxIn& txin : tx.vin)
+                utxoStats.RemoveCoin(txin.prevout, Coin(*view.AccessCoins(txin.prevout.hash), txin.prevout.n));
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
 
+        if (fUtxoStats) {
+            // The undo data records the height of a spent output when it was the last of its transaction
+            if (i > 0) {
+                for (const CTxInUndo& undo : blockundo.vtxundo.back().vprevout) {
+                    if (undo.nHeight != 0)
+                        utxoStats.nTransactions--;
+                }
+            }
+            const uint256 txhash = tx.GetHash();
+            const CCoins* coins = view.AccessCoins(txhash);
+            if (coins && !coins->IsPruned()) {
+                utxoStats.nTransactions++;
+                for (unsigned int k = 0; k < coins->vout.size(); k++) {
+                    if (coins->IsAvailable(k))
+                        utxoStats.AddCoin(COutPoint(txhash, k), Coin(*coins, k));
+                }
+            }
+        }
+
+        if (fAddressIndex || fSpentIndex) {
+            const uint256 txhash = tx.GetHash();
+            // The undo data has the outputs the inputs spent, so nothing has to be looked up
+            if (i > 0 && !tx.HasZerocoinSpendInputs()) {
+                const CTxUndo& txundo = blockundo.vtxundo.back();
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const CTxOut& prevout = txundo.vprevout[j].txout;
+                    int addressType;
+                    uint160 addressHash;
+                    if (!GetAddressIndexKey(prevout.scriptPubKey, addressType, addressHash)) {
+                        addressType = ADDRESS_INDEX_NONE;
+                        addressHash.SetNull();
+                    }
+
+                    if (fAddressIndex && addressType != ADDRESS_INDEX_NONE) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, addressHash, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, addressHash, tx.vin[j].prevout.hash, tx.vin[j].prevout.n), CAddressUnspentValue()));
+                    }
+                    if (fSpentIndex) {
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(tx.vin[j].prevout.hash, tx.vin[j].prevout.n),
+                                                            CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, addressHash)));
+                    }
+                }
+            }
+
+            if (fAddressIndex) {
+                for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                    const CTxOut& out = tx.vout[k];
+                    int addressType;
+                    uint160 addressHash;
+                    if (!GetAddressIndexKey(out.scriptPubKey, addressType, addressHash))
+                        continue;
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, addressHash, pindex->nHeight, i, txhash, k, false), out.nValue));
+                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, addressHash, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+                }
+            }
+        }
+
         vPos.push_back(std::make_pair(tx.GetHash(), pos));
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
@@ -3154,6 +3524,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    if (!zerocoinControl.Wait())
+        return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, block.GetHash().GetHex()), REJECT_INVALID);
     int64_t nTime2 = GetTimeMicros();
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
@@ -3212,6 +3584,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Flush spend/mint info to disk
     if (!zerocoinDB->WriteCoinSpendBatch(vSpends)) return state.Abort(("Failed to record coin serials to database"));
     if (!zerocoinDB->WriteCoinMintBatch(vMints)) return state.Abort(("Failed to record new mints to database"));
+    if (!vMints.empty()) {
+        // Index the mints of the block so witness generation does not have to read it again
+        std::list<libzerocoin::PublicCoin> listPubcoins;
+        if (BlockToPubcoinList(block, listPubcoins, true) && !zerocoinDB->WriteBlockMints(block.GetHash(), listPubcoins))
+            return state.Abort(("Failed to record block mints to database"));
+    }
 
     //Record accumulator checksums
     DatabaseChecksums(mapAccumulators);
@@ -3220,6 +3598,28 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (fAddressIndex) {
+        if (!pblocktree->WriteAddressIndex(addressIndex))
+            return state.Abort("Failed to write address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return state.Abort("Failed to write address unspent index");
+    }
+
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(spentIndex))
+            return state.Abort("Failed to write spent index");
+
+    if (fTimestampIndex)
+        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
+            return state.Abort("Failed to write timestamp index");
+
+    if (fUtxoStats) {
+        if (!pblocktree->WriteUtxoStats(pindex->GetBlockHash(), utxoStats))
+            return state.Abort("Failed to write unspent output set stats");
+        utxoStats.hashBlock = pindex->GetBlockHash();
+        utxoStatsTip = utxoStats;
+    }
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3252,6 +3652,21 @@ enum FlushStateMode {
     FLUSH_STATE_ALWAYS
 };
 
+static void NotifyBestChain(const CBlockLocator& locator)
+{
+    GetMainSignals().QueueSetBestChain(locator);
+}
+
+bool CoinCacheNeedsFlush(unsigned int nCacheSize, unsigned int nPendingSize, unsigned int nMaxSize, bool fAsync)
+{
+    if (!fAsync)
+        return nCacheSize > nMaxSize;
+    // Flushing while a write is in flight waits for it, so only do that once the budget is used up
+    if (nPendingSize)
+        return nCacheSize + nPendingSize > nMaxSize;
+    return nCacheSize > nMaxSize / 2;
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
@@ -3262,8 +3677,9 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     try {
+        bool fCacheFull = CoinCacheNeedsFlush(pcoinsTip->GetCacheSize(), pcoinsflush->GetPendingSize(), nCoinCacheSize, fAsyncFlush);
         if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && fCacheFull) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
             // Typical CCoins structures on disk are around 100 bytes in size.
             // Pushing a new one to the database can cause it to be written
@@ -3293,11 +3709,16 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
                 }
             }
             // Finally flush the chainstate (which may refer to block index entries).
+            // The coins are written by pcoinsflush; unless the flush may finish in
+            // the background, wait for them to reach the database.
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
-            // Update best block in wallet (so we can detect restored wallets).
+            if ((mode == FLUSH_STATE_ALWAYS || !fAsyncFlush) && !pcoinsflush->Wait())
+                return state.Abort("Failed to write to coin database");
+            // Update best block in wallet (so we can detect restored wallets),
+            // once the chainstate it refers to is on disk.
             if (mode != FLUSH_STATE_IF_NEEDED) {
-                GetMainSignals().SetBestChain(chainActive.GetLocator());
+                pcoinsflush->OnWritten(boost::bind(&NotifyBestChain, chainActive.GetLocator()));
             }
             nLastWrite = GetTimeMicros();
         }
@@ -3367,7 +3788,8 @@ bool static DisconnectTip(CValidationState& state)
     assert(pindexDelete);
     mempool.check(pcoinsTip);
     // Read block from disk.
-    CBlock block;
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    CBlock& block = *pblock;
     if (!ReadBlockFromDisk(block, pindexDelete))
         return state.Abort("Failed to read block");
     // Apply the block atomically to the chain state.
@@ -3397,7 +3819,7 @@ bool static DisconnectTip(CValidationState& state)
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     for (const CTransaction& tx : block.vtx) {
-        SyncWithWallets(tx, NULL);
+        SyncWithWallets(std::shared_ptr<const CTransaction>(pblock, &tx), nullptr);
     }
     return true;
 }
@@ -3423,11 +3845,13 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
 
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
-    CBlock block;
+    std::shared_ptr<const CBlock> pblockShared;
     if (!pblock) {
-        if (!ReadBlockFromDisk(block, pindexNew))
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindexNew))
             return state.Abort("Failed to read block");
-        pblock = &block;
+        pblock = pblockRead.get();
+        pblockShared = pblockRead;
     }
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros();
@@ -3472,11 +3896,21 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     // Tell wallet about transactions that went from mempool
     // to conflicted:
     for (const CTransaction& tx : txConflicted) {
-        SyncWithWallets(tx, NULL);
+        SyncWithWallets(std::make_shared<const CTransaction>(tx), nullptr);
     }
-    // ... and about transactions that got confirmed:
-    for (const CTransaction& tx : pblock->vtx) {
-        SyncWithWallets(tx, pblock);
+    // ... and about transactions that got confirmed. The notifications are
+    // delivered after the caller is done with its block, so they hold a copy.
+    if (!pblockShared)
+        pblockShared = std::make_shared<const CBlock>(*pblock);
+    for (const CTransaction& tx : pblockShared->vtx) {
+        SyncWithWallets(std::shared_ptr<const CTransaction>(pblockShared, &tx), pblockShared);
+    }
+
+    // A new tip is about to be requested by every peer we announce it to
+    if (!IsInitialBlockDownload()) {
+        std::shared_ptr<CDataStream> ss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+        *ss << *pblock;
+        hotBlocks.Add(pindexNew->GetBlockHash(), ss);
     }
 
     int64_t nTime6 = GetTimeMicros();
@@ -3763,7 +4197,17 @@ bool ActivateBestChain(CValidationState& state, CBlock* pblock, bool fAlreadyChe
             // Notify external listeners about the new tip.
             // Note: uiInterface, should switch main signals.
             uiInterface.NotifyBlockTip(hashNewTip);
-            GetMainSignals().UpdatedBlockTip(pindexNewTip);
+            // ConnectTip left the serialized tip in the block cache, unless the cache is
+            // disabled or the tip was connected while still in initial block download.
+            // Otherwise the block we were handed is serialized here, but only for
+            // listeners that publish it.
+            CBlockCache::BlockData pblockData = hotBlocks.Get(hashNewTip);
+            if (!pblockData && pblock && pblock->GetHash() == hashNewTip && HaveBlockDataListeners()) {
+                std::shared_ptr<CDataStream> ss = std::make_shared<CDataStream>(SER_NETWORK, PROTOCOL_VERSION);
+                *ss << *pblock;
+                pblockData = ss;
+            }
+            GetMainSignals().QueueUpdatedBlockTip(pindexNewTip, pblockData);
 
             unsigned size = 0;
             if (pblock)
@@ -3863,8 +4307,7 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = blockIndexArena.Allocate(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -4186,15 +4629,22 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     std::vector<CBigNum> vBlockSerials;
     // TODO: Check if this is ok... blockHeight is always the tip or should we look for the prevHash and get the height?
     int blockHeight = chainActive.Height() + 1;
+    // Verify zerocoin spend proofs on the check queue while the remaining transactions are checked
+    boost::unique_lock<boost::mutex> lockZerocoinChecks(zerocoinspendcheckmutex, boost::try_to_lock);
+    bool fDeferZerocoinChecks = lockZerocoinChecks.owns_lock() && nScriptCheckThreads;
+    CCheckQueueControl<CZerocoinSpendCheck> zerocoinControl(fDeferZerocoinChecks ? &zerocoinspendcheckqueue : nullptr);
     for (const CTransaction& tx : block.vtx) {
+        std::vector<CZerocoinSpendCheck> vZerocoinChecks;
         if (!CheckTransaction(
                 tx,
                 fZerocoinActive,
                 blockHeight >= Params().NEW_PROTOCOLS_STARTHEIGHT(),
                 state,
-                isBlockBetweenFakeSerialAttackRange(blockHeight)
+                isBlockBetweenFakeSerialAttackRange(blockHeight),
+                fDeferZerocoinChecks ? &vZerocoinChecks : nullptr
         ))
             return error("CheckBlock() : CheckTransaction failed");
+        zerocoinControl.Add(vZerocoinChecks);
 
         // double check that there are no double spent zWSP spends in this block
         if (tx.HasZerocoinSpendInputs()) {
@@ -4221,6 +4671,9 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         }
     }
 
+    if (!zerocoinControl.Wait())
+        return state.DoS(100, error("CheckBlock() : CheckTransaction failed, invalid zerocoin spend"));
+
 
     unsigned int nSigOps = 0;
     for (const CTransaction& tx : block.vtx) {
@@ -4816,11 +5269,11 @@ void CBlockIndex::BuildSkip()
         pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
 }
 
-bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp)
+bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp, bool fPrechecked)
 {
     // Preliminary checks
     int64_t nStartTime = GetTimeMillis();
-    bool checked = CheckBlock(*pblock, state);
+    bool checked = CheckBlock(*pblock, state, true, !fPrechecked);
 
     int nMints = 0;
     int nSpends = 0;
@@ -4839,7 +5292,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     if (nMints || nSpends)
         LogPrintf("%s : block contains %d zWSP mints and %d zWSP spends\n", __func__, nMints, nSpends);
 
-    if (!CheckBlockSignature(*pblock))
+    if (!fPrechecked && !CheckBlockSignature(*pblock))
         return error("ProcessNewBlock() : bad proof-of-stake block signature");
 
     if (pblock->GetHash() != Params().HashGenesisBlock() && pfrom != nullptr) {
@@ -4892,6 +5345,11 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     if (!ActivateBestChain(state, pblock, checked))
         return error("%s : ActivateBestChain failed", __func__);
 
+    // Don't let a long run of blocks queue up notifications faster than the
+    // listeners deliver them; cs_main is not held here, so they can catch up
+    if (GetMainSignals().CallbacksPending() > MAX_PENDING_VALIDATION_NOTIFICATIONS)
+        SyncWithValidationInterfaceQueue();
+
     if (!fLiteMode) {
         if (masternodeSync.RequestedMasternodeAssets > MASTERNODE_SYNC_LIST) {
             obfuScationPool.NewBlock();
@@ -4901,6 +5359,11 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
     }
 
     if (pwalletMain) {
+        // MultiSend and dust combining look at the outputs of the block just
+        // connected, so wait for the wallet to have seen it
+        if (pwalletMain->isMultiSendEnabled() || pwalletMain->fCombineDust)
+            SyncWithValidationInterfaceQueue();
+
         // If turned on MultiSend will send a transaction (or more) on the after maturity of a stake
         if (pwalletMain->isMultiSendEnabled())
             pwalletMain->MultiSend();
@@ -5016,9 +5479,7 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error("LoadBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
 
     pindexNew->phashBlock = &((*mi).first);
@@ -5113,6 +5574,14 @@ bool static LoadBlockIndexDB(std::string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether the optional indexes are enabled
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("timestampindex", fTimestampIndex);
+    LogPrintf("LoadBlockIndexDB(): timestamp index %s\n", fTimestampIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -5242,10 +5711,8 @@ void UnloadBlockIndex()
     setDirtyFileInfo.clear();
     mapNodeState.clear();
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
 }
 
 bool LoadBlockIndex(std::string& strError)
@@ -5267,6 +5734,12 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
+    fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+    pblocktree->WriteFlag("timestampindex", fTimestampIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -5297,103 +5770,147 @@ bool InitBlockIndex()
 }
 
 
+/** A block read from an external file before its parent was known */
+struct CUnknownParentBlock {
+    CDiskBlockPos pos;
+    //! null once the block only lives on disk
+    std::shared_ptr<CBlock> pblock;
+    unsigned int nSize;
+    bool fPrechecked;
+};
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+    // Blocks with unknown parent. The most recent ones are kept in memory
+    // until the end of the file; the rest are read back from disk, which is
+    // only possible for reindex.
+    static std::multimap<uint256, CUnknownParentBlock> mapBlocksUnknownParent;
+    static size_t nUnknownParentBytes = 0;
     int64_t nStart = GetTimeMillis();
 
+    int nThreads = GetArg("-importthreads", DEFAULT_IMPORT_THREADS);
+    if (nThreads <= 0)
+        nThreads += boost::thread::hardware_concurrency();
+    nThreads = std::max(1, std::min(nThreads, MAX_IMPORT_THREADS));
+
     int nLoaded = 0;
+    uint64_t nBlocks = 0;
+    CBlockImportStats stats = CBlockImportStats();
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        CBlockImportPipeline pipeline(fileIn, nThreads);
+        std::unique_ptr<CImportBlock> item;
+        int64_t nLastProgress = nStart;
+        while (pipeline.Next(item)) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+            if (GetTimeMillis() - nLastProgress >= 10000) {
+                nLastProgress = GetTimeMillis();
+                stats = pipeline.GetStats();
+                double dSeconds = std::max<int64_t>(nLastProgress - nStart, 1) * 0.001;
+                LogPrintf("Block import: %u blocks (%.1f/s, %.2f MB/s) at height %d, waited %dms for blocks and %dms for room in the queue\n",
+                          nBlocks, nBlocks / dSeconds, stats.nBytes / dSeconds / 1000000.0, chainActive.Height(),
+                          stats.nConnectWaitMillis, stats.nReaderWaitMillis);
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+
+            if (!item->pblock) {
+                LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, item->strError);
+                pipeline.Rewind(*item);
+                continue;
+            }
+            nBlocks++;
+            if (dbp)
+                dbp->nPos = item->nPos;
+            CBlock& block = *item->pblock;
+            const uint256& hash = item->hash;
+
+            // detect out of order blocks, and store them for later
+            if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                         block.hashPrevBlock.ToString());
+                CUnknownParentBlock unknown;
+                unknown.nSize = item->nSize;
+                unknown.fPrechecked = item->fPrechecked;
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                             block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
+                    unknown.pos = *dbp;
+                if (nUnknownParentBytes + item->nSize <= MAX_IMPORT_UNKNOWN_PARENT_BYTES) {
+                    unknown.pblock = item->pblock;
+                    nUnknownParentBytes += item->nSize;
                 }
+                if (unknown.pblock || dbp)
+                    mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, unknown));
+                continue;
+            }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, nullptr, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+            // process in case the block isn't known yet
+            if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                CValidationState state;
+                if (ProcessNewBlock(state, nullptr, &block, dbp, item->fPrechecked))
+                    nLoaded++;
+                if (state.IsError())
+                    break;
+            } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+            }
 
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                      head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, nullptr, &block, &it->second)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
+            // Recursively process earlier encountered successors of this block
+            std::deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                std::pair<std::multimap<uint256, CUnknownParentBlock>::iterator, std::multimap<uint256, CUnknownParentBlock>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    std::multimap<uint256, CUnknownParentBlock>::iterator it = range.first;
+                    CUnknownParentBlock& unknown = it->second;
+                    std::shared_ptr<CBlock> pchild = unknown.pblock;
+                    bool fPrechecked = unknown.fPrechecked;
+                    if (pchild) {
+                        nUnknownParentBytes -= unknown.nSize;
+                    } else {
+                        pchild = std::make_shared<CBlock>();
+                        fPrechecked = false;
+                        if (!ReadBlockFromDisk(*pchild, unknown.pos))
+                            pchild.reset();
+                    }
+                    if (pchild) {
+                        LogPrintf("%s: Processing out of order child %s of %s\n", __func__, pchild->GetHash().ToString(),
+                                  head.ToString());
+                        CValidationState dummy;
+                        if (ProcessNewBlock(dummy, nullptr, pchild.get(), unknown.pos.IsNull() ? nullptr : &unknown.pos, fPrechecked)) {
+                            nLoaded++;
+                            queue.push_back(pchild->GetHash());
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
                     }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
                 }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
         }
+        if (!pipeline.GetReadError().empty())
+            LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, pipeline.GetReadError());
+        stats = pipeline.GetStats();
     } catch (std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+
+    // Children still waiting for their parent are only remembered by position from here on
+    for (std::multimap<uint256, CUnknownParentBlock>::iterator it = mapBlocksUnknownParent.begin(); it != mapBlocksUnknownParent.end();) {
+        if (it->second.pblock) {
+            nUnknownParentBytes -= it->second.nSize;
+            it->second.pblock.reset();
+            if (it->second.pos.IsNull()) {
+                mapBlocksUnknownParent.erase(it++);
+                continue;
+            }
+        }
+        it++;
+    }
+
+    if (nLoaded > 0) {
+        int64_t nMillis = GetTimeMillis() - nStart;
+        LogPrintf("Loaded %i blocks from external file in %dms (%.1f blocks/s, %.2f MB/s, %d threads, %u rewinds)\n", nLoaded, nMillis,
+                  nLoaded * 1000.0 / std::max<int64_t>(nMillis, 1), stats.nBytes / 1000.0 / std::max<int64_t>(nMillis, 1), nThreads, stats.nRewinds);
+    }
     return nLoaded > 0;
 }
 
@@ -5597,7 +6114,15 @@ std::string GetWarnings(std::string strFor)
 // Messages
 //
 
+/**
+ * Guards the state of the masternode, budget, spork and swiftx extensions. Their
+ * message handlers keep it unlocked otherwise, and with several message handler
+ * threads only one of them may use it at a time. Taken before cs_main.
+ */
+static CCriticalSection cs_extensionMessages;
+
 
+/** Requires cs_main and cs_extensionMessages */
 bool static AlreadyHave(const CInv& inv)
 {
     switch (inv.type) {
@@ -5663,6 +6188,122 @@ bool static AlreadyHave(const CInv& inv)
 }
 
 
+/** Send an inventory item of one of the extensions from their state, false if it is unknown */
+static bool PushExtensionInventory(CNode* pfrom, const CInv& inv)
+{
+    LOCK(cs_extensionMessages);
+    bool pushed = false;
+    if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
+        if (mapTxLockVote.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << mapTxLockVote[inv.hash];
+            pfrom->PushMessage("txlvote", ss);
+            pushed = true;
+        }
+    }
+    if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
+        if (mapTxLockReq.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << mapTxLockReq[inv.hash];
+            pfrom->PushMessage("ix", ss);
+            pushed = true;
+        }
+    }
+    if (!pushed && inv.type == MSG_SPORK) {
+        if (mapSporks.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << mapSporks[inv.hash];
+            pfrom->PushMessage("spork", ss);
+            pushed = true;
+        }
+    }
+    if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
+        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
+            pfrom->PushMessage("mnw", ss);
+            pushed = true;
+        }
+    }
+    if (!pushed && inv.type == MSG_BUDGET_VOTE) {
+        if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
+            pfrom->PushMessage("mvote", ss);
+            pushed = true;
+        }
+    }
+
+    if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
+        if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
+            pfrom->PushMessage("mprop", ss);
+            pushed = true;
+        }
+    }
+
+    if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
+        if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
+            pfrom->PushMessage("fbvote", ss);
+            pushed = true;
+        }
+    }
+
+    if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
+        if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << budget.mapSeenFinalizedBudgets[inv.hash];
+            pfrom->PushMessage("fbs", ss);
+            pushed = true;
+        }
+    }
+
+    if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
+        if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
+            pfrom->PushMessage("mnb", ss);
+            pushed = true;
+        }
+    }
+
+    if (!pushed && inv.type == MSG_MASTERNODE_PING) {
+        if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << mnodeman.mapSeenMasternodePing[inv.hash];
+            pfrom->PushMessage("mnp", ss);
+            pushed = true;
+        }
+    }
+
+    if (!pushed && inv.type == MSG_DSTX) {
+        if (mapObfuscationBroadcastTxes.count(inv.hash)) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss.reserve(1000);
+            ss << mapObfuscationBroadcastTxes[inv.hash].tx << mapObfuscationBroadcastTxes[inv.hash].vin << mapObfuscationBroadcastTxes[inv.hash].vchSig << mapObfuscationBroadcastTxes[inv.hash].sigTime;
+
+            pfrom->PushMessage("dstx", ss);
+            pushed = true;
+        }
+    }
+
+    return pushed;
+}
+
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -5700,14 +6341,43 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    // Send block from the hot block cache or from disk. Block data never moves
+                    // once written, so other message handler threads can take cs_main during the read.
+                    if (inv.type == MSG_BLOCK) {
+                        // Disk and network serialization are identical: relay the bytes as they are
+                        CBlockCache::BlockData data = hotBlocks.Get(inv.hash);
+                        if (!data) {
+                            std::shared_ptr<CDataStream> ss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+                            // mi may be invalidated by an insert into mapBlockIndex while cs_main is released
+                            const CBlockIndex* pindex = mi->second;
+                            CDiskBlockPos pos = pindex->GetBlockPos();
+                            LEAVE_CRITICAL_SECTION(cs_main);
+                            bool fRead = ReadRawBlockFromDisk(*ss, pos);
+                            ENTER_CRITICAL_SECTION(cs_main);
+                            CBlockHeader header;
+                            if (fRead) {
+                                try {
+                                    CSpanReader(&(*ss)[0], &(*ss)[0] + ss->size(), SER_NETWORK, PROTOCOL_VERSION) >> header;
+                                } catch (const std::exception&) {
+                                    fRead = false;
+                                }
+                            }
+                            if (!fRead || header.GetHash() != pindex->GetBlockHash())
+                                assert(!"cannot load block from disk");
+                            data = ss;
+                            hotBlocks.Add(inv.hash, data);
+                        }
+                        pfrom->PushMessage("block", *data);
+                    } else // MSG_FILTERED_BLOCK)
                     {
+                        CBlock block;
+                        const CBlockIndex* pindex = mi->second;
+                        CDiskBlockPos pos = pindex->GetBlockPos();
+                        LEAVE_CRITICAL_SECTION(cs_main);
+                        bool fRead = ReadBlockFromDisk(block, pos);
+                        ENTER_CRITICAL_SECTION(cs_main);
+                        if (!fRead || block.GetHash() != pindex->GetBlockHash())
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
                             CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -5743,9 +6413,9 @@ void static ProcessGetData(CNode* pfrom)
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    std::map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    std::map<CInv, std::shared_ptr<const CDataStream> >::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushMessage(inv.GetCommand(), *(*mi).second);
                         pushed = true;
                     }
                 }
@@ -5803,114 +6473,13 @@ void static ProcessGetData(CNode* pfrom)
                     }
                 }
 
-                if (!pushed && inv.type == MSG_TXLOCK_VOTE) {
-                    if (mapTxLockVote.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockVote[inv.hash];
-                        pfrom->PushMessage("txlvote", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_TXLOCK_REQUEST) {
-                    if (mapTxLockReq.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapTxLockReq[inv.hash];
-                        pfrom->PushMessage("ix", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_SPORK) {
-                    if (mapSporks.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapSporks[inv.hash];
-                        pfrom->PushMessage("spork", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_MASTERNODE_WINNER) {
-                    if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << masternodePayments.mapMasternodePayeeVotes[inv.hash];
-                        pfrom->PushMessage("mnw", ss);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_BUDGET_VOTE) {
-                    if (budget.mapSeenMasternodeBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetVotes[inv.hash];
-                        pfrom->PushMessage("mvote", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_BUDGET_PROPOSAL) {
-                    if (budget.mapSeenMasternodeBudgetProposals.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenMasternodeBudgetProposals[inv.hash];
-                        pfrom->PushMessage("mprop", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED_VOTE) {
-                    if (budget.mapSeenFinalizedBudgetVotes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgetVotes[inv.hash];
-                        pfrom->PushMessage("fbvote", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_BUDGET_FINALIZED) {
-                    if (budget.mapSeenFinalizedBudgets.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << budget.mapSeenFinalizedBudgets[inv.hash];
-                        pfrom->PushMessage("fbs", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_MASTERNODE_ANNOUNCE) {
-                    if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodeBroadcast[inv.hash];
-                        pfrom->PushMessage("mnb", ss);
-                        pushed = true;
-                    }
-                }
-
-                if (!pushed && inv.type == MSG_MASTERNODE_PING) {
-                    if (mnodeman.mapSeenMasternodePing.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mnodeman.mapSeenMasternodePing[inv.hash];
-                        pfrom->PushMessage("mnp", ss);
-                        pushed = true;
-                    }
+                if (!pushed && inv.type >= MSG_TXLOCK_REQUEST && inv.type <= MSG_DSTX) {
+                    // The extension state doesn't need cs_main, and cs_extensionMessages is taken before it
+                    LEAVE_CRITICAL_SECTION(cs_main);
+                    pushed = PushExtensionInventory(pfrom, inv);
+                    ENTER_CRITICAL_SECTION(cs_main);
                 }
 
-                if (!pushed && inv.type == MSG_DSTX) {
-                    if (mapObfuscationBroadcastTxes.count(inv.hash)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << mapObfuscationBroadcastTxes[inv.hash].tx << mapObfuscationBroadcastTxes[inv.hash].vin << mapObfuscationBroadcastTxes[inv.hash].vchSig << mapObfuscationBroadcastTxes[inv.hash].sigTime;
-
-                        pfrom->PushMessage("dstx", ss);
-                        pushed = true;
-                    }
-                }
-
-
                 if (!pushed) {
                     vNotFound.push_back(inv);
                 }
@@ -6117,9 +6686,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                     LOCK(cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
                     // at a time so the setAddrKnowns of the chosen nodes prevent repeats
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
+                    static const uint256 hashSalt = GetRandHash();
                     uint64_t hashAddr = addr.GetHash();
                     uint256 hashRand = hashSalt ^ (hashAddr << 32) ^ ((GetTime() + hashAddr) / (24 * 60 * 60));
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
@@ -6159,7 +6726,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             return error("message inv size() = %u", vInv.size());
         }
 
-        LOCK(cs_main);
+        LOCK2(cs_extensionMessages, cs_main);
 
         std::vector<CInv> vToFetch;
 
@@ -6300,9 +6867,20 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         std::vector<unsigned char> vchSig;
         int64_t sigTime;
 
+        // A "tx" payload is the transaction as its sender serialized it: relay those bytes
+        // rather than serializing the transaction again
+        std::shared_ptr<const CDataStream> ssRelay;
+
         if (strCommand == "tx") {
-            vRecv >> tx;
+            size_t nPayload = vRecv.size();
+            CSpanReader reader(nPayload ? &vRecv[0] : nullptr, nPayload ? &vRecv[0] + nPayload : nullptr, vRecv.GetType(), vRecv.GetVersion());
+            reader >> tx;
+            // mapRelay keeps the bytes for 15 minutes, so they are copied into a buffer of
+            // their own size rather than holding on to a pooled buffer of the next size class
+            if (reader.empty() && ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION) == nPayload)
+                ssRelay = std::make_shared<const CDataStream>(vRecv.begin(), vRecv.end(), vRecv.GetType(), vRecv.GetVersion());
         } else if (strCommand == "dstx") {
+            LOCK(cs_extensionMessages);
             //these allow masternodes to publish a limited amount of free transactions
             vRecv >> tx >> vin >> vchSig >> sigTime;
 
@@ -6353,7 +6931,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
         if (!tx.HasZerocoinSpendInputs() && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs, false, ignoreFees)) {
             mempool.check(pcoinsTip);
-            RelayTransaction(tx);
+            RelayTransaction(tx, ssRelay);
             vWorkQueue.push_back(inv.hash);
 
             LogPrint("mempool", "AcceptToMemoryPool: peer=%d %s : accepted %s (poolsz %u)\n",
@@ -6409,7 +6987,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         } else if (tx.HasZerocoinSpendInputs() && AcceptToMemoryPool(mempool, state, tx, true, &fMissingZerocoinInputs, false, ignoreFees)) {
             //Presstab: ZCoin has a bunch of code commented out here. Is this something that should have more going on?
             //Also there is nothing that handles fMissingZerocoinInputs. Does there need to be?
-            RelayTransaction(tx);
+            RelayTransaction(tx, ssRelay);
             LogPrint("mempool", "AcceptToMemoryPool: Zerocoinspend peer=%d %s : accepted %s (poolsz %u)\n",
                      pfrom->id, pfrom->cleanSubVer,
                      tx.GetHash().ToString(),
@@ -6427,7 +7005,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             // if they are already in the mempool (allowing the node to function
             // as a gateway for nodes hidden behind it).
 
-            RelayTransaction(tx);
+            RelayTransaction(tx, ssRelay);
         }
 
         if (strCommand == "dstx") {
@@ -6609,7 +7187,10 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         // Making users (which are behind NAT and can only make outgoing connections) ignore
         // getaddr message mitigates the attack.
     else if ((strCommand == "getaddr") && (pfrom->fInbound)) {
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addresses);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = addrman.GetAddr();
         for (const CAddress& addr : vAddr)
             pfrom->PushAddress(addr);
@@ -6822,6 +7403,8 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             }
         }
     } else {
+        LOCK(cs_extensionMessages);
+
         //probably one the extensions
         mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
         budget.ProcessMessage(pfrom, strCommand, vRecv);
@@ -6926,8 +7509,10 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        int64_t nTimeStart = GetTimeMicros();
         try {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
+            RecordMessageTime(strCommand, GetTimeMicros() - nTimeStart);
             boost::this_thread::interruption_point();
         } catch (std::ios_base::failure& e) {
             pfrom->PushMessage("reject", strCommand, REJECT_MALFORMED, std::string("error parsing message"));
@@ -6998,18 +7583,24 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             }
         }
 
+        // Acquire cs_extensionMessages for AlreadyHave(), it is taken before cs_main
+        TRY_LOCK(cs_extensionMessages, lockExtensions);
+        if (!lockExtensions)
+            return true;
         TRY_LOCK(cs_main, lockMain); // Acquire cs_main for IsInitialBlockDownload() and CNodeState()
         if (!lockMain)
             return true;
 
-        // Address refresh broadcast
-        static int64_t nLastRebroadcast;
+        // Address refresh broadcast, shared by the message handler threads under cs_main
+        static int64_t nLastRebroadcast = 0;
         if (!IsInitialBlockDownload() && (GetTime() - nLastRebroadcast > 24 * 60 * 60)) {
             LOCK(cs_vNodes);
             for (CNode* pnode : vNodes) {
                 // Periodically clear setAddrKnown to allow refresh broadcasts
-                if (nLastRebroadcast)
+                if (nLastRebroadcast) {
+                    LOCK(pnode->cs_addresses);
                     pnode->setAddrKnown.clear();
+                }
 
                 // Rebroadcast our address
                 AdvertiseLocal(pnode);
@@ -7022,6 +7613,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Message: addr
         //
         if (fSendTrickle) {
+            LOCK(pto->cs_addresses);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend) {
@@ -7098,10 +7690,9 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
 
                 // trickle out tx inv to protect privacy
                 if (inv.type == MSG_TX && !fSendTrickle) {
-                    // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
+                    // 1/4 of tx invs blast to all immediately. The salt is
+                    // initialized once, whichever handler thread gets here first.
+                    static const uint256 hashSalt = GetRandHash();
                     uint256 hashRand = inv.hash ^ hashSalt;
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
                     bool fTrickleWait = ((hashRand & 3) != 0);
@@ -7257,10 +7848,8 @@ public:
     ~CMainCleanup()
     {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
 
         // orphan transactions
         mapOrphanTransactions.clear();
@@ -34,6 +34,7 @@
 #include <algorithm>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -47,16 +48,24 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewDB;
+class CCoinsViewBackgroundFlush;
 class CZerocoinDB;
 class CSporkDB;
 class CBloomFilter;
 class CInv;
 class CScriptCheck;
+class CZerocoinSpendCheck;
 class CValidationInterface;
 class CValidationState;
 
+struct CAddressIndexKey;
+struct CAddressUnspentKey;
+struct CAddressUnspentValue;
 struct CBlockTemplate;
 struct CNodeStateStats;
+struct CSpentIndexKey;
+struct CSpentIndexValue;
 
 /** Default for -blockmaxsize and -blockminsize, which control the range of sizes the mining code will create **/
 static const unsigned int DEFAULT_BLOCK_MAX_SIZE = 750000;
@@ -90,6 +99,8 @@ static const int COINBASE_MATURITY = 100;
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -asyncflush default: write periodic chainstate flushes in the background */
+static const bool DEFAULT_ASYNC_FLUSH = true;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -146,6 +157,8 @@ extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** Storage of the entries in mapBlockIndex */
+extern CBlockIndexArena blockIndexArena;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern const std::string strMessageMagic;
@@ -156,9 +169,13 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fAddressIndex;
+extern bool fSpentIndex;
+extern bool fTimestampIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern unsigned int nCoinCacheSize;
+extern bool fAsyncFlush;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern int64_t nMaxTipAge;
@@ -199,9 +216,10 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals);
  * @param[in]   pfrom   The node which we are receiving the block from; it is added to mapBlockSource and may be penalised if the block is invalid.
  * @param[in]   pblock  The block we want to process.
  * @param[out]  dbp     If pblock is stored to disk (or already there), this will be set to its location.
+ * @param[in]   fPrechecked  The merkle root and block signature were already verified, see PrepareImportBlock.
  * @return True if state.IsValid()
  */
-bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp = nullptr);
+bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDiskBlockPos* dbp = nullptr, bool fPrechecked = false);
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
@@ -231,6 +249,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the zerocoin spend checking thread */
+void ThreadZerocoinSpendCheck();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -238,6 +258,15 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransaction& tx, uint256& hashBlock, bool fAllowSlow = false, CBlockIndex* blockIndex = nullptr);
+/** Look up the optional indexes, false if the index is disabled or has no entry */
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int nStart = 0, int nEnd = 0);
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+bool GetTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& vHashes);
+/** Stats of the unspent output set after pindex, false if they were not kept for it */
+bool GetUtxoStats(const CBlockIndex* pindex, CUtxoStats& stats);
+/** Load the stats of the chainstate's best block, hashing the chainstate if the database predates them */
+bool LoadUtxoStats(CCoinsViewDB* coinsdb);
 /** Retrieve an output (from memory pool, or from disk, if possible) */
 bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state, CTxOut& out);
 /** Find the best known block, and make it the tip of the block chain */
@@ -260,6 +289,12 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/**
+ * Whether the coin cache is due a flush, with nPendingSize coins of the last flush
+ * still being written. With background writes the cache flushes at half of
+ * nMaxSize, so the write and the cache refilling behind it share the budget.
+ */
+bool CoinCacheNeedsFlush(unsigned int nCacheSize, unsigned int nPendingSize, unsigned int nMaxSize, bool fAsync);
 
 
 /** (try to) add transaction to memory pool **/
@@ -356,12 +391,23 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCache& inputs, CTxUndo& txundo, int nHeight);
 
+/**
+ * Restore an output spent by a disconnected block from its undo data.
+ * Returns false if the view was not in the state the undo data expects.
+ */
+bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out);
+
 /** Context-independent validity checks */
-bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack = false);
+bool CheckTransaction(const CTransaction& tx, bool fZerocoinActive, bool fRejectBadUTXO, CValidationState& state, bool fFakeSerialAttack = false, std::vector<CZerocoinSpendCheck>* pvZerocoinChecks = nullptr);
 bool CheckZerocoinMint(const uint256& txHash, const CTxOut& txout, CValidationState& state, bool fCheckOnly = false);
-bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack = false);
+/**
+ * Check the zerocoin spend inputs of tx. If pvChecks is not NULL, the spend proofs
+ * are appended to it instead of being verified, and the caller runs them later.
+ */
+bool CheckZerocoinSpend(const CTransaction& tx, bool fVerifySignature, CValidationState& state, bool fFakeSerialAttack = false, std::vector<CZerocoinSpendCheck>* pvChecks = nullptr);
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend* spend, CBlockIndex* pindex, const uint256& hashBlock);
 bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const libzerocoin::CoinSpend* spend, CBlockIndex* pindex, const uint256& hashBlock);
+bool CheckZerocoinSpendSerialNotInChain(const libzerocoin::CoinSpend* spend);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransaction& tx);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx);
 bool IsBlockHashInChain(const uint256& hashBlock);
@@ -447,10 +493,50 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the verification of one zerocoin spend: the proofs of a
+ * private spend against its accumulator, the commitment and signature of a public
+ * spend, or the contextual checks of either at a given block.
+ * Note that this stores references to the spending transaction and block index
+ */
+class CZerocoinSpendCheck
+{
+private:
+    std::shared_ptr<const libzerocoin::CoinSpend> spend;
+    std::shared_ptr<const PublicCoinSpend> publicSpend;
+    std::shared_ptr<const libzerocoin::Accumulator> accumulator;
+    bool fVerifyParams;
+    const CTransaction* ptxTo;
+    CBlockIndex* pindex;
+    uint256 hashBlock;
+
+public:
+    CZerocoinSpendCheck() : fVerifyParams(false), ptxTo(nullptr), pindex(nullptr) {}
+    CZerocoinSpendCheck(const CTransaction& txToIn, const libzerocoin::CoinSpend& spendIn, const libzerocoin::Accumulator& accumulatorIn, bool fVerifyParamsIn);
+    CZerocoinSpendCheck(const CTransaction& txToIn, const PublicCoinSpend& spendIn);
+    CZerocoinSpendCheck(const CTransaction& txToIn, const libzerocoin::CoinSpend& spendIn, CBlockIndex* pindexIn, const uint256& hashBlockIn);
+    CZerocoinSpendCheck(const CTransaction& txToIn, const PublicCoinSpend& spendIn, CBlockIndex* pindexIn, const uint256& hashBlockIn);
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        spend.swap(check.spend);
+        publicSpend.swap(check.publicSpend);
+        accumulator.swap(check.accumulator);
+        std::swap(fVerifyParams, check.fVerifyParams);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(pindex, check.pindex);
+        std::swap(hashBlock, check.hashBlock);
+    }
+};
+
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
+/** Read the serialized block at pos without deserializing it */
+bool ReadRawBlockFromDisk(CDataStream& ss, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 
 
@@ -640,6 +726,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Global variable that points to the layer writing pcoinsTip's flushes to the coin database (protected by cs_main) */
+extern CCoinsViewBackgroundFlush* pcoinsflush;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
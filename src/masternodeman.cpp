@@ -195,6 +195,7 @@ void DumpMasternodes()
 CMasternodeMan::CMasternodeMan()
 {
     nDsqCount = 0;
+    nRankTableUses = 0;
 }
 
 bool CMasternodeMan::Add(CMasternode& mn)
@@ -208,6 +209,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == nullptr) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        mapRankTables.clear();
         return true;
     }
 
@@ -278,6 +280,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = vMasternodes.erase(it);
+            mapRankTables.clear();
         } else {
             ++it;
         }
@@ -344,6 +347,7 @@ void CMasternodeMan::Clear()
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
+    mapRankTables.clear();
     nDsqCount = 0;
 }
 
@@ -566,59 +570,47 @@ CMasternode* CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn>& vecToExclude
     return nullptr;
 }
 
-CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
+const CMasternodeRankTable* CMasternodeMan::GetRankTable(int64_t nBlockHeight, int minProtocol, int nFilter)
 {
-    int64_t score = 0;
-    CMasternode* winner = nullptr;
-
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
-        mn.Check();
-        if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
+    AssertLockHeld(cs);
 
-        // calculate the score for each Masternode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = &mn;
-        }
+    // Height 0 means the current tip; resolve it so tables of different blocks never mix
+    if (nBlockHeight == 0) {
+        if (chainActive.Tip() == nullptr) return nullptr;
+        nBlockHeight = chainActive.Tip()->nHeight;
     }
 
-    return winner;
-}
-
-int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
-{
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
-    int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
-    int64_t nMasternode_Age = 0;
+    // Scores only depend on the block hash, but which masternodes are enabled or
+    // old enough changes over time, so tables are rebuilt at the same pace as
+    // the masternodes are checked.
+    RankTableKey key(nBlockHeight, minProtocol, nFilter);
+    std::map<RankTableKey, CMasternodeRankTable>::iterator it = mapRankTables.find(key);
+    if (it != mapRankTables.end() && GetTime() - it->second.nTimeBuilt < MASTERNODE_CHECK_SECONDS) {
+        it->second.nLastUsed = ++nRankTableUses;
+        return &it->second;
+    }
 
     //make sure we know about this block
     uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    if (!GetBlockHash(hash, nBlockHeight)) return nullptr;
 
-    // scan for winner
+    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
     for (CMasternode& mn : vMasternodes) {
-        if (mn.protocolVersion < minProtocol) {
-            LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
-            continue;                                                       // Skip obsolete versions
-        }
+        if (mn.protocolVersion < minProtocol) continue;
 
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
-            nMasternode_Age = GetAdjustedTime() - mn.sigTime;
-            if ((nMasternode_Age) < nMasternode_Min_Age) {
+        if (nFilter & RANK_MIN_AGE) {
+            int64_t nMasternode_Age = GetAdjustedTime() - mn.sigTime;
+            if (nMasternode_Age < MN_WINNER_MINIMUM_AGE) {
                 if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
                 continue;                                                   // Skip masternodes younger than (default) 1 hour
             }
         }
-        if (fOnlyActive) {
+        if (nFilter & RANK_ONLY_ACTIVE) {
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
+
+        uint256 n = mn.CalculateScore(hash);
         int64_t n2 = n.GetCompact(false);
 
         vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
@@ -626,15 +618,58 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
 
-    int rank = 0;
-    for (std::pair<int64_t, CTxIn> & s: vecMasternodeScores) {
-        rank++;
-        if (s.second.prevout == vin.prevout) {
-            return rank;
+    if (it == mapRankTables.end()) {
+        if (mapRankTables.size() >= MASTERNODE_RANK_TABLES) {
+            std::map<RankTableKey, CMasternodeRankTable>::iterator itOldest = mapRankTables.begin();
+            for (std::map<RankTableKey, CMasternodeRankTable>::iterator it2 = mapRankTables.begin(); it2 != mapRankTables.end(); ++it2) {
+                if (it2->second.nLastUsed < itOldest->second.nLastUsed)
+                    itOldest = it2;
+            }
+            mapRankTables.erase(itOldest);
         }
+        it = mapRankTables.insert(std::make_pair(key, CMasternodeRankTable())).first;
+    }
+
+    CMasternodeRankTable& table = it->second;
+    table.nTimeBuilt = GetTime();
+    table.nLastUsed = ++nRankTableUses;
+    table.vecRanked.clear();
+    table.mapRank.clear();
+    for (std::pair<int64_t, CTxIn>& s : vecMasternodeScores) {
+        table.vecRanked.push_back(s.second);
+        table.mapRank.insert(std::make_pair(s.second.prevout, (int)table.vecRanked.size()));
     }
 
-    return -1;
+    LogPrint("masternode", "CMasternodeMan::GetRankTable - height %d, protocol %d, filter %d: %d masternodes ranked\n", nBlockHeight, minProtocol, nFilter, table.vecRanked.size());
+    return &table;
+}
+
+CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
+{
+    LOCK(cs);
+
+    // the winner is the enabled masternode with the highest score
+    const CMasternodeRankTable* pTable = GetRankTable(nBlockHeight, minProtocol, RANK_ONLY_ACTIVE);
+    if (pTable == nullptr || pTable->vecRanked.empty()) return nullptr;
+
+    return Find(pTable->vecRanked.front());
+}
+
+int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    LOCK(cs);
+
+    int nFilter = fOnlyActive ? RANK_ONLY_ACTIVE : 0;
+    if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT))
+        nFilter |= RANK_MIN_AGE;
+
+    const CMasternodeRankTable* pTable = GetRankTable(nBlockHeight, minProtocol, nFilter);
+    if (pTable == nullptr) return -1;
+
+    std::map<COutPoint, int>::const_iterator it = pTable->mapRank.find(vin.prevout);
+    if (it == pTable->mapRank.end()) return -1;
+
+    return it->second;
 }
 
 std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
@@ -676,33 +711,12 @@ std::vector<std::pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
-
-    // scan for winner
-    for (CMasternode& mn : vMasternodes) {
-        if (mn.protocolVersion < minProtocol) continue;
-        if (fOnlyActive) {
-            mn.Check();
-            if (!mn.IsEnabled()) continue;
-        }
-
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    LOCK(cs);
 
-    int rank = 0;
-    for (std::pair<int64_t, CTxIn> & s: vecMasternodeScores) {
-        rank++;
-        if (rank == nRank) {
-            return Find(s.second);
-        }
-    }
+    const CMasternodeRankTable* pTable = GetRankTable(nBlockHeight, minProtocol, fOnlyActive ? RANK_ONLY_ACTIVE : 0);
+    if (pTable == nullptr || nRank < 1 || nRank > (int)pTable->vecRanked.size()) return nullptr;
 
-    return nullptr;
+    return Find(pTable->vecRanked[nRank - 1]);
 }
 
 void CMasternodeMan::ProcessMasternodeConnections()
@@ -1139,6 +1153,7 @@ void CMasternodeMan::Remove(CTxIn vin)
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
             vMasternodes.erase(it);
+            mapRankTables.clear();
             break;
         }
         ++it;
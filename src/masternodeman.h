@@ -14,8 +14,11 @@
 #include "sync.h"
 #include "util.h"
 
+#include <tuple>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODE_RANK_TABLES 8
 
 
 class CMasternodeMan;
@@ -47,6 +50,20 @@ public:
     ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
 };
 
+/** Masternodes ordered by score for one block height, see CMasternodeMan::GetRankTable
+ */
+class CMasternodeRankTable
+{
+public:
+    int64_t nTimeBuilt;
+    uint64_t nLastUsed;
+    // vecRanked[n - 1] holds the masternode of rank n
+    std::vector<CTxIn> vecRanked;
+    std::map<COutPoint, int> mapRank;
+
+    CMasternodeRankTable() : nTimeBuilt(0), nLastUsed(0) {}
+};
+
 class CMasternodeMan
 {
 private:
@@ -65,6 +82,19 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    enum RankFilter {
+        RANK_ONLY_ACTIVE = (1 << 0), // skip masternodes that are not enabled
+        RANK_MIN_AGE = (1 << 1)      // skip masternodes younger than MN_WINNER_MINIMUM_AGE
+    };
+
+    // rank tables by (block height, minimum protocol, RankFilter flags), not serialized
+    typedef std::tuple<int64_t, int, int> RankTableKey;
+    std::map<RankTableKey, CMasternodeRankTable> mapRankTables;
+    uint64_t nRankTableUses;
+
+    /// Get the masternodes ordered by score for a block, scoring them only if no recent table exists
+    const CMasternodeRankTable* GetRankTable(int64_t nBlockHeight, int minProtocol, int nFilter);
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
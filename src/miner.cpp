@@ -41,11 +41,12 @@
 
 //
 // Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
+// transactions in the memory pool. The high-priority part of the block is
+// filled by priority, so we might consider transactions that depend on
+// transactions that aren't yet in the block. The COrphan class keeps track
+// of these 'temporary orphans' while CreateBlock is figuring out which
+// transactions to include. The rest of the block is filled from the
+// mempool's ancestor fee rate index, which adds parents before children.
 //
 class COrphan
 {
@@ -64,31 +65,196 @@ uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
 
-// We want to sort transactions by priority and fee rate, so:
+// We want to sort transactions by priority, then fee rate, so:
 typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
 class TxPriorityCompare
 {
-    bool byFee;
-
 public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
-
     bool operator()(const TxPriority& a, const TxPriority& b)
     {
-        if (byFee) {
-            if (a.get<1>() == b.get<1>()){
-                return a.get<0>() < b.get<0>();
-            }
+        if (a.get<0>() == b.get<0>()){
             return a.get<1>() < b.get<1>();
-        } else {
-            if (a.get<0>() == b.get<0>()){
-                return a.get<1>() < b.get<1>();
-            }
-            return a.get<0>() < b.get<0>();
         }
+        return a.get<0>() < b.get<0>();
     }
 };
 
+/** Order the members of an ancestor package so that parents come before their children */
+class CompareTxIterByAncestorCount
+{
+public:
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
+    }
+};
+
+/** The block CreateNewBlock is filling and its running totals */
+struct CBlockAssembly {
+    CBlockAssembly(CBlockTemplate* pblocktemplateIn, CCoinsViewCache& viewIn, int nHeightIn, unsigned int nBlockMaxSizeIn) :
+        pblocktemplate(pblocktemplateIn), view(viewIn), nHeight(nHeightIn), nBlockMaxSize(nBlockMaxSizeIn),
+        nBlockSize(1000), nBlockTx(0), nBlockSigOps(100), nFees(0) {}
+
+    CBlockTemplate* pblocktemplate;
+    CCoinsViewCache& view;
+    int nHeight;
+    unsigned int nBlockMaxSize;
+
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    int nBlockSigOps;
+    CAmount nFees;
+    std::vector<CBigNum> vBlockSerials;
+    std::set<uint256> setInBlock;
+};
+
+static bool IsMinableTx(const CTransaction& tx, int nHeight)
+{
+    if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+        return false;
+    if (GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins())
+        return false;
+    return true;
+}
+
+static double GetZerocoinSpendPriority(const CTransaction& tx, unsigned int nTxSize)
+{
+    //Give a high priority to zerocoinspends to get into the next block
+    //Priority = (age^6+100000)*amount - gives higher priority to zwsps that have been in mempool long
+    //and higher priority to zwsps that are large in value
+    const uint256 txid = tx.GetHash();
+    CAmount nTotalIn = tx.GetZerocoinSpent();
+    int64_t nTimeSeen = GetAdjustedTime();
+    double nConfs = 100000;
+
+    auto it = mapZerocoinspends.find(txid);
+    if (it != mapZerocoinspends.end()) {
+        nTimeSeen = it->second;
+    } else {
+        //for some reason not in map, add it
+        mapZerocoinspends[txid] = nTimeSeen;
+    }
+
+    double nTimePriority = std::pow(GetAdjustedTime() - nTimeSeen, 6);
+
+    double dPriority = 0;
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        // zWSP spends can have very large priority, use non-overflowing safe functions
+        dPriority = double_safe_addition(dPriority, (nTimePriority * nConfs));
+        dPriority = double_safe_multiplication(dPriority, nTotalIn);
+    }
+    return tx.ComputePriority(dPriority, nTxSize);
+}
+
+/** Run the consensus checks for tx against the block built so far and add it if they pass */
+static bool TryAddTxToBlock(CBlockAssembly& assembly, const CTransaction& tx)
+{
+    CCoinsViewCache& view = assembly.view;
+
+    // Size limits
+    unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    if (assembly.nBlockSize + nTxSize >= assembly.nBlockMaxSize)
+        return false;
+
+    // Legacy limits on sigOps:
+    unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
+    unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+    if (assembly.nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
+        return false;
+
+    if (!tx.HasZerocoinSpendInputs()) {
+        //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
+        for (const CTxIn& txin : tx.vin) {
+            if (invalid_out::ContainsOutPoint(txin.prevout)) {
+                LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
+                return false;
+            }
+        }
+    }
+
+    if (!view.HaveInputs(tx))
+        return false;
+
+    // double check that there are no double spent zWSP spends in this block or tx
+    std::vector<CBigNum> vTxSerials;
+    if (tx.HasZerocoinSpendInputs()) {
+        int nHeightTx = 0;
+        if (IsTransactionInChain(tx.GetHash(), nHeightTx))
+            return false;
+
+        bool fDoubleSerial = false;
+        for (const CTxIn& txIn : tx.vin) {
+            bool isPublicSpend = txIn.IsZerocoinPublicSpend();
+            if (txIn.IsZerocoinSpend() || isPublicSpend) {
+                libzerocoin::CoinSpend* spend;
+                if (isPublicSpend) {
+                    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+                    PublicCoinSpend publicSpend(params);
+                    CValidationState state;
+                    if (!ZWSPModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
+                        throw std::runtime_error("Invalid public spend parse");
+                    }
+                    spend = &publicSpend;
+                } else {
+                    libzerocoin::CoinSpend spendObj = TxInToZerocoinSpend(txIn);
+                    spend = &spendObj;
+                }
+
+                bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(spend->getCoinSerialNumber()) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
+                if (!spend->HasValidSerial(Params().Zerocoin_Params(fUseV1Params)))
+                    fDoubleSerial = true;
+                if (std::count(assembly.vBlockSerials.begin(), assembly.vBlockSerials.end(), spend->getCoinSerialNumber()))
+                    fDoubleSerial = true;
+                if (std::count(vTxSerials.begin(), vTxSerials.end(), spend->getCoinSerialNumber()))
+                    fDoubleSerial = true;
+                if (fDoubleSerial)
+                    break;
+                vTxSerials.emplace_back(spend->getCoinSerialNumber());
+            }
+        }
+        //This zWSP serial has already been included in the block, do not add this tx.
+        if (fDoubleSerial){
+            return false;
+        }
+    }
+
+    CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+
+    nTxSigOps += GetP2SHSigOpCount(tx, view);
+    if (assembly.nBlockSigOps + nTxSigOps >= nMaxBlockSigOps){
+        return false;
+    }
+
+    // Note that flags: we don't want to set mempool/IsStandard()
+    // policy here, but we still have to ensure that the block we
+    // create only contains transactions that are valid in new blocks.
+
+    CValidationState state;
+    if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)){
+        return false;
+    }
+
+    CTxUndo txundo;
+    UpdateCoins(tx, state, view, txundo, assembly.nHeight);
+
+    // Added
+    assembly.pblocktemplate->block.vtx.push_back(tx);
+    assembly.pblocktemplate->vTxFees.push_back(nTxFees);
+    assembly.pblocktemplate->vTxSigOps.push_back(nTxSigOps);
+    assembly.nBlockSize += nTxSize;
+    ++assembly.nBlockTx;
+    assembly.nBlockSigOps += nTxSigOps;
+    assembly.nFees += nTxFees;
+    assembly.setInBlock.insert(tx.GetHash());
+
+    for (const CBigNum& bnSerial : vTxSerials){
+        assembly.vBlockSerials.emplace_back(bnSerial);
+    }
+    return true;
+}
+
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -204,266 +370,150 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         const int nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache view(pcoinsTip);
 
-        // Priority order to process transactions
-        std::list<COrphan> vOrphan; // list memory doesn't move
-        std::map<uint256, std::vector<COrphan*> > mapDependers;
+        CBlockAssembly assembly(pblocktemplate.get(), view, nHeight, nBlockMaxSize);
         bool fPrintPriority = GetBoolArg("-printpriority", false);
 
-        // This vector will be sorted into a priority queue:
-        std::vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (auto mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)){
-                continue;
-            }
-            if(GetAdjustedTime() > GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins()){
-                continue;
-            }
-
-            COrphan* porphan = nullptr;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            uint256 txid = tx.GetHash();
-            bool hasZerocoinSpends = tx.HasZerocoinSpendInputs();
-            if (hasZerocoinSpends)
-                nTotalIn = tx.GetZerocoinSpent();
-
-            for (const CTxIn& txin : tx.vin) {
-                //zerocoinspend has special vin
-                if (hasZerocoinSpends) {
-                    //Give a high priority to zerocoinspends to get into the next block
-                    //Priority = (age^6+100000)*amount - gives higher priority to zwsps that have been in mempool long
-                    //and higher priority to zwsps that are large in value
-                    int64_t nTimeSeen = GetAdjustedTime();
-                    double nConfs = 100000;
-
-                    auto it = mapZerocoinspends.find(txid);
-                    if (it != mapZerocoinspends.end()) {
-                        nTimeSeen = it->second;
-                    } else {
-                        //for some reason not in map, add it
-                        mapZerocoinspends[txid] = nTimeSeen;
-                    }
-
-                    double nTimePriority = std::pow(GetAdjustedTime() - nTimeSeen, 6);
-
-                    // zWSP spends can have very large priority, use non-overflowing safe functions
-                    dPriority = double_safe_addition(dPriority, (nTimePriority * nConfs));
-                    dPriority = double_safe_multiplication(dPriority, nTotalIn);
-
+        // Fill the high-priority part of the block first
+        if (nBlockPrioritySize > 0) {
+            // Priority order to process transactions
+            std::list<COrphan> vOrphan; // list memory doesn't move
+            std::map<uint256, std::vector<COrphan*> > mapDependers;
+
+            // This vector will be sorted into a priority queue:
+            std::vector<TxPriority> vecPriority;
+            vecPriority.reserve(mempool.mapTx.size());
+            for (CTxMemPool::txiter mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi) {
+                const CTransaction& tx = mi->GetTx();
+                if (!IsMinableTx(tx, nHeight))
                     continue;
-                }
-
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
 
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.emplace_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
+                // Priority is sum(valuein * age) / modified_txsize
+                double dPriority;
+                if (tx.HasZerocoinSpendInputs())
+                    dPriority = GetZerocoinSpendPriority(tx, mi->GetTxSize());
+                else
+                    dPriority = mi->GetPriority(nHeight);
+
+                CAmount nFeeDelta = 0;
+                mempool.ApplyDeltas(tx.GetHash(), dPriority, nFeeDelta);
+                CFeeRate feeRate(mi->GetModifiedFee(), mi->GetTxSize());
+
+                // Has to wait for dependencies
+                const CTxMemPool::setEntries& setParents = mempool.GetMemPoolParents(mi);
+                if (!setParents.empty()) {
+                    vOrphan.emplace_back(COrphan(&tx));
+                    COrphan* porphan = &vOrphan.back();
+                    porphan->dPriority = dPriority;
+                    porphan->feeRate = feeRate;
+                    for (CTxMemPool::txiter parent : setParents) {
+                        mapDependers[parent->GetTx().GetHash()].push_back(porphan);
+                        porphan->setDependsOn.insert(parent->GetTx().GetHash());
                     }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-
-                //Check for invalid/fraudulent inputs. They shouldn't make it through mempool, but check anyways.
-                if (invalid_out::ContainsOutPoint(txin.prevout)) {
-                    LogPrintf("%s : found invalid input %s in tx %s", __func__, txin.prevout.ToString(), tx.GetHash().ToString());
-                    fMissingInputs = true;
-                    break;
+                } else {
+                    vecPriority.push_back(TxPriority(dPriority, feeRate, &tx));
                 }
-
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                // zWSP spends can have very large priority, use non-overflowing safe functions
-                dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
-
             }
-            if (fMissingInputs) continue;
 
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
+            TxPriorityCompare comparer;
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
 
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
+            while (!vecPriority.empty()) {
+                // Take highest priority transaction off the priority queue:
+                double dPriority = vecPriority.front().get<0>();
+                CFeeRate feeRate = vecPriority.front().get<1>();
+                const CTransaction& tx = *(vecPriority.front().get<2>());
 
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
+                std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                vecPriority.pop_back();
 
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else{
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-            }
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        std::vector<CBigNum> vBlockSerials;
-        std::vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (!tx.HasZerocoinSpendInputs() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
+                // Switch to fee rate order once past the priority size or we run
+                // out of high-priority transactions; anything left over gets
+                // another chance there.
+                unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+                if ((assembly.nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))
+                    break;
 
-            // double check that there are no double spent zWSP spends in this block or tx
-            if (tx.HasZerocoinSpendInputs()) {
-                int nHeightTx = 0;
-                if (IsTransactionInChain(tx.GetHash(), nHeightTx))
+                if (!TryAddTxToBlock(assembly, tx))
                     continue;
 
-                bool fDoubleSerial = false;
-                for (const CTxIn& txIn : tx.vin) {
-                    bool isPublicSpend = txIn.IsZerocoinPublicSpend();
-                    if (txIn.IsZerocoinSpend() || isPublicSpend) {
-                        libzerocoin::CoinSpend* spend;
-                        if (isPublicSpend) {
-                            libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
-                            PublicCoinSpend publicSpend(params);
-                            CValidationState state;
-                            if (!ZWSPModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
-                                throw std::runtime_error("Invalid public spend parse");
+                if (fPrintPriority) {
+                    LogPrintf("priority %.1f fee %s txid %s\n",
+                              dPriority, feeRate.ToString(), tx.GetHash().ToString());
+                }
+
+                // Add transactions that depend on this one to the priority queue
+                const uint256& hash = tx.GetHash();
+                if (mapDependers.count(hash)) {
+                    for (COrphan* porphan : mapDependers[hash]) {
+                        if (!porphan->setDependsOn.empty()) {
+                            porphan->setDependsOn.erase(hash);
+                            if (porphan->setDependsOn.empty()) {
+                                vecPriority.emplace_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
+                                std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
                             }
-                            spend = &publicSpend;
-                        } else {
-                            libzerocoin::CoinSpend spendObj = TxInToZerocoinSpend(txIn);
-                            spend = &spendObj;
                         }
-
-                        bool fUseV1Params = libzerocoin::ExtractVersionFromSerial(spend->getCoinSerialNumber()) < libzerocoin::PrivateCoin::PUBKEY_VERSION;
-                        if (!spend->HasValidSerial(Params().Zerocoin_Params(fUseV1Params)))
-                            fDoubleSerial = true;
-                        if (std::count(vBlockSerials.begin(), vBlockSerials.end(), spend->getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (std::count(vTxSerials.begin(), vTxSerials.end(), spend->getCoinSerialNumber()))
-                            fDoubleSerial = true;
-                        if (fDoubleSerial)
-                            break;
-                        vTxSerials.emplace_back(spend->getCoinSerialNumber());
                     }
                 }
-                //This zWSP serial has already been included in the block, do not add this tx.
-                if (fDoubleSerial){
-                    continue;
-                }
             }
+        }
 
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps){
+        // Fill the rest of the block by ancestor package fee rate. Every entry
+        // is taken together with whichever of its unconfirmed ancestors the
+        // block doesn't have yet, so a high-fee child pulls in its parents.
+        CTxMemPool::setEntries setFailed;
+        const auto& ancestorIndex = mempool.mapTx.get<ancestor_score>();
+        for (auto mi = ancestorIndex.begin(); mi != ancestorIndex.end(); ++mi) {
+            CTxMemPool::txiter iter = mempool.mapTx.project<0>(mi);
+            const CTransaction& tx = iter->GetTx();
+            if (assembly.setInBlock.count(tx.GetHash()) || setFailed.count(iter))
                 continue;
-            }
 
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true)){
+            CTxMemPool::setEntries setAncestors;
+            mempool.CalculateMemPoolAncestors(iter, setAncestors);
+            std::vector<CTxMemPool::txiter> vPackage(1, iter);
+            uint64_t nPackageSize = iter->GetTxSize();
+            CAmount nPackageFees = iter->GetModifiedFee();
+            bool fAncestorFailed = false;
+            for (CTxMemPool::txiter ancestor : setAncestors) {
+                if (assembly.setInBlock.count(ancestor->GetTx().GetHash()))
+                    continue;
+                if (setFailed.count(ancestor)) {
+                    fAncestorFailed = true;
+                    break;
+                }
+                vPackage.push_back(ancestor);
+                nPackageSize += ancestor->GetTxSize();
+                nPackageFees += ancestor->GetModifiedFee();
+            }
+            if (fAncestorFailed) {
+                setFailed.insert(iter);
                 continue;
             }
 
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            for (const CBigNum& bnSerial : vTxSerials){
-                vBlockSerials.emplace_back(bnSerial);
-            }
+            if (assembly.nBlockSize + nPackageSize >= nBlockMaxSize)
+                continue;
 
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                          dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
+            // Skip free transactions if we're past the minimum block size:
+            double dPriorityDelta = 0;
+            CAmount nFeeDelta = 0;
+            mempool.ApplyDeltas(tx.GetHash(), dPriorityDelta, nFeeDelta);
+            CFeeRate packageFeeRate(nPackageFees, nPackageSize);
+            if (!tx.HasZerocoinSpendInputs() && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (packageFeeRate < ::minRelayTxFee) && (assembly.nBlockSize + nPackageSize >= nBlockMinSize))
+                continue;
 
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                for (COrphan* porphan : mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.emplace_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
+            std::sort(vPackage.begin(), vPackage.end(), CompareTxIterByAncestorCount());
+            for (CTxMemPool::txiter it : vPackage) {
+                if (!IsMinableTx(it->GetTx(), nHeight) || !TryAddTxToBlock(assembly, it->GetTx())) {
+                    setFailed.insert(it);
+                    break;
+                }
+                if (fPrintPriority) {
+                    LogPrintf("package fee %s fee %s txid %s\n",
+                              packageFeeRate.ToString(), CFeeRate(it->GetModifiedFee(), it->GetTxSize()).ToString(), it->GetTx().GetHash().ToString());
                 }
             }
         }
+        nFees = assembly.nFees;
 
         if (!fProofOfStake) {
             //Masternode and general budget payments
@@ -479,9 +529,9 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
             }
         }
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("CreateNewBlock(): total size %u\n", nBlockSize);
+        nLastBlockTx = assembly.nBlockTx;
+        nLastBlockSize = assembly.nBlockSize;
+        LogPrintf("CreateNewBlock(): total size %u\n", assembly.nBlockSize);
 
         // Compute final coinbase transaction.
         pblock->vtx[0].vin[0].scriptSig = CScript() << nHeight << OP_0;
@@ -649,6 +699,9 @@ bool ProcessBlockFound(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey)
         return error("WISPRMiner : ProcessNewBlock, block not accepted");
     }
 
+    // The next stake must not pick the inputs this one spent
+    SyncWithValidationInterfaceQueue();
+
     for (CNode* node : vNodes) {
         node->PushInventory(CInv(MSG_BLOCK, pblock->GetHash()));
     }
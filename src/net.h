@@ -21,6 +21,7 @@
 #include "utilstrencodings.h"
 
 #include <deque>
+#include <memory>
 #include <stdint.h>
 
 #ifndef WIN32
@@ -54,6 +55,10 @@ static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 2 * 1024 * 1024;
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 /** -listen default */
 static const bool DEFAULT_LISTEN = true;
+/** -msghandlerthreads default: number of threads processing peer messages */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
 /** -upnp default */
 #ifdef USE_UPNP
 static const bool DEFAULT_UPNP = USE_UPNP;
@@ -62,6 +67,20 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** -socketevents default */
+#ifdef HAVE_SYS_EPOLL_H
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+
+/** How the socket handler thread waits for peer sockets to become ready */
+enum SocketEventsMode {
+    //! select() over every socket on every round; limited to FD_SETSIZE sockets
+    SOCKETEVENTS_SELECT,
+    //! edge-triggered epoll (Linux); only ready sockets are visited
+    SOCKETEVENTS_EPOLL,
+};
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -81,6 +100,10 @@ bool BindListenPort(const CService& bindAddr, std::string& strError, bool fWhite
 void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler);
 bool StopNode();
 void SocketSendData(CNode* pnode);
+/** Select the socket event backend by name ("select" or "epoll"); must be called before binding */
+bool SetSocketEventsMode(const std::string& strMode);
+SocketEventsMode GetSocketEventsMode();
+std::string GetSocketEventsModeName();
 
 typedef int NodeId;
 
@@ -96,6 +119,21 @@ struct CNodeSignals {
 
 CNodeSignals& GetNodeSignals();
 
+/** Time spent processing the messages of one command */
+class CMessageStats
+{
+public:
+    uint64_t nCount;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+
+    CMessageStats() : nCount(0), nTotalMicros(0), nMaxMicros(0) {}
+};
+
+void RecordMessageTime(const std::string& strCommand, int64_t nMicros);
+std::map<std::string, CMessageStats> GetMessageStats();
+int GetMessageHandlerThreads();
+
 
 enum {
     LOCAL_NONE,   // unknown
@@ -132,7 +170,7 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, std::shared_ptr<const CDataStream> > mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
@@ -182,24 +220,25 @@ class CNetMessage
 public:
     bool in_data; // parsing header (false) or data (true)
 
-    CDataStream hdrbuf; // partially received header
+    char hdrbuf[24];    // partially received header
     CMessageHeader hdr; // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv; // received message data
+    CDataStream vRecv; // received message data, in a buffer from netBufferPool
     unsigned int nDataPos;
 
     int64_t nTime; // time (in microseconds) of message receipt.
 
-    CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn)
+    CNetMessage(int nTypeIn, int nVersionIn) : vRecv(nTypeIn, nVersionIn)
     {
-        hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
     }
 
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -209,7 +248,6 @@ public:
 
     void SetVersion(int nVersionIn)
     {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
@@ -297,6 +335,8 @@ public:
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    // held by the message handler thread working on this peer, so its messages stay in order
+    CCriticalSection cs_messageHandler;
     uint64_t nRecvBytes;
     int nRecvVersion;
 
@@ -358,9 +398,10 @@ public:
     uint256 hashContinue;
     int nStartingHeight;
 
-    // flood relay
+    // flood relay, written to by the handlers of other peers as well
     std::vector<CAddress> vAddrToSend;
     mruset<CAddress> setAddrKnown;
+    CCriticalSection cs_addresses;
     bool fGetAddr;
     std::set<uint256> setKnown;
 
@@ -440,11 +481,13 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_addresses);
         setAddrKnown.insert(addr);
     }
 
     void PushAddress(const CAddress& addr)
     {
+        LOCK(cs_addresses);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -740,7 +783,8 @@ public:
 
 class CTransaction;
 void RelayTransaction(const CTransaction& tx);
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
+/** Relay tx serialized as ss, which can be the payload tx was received in; if ss is null, tx is serialized here */
+void RelayTransaction(const CTransaction& tx, const std::shared_ptr<const CDataStream>& ss);
 void RelayTransactionLockReq(const CTransaction& tx, bool relayToAll = false);
 void RelayInv(CInv& inv);
 
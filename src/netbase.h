@@ -223,5 +223,11 @@ bool SetSocketNonBlocking(SOCKET& hSocket, bool fNonBlocking);
  * Convert milliseconds to a struct timeval for e.g. select.
  */
 struct timeval MillisToTimeval(int64_t nTimeout);
+/**
+ * Wait up to nTimeout milliseconds for a socket to become readable, or
+ * writable if fWrite. Returns like select(): 1 when it is ready, 0 on
+ * timeout and SOCKET_ERROR on failure. Not limited to FD_SETSIZE.
+ */
+int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeout);
 
 #endif // BITCOIN_NETBASE_H
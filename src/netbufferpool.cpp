@@ -0,0 +1,108 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netbufferpool.h"
+
+#include <algorithm>
+
+CNetBufferPool::CNetBufferPool(size_t nMaxBytesIn) : nMaxBytes(nMaxBytesIn)
+{
+    stats.nAcquired = stats.nReused = stats.nAllocated = stats.nReturned = stats.nFreed = 0;
+    stats.nPooledBuffers = stats.nPooledBytes = 0;
+}
+
+void CNetBufferPool::SetMaxBytes(size_t nMaxBytesIn)
+{
+    // Buffers dropped here are freed after the lock is released
+    std::vector<CSerializeData> vDrop;
+    {
+        LOCK(cs);
+        nMaxBytes = nMaxBytesIn;
+        for (int nClass = NUM_CLASSES - 1; nClass >= 0 && stats.nPooledBytes > nMaxBytes; nClass--) {
+            while (!vFree[nClass].empty() && stats.nPooledBytes > nMaxBytes) {
+                stats.nPooledBytes -= vFree[nClass].back().capacity();
+                stats.nPooledBuffers--;
+                vDrop.push_back(CSerializeData());
+                vDrop.back().swap(vFree[nClass].back());
+                vFree[nClass].pop_back();
+            }
+        }
+    }
+}
+
+void CNetBufferPool::Acquire(CSerializeData& data, size_t nSize)
+{
+    LOCK(cs);
+    stats.nAcquired++;
+    int nClass = 0;
+    while (nClass < NUM_CLASSES && ClassBytes(nClass) < nSize)
+        nClass++;
+    if (nClass == NUM_CLASSES) {
+        // Larger than any class: not worth keeping around
+        stats.nAllocated++;
+        data.reserve(nSize);
+        return;
+    }
+    if (!vFree[nClass].empty()) {
+        stats.nReused++;
+        data.swap(vFree[nClass].back());
+        vFree[nClass].pop_back();
+        stats.nPooledBytes -= data.capacity();
+        stats.nPooledBuffers--;
+        return;
+    }
+    stats.nAllocated++;
+    data.reserve(ClassBytes(nClass));
+}
+
+void CNetBufferPool::Release(CSerializeData& data)
+{
+    CSerializeData drop;
+    LOCK(cs);
+    size_t nCapacity = data.capacity();
+    if (nCapacity == 0)
+        return;
+    // The largest class the buffer can serve
+    int nClass = NUM_CLASSES - 1;
+    while (nClass >= 0 && ClassBytes(nClass) > nCapacity)
+        nClass--;
+    if (nClass < 0 || nCapacity > 2 * ClassBytes(NUM_CLASSES - 1) || stats.nPooledBytes + nCapacity > nMaxBytes) {
+        stats.nFreed++;
+        drop.swap(data);
+        return;
+    }
+    stats.nReturned++;
+    data.clear();
+    vFree[nClass].push_back(CSerializeData());
+    vFree[nClass].back().swap(data);
+    stats.nPooledBytes += nCapacity;
+    stats.nPooledBuffers++;
+}
+
+void CNetBufferPool::Reserve(CDataStream& ss, size_t nMin, size_t nWanted)
+{
+    CSerializeData data;
+    ss.Swap(data);
+    if (data.capacity() < nMin) {
+        CSerializeData bigger;
+        Acquire(bigger, std::max(nMin, nWanted));
+        bigger.insert(bigger.end(), data.begin(), data.end());
+        Release(data);
+        data.swap(bigger);
+    }
+    ss.Swap(data);
+}
+
+void CNetBufferPool::Release(CDataStream& ss)
+{
+    CSerializeData data;
+    ss.Swap(data);
+    Release(data);
+}
+
+CNetBufferStats CNetBufferPool::GetStats()
+{
+    LOCK(cs);
+    return stats;
+}
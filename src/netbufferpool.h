@@ -0,0 +1,78 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WISPR_NETBUFFERPOOL_H
+#define WISPR_NETBUFFERPOOL_H
+
+#include "allocators.h"
+#include "streams.h"
+#include "sync.h"
+
+#include <stdint.h>
+#include <vector>
+
+/** Default number of bytes kept in idle network message buffers (-netbufferpool is in megabytes) */
+static const size_t DEFAULT_NET_BUFFER_POOL_SIZE = 32 << 20;
+
+/** Allocation counters of a CNetBufferPool */
+struct CNetBufferStats {
+    //! buffers handed out ...
+    uint64_t nAcquired;
+    //! ... of which were taken from the pool
+    uint64_t nReused;
+    //! ... of which had to be allocated
+    uint64_t nAllocated;
+    //! buffers handed back and kept for reuse
+    uint64_t nReturned;
+    //! buffers handed back and freed (pool full, or no size class fits)
+    uint64_t nFreed;
+    size_t nPooledBuffers;
+    size_t nPooledBytes;
+};
+
+/**
+ * Idle buffers for network message payloads, kept by size class.
+ *
+ * Every received message used to get a freshly allocated buffer that was
+ * zeroed again when the message was dropped. Buffers handed back here keep
+ * their memory and are reused by later messages of a similar size; their
+ * contents are never zeroed, which is fine for data that came off the wire.
+ *
+ * Buffers are class sized, at least MIN_CLASS_BYTES, so data kept for long
+ * (like mapRelay entries) is copied out of them exactly.
+ */
+class CNetBufferPool
+{
+public:
+    explicit CNetBufferPool(size_t nMaxBytesIn);
+
+    /** Change the number of idle bytes kept; 0 disables pooling */
+    void SetMaxBytes(size_t nMaxBytesIn);
+
+    /** Make sure ss can hold at least nMin bytes; if it must grow, grow it to nWanted */
+    void Reserve(CDataStream& ss, size_t nMin, size_t nWanted);
+    /** Hand the buffer of ss back to the pool, leaving ss empty */
+    void Release(CDataStream& ss);
+
+    CNetBufferStats GetStats();
+
+private:
+    //! Size classes: 4 KiB, 16 KiB, ... 4 MiB, enough for any block message
+    static const size_t MIN_CLASS_BYTES = 4 << 10;
+    static const int NUM_CLASSES = 6;
+
+    CCriticalSection cs;
+    size_t nMaxBytes;
+    std::vector<CSerializeData> vFree[NUM_CLASSES];
+    CNetBufferStats stats;
+
+    static size_t ClassBytes(int nClass) { return MIN_CLASS_BYTES << (2 * nClass); }
+
+    void Acquire(CSerializeData& data, size_t nSize);
+    void Release(CSerializeData& data);
+};
+
+extern CNetBufferPool netBufferPool;
+
+#endif // WISPR_NETBUFFERPOOL_H
@@ -30,6 +30,17 @@ uint256 CBlockHeader::GetPoWHash() const
     return scrypt_blockhash(CVOIDBEGIN(nVersion));
 }
 
+void GetPoWHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashesOut)
+{
+    std::vector<const void*> vInputs;
+    vInputs.reserve(vHeaders.size());
+    for (const CBlockHeader& header : vHeaders)
+        vInputs.push_back(CVOIDBEGIN(header.nVersion));
+    vHashesOut.resize(vHeaders.size());
+    if (!vHeaders.empty())
+        scrypt_blockhash_batch(&vInputs[0], &vHashesOut[0], vHeaders.size());
+}
+
 
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
 {
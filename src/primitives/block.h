@@ -91,6 +91,9 @@ public:
     }
 };
 
+/** Compute GetPoWHash() of every header, running several scrypt hashes per pass where the CPU supports it */
+void GetPoWHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashesOut);
+
 /**
     see GETHEADERS message, vtx collapses to a single 0 byte
 */
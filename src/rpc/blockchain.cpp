@@ -28,6 +28,8 @@
 #include <numeric>
 #include <condition_variable>
 
+#include <boost/bind.hpp>
+
 
 struct CUpdatedBlock
 {
@@ -140,7 +142,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
 
     UniValue zwspObj(UniValue::VOBJ);
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zwspObj.push_back(Pair(std::to_string(denom), ValueFromAmount(blockindex->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        zwspObj.push_back(Pair(std::to_string(denom), ValueFromAmount(blockindex->zerocoinSupply.at(denom) * (denom*COIN))));
     }
     zwspObj.push_back(Pair("total", ValueFromAmount(blockindex->GetZerocoinSupply())));
     result.push_back(Pair("zWSPsupply", zwspObj));
@@ -433,9 +435,8 @@ UniValue mempoolToJSON(bool fVerbose = false)
     if (fVerbose) {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        for (const std::pair<uint256, CTxMemPoolEntry> & entry: mempool.mapTx) {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
+        for (const CTxMemPoolEntry& e : mempool.mapTx) {
+            const uint256& hash = e.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
             info.push_back(Pair("size", (int)e.GetTxSize()));
             info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
@@ -443,6 +444,12 @@ UniValue mempoolToJSON(bool fVerbose = false)
             info.push_back(Pair("height", (int)e.GetHeight()));
             info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
             info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+            info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+            info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+            info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
+            info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
+            info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
+            info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
             const CTransaction& tx = e.GetTx();
             std::set<std::string> setDepends;
             for (const CTxIn& txin: tx.vin) {
@@ -496,6 +503,12 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
             "    \"height\" : n,           (numeric) block height when transaction entered pool\n"
             "    \"startingpriority\" : n, (numeric) priority when transaction entered pool\n"
             "    \"currentpriority\" : n,  (numeric) transaction priority now\n"
+            "    \"descendantcount\" : n,  (numeric) number of in-mempool descendant transactions (including this one)\n"
+            "    \"descendantsize\" : n,   (numeric) size of in-mempool descendants (including this one)\n"
+            "    \"descendantfees\" : n,   (numeric) modified fees in satoshis of in-mempool descendants (including this one)\n"
+            "    \"ancestorcount\" : n,    (numeric) number of in-mempool ancestor transactions (including this one)\n"
+            "    \"ancestorsize\" : n,     (numeric) size of in-mempool ancestors (including this one)\n"
+            "    \"ancestorfees\" : n,     (numeric) modified fees in satoshis of in-mempool ancestors (including this one)\n"
             "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
             "        \"transactionid\",    (string) parent transaction id\n"
             "       ... ]\n"
@@ -540,6 +553,43 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+UniValue getblockhashes(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw std::runtime_error(
+            "getblockhashes high low\n"
+            "\nReturns the hashes of the active chain blocks with low <= time < high (requires -timestampindex).\n"
+
+            "\nArguments:\n"
+            "1. high         (numeric, required) The newer block timestamp, exclusive\n"
+            "2. low          (numeric, required) The older block timestamp\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  \"hash\"         (string) The block hash\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockhashes", "1231614698 1231024505") + HelpExampleRpc("getblockhashes", "1231614698, 1231024505"));
+
+    int64_t nHigh = params[0].get_int64();
+    int64_t nLow = params[1].get_int64();
+    if (nLow < 0 || nHigh < nLow || nHigh > std::numeric_limits<unsigned int>::max())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Timestamps out of range");
+
+    LOCK(cs_main);
+
+    std::vector<uint256> vHashes;
+    if (!GetTimestampIndex((unsigned int)nHigh, (unsigned int)nLow, vHashes))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
+
+    UniValue result(UniValue::VARR);
+    for (const uint256& hash : vHashes)
+        result.push_back(hash.GetHex());
+    return result;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -675,11 +725,16 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "The muhash stats are kept up to date block by block; hash_serialized reads the\n"
+            "whole set and may take some time.\n"
+
+            "\nArguments:\n"
+            "1. \"hash_type\"      (string, optional, default=muhash) muhash, or hash_serialized for the old hash\n"
+            "2. hash_or_height   (string or numeric, optional) The block to return the muhash stats for, default the tip\n"
 
             "\nResult:\n"
             "{\n"
@@ -688,28 +743,73 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"muhash\": \"hash\",          (string) The rolling hash of the set, with hash_type muhash\n"
+            "  \"hash_serialized\": \"hash\", (string) The serialized hash, with hash_type hash_serialized\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
 
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "muhash 1000") +
+            HelpExampleRpc("gettxoutsetinfo", ""));
 
-    LOCK(cs_main);
+    std::string strHashType = params.size() > 0 ? params[0].get_str() : "muhash";
+    if (strHashType != "muhash" && strHashType != "hash_serialized")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_type must be muhash or hash_serialized");
 
     UniValue ret(UniValue::VOBJ);
+    if (strHashType == "hash_serialized") {
+        if (params.size() > 1)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_serialized is only available for the tip");
 
-    CCoinsStats stats;
-    FlushStateToDisk();
-    if (pcoinsTip->GetStats(stats)) {
-        ret.push_back(Pair("height", (int64_t)stats.nHeight));
-        ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
-        ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
-        ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
-        ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
-        ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        LOCK(cs_main);
+        CCoinsStats stats;
+        FlushStateToDisk();
+        if (pcoinsTip->GetStats(stats)) {
+            ret.push_back(Pair("height", (int64_t)stats.nHeight));
+            ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+            ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+            ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+            ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+            ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+            ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
+        }
+        return ret;
+    }
+
+    CUtxoStats stats;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        CBlockIndex* pindex = chainActive.Tip();
+        if (params.size() > 1) {
+            if (params[1].isNum()) {
+                int nRequested = params[1].get_int();
+                if (nRequested < 0 || nRequested > chainActive.Height())
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+                pindex = chainActive[nRequested];
+            } else {
+                uint256 hash = ParseHashV(params[1], "hash_or_height");
+                BlockMap::iterator mi = mapBlockIndex.find(hash);
+                if (mi == mapBlockIndex.end())
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+                pindex = mi->second;
+            }
+        }
+        if (!GetUtxoStats(pindex, stats))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "No unspent output set stats for this block");
+        nHeight = pindex->nHeight;
     }
+
+    // Dividing out the spent outputs is the slow part, do it without cs_main
+    unsigned char hash[MuHash3072::OUTPUT_SIZE];
+    stats.muhash.Finalize(hash);
+    ret.push_back(Pair("height", nHeight));
+    ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
+    ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
+    ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
+    ret.push_back(Pair("muhash", HexStr(hash, hash + sizeof(hash))));
+    ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     return ret;
 }
 
@@ -1075,6 +1175,218 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue getsigcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns details on the signature verification cache.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"capacity\": xxxxx            (numeric) Number of signatures the cache can hold\n"
+            "  \"entries\": xxxxx             (numeric) Number of signatures currently cached\n"
+            "  \"hits\": xxxxx                (numeric) Lookups that skipped a signature check\n"
+            "  \"misses\": xxxxx              (numeric) Lookups that had to verify the signature\n"
+            "  \"hitrate\": x.xxx             (numeric) hits / (hits + misses)\n"
+            "  \"inserts\": xxxxx             (numeric) Signatures added to the cache\n"
+            "  \"evictions\": xxxxx           (numeric) Signatures dropped to make room for new ones\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getsigcacheinfo", "") + HelpExampleRpc("getsigcacheinfo", ""));
+
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    uint64_t nLookups = stats.nHits + stats.nMisses;
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("capacity", (uint64_t)stats.nCapacity));
+    ret.push_back(Pair("entries", (uint64_t)stats.nEntries));
+    ret.push_back(Pair("hits", stats.nHits));
+    ret.push_back(Pair("misses", stats.nMisses));
+    ret.push_back(Pair("hitrate", nLookups ? (double)stats.nHits / nLookups : 0.0));
+    ret.push_back(Pair("inserts", stats.nInserts));
+    ret.push_back(Pair("evictions", stats.nEvictions));
+    return ret;
+}
+
+UniValue getblockindexmemory(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getblockindexmemory\n"
+            "\nReturns the memory held by the in-memory block index.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx             (numeric) Number of block index entries\n"
+            "  \"entrysize\": xxxxx           (numeric) Bytes of one entry\n"
+            "  \"slabs\": xxxxx               (numeric) Number of slabs the entries are stored in\n"
+            "  \"entrybytes\": xxxxx          (numeric) Bytes allocated for entries, including unused slab space\n"
+            "  \"mapbytes\": xxxxx            (numeric) Estimated bytes of the hash to entry map\n"
+            "  \"totalbytes\": xxxxx          (numeric) entrybytes + mapbytes\n"
+            "  \"bytesperblock\": xxxxx       (numeric) totalbytes / entries\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockindexmemory", "") + HelpExampleRpc("getblockindexmemory", ""));
+
+    LOCK(cs_main);
+    size_t nEntries = mapBlockIndex.size();
+    size_t nEntryBytes = blockIndexArena.DynamicMemoryUsage();
+    // Each map node holds the key, the pointer, a link and the cached hash
+    size_t nMapBytes = mapBlockIndex.bucket_count() * sizeof(void*) +
+                       nEntries * (sizeof(BlockMap::value_type) + sizeof(void*) + sizeof(size_t));
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("entries", (uint64_t)nEntries));
+    ret.push_back(Pair("entrysize", (uint64_t)sizeof(CBlockIndex)));
+    ret.push_back(Pair("slabs", (uint64_t)blockIndexArena.Slabs()));
+    ret.push_back(Pair("entrybytes", (uint64_t)nEntryBytes));
+    ret.push_back(Pair("mapbytes", (uint64_t)nMapBytes));
+    ret.push_back(Pair("totalbytes", (uint64_t)(nEntryBytes + nMapBytes)));
+    ret.push_back(Pair("bytesperblock", nEntries ? (uint64_t)((nEntryBytes + nMapBytes) / nEntries) : 0));
+    return ret;
+}
+
+static void AddLevelDBInfo(UniValue& ret, const std::string& strFilter, CLevelDBWrapper& db)
+{
+    if (!strFilter.empty() && db.GetName() != strFilter)
+        return;
+    const CLevelDBTuning& tuning = db.GetTuning();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("path", db.GetPath().string()));
+    obj.push_back(Pair("blockcache", (uint64_t)tuning.nBlockCache));
+    obj.push_back(Pair("writebuffer", (uint64_t)tuning.nWriteBuffer));
+    obj.push_back(Pair("maxopenfiles", tuning.nMaxOpenFiles));
+    obj.push_back(Pair("bloombits", tuning.nBloomBits));
+    obj.push_back(Pair("compression", tuning.fCompression));
+    obj.push_back(Pair("approximatesize", db.GetApproximateSize()));
+    obj.push_back(Pair("memoryusage", atoi64(db.GetProperty("leveldb.approximate-memory-usage"))));
+    UniValue files(UniValue::VARR);
+    for (int nLevel = 0; nLevel < 7; nLevel++)
+        files.push_back(atoi64(db.GetProperty(strprintf("leveldb.num-files-at-level%d", nLevel))));
+    obj.push_back(Pair("files", files));
+    obj.push_back(Pair("stats", db.GetProperty("leveldb.stats")));
+    ret.push_back(Pair(db.GetName(), obj));
+}
+
+UniValue getdbinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw std::runtime_error(
+            "getdbinfo ( \"name\" )\n"
+            "\nReturns the tuning and statistics of the LevelDB databases.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"     (string, optional) Only this database: chainstate, blockindex, zerocoin or sporks\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {\n"
+            "    \"path\": \"xxx\",              (string) Directory of the database\n"
+            "    \"blockcache\": xxxxx,          (numeric) Bytes of block cache\n"
+            "    \"writebuffer\": xxxxx,         (numeric) Bytes of write buffer\n"
+            "    \"maxopenfiles\": xxxxx,        (numeric) Files the database may keep open\n"
+            "    \"bloombits\": xxxxx,           (numeric) Bloom filter bits per key, 0 for none\n"
+            "    \"compression\": true|false,    (boolean) Whether new tables are compressed\n"
+            "    \"approximatesize\": xxxxx,     (numeric) Approximate bytes on disk\n"
+            "    \"memoryusage\": xxxxx,         (numeric) Approximate bytes of memory in use\n"
+            "    \"files\": [n, ...],            (array) Table files at each level\n"
+            "    \"stats\": \"xxx\"              (string) LevelDB's compaction statistics\n"
+            "  }, ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getdbinfo", "") + HelpExampleCli("getdbinfo", "\"chainstate\"") + HelpExampleRpc("getdbinfo", "\"chainstate\""));
+
+    std::string strName = params.size() > 0 ? params[0].get_str() : "";
+    UniValue ret(UniValue::VOBJ);
+    ForEachLevelDB(boost::bind(&AddLevelDBInfo, boost::ref(ret), boost::cref(strName), _1));
+    if (!strName.empty() && ret.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database: " + strName);
+    return ret;
+}
+
+static void CompactLevelDB(const std::string& strName, bool& fFound, CLevelDBWrapper& db)
+{
+    if (db.GetName() != strName)
+        return;
+    fFound = true;
+    db.CompactFull();
+}
+
+UniValue compactdb(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "compactdb \"name\"\n"
+            "\nCompacts a LevelDB database, dropping deleted and overwritten entries and\n"
+            "rewriting its tables with the current compression setting. This may take minutes.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"     (string, required) The database: chainstate, blockindex, zerocoin or sporks\n"
+
+            "\nResult:\n"
+            "n    (numeric) Approximate bytes on disk after compaction\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("compactdb", "\"chainstate\"") + HelpExampleRpc("compactdb", "\"chainstate\""));
+
+    std::string strName = params[0].get_str();
+    bool fFound = false;
+    ForEachLevelDB(boost::bind(&CompactLevelDB, boost::cref(strName), boost::ref(fFound), _1));
+    if (!fFound)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown database: " + strName);
+
+    UniValue ret(UniValue::VOBJ);
+    ForEachLevelDB(boost::bind(&AddLevelDBInfo, boost::ref(ret), boost::cref(strName), _1));
+    return ret[strName]["approximatesize"];
+}
+
+UniValue getflushinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getflushinfo\n"
+            "\nReturns statistics about writing the coin cache to the coin database.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"async\": true|false        (boolean) Whether flushes are written in the background\n"
+            "  \"flushes\": xxxxx           (numeric) Number of flushes written since startup\n"
+            "  \"pending\": true|false      (boolean) Whether a flush is being written right now\n"
+            "  \"lastentries\": xxxxx       (numeric) Cache entries handed over by the last flush\n"
+            "  \"lastoutputs\": xxxxx       (numeric) Outputs written or erased by the last flush\n"
+            "  \"lastbytes\": xxxxx         (numeric) Bytes written by the last flush\n"
+            "  \"lastms\": xxxxx            (numeric) Milliseconds the last write took\n"
+            "  \"maxms\": xxxxx             (numeric) Milliseconds the slowest write took\n"
+            "  \"totalms\": xxxxx           (numeric) Milliseconds spent writing in total\n"
+            "  \"waitms\": xxxxx            (numeric) Milliseconds validation waited for a write to finish\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getflushinfo", "") + HelpExampleRpc("getflushinfo", ""));
+
+    LOCK(cs_main);
+    if (!pcoinsflush)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Coin database is not loaded");
+    CCoinsFlushStats stats = pcoinsflush->GetFlushStats();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("async", fAsyncFlush));
+    ret.push_back(Pair("flushes", stats.nFlushes));
+    ret.push_back(Pair("pending", stats.fPending));
+    ret.push_back(Pair("lastentries", stats.nLastEntries));
+    ret.push_back(Pair("lastoutputs", stats.nLastOutputs));
+    ret.push_back(Pair("lastbytes", stats.nLastBytes));
+    ret.push_back(Pair("lastms", stats.nLastMillis));
+    ret.push_back(Pair("maxms", stats.nMaxMillis));
+    ret.push_back(Pair("totalms", stats.nTotalMillis));
+    ret.push_back(Pair("waitms", stats.nWaitMillis));
+    return ret;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -1342,7 +1654,7 @@ UniValue getmintsinblocks(const UniValue& params, bool fHelp) {
         CBlockIndex* pindex = chainActive[heightStart];
 
         while (true) {
-            num_of_mints += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+            num_of_mints += pindex->mintsInBlock.Count(denom);
             if (pindex->nHeight < heightEnd) {
                 pindex = chainActive.Next(pindex);
             } else {
@@ -1613,7 +1925,7 @@ UniValue getblockindexstats(const UniValue& params, bool fHelp) {
         // add mints to map
         if (!fFeeOnly) {
             for (auto& denom : libzerocoin::zerocoinDenomList) {
-                mapMintCount[denom] += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+                mapMintCount[denom] += pindex->mintsInBlock.Count(denom);
             }
         }
 
@@ -5,6 +5,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "base58.h"
 #include "clientversion.h"
 #include "init.h"
@@ -13,6 +14,7 @@
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
+#include "spentindex.h"
 #include "spork.h"
 #include "timedata.h"
 #include "util.h"
@@ -143,7 +145,7 @@ UniValue getinfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("moneysupply",ValueFromAmount(chainActive.Tip()->nMoneySupply)));
     UniValue zwspObj(UniValue::VOBJ);
     for (auto denom : libzerocoin::zerocoinDenomList) {
-        zwspObj.push_back(Pair(std::to_string(denom), ValueFromAmount(chainActive.Tip()->mapZerocoinSupply.at(denom) * (denom*COIN))));
+        zwspObj.push_back(Pair(std::to_string(denom), ValueFromAmount(chainActive.Tip()->zerocoinSupply.at(denom) * (denom*COIN))));
     }
     zwspObj.push_back(Pair("total", ValueFromAmount(chainActive.Tip()->GetZerocoinSupply())));
     obj.push_back(Pair("zWSPsupply", zwspObj));
@@ -584,6 +586,276 @@ UniValue setmocktime(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+static bool GetIndexKey(const CBitcoinAddress& address, uint160& hashBytes, int& type)
+{
+    CTxDestination dest = address.Get();
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        type = ADDRESS_INDEX_PUBKEYHASH;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        type = ADDRESS_INDEX_SCRIPTHASH;
+        return true;
+    }
+    return false;
+}
+
+static std::string GetAddressFromIndex(int type, const uint160& hashBytes)
+{
+    if (type == ADDRESS_INDEX_SCRIPTHASH)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+/** The addresses of the getaddress* calls, either a single address or {"addresses": [...]} */
+static void GetAddressesFromParams(const UniValue& params, std::vector<std::pair<uint160, int> >& addresses)
+{
+    std::vector<UniValue> values;
+    if (params[0].isStr()) {
+        values.push_back(params[0]);
+    } else if (params[0].isObject()) {
+        const UniValue& addressValues = find_value(params[0].get_obj(), "addresses");
+        if (!addressValues.isArray())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Addresses is expected to be an array");
+        values = addressValues.getValues();
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    for (const UniValue& value : values) {
+        CBitcoinAddress address(value.get_str());
+        uint160 hashBytes;
+        int type = 0;
+        if (!address.IsValid() || !GetIndexKey(address, hashBytes, type))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        addresses.push_back(std::make_pair(hashBytes, type));
+    }
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the balance of addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\"  (array, required) The wispr addresses\n"
+            "    [\n"
+            "      \"address\"  (string) The wispr address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : n,   (numeric) The current balance in WSP\n"
+            "  \"received\" : n   (numeric) The total amount received in WSP, including change\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"WZH8cBsZ8CrsYzbXLRyg7f3MBxhHs1shNP\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"WZH8cBsZ8CrsYzbXLRyg7f3MBxhHs1shNP\"]}"));
+
+    std::vector<std::pair<uint160, int> > addresses;
+    GetAddressesFromParams(params, addresses);
+
+    // ConnectBlock updates the indexes under cs_main
+    LOCK(cs_main);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    for (const std::pair<uint160, int>& it : addresses) {
+        if (!GetAddressIndex(it.first, it.second, addressIndex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (const std::pair<CAddressIndexKey, CAmount>& it : addressIndex) {
+        if (it.second > 0)
+            received += it.second;
+        balance += it.second;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(balance)));
+    result.push_back(Pair("received", ValueFromAmount(received)));
+    return result;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getaddresstxids {\"addresses\": [\"address\",...], \"start\": n, \"end\": n}\n"
+            "\nReturns the txids of addresses in block order (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\"  (array, required) The wispr addresses\n"
+            "    [\n"
+            "      \"address\"  (string) The wispr address\n"
+            "      ,...\n"
+            "    ]\n"
+            "  \"start\"      (numeric, optional) The start block height\n"
+            "  \"end\"        (numeric, optional) The end block height\n"
+            "}\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"WZH8cBsZ8CrsYzbXLRyg7f3MBxhHs1shNP\"]}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"WZH8cBsZ8CrsYzbXLRyg7f3MBxhHs1shNP\"]}"));
+
+    std::vector<std::pair<uint160, int> > addresses;
+    GetAddressesFromParams(params, addresses);
+
+    int start = 0;
+    int end = 0;
+    if (params[0].isObject()) {
+        const UniValue& startValue = find_value(params[0].get_obj(), "start");
+        const UniValue& endValue = find_value(params[0].get_obj(), "end");
+        if (startValue.isNum() && endValue.isNum()) {
+            start = startValue.get_int();
+            end = endValue.get_int();
+            if (start <= 0 || end < start)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end are expected to be heights with 0 < start <= end");
+        }
+    }
+
+    LOCK(cs_main);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    for (const std::pair<uint160, int>& it : addresses) {
+        if (!GetAddressIndex(it.first, it.second, addressIndex, start, end))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    // Entries of several addresses are merged by block height and position in the
+    // block; all entries of a transaction share that key, so it is listed once
+    std::map<std::pair<int, unsigned int>, uint256> txids;
+    for (const std::pair<CAddressIndexKey, CAmount>& it : addressIndex)
+        txids[std::make_pair(it.first.blockHeight, it.first.txindex)] = it.first.txhash;
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<std::pair<int, unsigned int>, uint256>& it : txids)
+        result.push_back(it.second.GetHex());
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw std::runtime_error(
+            "getaddressutxos {\"addresses\": [\"address\",...]}\n"
+            "\nReturns the unspent outputs of addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"addresses\"  (array, required) The wispr addresses\n"
+            "    [\n"
+            "      \"address\"  (string) The wispr address\n"
+            "      ,...\n"
+            "    ]\n"
+            "}\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\" : \"address\",  (string) The wispr address\n"
+            "    \"txid\" : \"hash\",        (string) The output txid\n"
+            "    \"outputIndex\" : n,      (numeric) The output index\n"
+            "    \"script\" : \"hex\",       (string) The script hex encoded\n"
+            "    \"satoshis\" : n,         (numeric) The value of the output in satoshis\n"
+            "    \"height\" : n            (numeric) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"WZH8cBsZ8CrsYzbXLRyg7f3MBxhHs1shNP\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"WZH8cBsZ8CrsYzbXLRyg7f3MBxhHs1shNP\"]}"));
+
+    std::vector<std::pair<uint160, int> > addresses;
+    GetAddressesFromParams(params, addresses);
+
+    LOCK(cs_main);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (const std::pair<uint160, int>& it : addresses) {
+        if (!GetAddressUnspent(it.first, it.second, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const std::pair<CAddressUnspentKey, CAddressUnspentValue>& it : unspentOutputs) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", GetAddressFromIndex(it.first.type, it.first.hashBytes)));
+        output.push_back(Pair("txid", it.first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it.first.index));
+        output.push_back(Pair("script", HexStr(it.second.script.begin(), it.second.script.end())));
+        output.push_back(Pair("satoshis", it.second.satoshis));
+        output.push_back(Pair("height", it.second.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw std::runtime_error(
+            "getspentinfo {\"txid\": \"hash\", \"index\": n}\n"
+            "\nReturns the txid and index where an output is spent (requires -spentindex).\n"
+
+            "\nArguments:\n"
+            "1. {\n"
+            "  \"txid\"   (string, required) The hex string of the txid\n"
+            "  \"index\"  (numeric, required) The output index\n"
+            "}\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"hash\",   (string) The transaction id of the spending input\n"
+            "  \"index\" : n,       (numeric) The spending input index\n"
+            "  \"height\" : n       (numeric) The height of the block the input is in\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    const UniValue& txidValue = find_value(params[0].get_obj(), "txid");
+    const UniValue& indexValue = find_value(params[0].get_obj(), "index");
+    if (!txidValue.isStr() || !indexValue.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    uint256 txid = ParseHashV(txidValue, "txid");
+    int outputIndex = indexValue.get_int();
+    if (outputIndex < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid index");
+
+    LOCK(cs_main);
+
+    CSpentIndexKey key(txid, outputIndex);
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("txid", value.txid.GetHex()));
+    result.push_back(Pair("index", (int)value.inputIndex));
+    result.push_back(Pair("height", value.blockHeight));
+    return result;
+}
+
 #ifdef ENABLE_WALLET
 UniValue getstakingstatus(const UniValue& params, bool fHelp)
 {
@@ -10,6 +10,7 @@
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
+#include "netbufferpool.h"
 #include "protocol.h"
 #include "sync.h"
 #include "timedata.h"
@@ -352,7 +353,16 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"messagebuffers\": {    (json object) Buffers holding received and relayed messages\n"
+            "    \"acquired\": n,       (numeric) Buffers handed out\n"
+            "    \"reused\": n,         (numeric) Buffers handed out from the pool\n"
+            "    \"allocated\": n,      (numeric) Buffers newly allocated\n"
+            "    \"returned\": n,       (numeric) Buffers given back to the pool\n"
+            "    \"freed\": n,          (numeric) Buffers freed instead of pooled\n"
+            "    \"pooled\": n,         (numeric) Idle buffers in the pool\n"
+            "    \"pooledbytes\": n     (numeric) Memory held by idle buffers\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -362,6 +372,58 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     obj.push_back(Pair("totalbytesrecv", CNode::GetTotalBytesRecv()));
     obj.push_back(Pair("totalbytessent", CNode::GetTotalBytesSent()));
     obj.push_back(Pair("timemillis", GetTimeMillis()));
+
+    CNetBufferStats stats = netBufferPool.GetStats();
+    UniValue buffers(UniValue::VOBJ);
+    buffers.push_back(Pair("acquired", stats.nAcquired));
+    buffers.push_back(Pair("reused", stats.nReused));
+    buffers.push_back(Pair("allocated", stats.nAllocated));
+    buffers.push_back(Pair("returned", stats.nReturned));
+    buffers.push_back(Pair("freed", stats.nFreed));
+    buffers.push_back(Pair("pooled", (uint64_t)stats.nPooledBuffers));
+    buffers.push_back(Pair("pooledbytes", (uint64_t)stats.nPooledBytes));
+    obj.push_back(Pair("messagebuffers", buffers));
+    return obj;
+}
+
+UniValue getmessagestats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw std::runtime_error(
+            "getmessagestats\n"
+            "\nReturns how long processing peer messages took, per message command.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,            (numeric) Number of message handler threads\n"
+            "  \"commands\": {\n"
+            "    \"command\": {          (string) The message command\n"
+            "      \"count\": n,          (numeric) Messages processed\n"
+            "      \"totalms\": n,        (numeric) Total processing time in milliseconds\n"
+            "      \"avgus\": n,          (numeric) Average processing time in microseconds\n"
+            "      \"maxus\": n           (numeric) Longest processing time in microseconds\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getmessagestats", "") + HelpExampleRpc("getmessagestats", ""));
+
+    UniValue commands(UniValue::VOBJ);
+    std::map<std::string, CMessageStats> mapStats = GetMessageStats();
+    for (const auto& entry : mapStats) {
+        const CMessageStats& stats = entry.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", stats.nCount));
+        obj.push_back(Pair("totalms", stats.nTotalMicros / 1000));
+        obj.push_back(Pair("avgus", stats.nCount ? stats.nTotalMicros / (int64_t)stats.nCount : 0));
+        obj.push_back(Pair("maxus", stats.nMaxMicros));
+        commands.push_back(Pair(entry.first, obj));
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("threads", GetMessageHandlerThreads()));
+    obj.push_back(Pair("commands", commands));
     return obj;
 }
 
@@ -400,6 +462,7 @@ UniValue getnetworkinfo(const UniValue& params, bool fHelp)
             "  \"localservices\": \"xxxxxxxxxxxxxxxx\", (string) the services we offer to the network\n"
             "  \"timeoffset\": xxxxx,                   (numeric) the time offset\n"
             "  \"connections\": xxxxx,                  (numeric) the number of connections\n"
+            "  \"socketevents\": \"mode\",               (string) how peer sockets are waited for (select or epoll)\n"
             "  \"networks\": [                          (array) information per network\n"
             "  {\n"
             "    \"name\": \"xxx\",                     (string) network (ipv4, ipv6 or onion)\n"
@@ -432,6 +495,7 @@ UniValue getnetworkinfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("localservices", strprintf("%016x", nLocalServices)));
     obj.push_back(Pair("timeoffset", GetTimeOffset()));
     obj.push_back(Pair("connections", (int)vNodes.size()));
+    obj.push_back(Pair("socketevents", GetSocketEventsModeName()));
     obj.push_back(Pair("networks", GetNetworksInfo()));
     obj.push_back(Pair("relayfee", ValueFromAmount(::minRelayTxFee.GetFeePerK())));
     UniValue localAddresses(UniValue::VARR);
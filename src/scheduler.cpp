@@ -131,3 +131,89 @@ size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
     }
     return result;
 }
+
+bool CScheduler::AreThreadsServicingQueue() const
+{
+    boost::unique_lock<boost::mutex> lock(newTaskMutex);
+    return nThreadsServicingQueue;
+}
+
+
+void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_cs_callbacks_pending);
+        // Try to avoid scheduling too many copies here, but if we
+        // accidentally have two ProcessQueue's scheduled at once its
+        // not a big deal.
+        if (m_are_callbacks_running || m_callbacks_pending.empty())
+            return;
+    }
+    m_pscheduler->schedule(boost::bind(&SingleThreadedSchedulerClient::ProcessQueue, this), boost::chrono::system_clock::now());
+}
+
+namespace
+{
+// Clears the running flag and schedules the next callback even if the
+// current one throws
+struct CallbacksRunningGuard {
+    boost::mutex& mutex;
+    bool& fRunning;
+    boost::function<void()> next;
+
+    CallbacksRunningGuard(boost::mutex& mutexIn, bool& fRunningIn, boost::function<void()> nextIn) : mutex(mutexIn), fRunning(fRunningIn), next(nextIn) {}
+    ~CallbacksRunningGuard()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fRunning = false;
+        }
+        next();
+    }
+};
+}
+
+void SingleThreadedSchedulerClient::ProcessQueue()
+{
+    CScheduler::Function callback;
+    {
+        boost::unique_lock<boost::mutex> lock(m_cs_callbacks_pending);
+        if (m_are_callbacks_running || m_callbacks_pending.empty())
+            return;
+        m_are_callbacks_running = true;
+        callback.swap(m_callbacks_pending.front());
+        m_callbacks_pending.pop_front();
+    }
+
+    CallbacksRunningGuard guard(m_cs_callbacks_pending, m_are_callbacks_running,
+        boost::bind(&SingleThreadedSchedulerClient::MaybeScheduleProcessQueue, this));
+    callback();
+}
+
+void SingleThreadedSchedulerClient::AddToProcessQueue(CScheduler::Function func)
+{
+    assert(m_pscheduler);
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_cs_callbacks_pending);
+        m_callbacks_pending.push_back(func);
+    }
+    MaybeScheduleProcessQueue();
+}
+
+void SingleThreadedSchedulerClient::EmptyQueue()
+{
+    assert(!m_pscheduler->AreThreadsServicingQueue());
+    bool fContinue = true;
+    while (fContinue) {
+        ProcessQueue();
+        boost::unique_lock<boost::mutex> lock(m_cs_callbacks_pending);
+        fContinue = !m_callbacks_pending.empty();
+    }
+}
+
+size_t SingleThreadedSchedulerClient::CallbacksPending()
+{
+    boost::unique_lock<boost::mutex> lock(m_cs_callbacks_pending);
+    return m_callbacks_pending.size();
+}
@@ -14,6 +14,7 @@
 #include <boost/function.hpp>
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
+#include <deque>
 #include <map>
 
 //
@@ -71,6 +72,9 @@ public:
     size_t getQueueInfo(boost::chrono::system_clock::time_point &first,
                         boost::chrono::system_clock::time_point &last) const;
 
+    // Returns true if there are threads actively running in serviceQueue()
+    bool AreThreadsServicingQueue() const;
+
 private:
     std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
     boost::condition_variable newTaskScheduled;
@@ -81,4 +85,34 @@ private:
     bool shouldStop() { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
 };
 
+/**
+ * Runs the functions added to it one at a time, in the order they were added,
+ * on the threads of a CScheduler. Functions added from different clients, or
+ * scheduled directly on the CScheduler, may still run at the same time.
+ */
+class SingleThreadedSchedulerClient
+{
+private:
+    CScheduler* m_pscheduler;
+
+    boost::mutex m_cs_callbacks_pending;
+    std::deque<CScheduler::Function> m_callbacks_pending;
+    bool m_are_callbacks_running;
+
+    void MaybeScheduleProcessQueue();
+    void ProcessQueue();
+
+public:
+    explicit SingleThreadedSchedulerClient(CScheduler* pschedulerIn) : m_pscheduler(pschedulerIn), m_are_callbacks_running(false) {}
+
+    // Add a function to be run after the ones added before it
+    void AddToProcessQueue(CScheduler::Function func);
+
+    // Run the remaining functions on the calling thread. Must only be
+    // called once no thread is servicing the scheduler any more.
+    void EmptyQueue();
+
+    size_t CallbacksPending();
+};
+
 #endif
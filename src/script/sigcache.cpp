@@ -5,84 +5,220 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <string.h>
+
+#include <boost/scoped_array.hpp>
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
 
 namespace {
 
+//! Table memory per cached signature: the entry and its erased flag
+static const size_t SIG_CACHE_ENTRY_BYTES = sizeof(uint256) + sizeof(std::atomic<bool>);
+
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * Each signature is reduced to a single 32-byte entry, SHA256(salt || sighash
+ * || pubkey || signature), and stored in a fixed-size cuckoo table: an entry
+ * may live in any of eight slots, picked from the eight 32-bit words of the
+ * entry itself. The salt is random per process, so an attacker cannot aim
+ * signatures at a set of slots.
+ *
+ * Lookups only take a shared lock. Erasing flips a per-slot atomic flag, so
+ * block validation can drop the entries it consumed without an exclusive lock;
+ * inserts take the exclusive lock and may displace existing entries.
  */
 class CSignatureCache
 {
 private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
+    static const int NUM_LOCATIONS = 8;
+
+    //! pre-initialized hasher holding the salt, copied for every entry
+    CSHA256 saltedHasher;
+    std::vector<uint256> vTable;
+    //! true if the slot is free (never used, erased, or overwritten)
+    boost::scoped_array<std::atomic<bool> > vCollected;
+    uint32_t nSize;
+    unsigned int nDepthLimit;
+    unsigned int nNextEvict;
     boost::shared_mutex cs_sigcache;
 
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+    std::atomic<uint64_t> nInserts;
+    std::atomic<uint64_t> nEvictions;
+    std::atomic<int64_t> nEntries;
+
+    void ComputeLocations(const uint256& entry, uint32_t locs[NUM_LOCATIONS]) const
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        uint32_t words[NUM_LOCATIONS];
+        memcpy(words, entry.begin(), sizeof(words));
+        // Map each word to [0, nSize) without a division
+        for (int i = 0; i < NUM_LOCATIONS; i++)
+            locs[i] = (uint32_t)(((uint64_t)words[i] * nSize) >> 32);
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+public:
+    CSignatureCache() : nSize(0), nDepthLimit(0), nNextEvict(0), nHits(0), nMisses(0), nInserts(0), nEvictions(0), nEntries(0)
+    {
+        uint256 nonce = GetRandHash();
+        // Writing the nonce twice fills exactly one SHA256 block, so the
+        // salted midstate is computed once here and reused for every entry.
+        saltedHasher.Write(nonce.begin(), 32);
+        saltedHasher.Write(nonce.begin(), 32);
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        CSHA256(saltedHasher).Write(hash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
 
+    void Setup(size_t nBytes)
+    {
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        size_t nSlots = std::min<size_t>(nBytes / SIG_CACHE_ENTRY_BYTES, std::numeric_limits<uint32_t>::max());
+        nSize = nSlots;
+        std::vector<uint256>(nSize).swap(vTable);
+        vCollected.reset(nSize ? new std::atomic<bool>[nSize] : nullptr);
+        for (uint32_t i = 0; i < nSize; i++)
+            vCollected[i].store(true, std::memory_order_relaxed);
+        // A chain of displacements longer than log2(size) almost always
+        // means the table is full; give up and drop the last entry.
+        nDepthLimit = 1;
+        while ((1ULL << nDepthLimit) < nSize)
+            nDepthLimit++;
+        nEntries = 0;
+    }
 
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::set<sigdata_type>::iterator it = setValid.lower_bound(sigdata_type(randomHash));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+    bool Get(const uint256& entry, bool fErase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        if (nSize == 0)
+            return false;
+
+        uint32_t locs[NUM_LOCATIONS];
+        ComputeLocations(entry, locs);
+        for (int i = 0; i < NUM_LOCATIONS; i++) {
+            uint32_t loc = locs[i];
+            if (vTable[loc] == entry && !vCollected[loc].load(std::memory_order_relaxed)) {
+                if (fErase && !vCollected[loc].exchange(true, std::memory_order_relaxed))
+                    nEntries--;
+                nHits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
         }
+        nMisses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    void Set(uint256 entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        if (nSize == 0)
+            return;
+
+        uint32_t locs[NUM_LOCATIONS];
+        ComputeLocations(entry, locs);
+        for (int i = 0; i < NUM_LOCATIONS; i++) {
+            if (vTable[locs[i]] == entry && !vCollected[locs[i]].load(std::memory_order_relaxed))
+                return;
+        }
+        nInserts++;
+
+        // Rotate the slot we start displacing from, so that repeated inserts
+        // do not keep evicting the same neighbour.
+        unsigned int nLoc = nNextEvict++ % NUM_LOCATIONS;
+        for (unsigned int nDepth = 0; nDepth <= nDepthLimit; nDepth++) {
+            for (int i = 0; i < NUM_LOCATIONS; i++) {
+                if (vCollected[locs[i]].load(std::memory_order_relaxed)) {
+                    vTable[locs[i]] = entry;
+                    vCollected[locs[i]].store(false, std::memory_order_relaxed);
+                    nEntries++;
+                    return;
+                }
+            }
+            if (nDepth == nDepthLimit)
+                break;
+
+            // Every slot is taken: move in, and carry on with whoever lived there
+            uint32_t nPos = locs[nLoc];
+            std::swap(vTable[nPos], entry);
+            ComputeLocations(entry, locs);
+            for (int i = 0; i < NUM_LOCATIONS; i++) {
+                if (locs[i] == nPos) {
+                    nLoc = (i + 1) % NUM_LOCATIONS;
+                    break;
+                }
+            }
+        }
+        nEvictions++;
+    }
+
+    CSignatureCacheStats GetStats()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        CSignatureCacheStats stats;
+        stats.nCapacity = nSize;
+        stats.nEntries = std::max<int64_t>(nEntries, 0);
+        stats.nHits = nHits;
+        stats.nMisses = nMisses;
+        stats.nInserts = nInserts;
+        stats.nEvictions = nEvictions;
+        return stats;
     }
 };
 
+CSignatureCache signatureCache;
+
+}
+
+void InitSignatureCache()
+{
+    // -maxsigcachesize counted signatures before the cache was sized in
+    // memory. An old setting keeps that meaning instead of being read as MiB.
+    if (mapArgs.count("-maxsigcachesize") && !mapArgs.count("-sigcachesize")) {
+        int64_t nEntries = std::max<int64_t>(0, std::min<int64_t>(GetArg("-maxsigcachesize", 0), (MAX_MAX_SIG_CACHE_SIZE << 20) / SIG_CACHE_ENTRY_BYTES));
+        LogPrintf("Warning: -maxsigcachesize is deprecated and counts signatures; use -sigcachesize=<n> to set the size in MiB\n");
+        signatureCache.Setup((size_t)nEntries * SIG_CACHE_ENTRY_BYTES);
+        LogPrintf("Using %u signature cache slots for -maxsigcachesize=%d\n", signatureCache.GetStats().nCapacity, nEntries);
+        return;
+    }
+
+    int64_t nMaxCacheSize = std::max<int64_t>(0, std::min(GetArg("-sigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE), MAX_MAX_SIG_CACHE_SIZE));
+    signatureCache.Setup((size_t)nMaxCacheSize << 20);
+    LogPrintf("Using %d MiB for the signature cache, able to store %u signatures\n", nMaxCacheSize, signatureCache.GetStats().nCapacity);
+}
+
+CSignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    // Signatures checked while connecting a block (!store) are not going to
+    // be seen again, so make room for new mempool entries.
+    if (signatureCache.Get(entry, !store))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
@@ -10,8 +10,23 @@
 
 #include <vector>
 
+//! Default -sigcachesize, in MiB
+static const int64_t DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+//! Upper bound for -sigcachesize, in MiB
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+
 class CPubKey;
 
+/** Snapshot of the signature cache counters */
+struct CSignatureCacheStats {
+    size_t nCapacity;  //!< number of 32-byte slots in the table
+    size_t nEntries;   //!< slots currently holding a valid signature
+    uint64_t nHits;
+    uint64_t nMisses;
+    uint64_t nInserts;
+    uint64_t nEvictions; //!< entries dropped because no free slot could be found
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -23,4 +38,11 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/**
+ * (Re)allocate the signature cache according to -sigcachesize, or the number
+ * of signatures in the deprecated -maxsigcachesize. Drops all entries.
+ */
+void InitSignatureCache();
+CSignatureCacheStats GetSignatureCacheStats();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -178,6 +178,13 @@ bool CWspStake::SetInput(CTransaction txPrev, unsigned int n)
     return true;
 }
 
+void CWspStake::SetKernelCache(CBlockIndex* pindex, uint64_t nStakeModifierIn)
+{
+    this->pindexFrom = pindex;
+    nCachedStakeModifier = nStakeModifierIn;
+    fCachedStakeModifier = true;
+}
+
 bool CWspStake::GetTxFrom(CTransaction& tx)
 {
     tx = txFrom;
@@ -232,6 +239,11 @@ bool CWspStake::CreateTxOuts(CWallet* pwallet, std::vector<CTxOut>& vout, CAmoun
 
 bool CWspStake::GetModifier(uint64_t& nStakeModifier)
 {
+    if (fCachedStakeModifier) {
+        nStakeModifier = nCachedStakeModifier;
+        return true;
+    }
+
     int nStakeModifierHeight = 0;
     int64_t nStakeModifierTime = 0;
     GetIndexFrom();
@@ -255,6 +267,9 @@ CDataStream CWspStake::GetUniqueness()
 //The block that the UTXO was added to the chain
 CBlockIndex* CWspStake::GetIndexFrom()
 {
+    if (pindexFrom && chainActive.Contains(pindexFrom))
+        return pindexFrom;
+
     uint256 hashBlock = 0;
     CTransaction tx;
     if (GetTransaction(txFrom.GetHash(), tx, hashBlock, true)) {
@@ -74,13 +74,19 @@ class CWspStake : public CStakeInput
 private:
     CTransaction txFrom;
     unsigned int nPosition;
+    bool fCachedStakeModifier;
+    uint64_t nCachedStakeModifier;
 public:
     CWspStake()
     {
         this->pindexFrom = nullptr;
+        fCachedStakeModifier = false;
+        nCachedStakeModifier = 0;
     }
 
     bool SetInput(CTransaction txPrev, unsigned int n);
+    //! Use a block and stake modifier the wallet already looked up for this output
+    void SetKernelCache(CBlockIndex* pindex, uint64_t nStakeModifierIn);
 
     CBlockIndex* GetIndexFrom() override;
     bool GetTxFrom(CTransaction& tx) override;
@@ -293,9 +293,66 @@ public:
         data.insert(data.end(), begin(), end());
         clear();
     }
+
+    /** Exchange the unread contents with data, without copying */
+    void Swap(CSerializeData& data)
+    {
+        if (nReadPos) {
+            vch.erase(vch.begin(), vch.begin() + nReadPos);
+            nReadPos = 0;
+        }
+        vch.swap(data);
+    }
 };
 
 
+/** Read-only stream over memory owned by someone else, such as a mapped file.
+ *
+ * Unlike CDataStream it does not copy the data it deserializes from.
+ */
+class CSpanReader
+{
+private:
+    const char* pcur;
+    const char* pend;
+
+public:
+    int nType;
+    int nVersion;
+
+    CSpanReader(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn) : pcur(pbeginIn), pend(pendIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    size_t size() const { return pend - pcur; }
+    bool empty() const { return pcur == pend; }
+    int GetType() { return nType; }
+    int GetVersion() { return nVersion; }
+
+    CSpanReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::read() : end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CSpanReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CSpanReader::ignore() : end of data");
+        pcur += nSize;
+        return (*this);
+    }
+
+    template <typename T>
+    CSpanReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper for FILE*
  *
  * Will automatically close the file when it goes out of scope if not null.
@@ -89,7 +89,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
                 tx.GetHash().ToString().c_str());
 
             if (GetTransactionLockSignatures(tx.GetHash()) == SWIFTTX_SIGNATURES_REQUIRED) {
-                GetMainSignals().NotifyTransactionLock(tx);
+                GetMainSignals().QueueNotifyTransactionLock(std::make_shared<const CTransaction>(tx));
             }
 
             return;
@@ -166,7 +166,7 @@ void ProcessMessageSwiftTX(CNode* pfrom, std::string& strCommand, CDataStream& v
         }
 
         if (mapTxLockReq.count(ctx.txHash) && GetTransactionLockSignatures(ctx.txHash) == SWIFTTX_SIGNATURES_REQUIRED) {
-            GetMainSignals().NotifyTransactionLock(mapTxLockReq[ctx.txHash]);
+            GetMainSignals().QueueNotifyTransactionLock(std::make_shared<const CTransaction>(mapTxLockReq[ctx.txHash]));
         }
 
         return;
@@ -0,0 +1,174 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "clientversion.h"
+#include "key.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "test/test_wispr.h"
+#include "timestampindex.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+static std::string SerializeKey(const CAddressIndexKey& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << std::make_pair('a', key);
+    BOOST_CHECK_EQUAL(ss.size(), 1 + key.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+    return ss.str();
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_key_order)
+{
+    // The database iterates keys bytewise, which has to give height order
+    uint160 hash = uint160(1);
+    std::string strLow = SerializeKey(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hash, 255, 1, uint256(2), 0, false));
+    std::string strHigh = SerializeKey(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hash, 256, 0, uint256(1), 0, false));
+    BOOST_CHECK(strLow < strHigh);
+
+    // The seek key of an address is a prefix of its keys
+    CDataStream ssSeek(SER_DISK, CLIENT_VERSION);
+    ssSeek << std::make_pair('a', CAddressIndexIteratorKey(ADDRESS_INDEX_PUBKEYHASH, hash, 255));
+    BOOST_CHECK(strLow.compare(0, ssSeek.size(), ssSeek.str()) == 0);
+
+    CDataStream ss(strHigh.data(), strHigh.data() + strHigh.size(), SER_DISK, CLIENT_VERSION);
+    char chType;
+    CAddressIndexKey key;
+    ss >> chType >> key;
+    BOOST_CHECK_EQUAL(key.blockHeight, 256);
+    BOOST_CHECK(key.txhash == uint256(1));
+    BOOST_CHECK(key.hashBytes == hash);
+
+    CDataStream ssLow(SER_DISK, CLIENT_VERSION);
+    CDataStream ssHigh(SER_DISK, CLIENT_VERSION);
+    ssLow << CTimestampIndexKey(0x00ffffff, uint256(2));
+    ssHigh << CTimestampIndexKey(0x01000000, uint256(1));
+    BOOST_CHECK(ssLow.str() < ssHigh.str());
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_script_key)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    int type;
+    uint160 hashBytes;
+
+    BOOST_CHECK(GetAddressIndexKey(GetScriptForDestination(pubkey.GetID()), type, hashBytes));
+    BOOST_CHECK_EQUAL(type, ADDRESS_INDEX_PUBKEYHASH);
+    BOOST_CHECK(hashBytes == pubkey.GetID());
+
+    // Pay to pubkey shares the entries of the key id
+    BOOST_CHECK(GetAddressIndexKey(CScript() << ToByteVector(pubkey) << OP_CHECKSIG, type, hashBytes));
+    BOOST_CHECK_EQUAL(type, ADDRESS_INDEX_PUBKEYHASH);
+    BOOST_CHECK(hashBytes == pubkey.GetID());
+
+    CScript redeem = CScript() << OP_1;
+    BOOST_CHECK(GetAddressIndexKey(GetScriptForDestination(CScriptID(redeem)), type, hashBytes));
+    BOOST_CHECK_EQUAL(type, ADDRESS_INDEX_SCRIPTHASH);
+    BOOST_CHECK(hashBytes == CScriptID(redeem));
+
+    BOOST_CHECK(!GetAddressIndexKey(CScript() << OP_RETURN, type, hashBytes));
+}
+
+BOOST_FIXTURE_TEST_CASE(addressindex_db_read_bounds, TestingSetup)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hash = uint160(1);
+    uint160 hashOther = uint160(2);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vEntries;
+    for (int nHeight = 1; nHeight <= 5; nHeight++)
+        vEntries.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hash, nHeight, 0, uint256(nHeight), 0, false), nHeight * COIN));
+    vEntries.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_PUBKEYHASH, hashOther, 3, 0, uint256(10), 0, false), COIN));
+    vEntries.push_back(std::make_pair(CAddressIndexKey(ADDRESS_INDEX_SCRIPTHASH, hash, 3, 0, uint256(11), 0, false), COIN));
+    BOOST_CHECK(db.WriteAddressIndex(vEntries));
+
+    // Without bounds all entries of the address and type are read, in height order
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRead;
+    BOOST_CHECK(db.ReadAddressIndex(hash, ADDRESS_INDEX_PUBKEYHASH, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 5U);
+    for (unsigned int i = 0; i < vRead.size(); i++) {
+        BOOST_CHECK_EQUAL(vRead[i].first.blockHeight, (int)i + 1);
+        BOOST_CHECK_EQUAL(vRead[i].second, (CAmount)(i + 1) * COIN);
+    }
+
+    // Both bounds are inclusive
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hash, ADDRESS_INDEX_PUBKEYHASH, vRead, 2, 4));
+    BOOST_CHECK_EQUAL(vRead.size(), 3U);
+    BOOST_CHECK_EQUAL(vRead.front().first.blockHeight, 2);
+    BOOST_CHECK_EQUAL(vRead.back().first.blockHeight, 4);
+
+    // Disconnecting a block erases its entries
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vErase(vEntries.begin() + 2, vEntries.begin() + 3);
+    BOOST_CHECK(db.EraseAddressIndex(vErase));
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hash, ADDRESS_INDEX_PUBKEYHASH, vRead, 2, 4));
+    BOOST_CHECK_EQUAL(vRead.size(), 2U);
+    BOOST_CHECK_EQUAL(vRead.front().first.blockHeight, 2);
+    BOOST_CHECK_EQUAL(vRead.back().first.blockHeight, 4);
+
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashOther, ADDRESS_INDEX_PUBKEYHASH, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 1U);
+}
+
+BOOST_FIXTURE_TEST_CASE(addressindex_db_unspent_update, TestingSetup)
+{
+    CBlockTreeDB db(1 << 20, true);
+    uint160 hash = uint160(1);
+    CScript script = GetScriptForDestination(CKeyID(hash));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUpdate;
+    vUpdate.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, uint256(1), 0), CAddressUnspentValue(COIN, script, 1)));
+    vUpdate.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, uint256(2), 1), CAddressUnspentValue(2 * COIN, script, 2)));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(vUpdate));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vRead;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hash, ADDRESS_INDEX_PUBKEYHASH, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 2U);
+
+    // A null value marks the output as spent and erases it
+    vUpdate.clear();
+    vUpdate.push_back(std::make_pair(CAddressUnspentKey(ADDRESS_INDEX_PUBKEYHASH, hash, uint256(1), 0), CAddressUnspentValue()));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(vUpdate));
+
+    vRead.clear();
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hash, ADDRESS_INDEX_PUBKEYHASH, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 1U);
+    BOOST_CHECK(vRead[0].first.txhash == uint256(2));
+    BOOST_CHECK_EQUAL(vRead[0].second.satoshis, 2 * COIN);
+    BOOST_CHECK_EQUAL(vRead[0].second.blockHeight, 2);
+    BOOST_CHECK(vRead[0].second.script == script);
+}
+
+BOOST_FIXTURE_TEST_CASE(timestampindex_db_read_bounds, TestingSetup)
+{
+    CBlockTreeDB db(1 << 20, true);
+    for (unsigned int nTime = 100; nTime <= 104; nTime++)
+        BOOST_CHECK(db.WriteTimestampIndex(CTimestampIndexKey(nTime, uint256(nTime))));
+
+    // The low bound is inclusive and the high bound is not
+    std::vector<uint256> vHashes;
+    BOOST_CHECK(db.ReadTimestampIndex(104, 101, vHashes));
+    BOOST_CHECK_EQUAL(vHashes.size(), 3U);
+    BOOST_CHECK(vHashes.front() == uint256(101));
+    BOOST_CHECK(vHashes.back() == uint256(103));
+
+    BOOST_CHECK(db.EraseTimestampIndex(CTimestampIndexKey(102, uint256(102))));
+    vHashes.clear();
+    BOOST_CHECK(db.ReadTimestampIndex(104, 101, vHashes));
+    BOOST_CHECK_EQUAL(vHashes.size(), 2U);
+
+    vHashes.clear();
+    BOOST_CHECK(db.ReadTimestampIndex(100, 100, vHashes));
+    BOOST_CHECK(vHashes.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,192 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "clientversion.h"
+#include "main.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "tinyformat.h"
+#include "utiltime.h"
+#include "test/test_wispr.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, TestingSetup)
+
+static CBlockCache::BlockData RandomData(size_t nSize)
+{
+    std::shared_ptr<CDataStream> ss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+    std::vector<unsigned char> vch(nSize);
+    GetRandBytes(vch.data(), vch.size());
+    ss->write((const char*)vch.data(), vch.size());
+    return ss;
+}
+
+/** A block of nTx transactions with random scripts; the unit test chain skips the proof of work check */
+static CBlock RandomBlock(int nTx)
+{
+    CBlock block;
+    block.nTime = GetTime();
+    for (int i = 0; i < nTx; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, (unsigned char)i) << ToByteVector(GetRandHash());
+        tx.vout.resize(2);
+        tx.vout[0].nValue = i * COIN;
+        tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(GetRandHash()) << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout[1] = tx.vout[0];
+        block.vtx.push_back(CTransaction(tx));
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** Write blocks one after the other into blk00000.dat, the way FindBlockPos lays them out */
+static void WriteBlocks(std::vector<CBlock>& blocks, std::vector<CDiskBlockPos>& positions)
+{
+    unsigned int nOffset = 0;
+    for (CBlock& block : blocks) {
+        CDiskBlockPos pos(0, nOffset);
+        BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+        positions.push_back(pos);
+        nOffset = pos.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    }
+}
+
+static std::string Serialized(const CBlock& block)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    return std::string(ss.begin(), ss.end());
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    CBlockCache cache(1000);
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 4; i++)
+        hashes.push_back(GetRandHash());
+
+    cache.Add(hashes[0], RandomData(300));
+    cache.Add(hashes[1], RandomData(300));
+    cache.Add(hashes[2], RandomData(300));
+    BOOST_CHECK_EQUAL(cache.GetCount(), 3U);
+    BOOST_CHECK_EQUAL(cache.GetBytes(), 900U);
+
+    // Touching the oldest block makes the next one the eviction candidate
+    BOOST_CHECK(cache.Get(hashes[0]));
+    cache.Add(hashes[3], RandomData(300));
+    BOOST_CHECK_EQUAL(cache.GetCount(), 3U);
+    BOOST_CHECK(cache.Get(hashes[0]));
+    BOOST_CHECK(!cache.Get(hashes[1]));
+    BOOST_CHECK(cache.Get(hashes[2]));
+    BOOST_CHECK(cache.Get(hashes[3]));
+    BOOST_CHECK_EQUAL(cache.GetHits(), 4U);
+    BOOST_CHECK_EQUAL(cache.GetMisses(), 1U);
+
+    // A block over half the cache is never kept
+    uint256 hashLarge = GetRandHash();
+    cache.Add(hashLarge, RandomData(501));
+    BOOST_CHECK(!cache.Get(hashLarge));
+    BOOST_CHECK_EQUAL(cache.GetCount(), 3U);
+
+    cache.SetMaxSize(600);
+    BOOST_CHECK_EQUAL(cache.GetCount(), 2U);
+    BOOST_CHECK(cache.GetBytes() <= 600U);
+    cache.SetMaxSize(0);
+    BOOST_CHECK_EQUAL(cache.GetCount(), 0U);
+    BOOST_CHECK_EQUAL(cache.GetBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_disk_reads)
+{
+    std::vector<CBlock> blocks;
+    for (int i = 0; i < 8; i++)
+        blocks.push_back(RandomBlock(1 + i * 20));
+    std::vector<CDiskBlockPos> positions;
+    WriteBlocks(blocks, positions);
+
+    for (int fMmap = 0; fMmap <= 1; fMmap++) {
+        mappedBlockFiles.SetEnabled(fMmap);
+        for (size_t i = 0; i < blocks.size(); i++) {
+            CBlock block;
+            BOOST_CHECK(ReadBlockFromDisk(block, positions[i]));
+            BOOST_CHECK(block.GetHash() == blocks[i].GetHash());
+
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            BOOST_CHECK(ReadRawBlockFromDisk(ss, positions[i]));
+            BOOST_CHECK(std::string(ss.begin(), ss.end()) == Serialized(blocks[i]));
+        }
+
+        // Nothing was written at this offset
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        BOOST_CHECK(!ReadRawBlockFromDisk(ss, CDiskBlockPos(0, positions[1].nPos + 1)));
+    }
+
+    // Blocks appended after the file was mapped are still found
+    std::vector<CBlock> more(1, RandomBlock(50));
+    CDiskBlockPos pos(0, positions.back().nPos + ::GetSerializeSize(blocks.back(), SER_DISK, CLIENT_VERSION));
+    BOOST_REQUIRE(WriteBlockToDisk(more[0], pos));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(ReadRawBlockFromDisk(ss, pos));
+    BOOST_CHECK(std::string(ss.begin(), ss.end()) == Serialized(more[0]));
+    mappedBlockFiles.SetEnabled(false);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_getdata_storm_benchmark)
+{
+    // Many peers asking for the same few recent blocks, as after a new tip is announced
+    std::vector<CBlock> blocks;
+    for (int i = 0; i < 4; i++)
+        blocks.push_back(RandomBlock(500));
+    std::vector<CDiskBlockPos> positions;
+    WriteBlocks(blocks, positions);
+    const int nRequests = 2000;
+
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nRequests; i++) {
+        CBlock block;
+        ReadBlockFromDisk(block, positions[i % positions.size()]);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+    }
+    int64_t nElapsed = std::max<int64_t>(GetTimeMicros() - nStart, 1);
+    BOOST_TEST_MESSAGE(strprintf("getdata storm %-18s %8.0f requests/s", "deserialize", nRequests * 1e6 / nElapsed));
+
+    for (int fMmap = 0; fMmap <= 1; fMmap++) {
+        mappedBlockFiles.SetEnabled(fMmap);
+        nStart = GetTimeMicros();
+        for (int i = 0; i < nRequests; i++) {
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ReadRawBlockFromDisk(ss, positions[i % positions.size()]);
+        }
+        nElapsed = std::max<int64_t>(GetTimeMicros() - nStart, 1);
+        BOOST_TEST_MESSAGE(strprintf("getdata storm %-18s %8.0f requests/s", fMmap ? "raw mmap" : "raw fread", nRequests * 1e6 / nElapsed));
+    }
+    mappedBlockFiles.SetEnabled(false);
+
+    CBlockCache cache(DEFAULT_BLOCK_CACHE_SIZE << 20);
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nRequests; i++) {
+        const CDiskBlockPos& pos = positions[i % positions.size()];
+        uint256 hash = blocks[i % blocks.size()].GetHash();
+        CBlockCache::BlockData data = cache.Get(hash);
+        if (!data) {
+            std::shared_ptr<CDataStream> ss(new CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+            ReadRawBlockFromDisk(*ss, pos);
+            data = ss;
+            cache.Add(hash, data);
+        }
+    }
+    nElapsed = std::max<int64_t>(GetTimeMicros() - nStart, 1);
+    BOOST_TEST_MESSAGE(strprintf("getdata storm %-18s %8.0f requests/s", "hot block cache", nRequests * 1e6 / nElapsed));
+    BOOST_CHECK_EQUAL(cache.GetMisses(), blocks.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
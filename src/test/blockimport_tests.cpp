@@ -0,0 +1,138 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "primitives/transaction.h"
+#include "protocol.h"
+#include "script/script.h"
+#include "streams.h"
+#include "test/test_wispr.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, BasicTestingSetup)
+
+static CBlock MakeBlock(const uint256& hashPrev, int n)
+{
+    CBlock block;
+    block.nVersion = 8;
+    block.hashPrevBlock = hashPrev;
+    block.nTime = n;
+    block.nBits = 0x1e0ffff0;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.SetNull();
+    tx.vin[0].scriptSig = CScript() << n << OP_0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = n;
+    block.vtx.push_back(tx);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+static void WriteRecord(CDataStream& ss, const CBlock& block)
+{
+    ss << FLATDATA(Params().MessageStart()) << (unsigned int)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION) << block;
+}
+
+static FILE* StreamToFile(const CDataStream& ss)
+{
+    FILE* file = tmpfile();
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(&ss[0], 1, ss.size(), file), ss.size());
+    rewind(file);
+    return file;
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_order)
+{
+    // More blocks than the queue holds, so the reader has to wait on the connect stage
+    std::vector<CBlock> vBlocks;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    uint256 hashPrev;
+    for (int i = 0; i < (int)MAX_IMPORT_QUEUE_BLOCKS * 2 + 10; i++) {
+        vBlocks.push_back(MakeBlock(hashPrev, i));
+        hashPrev = vBlocks.back().GetHash();
+        WriteRecord(ss, vBlocks.back());
+    }
+
+    CBlockImportPipeline pipeline(StreamToFile(ss), 4);
+    std::unique_ptr<CImportBlock> item;
+    size_t n = 0;
+    while (pipeline.Next(item)) {
+        BOOST_REQUIRE(n < vBlocks.size());
+        BOOST_REQUIRE(item->pblock);
+        BOOST_CHECK(item->hash == vBlocks[n].GetHash());
+        BOOST_CHECK(item->pblock->GetHash() == vBlocks[n].GetHash());
+        BOOST_CHECK(item->fPrechecked);
+        BOOST_CHECK(item->vData.empty());
+        n++;
+    }
+    BOOST_CHECK_EQUAL(n, vBlocks.size());
+    BOOST_CHECK(pipeline.GetReadError().empty());
+    CBlockImportStats stats = pipeline.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBlocks, vBlocks.size());
+    BOOST_CHECK_EQUAL(stats.nBytes + vBlocks.size() * (MESSAGE_START_SIZE + 4), ss.size());
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_rewind)
+{
+    CBlock blockA = MakeBlock(uint256(), 1);
+    CBlock blockB = MakeBlock(blockA.GetHash(), 2);
+    CBlock blockC = MakeBlock(blockB.GetHash(), 3);
+
+    // A record whose size spans garbage followed by a complete block, the way
+    // a block cut short by a crash can be overwritten by the next one
+    CDataStream ssB(SER_DISK, CLIENT_VERSION);
+    WriteRecord(ssB, blockB);
+    std::vector<char> vGarbage(100, (char)0xff);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    WriteRecord(ss, blockA);
+    ss << FLATDATA(Params().MessageStart()) << (unsigned int)(vGarbage.size() + ssB.size());
+    ss.write(&vGarbage[0], vGarbage.size());
+    ss.write(&ssB[0], ssB.size());
+    WriteRecord(ss, blockC);
+
+    CBlockImportPipeline pipeline(StreamToFile(ss), 2);
+    std::unique_ptr<CImportBlock> item;
+    BOOST_REQUIRE(pipeline.Next(item));
+    BOOST_CHECK(item->hash == blockA.GetHash());
+    BOOST_REQUIRE(pipeline.Next(item));
+    BOOST_CHECK(!item->pblock);
+    pipeline.Rewind(*item);
+    BOOST_REQUIRE(pipeline.Next(item));
+    BOOST_CHECK(item->hash == blockB.GetHash());
+    BOOST_REQUIRE(pipeline.Next(item));
+    BOOST_CHECK(item->hash == blockC.GetHash());
+    BOOST_CHECK(!pipeline.Next(item));
+    BOOST_CHECK_EQUAL(pipeline.GetStats().nRewinds, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_precheck)
+{
+    CBlock block = MakeBlock(uint256(), 1);
+    block.hashMerkleRoot = uint256(1);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+
+    CImportBlock item;
+    item.vData.assign(ss.begin(), ss.end());
+    PrepareImportBlock(item);
+    BOOST_REQUIRE(item.pblock);
+    BOOST_CHECK(item.hash == block.GetHash());
+    BOOST_CHECK(!item.fPrechecked);
+
+    CImportBlock truncated;
+    truncated.vData.assign(ss.begin(), ss.begin() + 90);
+    PrepareImportBlock(truncated);
+    BOOST_CHECK(!truncated.pblock);
+    BOOST_CHECK(!truncated.fPrechecked);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,93 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "streams.h"
+#include "test/test_wispr.h"
+#include "version.h"
+
+#include <map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(zerocoin_supply_serialization)
+{
+    // The inline supply serializes exactly like the map it replaced
+    std::map<libzerocoin::CoinDenomination, int64_t> mapSupply;
+    CZerocoinSupply supply;
+    int64_t n = 3;
+    for (auto& denom : libzerocoin::zerocoinDenomList) {
+        mapSupply.insert(std::make_pair(denom, n));
+        supply.at(denom) = n;
+        n = n * 7 + 1;
+    }
+    CDataStream ssMap(SER_DISK, CLIENT_VERSION);
+    ssMap << mapSupply;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << supply;
+    BOOST_CHECK(ss.str() == ssMap.str());
+    BOOST_CHECK_EQUAL(supply.GetSerializeSize(SER_DISK, CLIENT_VERSION), ss.size());
+
+    CZerocoinSupply supply2;
+    ssMap >> supply2;
+    for (auto& denom : libzerocoin::zerocoinDenomList)
+        BOOST_CHECK_EQUAL(supply2.at(denom), mapSupply.at(denom));
+    BOOST_CHECK_THROW(supply2.at(libzerocoin::ZQ_ERROR), std::out_of_range);
+}
+
+BOOST_AUTO_TEST_CASE(zerocoin_mint_counts_serialization)
+{
+    // Old records list the denominations in block order
+    std::vector<libzerocoin::CoinDenomination> vMints = {libzerocoin::ZQ_FIFTY, libzerocoin::ZQ_ONE, libzerocoin::ZQ_FIFTY, libzerocoin::ZQ_FIVE_THOUSAND};
+    CDataStream ssVector(SER_DISK, CLIENT_VERSION);
+    ssVector << vMints;
+
+    CZerocoinMintCounts mints;
+    ssVector >> mints;
+    BOOST_CHECK_EQUAL(mints.Count(libzerocoin::ZQ_ONE), 1);
+    BOOST_CHECK_EQUAL(mints.Count(libzerocoin::ZQ_FIVE), 0);
+    BOOST_CHECK_EQUAL(mints.Count(libzerocoin::ZQ_FIFTY), 2);
+    BOOST_CHECK_EQUAL(mints.Count(libzerocoin::ZQ_FIVE_THOUSAND), 1);
+    BOOST_CHECK_EQUAL(mints.Total(), 4);
+
+    // Written back in denomination order, readable as the old vector
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << mints;
+    BOOST_CHECK_EQUAL(mints.GetSerializeSize(SER_DISK, CLIENT_VERSION), ss.size());
+    std::vector<libzerocoin::CoinDenomination> vMints2;
+    ss >> vMints2;
+    std::vector<libzerocoin::CoinDenomination> vExpected = {libzerocoin::ZQ_ONE, libzerocoin::ZQ_FIFTY, libzerocoin::ZQ_FIFTY, libzerocoin::ZQ_FIVE_THOUSAND};
+    BOOST_CHECK(vMints2 == vExpected);
+}
+
+BOOST_AUTO_TEST_CASE(blockindex_arena)
+{
+    CBlockIndexArena arena;
+    std::vector<CBlockIndex*> vIndex;
+    for (int i = 0; i < 10000; i++) {
+        CBlockIndex* pindex = arena.Allocate();
+        BOOST_CHECK_EQUAL(pindex->nHeight, 0);
+        BOOST_CHECK_EQUAL(pindex->GetZcMints(libzerocoin::ZQ_ONE), 0);
+        pindex->nHeight = i;
+        pindex->pprev = vIndex.empty() ? nullptr : vIndex.back();
+        vIndex.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), 10000U);
+    BOOST_CHECK(arena.DynamicMemoryUsage() >= 10000 * sizeof(CBlockIndex));
+
+    // Entries never move once handed out
+    for (int i = 0; i < 10000; i++) {
+        BOOST_CHECK_EQUAL(vIndex[i]->nHeight, i);
+        BOOST_CHECK(vIndex[i]->pprev == (i ? vIndex[i - 1] : nullptr));
+    }
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+    BOOST_CHECK_EQUAL(arena.Slabs(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,9 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "main.h"
 #include "random.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "test/test_wispr.h"
+#include "undo.h"
 
 #include <vector>
 #include <map>
@@ -59,6 +62,27 @@ public:
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true, true) {}
+    CLevelDBWrapper& GetDB() { return db; }
+};
+
+CCoins RandomCoins(unsigned int nOutputs)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = insecure_rand() % 100000;
+    coins.fCoinStake = insecure_rand() % 2;
+    coins.vout.resize(nOutputs);
+    for (CTxOut& out : coins.vout) {
+        out.nValue = insecure_rand() % 1000000 + 1;
+        out.scriptPubKey = CScript() << OP_DUP << insecure_rand() << OP_DROP;
+    }
+    return coins;
+}
 }
 
 BOOST_FIXTURE_TEST_SUITE(coins_tests, BasicTestingSetup)
@@ -176,4 +200,288 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+// Randomized spends, replacements and flushes through two caches on top of
+// the per-outpoint coin database, checked against a fresh read of the database.
+BOOST_FIXTURE_TEST_CASE(coins_db_outpoint_test, TestingSetup)
+{
+    CCoinsViewDBTest base;
+    CCoinsViewCache* mid = new CCoinsViewCache(&base);
+    CCoinsViewCache* tip = new CCoinsViewCache(mid);
+    std::map<uint256, CCoins> result;
+
+    std::vector<uint256> txids(100);
+    for (unsigned int i = 0; i < txids.size(); i++)
+        txids[i] = GetRandHash();
+
+    for (unsigned int i = 0; i < 5000; i++) {
+        uint256 txid = txids[insecure_rand() % txids.size()];
+        CCoins& coins = result[txid];
+        if (coins.IsPruned()) {
+            // Some transactions get more outputs than the dirty mask tracks one by one
+            coins = RandomCoins(1 + insecure_rand() % (insecure_rand() % 4 == 0 ? 100 : 10));
+            if (insecure_rand() % 2)
+                *tip->ModifyNewCoins(txid) = coins;
+            else
+                *tip->ModifyCoins(txid) = coins;
+        } else if (insecure_rand() % 20 == 0) {
+            coins.Clear();
+            tip->ModifyCoins(txid)->Clear();
+        } else {
+            unsigned int nPos = insecure_rand() % coins.vout.size();
+            coins.Spend(nPos);
+            tip->ModifyCoins(txid)->Spend(nPos);
+        }
+
+        if (insecure_rand() % 50 == 0) {
+            tip->Flush();
+            if (insecure_rand() % 3 == 0)
+                mid->Flush();
+        }
+
+        if (insecure_rand() % 500 == 0 || i == 4999) {
+            tip->Flush();
+            mid->Flush();
+            CCoinsViewCache check(&base);
+            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+                const CCoins* coins = check.AccessCoins(it->first);
+                if (coins)
+                    BOOST_CHECK(*coins == it->second);
+                else
+                    BOOST_CHECK(it->second.IsPruned());
+                BOOST_CHECK_EQUAL(base.HaveCoins(it->first), !it->second.IsPruned());
+            }
+        }
+    }
+    delete tip;
+    delete mid;
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_upgrade_test, TestingSetup)
+{
+    CCoinsViewDBTest base;
+    std::map<uint256, CCoins> legacy;
+    for (unsigned int i = 0; i < 50; i++) {
+        CCoins coins = RandomCoins(2 + insecure_rand() % 20);
+        coins.vout[insecure_rand() % coins.vout.size()].SetNull();
+        coins.Cleanup();
+        uint256 txid = GetRandHash();
+        legacy[txid] = coins;
+        BOOST_CHECK(base.GetDB().Write(std::make_pair('c', txid), coins));
+    }
+
+    BOOST_CHECK(base.Upgrade());
+    for (std::map<uint256, CCoins>::iterator it = legacy.begin(); it != legacy.end(); it++) {
+        CCoins coins;
+        BOOST_CHECK(base.GetCoins(it->first, coins));
+        BOOST_CHECK(coins == it->second);
+        BOOST_CHECK(!base.GetDB().Exists(std::make_pair('c', it->first)));
+    }
+    // Nothing left to convert the second time
+    BOOST_CHECK(base.Upgrade());
+}
+
+// The same random changes as above, flushed from a single cache through the
+// background writer. Reads must see flushed coins whether or not they are
+// written yet, and the database must end up with all of them.
+BOOST_FIXTURE_TEST_CASE(coins_db_background_flush_test, TestingSetup)
+{
+    CCoinsViewDBTest base;
+    CCoinsViewBackgroundFlush flush(&base);
+    CCoinsViewCache* tip = new CCoinsViewCache(&flush);
+    std::map<uint256, CCoins> result;
+
+    std::vector<uint256> txids(100);
+    for (unsigned int i = 0; i < txids.size(); i++)
+        txids[i] = GetRandHash();
+
+    uint256 hashBest;
+    unsigned int nFlushes = 0;
+    for (unsigned int i = 0; i < 5000; i++) {
+        uint256 txid = txids[insecure_rand() % txids.size()];
+        CCoins& coins = result[txid];
+        if (coins.IsPruned()) {
+            coins = RandomCoins(1 + insecure_rand() % (insecure_rand() % 4 == 0 ? 100 : 10));
+            *tip->ModifyCoins(txid) = coins;
+        } else if (insecure_rand() % 20 == 0) {
+            coins.Clear();
+            tip->ModifyCoins(txid)->Clear();
+        } else {
+            unsigned int nPos = insecure_rand() % coins.vout.size();
+            coins.Spend(nPos);
+            tip->ModifyCoins(txid)->Spend(nPos);
+        }
+
+        if (insecure_rand() % 50 == 0) {
+            hashBest = GetRandHash();
+            tip->SetBestBlock(hashBest);
+            unsigned int nCacheSize = tip->GetCacheSize();
+            BOOST_CHECK(tip->Flush());
+            nFlushes++;
+            BOOST_CHECK(flush.GetBestBlock() == hashBest);
+            BOOST_CHECK(flush.GetPendingSize() <= nCacheSize);
+            if (insecure_rand() % 3 == 0) {
+                BOOST_CHECK(flush.Wait());
+                BOOST_CHECK_EQUAL(flush.GetPendingSize(), 0U);
+            }
+        }
+
+        if (insecure_rand() % 500 == 0) {
+            CCoinsViewCache check(&flush);
+            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+                const CCoins* pcoins = check.AccessCoins(it->first);
+                if (pcoins && !pcoins->IsPruned())
+                    BOOST_CHECK(*pcoins == it->second);
+                else
+                    BOOST_CHECK(it->second.IsPruned());
+            }
+        }
+    }
+    tip->SetBestBlock(hashBest);
+    BOOST_CHECK(tip->Flush());
+    BOOST_CHECK(flush.Wait());
+    nFlushes++;
+
+    BOOST_CHECK(base.GetBestBlock() == hashBest);
+    for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+        CCoins coins;
+        if (base.GetCoins(it->first, coins)) {
+            coins.Cleanup();
+            BOOST_CHECK(coins == it->second);
+        } else {
+            BOOST_CHECK(it->second.IsPruned());
+        }
+    }
+
+    CCoinsFlushStats stats = flush.GetFlushStats();
+    BOOST_CHECK_EQUAL(stats.nFlushes, nFlushes);
+    BOOST_CHECK(!stats.fPending);
+    delete tip;
+}
+
+BOOST_AUTO_TEST_CASE(coin_cache_flush_policy_test)
+{
+    const unsigned int nMaxSize = 1000;
+
+    // Synchronous flushes use the whole budget
+    BOOST_CHECK(!CoinCacheNeedsFlush(1000, 0, nMaxSize, false));
+    BOOST_CHECK(CoinCacheNeedsFlush(1001, 0, nMaxSize, false));
+
+    // Background flushes start at half of it
+    BOOST_CHECK(!CoinCacheNeedsFlush(500, 0, nMaxSize, true));
+    BOOST_CHECK(CoinCacheNeedsFlush(501, 0, nMaxSize, true));
+
+    // The next block after a flush does not flush again and wait for the write
+    BOOST_CHECK(!CoinCacheNeedsFlush(0, 501, nMaxSize, true));
+    BOOST_CHECK(!CoinCacheNeedsFlush(30, 501, nMaxSize, true));
+    BOOST_CHECK(!CoinCacheNeedsFlush(499, 501, nMaxSize, true));
+    // unless the cache and the write in flight are over the budget together
+    BOOST_CHECK(CoinCacheNeedsFlush(500, 501, nMaxSize, true));
+
+    // Blocks adding 30 coins each, with every write taking 5 blocks: a flush never
+    // starts while another is in flight, and the coins in memory stay within budget
+    unsigned int nCacheSize = 0;
+    unsigned int nPendingSize = 0;
+    unsigned int nFlushes = 0;
+    int nWrittenAt = 0;
+    for (int nBlock = 0; nBlock < 1000; nBlock++) {
+        if (nPendingSize && nBlock >= nWrittenAt)
+            nPendingSize = 0;
+        nCacheSize += 30;
+        if (CoinCacheNeedsFlush(nCacheSize, nPendingSize, nMaxSize, true)) {
+            BOOST_CHECK_EQUAL(nPendingSize, 0U);
+            nPendingSize = nCacheSize;
+            nCacheSize = 0;
+            nWrittenAt = nBlock + 5;
+            nFlushes++;
+        }
+        BOOST_CHECK(nCacheSize + nPendingSize <= nMaxSize);
+    }
+    BOOST_CHECK(nFlushes > 0);
+}
+
+static uint256 UtxoSetHash(CUtxoStats stats)
+{
+    uint256 hash;
+    stats.muhash.Finalize(hash.begin());
+    return hash;
+}
+
+static void CheckUtxoStats(const CUtxoStats& stats, const CCoinsViewDB& base)
+{
+    CUtxoStats computed;
+    BOOST_REQUIRE(base.ComputeUtxoStats(computed));
+    BOOST_CHECK(UtxoSetHash(stats) == UtxoSetHash(computed));
+    BOOST_CHECK_EQUAL(stats.nTransactions, computed.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, computed.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nSerializedSize, computed.nSerializedSize);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, computed.nTotalAmount);
+}
+
+// Spend the last output of a coinstake and undo it again, keeping the rolling
+// stats the way ConnectBlock and DisconnectBlock do, and compare them with a
+// full scan of the chainstate after each step
+BOOST_FIXTURE_TEST_CASE(coins_utxo_stats_undo_test, TestingSetup)
+{
+    CCoinsViewDBTest base;
+    CCoinsViewCache view(&base);
+
+    CMutableTransaction stake;
+    stake.vin.resize(1);
+    stake.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    stake.vout.resize(2);
+    stake.vout[0].SetEmpty();
+    stake.vout[1] = CTxOut(10 * COIN, CScript() << OP_TRUE);
+    const CTransaction txStake(stake);
+    BOOST_REQUIRE(txStake.IsCoinStake());
+    const uint256 hashStake = txStake.GetHash();
+    view.ModifyNewCoins(hashStake)->FromTx(txStake, 1);
+    view.SetBestBlock(uint256(1));
+    BOOST_CHECK(view.Flush());
+
+    CUtxoStats stats;
+    BOOST_REQUIRE(base.ComputeUtxoStats(stats));
+    const uint256 hashBefore = UtxoSetHash(stats);
+
+    // Connect
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(hashStake, 1);
+    spend.vout.resize(1);
+    spend.vout[0] = CTxOut(9 * COIN, CScript() << OP_TRUE);
+    const CTransaction txSpend(spend);
+    const uint256 hashSpend = txSpend.GetHash();
+    const COutPoint& out = txSpend.vin[0].prevout;
+
+    stats.RemoveCoin(out, Coin(*view.AccessCoins(out.hash), out.n));
+    CTxUndo txundo;
+    CValidationState state;
+    UpdateCoins(txSpend, state, view, txundo, 2);
+    BOOST_REQUIRE_EQUAL(txundo.vprevout.size(), 1U);
+    BOOST_CHECK(txundo.vprevout[0].nHeight != 0);
+    BOOST_CHECK(txundo.vprevout[0].fCoinStake);
+    // One transaction left the set and one came in
+    stats.AddCoin(COutPoint(hashSpend, 0), Coin(*view.AccessCoins(hashSpend), 0));
+    view.SetBestBlock(uint256(2));
+    BOOST_CHECK(view.Flush());
+    CheckUtxoStats(stats, base);
+
+    // Disconnect
+    {
+        CCoinsModifier outs = view.ModifyCoins(hashSpend);
+        stats.nTransactions--;
+        stats.RemoveCoin(COutPoint(hashSpend, 0), Coin(*outs, 0));
+        outs->Clear();
+    }
+    BOOST_CHECK(ApplyTxInUndo(txundo.vprevout[0], view, out));
+    const CCoins* coins = view.AccessCoins(out.hash);
+    BOOST_REQUIRE(coins);
+    BOOST_CHECK(coins->IsCoinStake());
+    stats.nTransactions++;
+    stats.AddCoin(out, Coin(*coins, out.n));
+    view.SetBestBlock(uint256(1));
+    BOOST_CHECK(view.Flush());
+    CheckUtxoStats(stats, base);
+    BOOST_CHECK(UtxoSetHash(stats) == hashBefore);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,8 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
+#include "crypto/common.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_wispr.h"
@@ -132,6 +134,44 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d_sweep_matches_scalar)
+{
+    // The zWSP (44 byte) and WSP (48 byte) stake kernel prefixes; 37 values
+    // do not divide by any lane width, so the padded tail is covered as well
+    static const size_t prefixLengths[] = {44, 48};
+    static const size_t laneWidths[] = {8, 4, 1};
+    for (size_t nPrefixLen : prefixLengths) {
+        BOOST_CHECK(CSHA256DWordSweep::IsSupported(nPrefixLen));
+        std::vector<unsigned char> prefix(nPrefixLen);
+        GetRandBytes(prefix.data(), prefix.size());
+        std::vector<uint32_t> values(37);
+        for (size_t i = 0; i < values.size(); i++)
+            values[i] = 1500000000 + 60 - i;
+
+        std::vector<unsigned char> expected(values.size() * 32);
+        for (size_t i = 0; i < values.size(); i++) {
+            unsigned char word[4];
+            WriteLE32(word, values[i]);
+            unsigned char first[32];
+            CSHA256().Write(prefix.data(), prefix.size()).Write(word, 4).Finalize(first);
+            CSHA256().Write(first, 32).Finalize(&expected[i * 32]);
+        }
+
+        CSHA256DWordSweep sweep(prefix.data(), prefix.size());
+        for (size_t nLanes : laneWidths) {
+            std::string strImpl = SHA256DSweepSelectImplementation(nLanes);
+            std::vector<unsigned char> hashes(values.size() * 32);
+            sweep.Hash(hashes.data(), values.data(), values.size());
+            for (size_t i = 0; i < values.size(); i++)
+                BOOST_CHECK_MESSAGE(memcmp(&hashes[i * 32], &expected[i * 32], 32) == 0,
+                                    strImpl + " mismatch at value " + std::to_string(i));
+        }
+    }
+    SHA256DSweepSelectImplementation((size_t)-1);
+    BOOST_CHECK(!CSHA256DWordSweep::IsSupported(46));
+    BOOST_CHECK(!CSHA256DWordSweep::IsSupported(56));
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -283,4 +323,60 @@ BOOST_AUTO_TEST_CASE(rfc6979_hmac_sha256)
             ("7597887cbd76321f32e30440679a22cf7f8d9d2eac390e581fea091ce202ba94"));
 }
 
+static std::string FinalizeMuHash(MuHash3072 muhash)
+{
+    unsigned char hash[MuHash3072::OUTPUT_SIZE];
+    muhash.Finalize(hash);
+    return HexStr(hash, hash + sizeof(hash));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    const unsigned char a[] = {1}, b[] = {2}, c[] = {3};
+
+    // The empty set hashes the number one
+    BOOST_CHECK_EQUAL(FinalizeMuHash(MuHash3072()), "c85525462fdcf30a2c18d6f4b92923000974355c2477f59594d2c205a1d25add");
+
+    MuHash3072 ab, ba;
+    ab.Insert(a, 1).Insert(b, 1);
+    ba.Insert(b, 1).Insert(a, 1);
+    BOOST_CHECK_EQUAL(FinalizeMuHash(ab), FinalizeMuHash(ba));
+    BOOST_CHECK(FinalizeMuHash(ab) != FinalizeMuHash(MuHash3072().Insert(a, 1)));
+
+    MuHash3072 removed;
+    removed.Insert(a, 1).Insert(c, 1).Insert(b, 1).Remove(c, 1);
+    BOOST_CHECK_EQUAL(FinalizeMuHash(removed), FinalizeMuHash(ab));
+    MuHash3072 empty;
+    empty.Remove(a, 1).Insert(a, 1);
+    BOOST_CHECK_EQUAL(FinalizeMuHash(empty), FinalizeMuHash(MuHash3072()));
+
+    MuHash3072 un = MuHash3072().Insert(a, 1);
+    un *= MuHash3072().Insert(b, 1);
+    BOOST_CHECK_EQUAL(FinalizeMuHash(un), FinalizeMuHash(ab));
+    un /= MuHash3072().Insert(b, 1);
+    BOOST_CHECK_EQUAL(FinalizeMuHash(un), FinalizeMuHash(MuHash3072().Insert(a, 1)));
+
+    unsigned char buf[MuHash3072::SERIALIZED_SIZE];
+    removed.ToBytes(buf);
+    MuHash3072 restored;
+    restored.FromBytes(buf);
+    BOOST_CHECK_EQUAL(FinalizeMuHash(restored), FinalizeMuHash(ab));
+
+    // p - 1 squared is one, and a number past p reduces
+    Num3072 x;
+    for (int i = 0; i < Num3072::LIMBS; i++)
+        x.limbs[i] = 0xffffffff;
+    x.limbs[0] = 0xffffffff - 1103717;
+    Num3072 y = x;
+    y.Multiply(x);
+    const std::string strOne = "01" + std::string(2 * Num3072::BYTE_SIZE - 2, '0');
+    unsigned char out[Num3072::BYTE_SIZE];
+    y.ToBytes(out);
+    BOOST_CHECK_EQUAL(HexStr(out, out + sizeof(out)), strOne);
+    Num3072 z = x.GetInverse();
+    z.Multiply(x);
+    z.ToBytes(out);
+    BOOST_CHECK_EQUAL(HexStr(out, out + sizeof(out)), strOne);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "leveldbwrapper.h"
 #include "util.h"
 #include "test/test_wispr.h"
 
@@ -159,4 +160,33 @@ BOOST_AUTO_TEST_CASE(boolargno)
     BOOST_CHECK(GetBoolArg("-foo", false));
 }
 
+BOOST_AUTO_TEST_CASE(leveldbtuning)
+{
+    ResetArgs("");
+    CLevelDBTuning tuning = GetLevelDBTuning("chainstate", 8 << 20);
+    BOOST_CHECK_EQUAL(tuning.nBlockCache, 4U << 20);
+    BOOST_CHECK_EQUAL(tuning.nWriteBuffer, 2U << 20);
+    BOOST_CHECK_EQUAL(tuning.nMaxOpenFiles, DEFAULT_LEVELDB_MAX_OPEN_FILES);
+    BOOST_CHECK_EQUAL(tuning.nBloomBits, DEFAULT_LEVELDB_BLOOM_BITS);
+    BOOST_CHECK_EQUAL(tuning.fCompression, DEFAULT_LEVELDB_COMPRESSION);
+
+    // A prefixed value wins over a plain one, whatever the order
+    ResetArgs("-dbmaxopenfiles=chainstate:1000 -dbmaxopenfiles=200 -dbcompression=1 -dbbloombits=zerocoin:0 -dbblockcache=blockindex:16");
+    tuning = GetLevelDBTuning("chainstate", 8 << 20);
+    BOOST_CHECK_EQUAL(tuning.nMaxOpenFiles, 1000);
+    BOOST_CHECK(tuning.fCompression);
+    BOOST_CHECK_EQUAL(tuning.nBloomBits, DEFAULT_LEVELDB_BLOOM_BITS);
+    BOOST_CHECK_EQUAL(tuning.nBlockCache, 4U << 20);
+    tuning = GetLevelDBTuning("zerocoin", 0);
+    BOOST_CHECK_EQUAL(tuning.nMaxOpenFiles, 200);
+    BOOST_CHECK_EQUAL(tuning.nBloomBits, 0);
+    tuning = GetLevelDBTuning("blockindex", 0);
+    BOOST_CHECK_EQUAL(tuning.nBlockCache, 16U << 20);
+
+    // Fewer open files than the default are not allowed
+    ResetArgs("-dbmaxopenfiles=10");
+    BOOST_CHECK_EQUAL(GetLevelDBTuning("sporks", 0).nMaxOpenFiles, DEFAULT_LEVELDB_MAX_OPEN_FILES);
+    ResetArgs("");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -99,4 +99,85 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+static void CheckPackageState(CTxMemPool& pool, const CMutableTransaction& tx, uint64_t nAncestors, CAmount nAncestorFees, uint64_t nDescendants, CAmount nDescendantFees)
+{
+    LOCK(pool.cs);
+    CTxMemPool::txiter it = pool.mapTx.find(tx.GetHash());
+    BOOST_REQUIRE(it != pool.mapTx.end());
+    BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), nAncestors);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), nAncestorFees);
+    BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), nDescendants);
+    BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), nDescendantFees);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolPackageStateTest)
+{
+    // Parent with two children, the first of which has a child of its own
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild[2];
+    for (int i = 0; i < 2; i++) {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout.hash = txParent.GetHash();
+        txChild[i].vin[0].prevout.n = i;
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 11000LL;
+    }
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout.hash = txChild[0].GetHash();
+    txGrandChild.vin[0].prevout.n = 0;
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 10000LL;
+
+    CTxMemPool testPool(CFeeRate(0));
+    std::list<CTransaction> removed;
+
+    // Descendants first, as when a block is disconnected and its transactions are re-added
+    testPool.addUnchecked(txGrandChild.GetHash(), CTxMemPoolEntry(txGrandChild, 1000, 0, 0.0, 1));
+    testPool.addUnchecked(txChild[0].GetHash(), CTxMemPoolEntry(txChild[0], 100, 0, 0.0, 1));
+    testPool.addUnchecked(txChild[1].GetHash(), CTxMemPoolEntry(txChild[1], 200, 0, 0.0, 1));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 10, 0, 0.0, 1));
+
+    CheckPackageState(testPool, txParent, 1, 10, 4, 1310);
+    CheckPackageState(testPool, txChild[0], 2, 110, 2, 1100);
+    CheckPackageState(testPool, txChild[1], 2, 210, 1, 200);
+    CheckPackageState(testPool, txGrandChild, 3, 1110, 1, 1000);
+
+    // The grandchild pays for its ancestors and has the best package fee rate
+    {
+        LOCK(testPool.cs);
+        BOOST_CHECK(testPool.mapTx.get<ancestor_score>().begin()->GetTx().GetHash() == txGrandChild.GetHash());
+    }
+
+    // A fee delta moves the package fees of everything connected to the entry
+    testPool.PrioritiseTransaction(txChild[0].GetHash(), txChild[0].GetHash().ToString(), 0.0, 50);
+    CheckPackageState(testPool, txParent, 1, 10, 4, 1360);
+    CheckPackageState(testPool, txChild[0], 2, 160, 2, 1150);
+    CheckPackageState(testPool, txChild[1], 2, 210, 1, 200);
+    CheckPackageState(testPool, txGrandChild, 3, 1160, 1, 1000);
+
+    // Confirming the parent leaves its descendants behind without it
+    testPool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    removed.clear();
+    CheckPackageState(testPool, txChild[0], 1, 150, 2, 1150);
+    CheckPackageState(testPool, txChild[1], 1, 200, 1, 200);
+    CheckPackageState(testPool, txGrandChild, 2, 1150, 1, 1000);
+
+    testPool.remove(txGrandChild, removed, false);
+    CheckPackageState(testPool, txChild[0], 1, 150, 1, 150);
+    BOOST_CHECK_EQUAL(testPool.size(), 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,11 +4,18 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "net.h"
 #include "netbase.h"
 #include "test/test_wispr.h"
+#include "util.h"
 
 #include <string>
 
+#ifndef WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 #include <boost/test/unit_test.hpp>
 
 
@@ -235,4 +242,43 @@ BOOST_AUTO_TEST_CASE(subnet_test)
     BOOST_CHECK_EQUAL(subnet.ToString(), "1:2:3:4:5:6:7:8/ffff:ffff:ffff:fffe:ffff:ffff:ffff:ff0f");
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(waitforsocket_test)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    // Move the socket above FD_SETSIZE when the limit allows it, where
+    // FD_SET() would write past the end of an fd_set
+    SOCKET hSocket = fds[0];
+    if (RaiseFileDescriptorLimit(FD_SETSIZE + 16) > FD_SETSIZE + 8) {
+        BOOST_REQUIRE(dup2(fds[0], FD_SETSIZE + 8) == FD_SETSIZE + 8);
+        close(fds[0]);
+        hSocket = FD_SETSIZE + 8;
+    }
+
+    BOOST_CHECK_EQUAL(WaitForSocket(hSocket, false, 10), 0);
+    BOOST_CHECK_EQUAL(WaitForSocket(hSocket, true, 10), 1);
+    BOOST_CHECK_EQUAL(write(fds[1], "x", 1), 1);
+    BOOST_CHECK_EQUAL(WaitForSocket(hSocket, false, 1000), 1);
+
+    close(fds[1]);
+    CloseSocket(hSocket);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(socketevents_mode)
+{
+    BOOST_CHECK(!SetSocketEventsMode("bogus"));
+    BOOST_CHECK(SetSocketEventsMode("select"));
+    BOOST_CHECK(GetSocketEventsMode() == SOCKETEVENTS_SELECT);
+#ifdef HAVE_SYS_EPOLL_H
+    BOOST_CHECK(SetSocketEventsMode("epoll"));
+    BOOST_CHECK(GetSocketEventsMode() == SOCKETEVENTS_EPOLL);
+    BOOST_CHECK(SetSocketEventsMode("select"));
+#else
+    BOOST_CHECK(!SetSocketEventsMode("epoll"));
+#endif
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "net.h"
+#include "netbufferpool.h"
+#include "random.h"
+#include "test/test_wispr.h"
+#include "version.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(netbufferpool_tests, BasicTestingSetup)
+
+static std::vector<char> RandomBytes(size_t nSize)
+{
+    std::vector<char> vch(nSize);
+    GetRandBytes((unsigned char*)vch.data(), vch.size());
+    return vch;
+}
+
+BOOST_AUTO_TEST_CASE(netbufferpool_reuse)
+{
+    CNetBufferPool pool(1 << 20);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    std::vector<char> data = RandomBytes(300);
+    pool.Reserve(ss, data.size(), data.size());
+    ss.write(data.data(), data.size());
+    pool.Release(ss);
+    BOOST_CHECK(ss.empty());
+
+    CNetBufferStats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nAllocated, 1U);
+    BOOST_CHECK_EQUAL(stats.nReturned, 1U);
+    BOOST_CHECK_EQUAL(stats.nPooledBuffers, 1U);
+
+    // A message of a similar size gets the same buffer back
+    CDataStream ss2(SER_NETWORK, PROTOCOL_VERSION);
+    pool.Reserve(ss2, 1000, 1000);
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nReused, 1U);
+    BOOST_CHECK_EQUAL(stats.nAllocated, 1U);
+    BOOST_CHECK_EQUAL(stats.nPooledBuffers, 0U);
+
+    // Growing keeps what was written so far
+    ss2.write(data.data(), data.size());
+    pool.Reserve(ss2, 100000, 100000);
+    BOOST_CHECK(std::vector<char>(ss2.begin(), ss2.end()) == data);
+    BOOST_CHECK_EQUAL(pool.GetStats().nPooledBuffers, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(netbufferpool_limit)
+{
+    CNetBufferPool pool(64 << 10);
+    std::vector<CDataStream> streams(4, CDataStream(SER_NETWORK, PROTOCOL_VERSION));
+    for (CDataStream& ss : streams)
+        pool.Reserve(ss, 20000, 20000);
+    for (CDataStream& ss : streams)
+        pool.Release(ss);
+
+    // Each buffer holds at least 64 KiB, so only the first fits
+    CNetBufferStats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nReturned, 1U);
+    BOOST_CHECK_EQUAL(stats.nFreed, 3U);
+    BOOST_CHECK(stats.nPooledBytes <= (64U << 10));
+
+    pool.SetMaxBytes(0);
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nPooledBuffers, 0U);
+    BOOST_CHECK_EQUAL(stats.nPooledBytes, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(netbufferpool_receive_message)
+{
+    std::vector<char> payload = RandomBytes(70000);
+    CMessageHeader hdr("tx", payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    ss.write(payload.data(), payload.size());
+
+    CNode node(INVALID_SOCKET, CAddress(CService("127.0.0.1", 0)), "", true);
+    LOCK(node.cs_vRecvMsg);
+    // Arrive in uneven pieces, splitting the header as well
+    size_t nPos = 0;
+    while (nPos < ss.size()) {
+        size_t nPiece = std::min<size_t>(ss.size() - nPos, 10 + nPos % 4099);
+        BOOST_CHECK(node.ReceiveMsgBytes(&ss[nPos], nPiece));
+        nPos += nPiece;
+    }
+
+    BOOST_REQUIRE_EQUAL(node.vRecvMsg.size(), 1U);
+    const CNetMessage& msg = node.vRecvMsg.front();
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK_EQUAL(msg.hdr.GetCommand(), "tx");
+    BOOST_CHECK(std::vector<char>(msg.vRecv.begin(), msg.vRecv.end()) == payload);
+
+    // Dropping the message hands its buffer to the pool
+    size_t nPooled = netBufferPool.GetStats().nPooledBuffers;
+    node.vRecvMsg.clear();
+    BOOST_CHECK_EQUAL(netBufferPool.GetStats().nPooledBuffers, nPooled + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 
 #include "random.h"
 #include "scheduler.h"
+#include "validationinterface.h"
 #if defined(HAVE_CONFIG_H)
 #include "config/wispr-config.h"
 #else
@@ -120,4 +121,76 @@ BOOST_AUTO_TEST_CASE(manythreads)
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+static void orderedTask(int& counter, int expected, bool& fOrdered)
+{
+    if (counter != expected)
+        fOrdered = false;
+    MicroSleep(10);
+    counter++;
+}
+
+BOOST_AUTO_TEST_CASE(singlethreadedscheduler_ordered)
+{
+    CScheduler scheduler;
+
+    // Each client's functions run in order and one at a time, even with
+    // several threads servicing the scheduler
+    SingleThreadedSchedulerClient queue1(&scheduler);
+    SingleThreadedSchedulerClient queue2(&scheduler);
+
+    boost::thread_group threads;
+    for (int i = 0; i < 5; i++)
+        threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+
+    int counter1 = 0, counter2 = 0;
+    bool fOrdered1 = true, fOrdered2 = true;
+    for (int i = 0; i < 100; i++) {
+        queue1.AddToProcessQueue(boost::bind(&orderedTask, boost::ref(counter1), i, boost::ref(fOrdered1)));
+        queue2.AddToProcessQueue(boost::bind(&orderedTask, boost::ref(counter2), i, boost::ref(fOrdered2)));
+    }
+
+    // Drain the task queue then exit threads
+    scheduler.stop(true);
+    threads.join_all();
+    BOOST_CHECK(!scheduler.AreThreadsServicingQueue());
+
+    // Whatever the threads left behind runs on this thread
+    queue1.EmptyQueue();
+    queue2.EmptyQueue();
+    BOOST_CHECK_EQUAL(queue1.CallbacksPending(), 0U);
+    BOOST_CHECK_EQUAL(queue2.CallbacksPending(), 0U);
+    BOOST_CHECK_EQUAL(counter1, 100);
+    BOOST_CHECK_EQUAL(counter2, 100);
+    BOOST_CHECK(fOrdered1);
+    BOOST_CHECK(fOrdered2);
+}
+
+static void syncInterruptible(bool& fInterrupted)
+{
+    try {
+        SyncWithValidationInterfaceQueue();
+    } catch (const boost::thread_interrupted&) {
+        fInterrupted = true;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(syncwithvalidationinterfacequeue_interrupt)
+{
+    // No thread services the scheduler, as at shutdown once it was stopped
+    CScheduler scheduler;
+    GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+
+    bool fInterrupted = false;
+    boost::thread waiter(boost::bind(&syncInterruptible, boost::ref(fInterrupted)));
+    MicroSleep(10000);
+    waiter.interrupt();
+    BOOST_CHECK(waiter.try_join_for(boost::chrono::seconds(10)));
+    BOOST_CHECK(fInterrupted);
+
+    // The callback left behind outlives the waiter
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), 1U);
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
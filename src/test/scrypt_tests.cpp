@@ -0,0 +1,89 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/scrypt.h"
+#include "random.h"
+#include "tinyformat.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+#include "test/test_wispr.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(scrypt_tests, BasicTestingSetup)
+
+/** Lane widths to exercise; detection clamps each to the best the CPU offers */
+static const size_t scryptLaneWidths[] = {1, 4, 8};
+
+static void TestScryptBlockhash(const std::string& hexin, const std::string& hexout)
+{
+    std::vector<unsigned char> in = ParseHex(hexin);
+    BOOST_CHECK_EQUAL(scrypt_blockhash(&in[0]).GetHex(), hexout);
+}
+
+static void RandomHeaders(std::vector<unsigned char>& data, std::vector<const void*>& headers, size_t count)
+{
+    data.resize(80 * count);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = insecure_rand();
+    headers.resize(count);
+    for (size_t i = 0; i < count; i++)
+        headers[i] = &data[80 * i];
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_blockhash_testvectors)
+{
+    // scrypt(N=1024, r=1, p=1) of the header salted with itself, displayed as uint256
+    TestScryptBlockhash(std::string(160, '0'),
+        "694b3a55a61339b43c01421b13f710e22e33a7eabda1cd48103bb9f376081d16");
+    TestScryptBlockhash("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+                        "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+                        "404142434445464748494a4b4c4d4e4f",
+        "d2a91baa45263cfd16c4fef0fb0776382d0e011ec70530496ef91d801a0a54bc");
+    TestScryptBlockhash("01" + std::string(158, '0'),
+        "5404c822c7af2630255dbd3d24312dbb36d8d74f3f6b5c194c0add98fafa9dab");
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_blockhash_batch_matches_scalar)
+{
+    // 19 does not divide by any lane width, so the scalar tail is covered as well
+    std::vector<unsigned char> data;
+    std::vector<const void*> headers;
+    RandomHeaders(data, headers, 19);
+
+    std::vector<uint256> expected(headers.size());
+    for (size_t i = 0; i < headers.size(); i++)
+        expected[i] = scrypt_blockhash(headers[i]);
+
+    for (size_t nLanes : scryptLaneWidths) {
+        std::string strImpl = scrypt_select_implementation(nLanes);
+        std::vector<uint256> hashes(headers.size());
+        scrypt_blockhash_batch(&headers[0], &hashes[0], headers.size());
+        for (size_t i = 0; i < headers.size(); i++)
+            BOOST_CHECK_MESSAGE(hashes[i] == expected[i], strImpl + " mismatch at header " + std::to_string(i));
+    }
+    scrypt_select_implementation((size_t)-1);
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_blockhash_batch_benchmark)
+{
+    std::vector<unsigned char> data;
+    std::vector<const void*> headers;
+    RandomHeaders(data, headers, 64);
+    std::vector<uint256> hashes(headers.size());
+
+    for (size_t nLanes : scryptLaneWidths) {
+        std::string strImpl = scrypt_select_implementation(nLanes);
+        int64_t nStart = GetTimeMicros();
+        scrypt_blockhash_batch(&headers[0], &hashes[0], headers.size());
+        int64_t nElapsed = std::max<int64_t>(GetTimeMicros() - nStart, 1);
+        BOOST_TEST_MESSAGE(strprintf("scrypt_blockhash_batch %-12s %8.0f hashes/s", strImpl, headers.size() * 1e6 / nElapsed));
+    }
+    scrypt_select_implementation((size_t)-1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
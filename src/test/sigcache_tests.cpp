@@ -0,0 +1,112 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "util.h"
+#include "test/test_wispr.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sigcache_tests, TestingSetup)
+
+static bool CheckCached(const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, const uint256& hash, bool fStore)
+{
+    CTransaction tx;
+    return CachingTransactionSignatureChecker(&tx, 0, fStore).VerifySignature(vchSig, pubkey, hash);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_mempool_then_block)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    for (int i = 0; i < 16; i++) {
+        uint256 hash = GetRandHash();
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(hash, vchSig));
+
+        // Mempool acceptance verifies and stores
+        CSignatureCacheStats before = GetSignatureCacheStats();
+        BOOST_CHECK(CheckCached(pubkey, vchSig, hash, true));
+        CSignatureCacheStats after = GetSignatureCacheStats();
+        BOOST_CHECK_EQUAL(after.nMisses, before.nMisses + 1);
+        BOOST_CHECK_EQUAL(after.nInserts, before.nInserts + 1);
+        BOOST_CHECK_EQUAL(after.nEntries, before.nEntries + 1);
+
+        // The block then finds it and frees the slot
+        BOOST_CHECK(CheckCached(pubkey, vchSig, hash, false));
+        CSignatureCacheStats block = GetSignatureCacheStats();
+        BOOST_CHECK_EQUAL(block.nHits, after.nHits + 1);
+        BOOST_CHECK_EQUAL(block.nEntries, before.nEntries);
+
+        // A second block lookup has to verify again, and still succeeds
+        BOOST_CHECK(CheckCached(pubkey, vchSig, hash, false));
+        BOOST_CHECK_EQUAL(GetSignatureCacheStats().nMisses, block.nMisses + 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_rejects_bad_signatures)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+
+    // Neither a different message nor a different key may hit the cache entry
+    BOOST_CHECK(CheckCached(pubkey, vchSig, hash, true));
+    BOOST_CHECK(!CheckCached(pubkey, vchSig, GetRandHash(), true));
+    CKey other;
+    other.MakeNewKey(true);
+    BOOST_CHECK(!CheckCached(other.GetPubKey(), vchSig, hash, true));
+
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    BOOST_CHECK(!CheckCached(pubkey, vchSig, GetRandHash(), true));
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().nInserts, stats.nInserts);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_disabled)
+{
+    mapArgs["-sigcachesize"] = "0";
+    InitSignatureCache();
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().nCapacity, 0U);
+
+    CKey key;
+    key.MakeNewKey(true);
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    BOOST_CHECK(CheckCached(key.GetPubKey(), vchSig, hash, true));
+    BOOST_CHECK(CheckCached(key.GetPubKey(), vchSig, hash, true));
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().nEntries, 0U);
+
+    mapArgs.erase("-sigcachesize");
+    InitSignatureCache();
+    BOOST_CHECK(GetSignatureCacheStats().nCapacity > 0);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_legacy_entries)
+{
+    // The deprecated option still counts signatures, not MiB
+    mapArgs["-maxsigcachesize"] = "50000";
+    InitSignatureCache();
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().nCapacity, 50000U);
+
+    // and yields to the new one
+    mapArgs["-sigcachesize"] = "1";
+    InitSignatureCache();
+    BOOST_CHECK(GetSignatureCacheStats().nCapacity > 30000U);
+    BOOST_CHECK(GetSignatureCacheStats().nCapacity < 50000U);
+
+    mapArgs.erase("-maxsigcachesize");
+    mapArgs.erase("-sigcachesize");
+    InitSignatureCache();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
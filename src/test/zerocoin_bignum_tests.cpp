@@ -87,4 +87,36 @@ BOOST_AUTO_TEST_CASE(bignum_random_generation_tests)
     }
 }
 
+BOOST_AUTO_TEST_CASE(bignum_fixed_base_tests)
+{
+    CBigNum modulus;
+    modulus.SetDec(zerocoinModulus);
+    CBigNum base = CBigNum::randBignum(modulus);
+    CBigNumFixedBase fixedBase(base, modulus, modulus.bitSize());
+    BOOST_CHECK(fixedBase.getMaxBits() >= (unsigned int)modulus.bitSize());
+
+    std::vector<CBigNum> vExponents;
+    vExponents.push_back(CBigNum(0));
+    vExponents.push_back(CBigNum(1));
+    vExponents.push_back(CBigNum(-1));
+    vExponents.push_back(modulus - 1);
+    for (int i = 0; i < 10; i++) {
+        vExponents.push_back(CBigNum::randKBitBignum(1 + i * modulus.bitSize() / 10));
+        vExponents.push_back(-CBigNum::randKBitBignum(256));
+    }
+    // Larger than the table, computed directly
+    vExponents.push_back(CBigNum::randKBitBignum(modulus.bitSize() + 100));
+
+    for (const CBigNum& e : vExponents) {
+        CBigNum expected = base.pow_mod(e, modulus);
+        BOOST_CHECK(fixedBase.pow_mod(e) == expected);
+        BOOST_CHECK(libzerocoin::FixedBasePowMod(base, e, modulus) == expected);
+
+        CBigNum other = CBigNum::randBignum(modulus);
+        CBigNum f = CBigNum::randKBitBignum(160);
+        BOOST_CHECK(base.mul_pow_mod(e, other, f, modulus) == base.pow_mod(e, modulus).mul_mod(other.pow_mod(f, modulus), modulus));
+        BOOST_CHECK(other.mul_pow_mod(f, base, e, modulus) == other.pow_mod(f, modulus).mul_mod(base.pow_mod(e, modulus), modulus));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -11,13 +11,16 @@
 #include "libzerocoin/Coin.h"
 #include "amount.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "coincontrol.h"
 #include "main.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #include "txdb.h"
 #include "test/test_wispr.h"
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 #include <iostream>
 
 
@@ -89,4 +92,82 @@ BOOST_AUTO_TEST_CASE(zerocoin_wrapped_serial_spend_test)
 
 }
 
+/**
+ * Check that spend proofs verified as queued checks accept and reject the same spends as inline verification.
+ */
+BOOST_AUTO_TEST_CASE(zerocoin_deferred_spend_check_test)
+{
+    libzerocoin::ZerocoinParams *ZCParams = Params().Zerocoin_Params(false);
+    libzerocoin::CoinDenomination denom = libzerocoin::CoinDenomination::ZQ_ONE;
+
+    std::vector<libzerocoin::PrivateCoin> vCoins;
+    for (unsigned int i = 0; i < 3; i++)
+        vCoins.emplace_back(libzerocoin::PrivateCoin(ZCParams, denom));
+
+    // The first coin is spent; the second accumulator does not contain it
+    libzerocoin::Accumulator acc(&ZCParams->accumulatorParams, denom);
+    libzerocoin::Accumulator accWithoutCoin(&ZCParams->accumulatorParams, denom);
+    libzerocoin::AccumulatorWitness accWitness(ZCParams, acc, vCoins[0].getPublicCoin());
+    for (unsigned int i = 0; i < vCoins.size(); i++) {
+        acc += vCoins[i].getPublicCoin();
+        if (i != 0) {
+            accWitness += vCoins[i].getPublicCoin();
+            accWithoutCoin += vCoins[i].getPublicCoin();
+        }
+    }
+
+    libzerocoin::CoinSpend spend(ZCParams, ZCParams, vCoins[0], acc, 0, accWitness, 0, libzerocoin::SpendType::SPEND);
+
+    // Only rejected when the serial range is verified
+    libzerocoin::PrivateCoin coinWrapped = vCoins[0];
+    coinWrapped.setSerialNumber(coinWrapped.getSerialNumber() + ZCParams->coinCommitmentGroup.groupOrder * CBigNum(2).pow(256) * 2);
+    libzerocoin::CoinSpend wrappedSerialSpend(ZCParams, ZCParams, coinWrapped, acc, 0, accWitness, 0, libzerocoin::SpendType::SPEND);
+
+    CTransaction tx;
+    std::vector<CZerocoinSpendCheck> vValid;
+    vValid.push_back(CZerocoinSpendCheck(tx, spend, acc, true));
+    vValid.push_back(CZerocoinSpendCheck(tx, wrappedSerialSpend, acc, false));
+    std::vector<CZerocoinSpendCheck> vInvalid;
+    vInvalid.push_back(CZerocoinSpendCheck(tx, spend, accWithoutCoin, true));
+    vInvalid.push_back(CZerocoinSpendCheck(tx, wrappedSerialSpend, acc, true));
+
+    BOOST_CHECK(spend.Verify(acc, true));
+    BOOST_CHECK(wrappedSerialSpend.Verify(acc, false));
+    BOOST_CHECK(!spend.Verify(accWithoutCoin, true));
+    BOOST_CHECK(!wrappedSerialSpend.Verify(acc, true));
+    for (unsigned int i = 0; i < vValid.size(); i++) {
+        CZerocoinSpendCheck check;
+        check.swap(vValid[i]);
+        BOOST_CHECK_MESSAGE(check(), "valid spend " << i << " rejected by its check");
+        check.swap(vValid[i]);
+    }
+    for (unsigned int i = 0; i < vInvalid.size(); i++) {
+        CZerocoinSpendCheck check;
+        check.swap(vInvalid[i]);
+        BOOST_CHECK_MESSAGE(!check(), "invalid spend " << i << " accepted by its check");
+        check.swap(vInvalid[i]);
+    }
+
+    // The same results through a check queue with worker threads
+    CCheckQueue<CZerocoinSpendCheck> queue(4);
+    boost::thread_group threads;
+    for (int i = 0; i < 2; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<CZerocoinSpendCheck>::Thread, &queue));
+    {
+        std::vector<CZerocoinSpendCheck> vChecks(vValid);
+        CCheckQueueControl<CZerocoinSpendCheck> control(&queue);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    for (unsigned int i = 0; i < vInvalid.size(); i++) {
+        std::vector<CZerocoinSpendCheck> vChecks(vValid);
+        vChecks.push_back(vInvalid[i]);
+        CCheckQueueControl<CZerocoinSpendCheck> control(&queue);
+        control.Add(vChecks);
+        BOOST_CHECK_MESSAGE(!control.Wait(), "invalid spend " << i << " accepted by the check queue");
+    }
+    threads.interrupt_all();
+    threads.join_all();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
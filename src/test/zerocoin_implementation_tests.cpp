@@ -507,4 +507,180 @@ BOOST_AUTO_TEST_CASE(deterministic_tests)
         }
 
 
+BOOST_AUTO_TEST_CASE(block_mints_index_test)
+{
+    CZerocoinDB db(1 << 20, true, true);
+    uint256 hashBlock = uint256(1);
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    BOOST_CHECK(!db.ReadBlockMints(hashBlock, listPubcoins));
+
+    std::list<libzerocoin::PublicCoin> listMints;
+    listMints.emplace_back(Params().Zerocoin_Params(false), CBigNum(1001), libzerocoin::CoinDenomination::ZQ_ONE);
+    listMints.emplace_back(Params().Zerocoin_Params(false), CBigNum(1002), libzerocoin::CoinDenomination::ZQ_FIVE);
+    BOOST_CHECK(db.WriteBlockMints(hashBlock, listMints));
+    BOOST_CHECK(db.ReadBlockMints(hashBlock, listPubcoins));
+    BOOST_CHECK_EQUAL(listPubcoins.size(), listMints.size());
+    auto it = listPubcoins.begin();
+    for (const libzerocoin::PublicCoin& mint : listMints) {
+        BOOST_CHECK(it->getValue() == mint.getValue());
+        BOOST_CHECK_EQUAL(it->getDenomination(), mint.getDenomination());
+        ++it;
+    }
+
+    // A block whose mints were all filtered out is indexed as empty, so it is not read again
+    BOOST_CHECK(db.WriteBlockMints(uint256(2), std::list<libzerocoin::PublicCoin>()));
+    BOOST_CHECK(db.ReadBlockMints(uint256(2), listPubcoins));
+    BOOST_CHECK(listPubcoins.empty());
+}
+
+BOOST_AUTO_TEST_CASE(zerocoindb_filter_test)
+{
+    CZerocoinDB db(1 << 20, true, true);
+    libzerocoin::PublicCoin pubcoin(Params().Zerocoin_Params(false), CBigNum(1001), libzerocoin::CoinDenomination::ZQ_ONE);
+    std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMints;
+    vMints.emplace_back(pubcoin, uint256(1));
+    BOOST_CHECK(db.WriteCoinMintBatch(vMints));
+
+    // Records written before the load are picked up by the scan
+    BOOST_CHECK(db.Write(std::make_pair('s', uint256(2)), uint256(3)));
+    BOOST_CHECK(db.LoadFilter());
+    size_t nSpends, nMints;
+    db.GetFilterSize(nSpends, nMints);
+    BOOST_CHECK_EQUAL(nSpends, 1U);
+    BOOST_CHECK_EQUAL(nMints, 1U);
+
+    uint256 hashTx;
+    BOOST_CHECK(db.ReadCoinMint(pubcoin.getValue(), hashTx));
+    BOOST_CHECK(hashTx == uint256(1));
+    BOOST_CHECK(db.ReadCoinSpend(uint256(2), hashTx));
+    BOOST_CHECK(hashTx == uint256(3));
+
+    // Keys the filter does not know are not read from the database
+    BOOST_CHECK(db.Write(std::make_pair('s', uint256(4)), uint256(5)));
+    BOOST_CHECK(!db.ReadCoinSpend(uint256(4), hashTx));
+
+    BOOST_CHECK(db.EraseCoinMint(pubcoin.getValue()));
+    BOOST_CHECK(!db.ReadCoinMint(pubcoin.getValue(), hashTx));
+    db.GetFilterSize(nSpends, nMints);
+    BOOST_CHECK_EQUAL(nMints, 0U);
+    BOOST_CHECK(db.WriteCoinMintBatch(vMints));
+    BOOST_CHECK(db.ReadCoinMint(pubcoin.getValue(), hashTx));
+}
+
+static void InitTestWitness(CoinWitnessData& witness, const CBigNum& bnValue, libzerocoin::CoinDenomination denom, int nHeightMintAdded)
+{
+    libzerocoin::ZerocoinParams* params = Params().Zerocoin_Params(false);
+    witness.denom = denom;
+    witness.coin = std::unique_ptr<libzerocoin::PublicCoin>(new libzerocoin::PublicCoin(params, bnValue, denom));
+    witness.pAccumulator = std::unique_ptr<libzerocoin::Accumulator>(new libzerocoin::Accumulator(params, denom));
+    witness.SetHeightMintAdded(nHeightMintAdded);
+}
+
+/** Lets a witness pass make nCallsMax - 1 progress callbacks and stops it on the next */
+struct CStopWitnessPass {
+    int* pnCalls;
+    int nCallsMax;
+
+    CStopWitnessPass(int* pnCallsIn, int nCallsMaxIn) : pnCalls(pnCallsIn), nCallsMax(nCallsMaxIn) {}
+
+    bool operator()(const std::vector<CoinWitnessData*>& vWitnesses) const
+    {
+        return ++*pnCalls < nCallsMax;
+    }
+};
+
+BOOST_AUTO_TEST_CASE(batch_witnesses_test)
+{
+    CZerocoinDB* zerocoinDBSaved = zerocoinDB;
+    zerocoinDB = new CZerocoinDB(1 << 20, true, true);
+    CBlockIndex* pindexTipSaved = chainActive.Tip();
+
+    // A chain whose blocks each mint one coin of 1 and every third block one of 5
+    const int nChainHeight = 40;
+    std::vector<uint256> vHashes(nChainHeight + 1);
+    std::vector<CBlockIndex> vBlocks(nChainHeight + 1);
+    for (int nHeight = 0; nHeight <= nChainHeight; nHeight++) {
+        vHashes[nHeight] = uint256(1000 + nHeight);
+        CBlockIndex& index = vBlocks[nHeight];
+        index.phashBlock = &vHashes[nHeight];
+        index.nHeight = nHeight;
+        index.pprev = nHeight ? &vBlocks[nHeight - 1] : nullptr;
+
+        std::list<libzerocoin::PublicCoin> listMints;
+        listMints.emplace_back(Params().Zerocoin_Params(false), CBigNum(10000 + nHeight), libzerocoin::CoinDenomination::ZQ_ONE);
+        if (nHeight % 3 == 0)
+            listMints.emplace_back(Params().Zerocoin_Params(false), CBigNum(20000 + nHeight), libzerocoin::CoinDenomination::ZQ_FIVE);
+        for (const libzerocoin::PublicCoin& mint : listMints)
+            index.mintsInBlock.Add(mint.getDenomination());
+        BOOST_CHECK(zerocoinDB->WriteBlockMints(vHashes[nHeight], listMints));
+    }
+    chainActive.SetTip(&vBlocks[nChainHeight]);
+
+    // Coins minted in the chain above, with the height their witness is accumulated to
+    const int nWitnesses = 3;
+    const CBigNum vValues[nWitnesses] = {CBigNum(10013), CBigNum(10021), CBigNum(20015)};
+    const libzerocoin::CoinDenomination vDenoms[nWitnesses] = {libzerocoin::CoinDenomination::ZQ_ONE, libzerocoin::CoinDenomination::ZQ_ONE, libzerocoin::CoinDenomination::ZQ_FIVE};
+    const int vHeightsMinted[nWitnesses] = {13, 21, 15};
+    const int vHeightsEnd[nWitnesses] = {29, 39, 34};
+
+    // One witness at a time
+    CoinWitnessData vSingle[nWitnesses];
+    for (int i = 0; i < nWitnesses; i++) {
+        InitTestWitness(vSingle[i], vValues[i], vDenoms[i], vHeightsMinted[i]);
+        std::vector<std::pair<CoinWitnessData*, int> > vRanges(1, std::make_pair(&vSingle[i], vHeightsEnd[i]));
+        BOOST_CHECK(AccumulateWitnesses(vRanges, WitnessProgressFn()));
+        BOOST_CHECK_EQUAL(vSingle[i].nHeightAccEnd, vHeightsEnd[i]);
+        BOOST_CHECK(vSingle[i].nMintsAdded > 0);
+    }
+
+    // All witnesses in one pass
+    CoinWitnessData vBatch[nWitnesses];
+    std::vector<std::pair<CoinWitnessData*, int> > vRanges;
+    for (int i = 0; i < nWitnesses; i++) {
+        InitTestWitness(vBatch[i], vValues[i], vDenoms[i], vHeightsMinted[i]);
+        vRanges.emplace_back(&vBatch[i], vHeightsEnd[i]);
+    }
+    BOOST_CHECK(AccumulateWitnesses(vRanges, WitnessProgressFn()));
+    for (int i = 0; i < nWitnesses; i++) {
+        BOOST_CHECK(vBatch[i].pAccumulator->getValue() == vSingle[i].pAccumulator->getValue());
+        BOOST_CHECK_EQUAL(vBatch[i].nMintsAdded, vSingle[i].nMintsAdded);
+        BOOST_CHECK_EQUAL(vBatch[i].nHeightAccEnd, vSingle[i].nHeightAccEnd);
+    }
+
+    // A pass that is stopped and resumed ends with the same witnesses
+    CoinWitnessData vResumed[nWitnesses];
+    vRanges.clear();
+    for (int i = 0; i < nWitnesses; i++) {
+        InitTestWitness(vResumed[i], vValues[i], vDenoms[i], vHeightsMinted[i]);
+        vRanges.emplace_back(&vResumed[i], vHeightsEnd[i]);
+    }
+    int nCalls = 0;
+    BOOST_CHECK(!AccumulateWitnesses(vRanges, CStopWitnessPass(&nCalls, 2)));
+    BOOST_CHECK_EQUAL(nCalls, 2);
+    BOOST_CHECK(vResumed[1].nHeightAccEnd < vHeightsEnd[1]);
+    BOOST_CHECK(AccumulateWitnesses(vRanges, WitnessProgressFn()));
+    for (int i = 0; i < nWitnesses; i++) {
+        BOOST_CHECK(vResumed[i].pAccumulator->getValue() == vSingle[i].pAccumulator->getValue());
+        BOOST_CHECK_EQUAL(vResumed[i].nMintsAdded, vSingle[i].nMintsAdded);
+        BOOST_CHECK_EQUAL(vResumed[i].nHeightAccEnd, vSingle[i].nHeightAccEnd);
+    }
+
+    // A batch stopped before its first witness is set up leaves the witness untouched
+    CoinWitnessData witnessNew;
+    witnessNew.coin = std::unique_ptr<libzerocoin::PublicCoin>(new libzerocoin::PublicCoin(Params().Zerocoin_Params(false), vValues[0], vDenoms[0]));
+    witnessNew.denom = vDenoms[0];
+    std::vector<CWitnessJob> vJobs(1, CWitnessJob(&witnessNew, nullptr));
+    AccumulatorMap mapAccumulators(Params().Zerocoin_Params(false));
+    nCalls = 0;
+    BOOST_CHECK(!GenerateAccumulatorWitnesses(vJobs, mapAccumulators, CStopWitnessPass(&nCalls, 1)));
+    BOOST_CHECK_EQUAL(nCalls, 1);
+    BOOST_CHECK(!vJobs[0].fDone);
+    BOOST_CHECK(vJobs[0].strError.empty());
+    BOOST_CHECK(!witnessNew.pAccumulator);
+
+    chainActive.SetTip(pindexTipSaved);
+    delete zerocoinDB;
+    zerocoinDB = zerocoinDBSaved;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
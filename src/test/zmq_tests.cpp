@@ -0,0 +1,99 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "streams.h"
+#include "version.h"
+#include "zmq/zmqpublishnotifier.h"
+#include "test/test_wispr.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#if ENABLE_ZMQ
+
+BOOST_FIXTURE_TEST_SUITE(zmq_tests, BasicTestingSetup)
+
+static CZMQOutgoingMessage TestMessage(void* psocket, size_t nSize, uint32_t nSequence)
+{
+    std::vector<char> vch(nSize, 'x');
+    CZMQOutgoingMessage msg;
+    msg.psocket = psocket;
+    msg.command = "rawtx";
+    msg.pdata = std::make_shared<const CDataStream>(vch.data(), vch.data() + vch.size(), SER_NETWORK, PROTOCOL_VERSION);
+    msg.nSequence = nSequence;
+    return msg;
+}
+
+BOOST_AUTO_TEST_CASE(zmq_queue_hwm_sequence_gap)
+{
+    int nSocket;
+    CZMQMessageQueue queue(3, MAX_ZMQ_QUEUE_BYTES);
+
+    // Like the notifiers, every message takes a sequence number whether or not it is queued
+    uint32_t nSequence = 0;
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket, 10, nSequence++)));
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket, 10, nSequence++)));
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket, 10, nSequence++)));
+    BOOST_CHECK(!queue.Push(TestMessage(&nSocket, 10, nSequence++)));
+    BOOST_CHECK(!queue.Push(TestMessage(&nSocket, 10, nSequence++)));
+    BOOST_CHECK_EQUAL(queue.Size(), 3U);
+    BOOST_CHECK_EQUAL(queue.Dropped(), 2U);
+
+    std::vector<uint32_t> vReceived;
+    CZMQOutgoingMessage msg;
+    BOOST_CHECK(queue.Pop(msg));
+    vReceived.push_back(msg.nSequence);
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket, 10, nSequence++)));
+    while (queue.Pop(msg))
+        vReceived.push_back(msg.nSequence);
+    BOOST_CHECK(queue.Empty());
+    BOOST_CHECK_EQUAL(queue.Bytes(), 0U);
+
+    // A subscriber sees the dropped messages as a gap in the sequence
+    std::vector<uint32_t> vExpected = {0, 1, 2, 5};
+    BOOST_CHECK(vReceived == vExpected);
+}
+
+BOOST_AUTO_TEST_CASE(zmq_queue_byte_limit)
+{
+    int nSocket;
+    CZMQMessageQueue queue(1000, 100);
+
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket, 60, 0)));
+    BOOST_CHECK(!queue.Push(TestMessage(&nSocket, 50, 1)));
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket, 40, 2)));
+    BOOST_CHECK_EQUAL(queue.Bytes(), 100U);
+    BOOST_CHECK_EQUAL(queue.Dropped(), 1U);
+
+    // Room is made as the sender takes messages
+    CZMQOutgoingMessage msg;
+    BOOST_CHECK(queue.Pop(msg));
+    BOOST_CHECK_EQUAL(msg.nSequence, 0U);
+    BOOST_CHECK_EQUAL(queue.Bytes(), 40U);
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket, 50, 3)));
+    BOOST_CHECK_EQUAL(queue.Bytes(), 90U);
+}
+
+BOOST_AUTO_TEST_CASE(zmq_queue_erase_socket)
+{
+    int nSocket1, nSocket2;
+    CZMQMessageQueue queue(1000, MAX_ZMQ_QUEUE_BYTES);
+
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket1, 10, 0)));
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket2, 20, 0)));
+    BOOST_CHECK(queue.Push(TestMessage(&nSocket1, 30, 1)));
+    queue.EraseSocket(&nSocket1);
+    BOOST_CHECK_EQUAL(queue.Size(), 1U);
+    BOOST_CHECK_EQUAL(queue.Bytes(), 20U);
+
+    CZMQOutgoingMessage msg;
+    BOOST_CHECK(queue.Pop(msg));
+    BOOST_CHECK(msg.psocket == &nSocket2);
+    BOOST_CHECK(!queue.Pop(msg));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif // ENABLE_ZMQ
@@ -0,0 +1,50 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WISPR_TIMESTAMPINDEX_H
+#define WISPR_TIMESTAMPINDEX_H
+
+#include "addressindex.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** Default for -timestampindex */
+static const bool DEFAULT_TIMESTAMPINDEX = false;
+
+/** A block of the active chain, sorted by its timestamp */
+struct CTimestampIndexKey {
+    unsigned int timestamp;
+    uint256 blockHash;
+
+    CTimestampIndexKey(unsigned int time, const uint256& hash) : timestamp(time), blockHash(hash) {}
+
+    CTimestampIndexKey() { SetNull(); }
+
+    void SetNull()
+    {
+        timestamp = 0;
+        blockHash.SetNull();
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 36;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        SerializeHeightBE(s, timestamp);
+        blockHash.Serialize(s, nType, nVersion);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        timestamp = UnserializeHeightBE(s);
+        blockHash.Unserialize(s, nType, nVersion);
+    }
+};
+
+#endif // WISPR_TIMESTAMPINDEX_H
@@ -6,22 +6,63 @@
 
 #include "txdb.h"
 
+#include "guiinterface.h"
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
 #include "zpiv/accumulators.h"
 
+#include <algorithm>
+#include <atomic>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
 
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
+/**
+ * The chainstate keeps one 'C' record per unspent outpoint. All outputs of a
+ * transaction share the key prefix 'C' + txid, so they can be collected back
+ * into a CCoins with a single seek.
+ */
+static const char DB_COIN = 'C';
+//! Per-transaction CCoins records written by older versions, see CCoinsViewDB::Upgrade
+static const char DB_COINS_LEGACY = 'c';
+
+/** Optional indexes in the block tree database, see -addressindex, -spentindex and -timestampindex */
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_SPENTINDEX = 'p';
+static const char DB_TIMESTAMPINDEX = 's';
+//! CUtxoStats of every connected block
+static const char DB_UTXOSTATS = 'U';
+
+static bool IsCoinKeyFor(const leveldb::Slice& slKey, const uint256& txid)
+{
+    return slKey.size() > 1 + sizeof(uint256) && slKey[0] == DB_COIN &&
+           memcmp(slKey.data() + 1, txid.begin(), sizeof(uint256)) == 0;
+}
+
+void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoinsCacheEntry& entry, const CCoins& coinsOnDisk, size_t& nChangedOutputs)
 {
-    if (coins.IsPruned()){
-        batch.Erase(std::make_pair('c', hash));
-    }else{
-        batch.Write(std::make_pair('c', hash), coins);
+    const CCoins& coins = entry.coins;
+    // Spent outputs may lie past the end of vout once it has been cleaned up.
+    // Past bit 63 the dirty mask is not precise, so compare with what is on disk.
+    size_t nOutputs = std::max(coins.vout.size(), coinsOnDisk.vout.size());
+    for (unsigned int i = 0; i < 63; i++) {
+        if (entry.IsOutputDirty(i))
+            nOutputs = std::max<size_t>(nOutputs, i + 1);
+    }
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        if (!(entry.flags & CCoinsCacheEntry::FRESH) && !entry.IsOutputDirty(i))
+            continue;
+        bool fAvailable = i < coins.vout.size() && !coins.vout[i].IsNull();
+        if (fAvailable) {
+            batch.Write(std::make_pair(DB_COIN, COutPoint(hash, i)), Coin(coins, i));
+            nChangedOutputs++;
+        } else if (!(entry.flags & CCoinsCacheEntry::FRESH)) {
+            batch.Erase(std::make_pair(DB_COIN, COutPoint(hash, i)));
+            nChangedOutputs++;
+        }
     }
 }
 
@@ -30,18 +71,53 @@ void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db("chainstate", GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
 {
 }
 
 bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
 {
-    return db.Read(std::make_pair('c', txid), coins);
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair(DB_COIN, COutPoint(txid, 0));
+    pcursor->Seek(ssKeySet.str());
+
+    coins.Clear();
+    bool fFound = false;
+    for (; pcursor->Valid() && IsCoinKeyFor(pcursor->key(), txid); pcursor->Next()) {
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            COutPoint outpoint;
+            ssKey >> chType >> outpoint;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            Coin coin;
+            ssValue >> coin;
+
+            if (coins.vout.size() <= outpoint.n)
+                coins.vout.resize(outpoint.n + 1);
+            coins.vout[outpoint.n] = coin.out;
+            coins.nHeight = coin.nHeight;
+            coins.nVersion = coin.nVersion;
+            coins.fCoinBase = coin.fCoinBase;
+            coins.fCoinStake = coin.fCoinStake;
+            fFound = true;
+        } catch (const std::exception& e) {
+            throw std::runtime_error(strprintf("%s : Deserialize or I/O error - %s", __func__, e.what()));
+        }
+    }
+    return fFound;
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256& txid) const
 {
-    return db.Exists(std::make_pair('c', txid));
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair(DB_COIN, COutPoint(txid, 0));
+    pcursor->Seek(ssKeySet.str());
+    return pcursor->Valid() && IsCoinKeyFor(pcursor->key(), txid);
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
@@ -53,14 +129,23 @@ uint256 CCoinsViewDB::GetBestBlock() const
     return hashBestChain;
 }
 
+void CCoinsViewDB::BatchWriteEntry(CLevelDBBatch& batch, const uint256& txid, const CCoinsCacheEntry& entry, size_t& nChangedOutputs) const
+{
+    CCoins coinsOnDisk;
+    if (!(entry.flags & CCoinsCacheEntry::FRESH) && entry.IsOutputDirty(63))
+        GetCoins(txid, coinsOnDisk);
+    BatchWriteCoins(batch, txid, entry, coinsOnDisk, nChangedOutputs);
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
 {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
+    size_t nChangedOutputs = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            BatchWriteEntry(batch, it->first, it->second, nChangedOutputs);
             changed++;
         }
         count++;
@@ -71,11 +156,262 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
         BatchWriteHashBestChain(batch, hashBlock);
     }
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", static_cast<unsigned int>(changed), static_cast<unsigned int>(count));
+    LogPrint("coindb", "Committing %u changed outputs of %u changed transactions (out of %u) to coin database...\n", static_cast<unsigned int>(nChangedOutputs), static_cast<unsigned int>(changed), static_cast<unsigned int>(count));
+    return db.WriteBatch(batch);
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock, size_t& nChangedOutputs, size_t& nBytes)
+{
+    CLevelDBBatch batch;
+    size_t changed = 0;
+    nChangedOutputs = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            BatchWriteEntry(batch, it->first, it->second, nChangedOutputs);
+            changed++;
+        }
+    }
+    if (hashBlock != uint256(0)){
+        BatchWriteHashBestChain(batch, hashBlock);
+    }
+    nBytes = batch.SizeEstimate();
+
+    LogPrint("coindb", "Committing %u changed outputs of %u changed transactions (out of %u) to coin database...\n", static_cast<unsigned int>(nChangedOutputs), static_cast<unsigned int>(changed), static_cast<unsigned int>(mapCoins.size()));
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
+bool CCoinsViewDB::Upgrade()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COINS_LEGACY;
+    pcursor->Seek(ssKeySet.str());
+    if (!pcursor->Valid() || pcursor->key()[0] != DB_COINS_LEGACY)
+        return true;
+
+    LogPrintf("Upgrading the coin database to per-output records...\n");
+    uiInterface.InitMessage(_("Upgrading coin database..."));
+    int64_t nStart = GetTimeMillis();
+    size_t nTransactions = 0, nOutputs = 0;
+    CLevelDBBatch batch;
+    for (; pcursor->Valid() && pcursor->key()[0] == DB_COINS_LEGACY; pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            uint256 txid;
+            ssKey >> chType >> txid;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (!coins.vout[i].IsNull()) {
+                    batch.Write(std::make_pair(DB_COIN, COutPoint(txid, i)), Coin(coins, i));
+                    nOutputs++;
+                }
+            }
+            batch.Erase(std::make_pair(DB_COINS_LEGACY, txid));
+        } catch (const std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+
+        // The conversion is resumable, so it can be committed in pieces
+        if (++nTransactions % 10000 == 0) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+            LogPrintf("Upgrading the coin database: %u transactions converted\n", nTransactions);
+        }
+    }
+    if (!db.WriteBatch(batch))
+        return false;
+    LogPrintf("Upgraded %u transactions with %u unspent outputs in the coin database in %dms\n", nTransactions, nOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
+CCoinsViewBackgroundFlush::CCoinsViewBackgroundFlush(CCoinsViewDB* dbIn) : db(dbIn), fPending(false), fFailed(false), fStop(false), stats()
+{
+    thread = boost::thread(boost::bind(&CCoinsViewBackgroundFlush::ThreadWrite, this));
+}
+
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush()
+{
+    {
+        WaitableLock lock(cs);
+        WaitIdle(lock);
+        fStop = true;
+    }
+    cvPending.notify_all();
+    thread.join();
+}
+
+void CCoinsViewBackgroundFlush::ThreadWrite()
+{
+    RenameThread("wispr-coinsflush");
+    WaitableLock lock(cs);
+    while (true) {
+        while (!fStop && (!fPending || fFailed))
+            cvPending.wait(lock);
+        if (fStop)
+            return;
+        uint256 hashBlock = hashPending;
+        lock.unlock();
+
+        // Nobody modifies mapPending until fPending is cleared, so it can be read without the lock
+        int64_t nStart = GetTimeMillis();
+        size_t nOutputs = 0;
+        size_t nBytes = 0;
+        bool fOk = false;
+        try {
+            fOk = db->WriteCoins(mapPending, hashBlock, nOutputs, nBytes);
+        } catch (const std::exception& e) {
+            LogPrintf("%s : %s\n", __func__, e.what());
+        }
+        int64_t nMillis = GetTimeMillis() - nStart;
+
+        if (!fOk) {
+            // The coins stay visible through mapPending; every later flush fails
+            AbortNode("Failed to write to coin database");
+            lock.lock();
+            fFailed = true;
+            cvPending.notify_all();
+            continue;
+        }
+
+        CCoinsMap mapWritten;
+        std::vector<boost::function<void()> > vNotify;
+        lock.lock();
+        stats.nFlushes++;
+        stats.nLastEntries = mapPending.size();
+        stats.nLastOutputs = nOutputs;
+        stats.nLastBytes = nBytes;
+        stats.nLastMillis = nMillis;
+        stats.nMaxMillis = std::max(stats.nMaxMillis, nMillis);
+        stats.nTotalMillis += nMillis;
+        mapWritten.swap(mapPending);
+        vNotify.swap(vOnWritten);
+        fPending = false;
+        cvPending.notify_all();
+        lock.unlock();
+
+        LogPrint("coindb", "Wrote %u outputs (%u bytes) to the coin database in the background in %dms\n", nOutputs, nBytes, nMillis);
+        // Free the written coins and notify outside the lock
+        CCoinsMap().swap(mapWritten);
+        for (const boost::function<void()>& func : vNotify)
+            func();
+        lock.lock();
+    }
+}
+
+bool CCoinsViewBackgroundFlush::WaitIdle(WaitableLock& lock) const
+{
+    while (fPending && !fFailed)
+        cvPending.wait(lock);
+    return !fFailed;
+}
+
+bool CCoinsViewBackgroundFlush::GetCoins(const uint256& txid, CCoins& coins) const
+{
+    {
+        WaitableLock lock(cs);
+        if (fPending) {
+            CCoinsMap::const_iterator it = mapPending.find(txid);
+            if (it != mapPending.end()) {
+                coins = it->second.coins;
+                return true;
+            }
+        }
+    }
+    return db->GetCoins(txid, coins);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoins(const uint256& txid) const
+{
+    {
+        WaitableLock lock(cs);
+        if (fPending) {
+            CCoinsMap::const_iterator it = mapPending.find(txid);
+            if (it != mapPending.end())
+                return !it->second.coins.IsPruned();
+        }
+    }
+    return db->HaveCoins(txid);
+}
+
+uint256 CCoinsViewBackgroundFlush::GetBestBlock() const
+{
+    {
+        WaitableLock lock(cs);
+        if (fPending && hashPending != uint256(0))
+            return hashPending;
+    }
+    return db->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    WaitableLock lock(cs);
+    int64_t nStart = GetTimeMillis();
+    if (!WaitIdle(lock))
+        return false;
+    stats.nWaitMillis += GetTimeMillis() - nStart;
+    // The empty map left behind here is swapped back to the caller
+    mapPending.swap(mapCoins);
+    hashPending = hashBlock;
+    fPending = true;
+    cvPending.notify_all();
+    return true;
+}
+
+bool CCoinsViewBackgroundFlush::GetStats(CCoinsStats& statsOut) const
+{
+    {
+        WaitableLock lock(cs);
+        if (!WaitIdle(lock))
+            return false;
+    }
+    return db->GetStats(statsOut);
+}
+
+bool CCoinsViewBackgroundFlush::Wait()
+{
+    WaitableLock lock(cs);
+    int64_t nStart = GetTimeMillis();
+    bool fOk = WaitIdle(lock);
+    stats.nWaitMillis += GetTimeMillis() - nStart;
+    return fOk;
+}
+
+void CCoinsViewBackgroundFlush::OnWritten(const boost::function<void()>& func)
+{
+    {
+        WaitableLock lock(cs);
+        if (fPending) {
+            vOnWritten.push_back(func);
+            return;
+        }
+    }
+    func();
+}
+
+unsigned int CCoinsViewBackgroundFlush::GetPendingSize() const
+{
+    WaitableLock lock(cs);
+    return fPending ? mapPending.size() : 0;
+}
+
+CCoinsFlushStats CCoinsViewBackgroundFlush::GetFlushStats() const
+{
+    WaitableLock lock(cs);
+    CCoinsFlushStats ret = stats;
+    ret.fPending = fPending;
+    return ret;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper("blockindex", GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
 {
 }
 
@@ -127,13 +463,36 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
+            if (chType == DB_COIN) {
+                // Collect the outputs of one transaction and hash them in the
+                // same per-transaction layout as before
                 uint256 txhash;
-                ssKey >> txhash;
+                CCoins coins;
+                while (pcursor->Valid()) {
+                    leveldb::Slice slCoinKey = pcursor->key();
+                    if (!coins.vout.empty() && !IsCoinKeyFor(slCoinKey, txhash))
+                        break;
+                    CDataStream ssCoinKey(slCoinKey.data(), slCoinKey.data() + slCoinKey.size(), SER_DISK, CLIENT_VERSION);
+                    COutPoint outpoint;
+                    ssCoinKey >> chType;
+                    if (chType != DB_COIN)
+                        break;
+                    ssCoinKey >> outpoint;
+                    leveldb::Slice slValue = pcursor->value();
+                    CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                    Coin coin;
+                    ssValue >> coin;
+                    txhash = outpoint.hash;
+                    if (coins.vout.size() <= outpoint.n)
+                        coins.vout.resize(outpoint.n + 1);
+                    coins.vout[outpoint.n] = coin.out;
+                    coins.nHeight = coin.nHeight;
+                    coins.nVersion = coin.nVersion;
+                    coins.fCoinBase = coin.fCoinBase;
+                    coins.fCoinStake = coin.fCoinStake;
+                    stats.nSerializedSize += slCoinKey.size() + slValue.size();
+                    pcursor->Next();
+                }
                 ss << txhash;
                 ss << VARINT(coins.nVersion);
                 ss << (coins.fCoinBase ? 'c' : 'n');
@@ -148,8 +507,8 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
                         nTotalAmount += out.nValue;
                     }
                 }
-                stats.nSerializedSize += 32 + slValue.size();
                 ss << VARINT(0);
+                continue;
             }
             pcursor->Next();
         } catch (std::exception& e) {
@@ -162,6 +521,44 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     return true;
 }
 
+bool CCoinsViewDB::ComputeUtxoStats(CUtxoStats& stats) const
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COIN;
+    pcursor->Seek(ssKeySet.str());
+
+    stats = CUtxoStats();
+    stats.hashBlock = GetBestBlock();
+    uint256 hashLastTx;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != DB_COIN)
+                break;
+            COutPoint outpoint;
+            ssKey >> outpoint;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            Coin coin;
+            ssValue >> coin;
+            // The outputs of a transaction are next to each other
+            if (stats.nTransactionOutputs == 0 || outpoint.hash != hashLastTx)
+                stats.nTransactions++;
+            hashLastTx = outpoint.hash;
+            stats.AddCoin(outpoint, coin);
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CLevelDBBatch batch;
     for (const auto & it : fileInfo) {
@@ -188,6 +585,178 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    CLevelDBBatch batch;
+    for (const auto& it : vect)
+        batch.Write(std::make_pair(DB_ADDRESSINDEX, it.first), it.second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
+{
+    CLevelDBBatch batch;
+    for (const auto& it : vect)
+        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it.first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int nStart, int nEnd)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (nStart > 0 && nEnd > 0)
+        ssKeySet << std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash, nStart));
+    else
+        ssKeySet << std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != DB_ADDRESSINDEX)
+                break;
+            CAddressIndexKey key;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != addressHash)
+                break;
+            if (nEnd > 0 && key.blockHeight > nEnd)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            vect.push_back(std::make_pair(key, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (const auto& it : vect) {
+        if (it.second.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it.first));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it.first), it.second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != DB_ADDRESSUNSPENTINDEX)
+                break;
+            CAddressUnspentKey key;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != addressHash)
+                break;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vect.push_back(std::make_pair(key, value));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (const auto& it : vect) {
+        if (it.second.IsNull())
+            batch.Erase(std::make_pair(DB_SPENTINDEX, it.first));
+        else
+            batch.Write(std::make_pair(DB_SPENTINDEX, it.first), it.second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    return Read(std::make_pair(DB_SPENTINDEX, key), value);
+}
+
+bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey& key)
+{
+    // All there is to know is in the key
+    return Write(std::make_pair(DB_TIMESTAMPINDEX, key), '0');
+}
+
+bool CBlockTreeDB::EraseTimestampIndex(const CTimestampIndexKey& key)
+{
+    return Erase(std::make_pair(DB_TIMESTAMPINDEX, key));
+}
+
+bool CBlockTreeDB::ReadTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& vHashes)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(nLow, uint256(0)));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != DB_TIMESTAMPINDEX)
+                break;
+            CTimestampIndexKey key;
+            ssKey >> key;
+            if (key.timestamp >= nHigh)
+                break;
+            vHashes.push_back(key.blockHash);
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteUtxoStats(const uint256& hashBlock, const CUtxoStats& stats)
+{
+    return Write(std::make_pair(DB_UTXOSTATS, hashBlock), stats);
+}
+
+bool CBlockTreeDB::ReadUtxoStats(const uint256& hashBlock, CUtxoStats& stats)
+{
+    if (!Read(std::make_pair(DB_UTXOSTATS, hashBlock), stats))
+        return false;
+    stats.hashBlock = hashBlock;
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -213,8 +782,60 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+/**
+ * Check the scrypt proof of work of vIndex[nBegin, nEnd). On failure nFirstFailure is lowered to the
+ * failing position; positions at or above the current failure are skipped, so after all workers are
+ * joined nFirstFailure is the lowest failing position regardless of thread scheduling.
+ */
+static void CheckIndexProofOfWorkRange(const std::vector<const CBlockIndex*>& vIndex, size_t nBegin, size_t nEnd, std::atomic<size_t>& nFirstFailure)
+{
+    // Headers are hashed in small groups so the multi-lane scrypt kernels can be used
+    static const size_t nGroupSize = 16;
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<uint256> vHashes;
+    for (size_t nGroup = nBegin; nGroup < nEnd && nGroup < nFirstFailure.load(); nGroup += nGroupSize) {
+        size_t nGroupEnd = std::min(nGroup + nGroupSize, nEnd);
+        vHeaders.clear();
+        for (size_t i = nGroup; i < nGroupEnd; i++)
+            vHeaders.push_back(vIndex[i]->GetBlockHeader());
+        GetPoWHashes(vHeaders, vHashes);
+
+        for (size_t i = nGroup; i < nGroupEnd; i++) {
+            if (!CheckProofOfWork(vHashes[i - nGroup], vIndex[i]->nBits)) {
+                size_t nPrev = nFirstFailure.load();
+                while (i < nPrev && !nFirstFailure.compare_exchange_weak(nPrev, i)) {}
+                return;
+            }
+        }
+    }
+}
+
+/** Verify the proof of work of all loaded PoW headers, spread over the -par script check thread budget */
+static bool CheckIndexProofOfWork(const std::vector<const CBlockIndex*>& vIndex, int nThreads)
+{
+    std::atomic<size_t> nFirstFailure(vIndex.size());
+    nThreads = std::max(1, std::min<int>(nThreads, vIndex.size()));
+
+    if (nThreads == 1) {
+        CheckIndexProofOfWorkRange(vIndex, 0, vIndex.size(), nFirstFailure);
+    } else {
+        boost::thread_group workers;
+        size_t nChunk = (vIndex.size() + nThreads - 1) / nThreads;
+        for (size_t nBegin = 0; nBegin < vIndex.size(); nBegin += nChunk) {
+            size_t nEnd = std::min(nBegin + nChunk, vIndex.size());
+            workers.create_thread(boost::bind(&CheckIndexProofOfWorkRange, boost::cref(vIndex), nBegin, nEnd, boost::ref(nFirstFailure)));
+        }
+        workers.join_all();
+    }
+
+    if (nFirstFailure.load() < vIndex.size())
+        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", vIndex[nFirstFailure.load()]->ToString());
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts()
 {
+    int64_t nStart = GetTimeMillis();
     boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
 
     CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
@@ -223,6 +844,8 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
     // Load mapBlockIndex
     uint256 nPreviousCheckpoint;
+    size_t nLoaded = 0;
+    std::vector<const CBlockIndex*> vPoWIndex;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -254,8 +877,8 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
                 //zerocoin
                 pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-                pindexNew->mapZerocoinSupply = diskindex.mapZerocoinSupply;
-                pindexNew->vMintDenominationsInBlock = diskindex.vMintDenominationsInBlock;
+                pindexNew->zerocoinSupply = diskindex.zerocoinSupply;
+                pindexNew->mintsInBlock = diskindex.mintsInBlock;
 
                 //Proof Of Stake
                 pindexNew->nMint = diskindex.nMint;
@@ -267,10 +890,10 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nStakeTime = diskindex.nStakeTime;
                 pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
 
-                if (pindexNew->IsProofOfWork()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHeader().GetPoWHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
+                // scrypt checks are deferred until all headers are linked so they can run in parallel
+                if (pindexNew->IsProofOfWork())
+                    vPoWIndex.push_back(pindexNew);
+                nLoaded++;
 
                 //populate accumulator checksum map in memory
                 if(pindexNew->nAccumulatorCheckpoint != 0 && pindexNew->nAccumulatorCheckpoint != nPreviousCheckpoint) {
@@ -291,25 +914,102 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
         }
     }
 
+    int64_t nLoadTime = GetTimeMillis() - nStart;
+    int nThreads = std::max(1, nScriptCheckThreads);
+    if (!CheckIndexProofOfWork(vPoWIndex, nThreads))
+        return false;
+
+    LogPrintf("%s : loaded %u block index entries in %dms, verified %u PoW headers using %d threads in %dms\n", __func__,
+        nLoaded, nLoadTime, vPoWIndex.size(), nThreads, GetTimeMillis() - nStart - nLoadTime);
+    return true;
+}
+
+CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper("zerocoin", GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe), fFilterLoaded(false)
+{
+}
+
+CZerocoinDB::HashSet& CZerocoinDB::FilterFor(char chType)
+{
+    return chType == 's' ? setSpendHashes : setMintHashes;
+}
+
+bool CZerocoinDB::FilterMayContain(char chType, const uint256& hash)
+{
+    LOCK(cs_filter);
+    return !fFilterLoaded || FilterFor(chType).count(hash);
+}
+
+bool CZerocoinDB::ScanKeys(char chType, std::vector<uint256>& vHashes)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << std::make_pair(chType, uint256(0));
+    pcursor->Seek(ssKeySet.str());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chKeyType;
+            ssKey >> chKeyType;
+            if (chKeyType != chType)
+                break;
+            uint256 hash;
+            ssKey >> hash;
+            vHashes.push_back(hash);
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CZerocoinDB::LoadFilter()
+{
+    int64_t nStart = GetTimeMillis();
+    // Scanned without the lock; records written meanwhile are added to the
+    // sets by the writers themselves, and keys erased meanwhile at worst
+    // come back as a harmless extra entry
+    std::vector<uint256> vSpends, vMints;
+    if (!ScanKeys('s', vSpends) || !ScanKeys('m', vMints))
+        return false;
+
+    LOCK(cs_filter);
+    setSpendHashes.reserve(setSpendHashes.size() + vSpends.size());
+    setSpendHashes.insert(vSpends.begin(), vSpends.end());
+    setMintHashes.reserve(setMintHashes.size() + vMints.size());
+    setMintHashes.insert(vMints.begin(), vMints.end());
+    fFilterLoaded = true;
+    LogPrintf("%s : loaded %u spent serials and %u pubcoins in %dms\n", __func__,
+        setSpendHashes.size(), setMintHashes.size(), GetTimeMillis() - nStart);
     return true;
 }
 
-CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe)
+void CZerocoinDB::GetFilterSize(size_t& nSpends, size_t& nMints)
 {
+    LOCK(cs_filter);
+    nSpends = setSpendHashes.size();
+    nMints = setMintHashes.size();
 }
 
 bool CZerocoinDB::WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo)
 {
     CLevelDBBatch batch;
-    size_t count = 0;
+    std::vector<uint256> vHashes;
+    vHashes.reserve(mintInfo.size());
     for (const auto & it : mintInfo) {
         libzerocoin::PublicCoin pubCoin = it.first;
         uint256 hash = GetPubCoinHash(pubCoin.getValue());
         batch.Write(std::make_pair('m', hash), it.second);
-        ++count;
+        vHashes.push_back(hash);
     }
 
-    LogPrint("zero", "Writing %u coin mints to db.\n", static_cast<unsigned int>(count));
+    LogPrint("zero", "Writing %u coin mints to db.\n", static_cast<unsigned int>(vHashes.size()));
+    // Added first, a failed write only leaves extra entries behind
+    LOCK(cs_filter);
+    setMintHashes.insert(vHashes.begin(), vHashes.end());
     return WriteBatch(batch, true);
 }
 
@@ -320,29 +1020,59 @@ bool CZerocoinDB::ReadCoinMint(const CBigNum& bnPubcoin, uint256& hashTx)
 
 bool CZerocoinDB::ReadCoinMint(const uint256& hashPubcoin, uint256& hashTx)
 {
+    if (!FilterMayContain('m', hashPubcoin))
+        return false;
     return Read(std::make_pair('m', hashPubcoin), hashTx);
 }
 
 bool CZerocoinDB::EraseCoinMint(const CBigNum& bnPubcoin)
 {
     uint256 hash = GetPubCoinHash(bnPubcoin);
-    return Erase(std::make_pair('m', hash));
+    LOCK(cs_filter);
+    if (!Erase(std::make_pair('m', hash)))
+        return false;
+    setMintHashes.erase(hash);
+    return true;
+}
+
+bool CZerocoinDB::WriteBlockMints(const uint256& hashBlock, const std::list<libzerocoin::PublicCoin>& listPubcoins)
+{
+    std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> > vMints;
+    vMints.reserve(listPubcoins.size());
+    for (const libzerocoin::PublicCoin& pubcoin : listPubcoins)
+        vMints.emplace_back(pubcoin.getDenomination(), pubcoin.getValue());
+    // Entries are keyed by block hash, so they stay correct across reorgs and are never erased
+    return Write(std::make_pair('b', hashBlock), vMints);
+}
+
+bool CZerocoinDB::ReadBlockMints(const uint256& hashBlock, std::list<libzerocoin::PublicCoin>& listPubcoins)
+{
+    std::vector<std::pair<libzerocoin::CoinDenomination, CBigNum> > vMints;
+    if (!Read(std::make_pair('b', hashBlock), vMints))
+        return false;
+    listPubcoins.clear();
+    for (const auto& mint : vMints)
+        listPubcoins.emplace_back(Params().Zerocoin_Params(false), mint.second, mint.first);
+    return true;
 }
 
 bool CZerocoinDB::WriteCoinSpendBatch(const std::vector<std::pair<libzerocoin::CoinSpend, uint256> >& spendInfo)
 {
     CLevelDBBatch batch;
-    size_t count = 0;
+    std::vector<uint256> vHashes;
+    vHashes.reserve(spendInfo.size());
     for (const auto & it : spendInfo) {
         CBigNum bnSerial = it.first.getCoinSerialNumber();
         CDataStream ss(SER_GETHASH, 0);
         ss << bnSerial;
         uint256 hash = Hash(ss.begin(), ss.end());
         batch.Write(std::make_pair('s', hash), it.second);
-        ++count;
+        vHashes.push_back(hash);
     }
 
-    LogPrint("zero", "Writing %u coin spends to db.\n", static_cast<unsigned int>(count));
+    LogPrint("zero", "Writing %u coin spends to db.\n", static_cast<unsigned int>(vHashes.size()));
+    LOCK(cs_filter);
+    setSpendHashes.insert(vHashes.begin(), vHashes.end());
     return WriteBatch(batch, true);
 }
 
@@ -352,11 +1082,13 @@ bool CZerocoinDB::ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash)
     ss << bnSerial;
     uint256 hash = Hash(ss.begin(), ss.end());
 
-    return Read(std::make_pair('s', hash), txHash);
+    return ReadCoinSpend(hash, txHash);
 }
 
 bool CZerocoinDB::ReadCoinSpend(const uint256& hashSerial, uint256 &txHash)
 {
+    if (!FilterMayContain('s', hashSerial))
+        return false;
     return Read(std::make_pair('s', hashSerial), txHash);
 }
 
@@ -366,7 +1098,11 @@ bool CZerocoinDB::EraseCoinSpend(const CBigNum& bnSerial)
     ss << bnSerial;
     uint256 hash = Hash(ss.begin(), ss.end());
 
-    return Erase(std::make_pair('s', hash));
+    LOCK(cs_filter);
+    if (!Erase(std::make_pair('s', hash)))
+        return false;
+    setSpendHashes.erase(hash);
+    return true;
 }
 
 bool CZerocoinDB::WipeCoins(const std::string& strType)
@@ -405,10 +1141,13 @@ bool CZerocoinDB::WipeCoins(const std::string& strType)
         }
     }
 
+    LOCK(cs_filter);
     for (auto& hash : setDelete) {
         if (!Erase(std::make_pair(type, hash))){
             LogPrintf("%s: error failed to delete %s\n", __func__, hash.GetHex());
+            continue;
         }
+        FilterFor(type).erase(hash);
     }
 
     return true;
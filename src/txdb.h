@@ -7,15 +7,23 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "spentindex.h"
+#include "timestampindex.h"
 #include "zpiv/zerocoin.h"
 
+#include <list>
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_set.hpp>
+
 class CCoins;
 class uint256;
 
@@ -32,6 +40,8 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CLevelDBWrapper db;
 
+    void BatchWriteEntry(CLevelDBBatch& batch, const uint256& txid, const CCoinsCacheEntry& entry, size_t& nChangedOutputs) const;
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -40,6 +50,86 @@ public:
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+    //! Hash the whole chainstate, for databases from before the per-block CUtxoStats
+    bool ComputeUtxoStats(CUtxoStats& stats) const;
+
+    //! Like BatchWrite, but leaves mapCoins untouched so it can be read meanwhile
+    bool WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock, size_t& nChangedOutputs, size_t& nBytes);
+
+    //! Convert per-transaction records left by older versions to per-output records
+    bool Upgrade();
+};
+
+/** Size and timing of chainstate writes, see getflushinfo */
+struct CCoinsFlushStats {
+    uint64_t nFlushes;
+    //! cache entries handed over by the last flush
+    uint64_t nLastEntries;
+    //! outputs written or erased by the last flush
+    uint64_t nLastOutputs;
+    //! bytes of keys and values written by the last flush
+    uint64_t nLastBytes;
+    int64_t nLastMillis;
+    int64_t nMaxMillis;
+    int64_t nTotalMillis;
+    //! time validation spent waiting for an earlier write to finish
+    int64_t nWaitMillis;
+    bool fPending;
+};
+
+/**
+ * Writes flushed coins to the coin database on a background thread.
+ *
+ * BatchWrite takes over the flushed map and returns at once, so validation
+ * continues while the coins are written. Until the write is done, lookups
+ * are answered from that map before the database. Writes happen one at a
+ * time and in order: a flush first waits for the previous one. The database
+ * therefore only ever moves from one flushed best block to the next, each in
+ * a single LevelDB batch, just as it does with synchronous flushes.
+ * The coins being written still take memory, so they share the -dbcache
+ * budget with the coins in the cache (see CoinCacheNeedsFlush).
+ */
+class CCoinsViewBackgroundFlush : public CCoinsView
+{
+private:
+    CCoinsViewDB* db;
+
+    mutable CWaitableCriticalSection cs;
+    mutable CConditionVariable cvPending;
+    //! coins handed over by the last BatchWrite; not modified until they are written
+    CCoinsMap mapPending;
+    uint256 hashPending;
+    bool fPending;
+    bool fFailed;
+    bool fStop;
+    //! called once the pending coins are written
+    std::vector<boost::function<void()> > vOnWritten;
+    CCoinsFlushStats stats;
+
+    boost::thread thread;
+
+    void ThreadWrite();
+    //! Wait until nothing is pending; false if a write failed
+    bool WaitIdle(WaitableLock& lock) const;
+
+public:
+    explicit CCoinsViewBackgroundFlush(CCoinsViewDB* dbIn);
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetCoins(const uint256& txid, CCoins& coins) const;
+    bool HaveCoins(const uint256& txid) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool GetStats(CCoinsStats& stats) const;
+
+    //! Wait until the coins of the last BatchWrite are on disk; false if writing them failed
+    bool Wait();
+    //! Call func once the coins of the last BatchWrite are on disk (right away if they already are)
+    void OnWritten(const boost::function<void()>& func);
+    //! Number of coin entries handed over by the last BatchWrite that are not written yet
+    unsigned int GetPendingSize() const;
+
+    CCoinsFlushStats GetFlushStats() const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -61,6 +151,20 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
+    //! Entries of an address in height order, limited to [nStart, nEnd] when nEnd > 0
+    bool ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int nStart = 0, int nEnd = 0);
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect);
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+    bool WriteTimestampIndex(const CTimestampIndexKey& key);
+    bool EraseTimestampIndex(const CTimestampIndexKey& key);
+    //! Hashes of the blocks with nLow <= time < nHigh, in time order
+    bool ReadTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& vHashes);
+    bool WriteUtxoStats(const uint256& hashBlock, const CUtxoStats& stats);
+    bool ReadUtxoStats(const uint256& hashBlock, CUtxoStats& stats);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
@@ -78,7 +182,30 @@ private:
     CZerocoinDB(const CZerocoinDB&);
     void operator=(const CZerocoinDB&);
 
+    typedef boost::unordered_set<uint256, CCoinsKeyHasher> HashSet;
+
+    /**
+     * Keys of the spend ('s') and mint ('m') records, so that lookups of
+     * serials and pubcoins that are not in the database don't read it.
+     * The sets may hold keys that are no longer on disk, but never miss
+     * one that is. Writes and erases hold cs_filter until the database
+     * is updated, to keep the two in step.
+     */
+    CCriticalSection cs_filter;
+    //! Until LoadFilter() has run every lookup goes to the database
+    bool fFilterLoaded;
+    HashSet setSpendHashes;
+    HashSet setMintHashes;
+
+    HashSet& FilterFor(char chType);
+    bool FilterMayContain(char chType, const uint256& hash);
+    bool ScanKeys(char chType, std::vector<uint256>& vHashes);
+
 public:
+    /** Read the keys of all spend and mint records into memory */
+    bool LoadFilter();
+    void GetFilterSize(size_t& nSpends, size_t& nMints);
+
     /** Write zWSP mints to the zerocoinDB in a batch */
     bool WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo);
     bool ReadCoinMint(const CBigNum& bnPubcoin, uint256& txHash);
@@ -88,6 +215,9 @@ public:
     bool ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash);
     bool ReadCoinSpend(const uint256& hashSerial, uint256 &txHash);
     bool EraseCoinMint(const CBigNum& bnPubcoin);
+    /** Index of the pubcoins minted in a block, as BlockToPubcoinList returns them with invalid mints filtered out */
+    bool WriteBlockMints(const uint256& hashBlock, const std::list<libzerocoin::PublicCoin>& listPubcoins);
+    bool ReadBlockMints(const uint256& hashBlock, std::list<libzerocoin::PublicCoin>& listPubcoins);
     bool EraseCoinSpend(const CBigNum& bnSerial);
     bool WipeCoins(const std::string& strType);
     bool WriteAccumulatorValue(const uint32_t& nChecksum, const CBigNum& bnValue);
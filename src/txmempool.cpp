@@ -17,16 +17,21 @@
 #include <random>
 
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nFeeDelta(0)
 {
     nHeight = MEMPOOL_HEIGHT;
+    SetAncestorState(1, 0, 0);
+    SetDescendantState(1, 0, 0);
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nFeeDelta(0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+
+    SetAncestorState(1, nTxSize, nFee);
+    SetDescendantState(1, nTxSize, nFee);
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -43,6 +48,45 @@ CTxMemPoolEntry::GetPriority(unsigned int currentHeight) const
     return dResult;
 }
 
+void CTxMemPoolEntry::UpdateFeeDelta(CAmount nNewFeeDelta)
+{
+    nModFeesWithAncestors += nNewFeeDelta - nFeeDelta;
+    nModFeesWithDescendants += nNewFeeDelta - nFeeDelta;
+    nFeeDelta = nNewFeeDelta;
+}
+
+void CTxMemPoolEntry::UpdateAncestorState(int64_t nModifySize, CAmount nModifyFee, int64_t nModifyCount)
+{
+    nSizeWithAncestors += nModifySize;
+    nModFeesWithAncestors += nModifyFee;
+    nCountWithAncestors += nModifyCount;
+    assert(int64_t(nSizeWithAncestors) > 0);
+    assert(int64_t(nCountWithAncestors) > 0);
+}
+
+void CTxMemPoolEntry::UpdateDescendantState(int64_t nModifySize, CAmount nModifyFee, int64_t nModifyCount)
+{
+    nSizeWithDescendants += nModifySize;
+    nModFeesWithDescendants += nModifyFee;
+    nCountWithDescendants += nModifyCount;
+    assert(int64_t(nSizeWithDescendants) > 0);
+    assert(int64_t(nCountWithDescendants) > 0);
+}
+
+void CTxMemPoolEntry::SetAncestorState(uint64_t nCount, uint64_t nSize, CAmount nModFees)
+{
+    nCountWithAncestors = nCount;
+    nSizeWithAncestors = nSize;
+    nModFeesWithAncestors = nModFees;
+}
+
+void CTxMemPoolEntry::SetDescendantState(uint64_t nCount, uint64_t nSize, CAmount nModFees)
+{
+    nCountWithDescendants = nCount;
+    nSizeWithDescendants = nSize;
+    nModFeesWithDescendants = nModFees;
+}
+
 /**
  * Keep track of fee/priority for transactions confirmed within N blocks
  */
@@ -402,68 +446,214 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolParents(txiter entry) const
+{
+    txlinksMap::const_iterator it = mapLinks.find(entry);
+    assert(it != mapLinks.end());
+    return it->second.parents;
+}
+
+const CTxMemPool::setEntries& CTxMemPool::GetMemPoolChildren(txiter entry) const
+{
+    txlinksMap::const_iterator it = mapLinks.find(entry);
+    assert(it != mapLinks.end());
+    return it->second.children;
+}
+
+void CTxMemPool::CalculateMemPoolAncestors(txiter entry, setEntries& setAncestors) const
+{
+    std::vector<txiter> vToVisit(1, entry);
+    while (!vToVisit.empty()) {
+        txiter it = vToVisit.back();
+        vToVisit.pop_back();
+        for (txiter parent : GetMemPoolParents(it)) {
+            if (parent != entry && setAncestors.insert(parent).second)
+                vToVisit.push_back(parent);
+        }
+    }
+}
+
+void CTxMemPool::CalculateDescendants(txiter entry, setEntries& setDescendants) const
+{
+    if (!setDescendants.insert(entry).second)
+        return;
+    std::vector<txiter> vToVisit(1, entry);
+    while (!vToVisit.empty()) {
+        txiter it = vToVisit.back();
+        vToVisit.pop_back();
+        for (txiter child : GetMemPoolChildren(it)) {
+            if (setDescendants.insert(child).second)
+                vToVisit.push_back(child);
+        }
+    }
+}
+
+void CTxMemPool::RecalculatePackageState(txiter entry)
+{
+    setEntries setAncestors;
+    CalculateMemPoolAncestors(entry, setAncestors);
+    uint64_t nCount = 1, nSize = entry->GetTxSize();
+    CAmount nModFees = entry->GetModifiedFee();
+    for (txiter it : setAncestors) {
+        nCount++;
+        nSize += it->GetTxSize();
+        nModFees += it->GetModifiedFee();
+    }
+    mapTx.modify(entry, set_package_state(true, nCount, nSize, nModFees));
+
+    setEntries setDescendants;
+    CalculateDescendants(entry, setDescendants);
+    nCount = 0, nSize = 0, nModFees = 0;
+    for (txiter it : setDescendants) {
+        nCount++;
+        nSize += it->GetTxSize();
+        nModFees += it->GetModifiedFee();
+    }
+    mapTx.modify(entry, set_package_state(false, nCount, nSize, nModFees));
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
 {
     // Add to memory pool without checking anything.
     // Used by main.cpp AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
-    {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
-        if(!tx.HasZerocoinSpendInputs()) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++)
-                mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+    if (mapTx.count(hash))
+        return true;
+
+    txiter newit = mapTx.insert(entry).first;
+    TxLinks& links = mapLinks[newit];
+
+    // Fee deltas given before the transaction arrived apply from the start
+    auto pos = mapDeltas.find(hash);
+    if (pos != mapDeltas.end() && pos->second.second != 0)
+        mapTx.modify(newit, update_fee_delta(pos->second.second));
+
+    const CTransaction& tx = newit->GetTx();
+    if (!tx.HasZerocoinSpendInputs()) {
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+            txiter parent = mapTx.find(tx.vin[i].prevout.hash);
+            if (parent != mapTx.end()) {
+                links.parents.insert(parent);
+                mapLinks[parent].children.insert(newit);
+            }
         }
-        nTransactionsUpdated++;
-        totalTxSize += entry.GetTxSize();
     }
+
+    // Transactions from a disconnected block can be re-added while their
+    // spenders are still in the pool
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        auto it = mapNextTx.find(COutPoint(hash, i));
+        if (it == mapNextTx.end())
+            continue;
+        txiter child = mapTx.find(it->second.ptx->GetHash());
+        assert(child != mapTx.end());
+        links.children.insert(child);
+        mapLinks[child].parents.insert(newit);
+    }
+
+    setEntries setAncestors;
+    CalculateMemPoolAncestors(newit, setAncestors);
+    if (links.children.empty()) {
+        // Common case: only the new entry and the descendant state of its ancestors change
+        uint64_t nCount = 1, nSize = newit->GetTxSize();
+        CAmount nModFees = newit->GetModifiedFee();
+        for (txiter it : setAncestors) {
+            nCount++;
+            nSize += it->GetTxSize();
+            nModFees += it->GetModifiedFee();
+            mapTx.modify(it, update_descendant_state(newit->GetTxSize(), newit->GetModifiedFee(), 1));
+        }
+        mapTx.modify(newit, set_package_state(true, nCount, nSize, nModFees));
+    } else {
+        setEntries setUpdate;
+        CalculateDescendants(newit, setUpdate);
+        setUpdate.insert(setAncestors.begin(), setAncestors.end());
+        for (txiter it : setUpdate)
+            RecalculatePackageState(it);
+    }
+
+    nTransactionsUpdated++;
+    totalTxSize += entry.GetTxSize();
     return true;
 }
 
+void CTxMemPool::RemoveStaged(const setEntries& stage, std::list<CTransaction>& removed)
+{
+    // Take the staged entries out of the package state of everything that stays
+    for (txiter it : stage) {
+        setEntries setAncestors;
+        CalculateMemPoolAncestors(it, setAncestors);
+        for (txiter ancestor : setAncestors) {
+            if (!stage.count(ancestor))
+                mapTx.modify(ancestor, update_descendant_state(-(int64_t)it->GetTxSize(), -it->GetModifiedFee(), -1));
+        }
+        setEntries setDescendants;
+        CalculateDescendants(it, setDescendants);
+        for (txiter descendant : setDescendants) {
+            if (!stage.count(descendant))
+                mapTx.modify(descendant, update_ancestor_state(-(int64_t)it->GetTxSize(), -it->GetModifiedFee(), -1));
+        }
+    }
+
+    for (txiter it : stage) {
+        const TxLinks& links = mapLinks[it];
+        for (txiter parent : links.parents) {
+            if (!stage.count(parent))
+                mapLinks[parent].children.erase(it);
+        }
+        for (txiter child : links.children) {
+            if (!stage.count(child))
+                mapLinks[child].parents.erase(it);
+        }
+        const CTransaction& tx = it->GetTx();
+        for (const CTxIn& txin : tx.vin)
+            mapNextTx.erase(txin.prevout);
+
+        removed.push_back(tx);
+        totalTxSize -= it->GetTxSize();
+        nTransactionsUpdated++;
+    }
+
+    // mapLinks orders by the entries' hashes, so it has to let go of them first
+    for (txiter it : stage)
+        mapLinks.erase(it);
+    for (txiter it : stage)
+        mapTx.erase(it);
+}
 
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
-    {
-        LOCK(cs);
-        std::deque<uint256> txToRemove;
-        txToRemove.push_back(origTx.GetHash());
-        if (fRecursive && !mapTx.count(origTx.GetHash())) {
-            // If recursively removing but origTx isn't in the mempool
-            // be sure to remove any children that are in the pool. This can
-            // happen during chain re-orgs if origTx isn't re-accepted into
-            // the mempool for any reason.
-            for (unsigned int i = 0; i < origTx.vout.size(); i++) {
-                auto it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
-                if (it == mapNextTx.end())
-                    continue;
-                txToRemove.push_back(it->second.ptx->GetHash());
-            }
-        }
-        while (!txToRemove.empty()) {
-            uint256 hash = txToRemove.front();
-            txToRemove.pop_front();
-            if (!mapTx.count(hash))
+    LOCK(cs);
+    setEntries txToRemove;
+    txiter origit = mapTx.find(origTx.GetHash());
+    if (origit != mapTx.end()) {
+        txToRemove.insert(origit);
+    } else if (fRecursive) {
+        // If recursively removing but origTx isn't in the mempool
+        // be sure to remove any children that are in the pool. This can
+        // happen during chain re-orgs if origTx isn't re-accepted into
+        // the mempool for any reason.
+        for (unsigned int i = 0; i < origTx.vout.size(); i++) {
+            auto it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
+            if (it == mapNextTx.end())
                 continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
-            if (fRecursive) {
-                for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    auto it = mapNextTx.find(COutPoint(hash, i));
-                    if (it == mapNextTx.end())
-                        continue;
-                    txToRemove.push_back(it->second.ptx->GetHash());
-                }
-            }
-            for (const CTxIn& txin : tx.vin)
-                mapNextTx.erase(txin.prevout);
-
-            removed.push_back(tx);
-            totalTxSize -= mapTx[hash].GetTxSize();
-            mapTx.erase(hash);
-            nTransactionsUpdated++;
+            txiter nextit = mapTx.find(it->second.ptx->GetHash());
+            assert(nextit != mapTx.end());
+            txToRemove.insert(nextit);
         }
     }
+
+    setEntries setAllRemoves;
+    if (fRecursive) {
+        for (txiter it : txToRemove)
+            CalculateDescendants(it, setAllRemoves);
+    } else {
+        setAllRemoves.swap(txToRemove);
+    }
+    RemoveStaged(setAllRemoves, removed);
 }
 
 void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight)
@@ -471,10 +661,10 @@ void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned in
     // Remove transactions spending a coinbase which are now immature
     LOCK(cs);
     std::list<CTransaction> transactionsToRemove;
-    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        const CTransaction& tx = it->second.GetTx();
+    for (txiter it = mapTx.begin(); it != mapTx.end(); it++) {
+        const CTransaction& tx = it->GetTx();
         for (const CTxIn& txin : tx.vin) {
-            std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
+            txiter it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end())
                 continue;
             const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
@@ -515,9 +705,9 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
     LOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
     for (const CTransaction& tx : vtx) {
-        const uint256& hash = tx.GetHash();
-        if (mapTx.count(hash))
-            entries.push_back(mapTx[hash]);
+        txiter it = mapTx.find(tx.GetHash());
+        if (it != mapTx.end())
+            entries.push_back(*it);
     }
     minerPolicyEstimator->seenBlock(entries, nBlockHeight, minRelayFee);
     for (const CTransaction& tx : vtx) {
@@ -532,6 +722,7 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
 void CTxMemPool::clear()
 {
     LOCK(cs);
+    mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -551,18 +742,21 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
 
     LOCK(cs);
     std::list<const CTxMemPoolEntry*> waitingOnDependants;
-    for (auto it = mapTx.begin(); it != mapTx.end(); it++) {
+    for (txiter it = mapTx.begin(); it != mapTx.end(); it++) {
         unsigned int i = 0;
-        checkTotal += it->second.GetTxSize();
-        const CTransaction& tx = it->second.GetTx();
+        checkTotal += it->GetTxSize();
+        const CTransaction& tx = it->GetTx();
         bool fDependsWait = false;
+        setEntries setParentCheck;
         for (const CTxIn& txin : tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
-            auto it2 = mapTx.find(txin.prevout.hash);
+            txiter it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end()) {
-                const CTransaction& tx2 = it2->second.GetTx();
+                const CTransaction& tx2 = it2->GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
+                if (!tx.HasZerocoinSpendInputs())
+                    setParentCheck.insert(it2);
             } else {
                 const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
                 if(!txin.IsZerocoinSpend() && !txin.IsZerocoinPublicSpend())
@@ -579,8 +773,44 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             }
             i++;
         }
+        assert(setParentCheck == GetMemPoolParents(it));
+
+        // Check the cached package state against a fresh walk of the links
+        setEntries setAncestors;
+        CalculateMemPoolAncestors(it, setAncestors);
+        uint64_t nCount = 1, nSize = it->GetTxSize();
+        CAmount nModFees = it->GetModifiedFee();
+        for (txiter ancestor : setAncestors) {
+            nCount++;
+            nSize += ancestor->GetTxSize();
+            nModFees += ancestor->GetModifiedFee();
+        }
+        assert(it->GetCountWithAncestors() == nCount);
+        assert(it->GetSizeWithAncestors() == nSize);
+        assert(it->GetModFeesWithAncestors() == nModFees);
+
+        setEntries setChildrenCheck;
+        for (auto iter = mapNextTx.lower_bound(COutPoint(tx.GetHash(), 0)); iter != mapNextTx.end() && iter->first.hash == tx.GetHash(); ++iter) {
+            txiter childit = mapTx.find(iter->second.ptx->GetHash());
+            assert(childit != mapTx.end());
+            setChildrenCheck.insert(childit);
+        }
+        assert(setChildrenCheck == GetMemPoolChildren(it));
+
+        setEntries setDescendants;
+        CalculateDescendants(it, setDescendants);
+        nCount = 0, nSize = 0, nModFees = 0;
+        for (txiter descendant : setDescendants) {
+            nCount++;
+            nSize += descendant->GetTxSize();
+            nModFees += descendant->GetModifiedFee();
+        }
+        assert(it->GetCountWithDescendants() == nCount);
+        assert(it->GetSizeWithDescendants() == nSize);
+        assert(it->GetModFeesWithDescendants() == nModFees);
+
         if (fDependsWait)
-            waitingOnDependants.push_back(&it->second);
+            waitingOnDependants.push_back(&(*it));
         else {
             CValidationState state;
             CTxUndo undo;
@@ -606,9 +836,9 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     }
     for (auto it = mapNextTx.begin(); it != mapNextTx.end(); it++) {
         uint256 hash = it->second.ptx->GetHash();
-        auto it2 = mapTx.find(hash);
-        const CTransaction& tx = it2->second.GetTx();
+        txiter it2 = mapTx.find(hash);
         assert(it2 != mapTx.end());
+        const CTransaction& tx = it2->GetTx();
         assert(&tx == it->second.ptx);
         assert(tx.vin.size() > it->second.n);
         assert(it->first == it->second.ptx->vin[it->second.n].prevout);
@@ -623,8 +853,8 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (auto & mi : mapTx)
-        vtxid.push_back(mi.first);
+    for (const CTxMemPoolEntry& entry : mapTx)
+        vtxid.push_back(entry.GetTx().GetHash());
 }
 
 void CTxMemPool::getTransactions(std::set<uint256>& setTxid)
@@ -632,8 +862,8 @@ void CTxMemPool::getTransactions(std::set<uint256>& setTxid)
     setTxid.clear();
 
     LOCK(cs);
-    for (auto & mi : mapTx)
-        setTxid.insert(mi.first);
+    for (const CTxMemPoolEntry& entry : mapTx)
+        setTxid.insert(entry.GetTx().GetHash());
 }
 
 bool CTxMemPool::lookup(const uint256& hash, CTransaction& result) const
@@ -641,7 +871,7 @@ bool CTxMemPool::lookup(const uint256& hash, CTransaction& result) const
     LOCK(cs);
     auto i = mapTx.find(hash);
     if (i == mapTx.end()) return false;
-    result = i->second.GetTx();
+    result = i->GetTx();
     return true;
 }
 
@@ -695,6 +925,20 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const std::string& s
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        txiter it = mapTx.find(hash);
+        if (it != mapTx.end() && nFeeDelta != 0) {
+            mapTx.modify(it, update_fee_delta(deltas.second));
+            // Keep the package fee of everything connected to it in line
+            setEntries setAncestors;
+            CalculateMemPoolAncestors(it, setAncestors);
+            for (txiter ancestor : setAncestors)
+                mapTx.modify(ancestor, update_descendant_state(0, nFeeDelta, 0));
+            setEntries setDescendants;
+            CalculateDescendants(it, setDescendants);
+            setDescendants.erase(it);
+            for (txiter descendant : setDescendants)
+                mapTx.modify(descendant, update_ancestor_state(0, nFeeDelta, 0));
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
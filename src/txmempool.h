@@ -8,12 +8,17 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/identity.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+
 class CAutoFile;
 
 inline double AllowFreeThreshold()
@@ -34,6 +39,13 @@ static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
 /**
  * CTxMemPool stores these:
+ *
+ * Besides the transaction itself, each entry caches the aggregate size and
+ * modified fee of its in-mempool ancestor package (the entry plus every
+ * unconfirmed transaction it depends on) and of its descendant package (the
+ * entry plus everything that depends on it). CTxMemPool keeps these up to
+ * date on every add and remove so block assembly never has to walk
+ * dependencies itself.
  */
 class CTxMemPoolEntry
 {
@@ -45,6 +57,14 @@ private:
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nFeeDelta;    //! Fee adjustment from prioritisetransaction
+
+    uint64_t nCountWithAncestors;   //! number of in-mempool ancestors, including this one
+    uint64_t nSizeWithAncestors;    //! ... and their total size
+    CAmount nModFeesWithAncestors;  //! ... and their total modified fees
+    uint64_t nCountWithDescendants; //! number of in-mempool descendants, including this one
+    uint64_t nSizeWithDescendants;  //! ... and their total size
+    CAmount nModFeesWithDescendants; //! ... and their total modified fees
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -54,11 +74,127 @@ public:
     const CTransaction& GetTx() const { return this->tx; }
     double GetPriority(unsigned int currentHeight) const;
     CAmount GetFee() const { return nFee; }
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+    uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
+    uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
+    CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+
+    //! Only to be called through CTxMemPool::mapTx.modify, which keeps the indexes in order
+    void UpdateFeeDelta(CAmount nNewFeeDelta);
+    void UpdateAncestorState(int64_t nModifySize, CAmount nModifyFee, int64_t nModifyCount);
+    void UpdateDescendantState(int64_t nModifySize, CAmount nModifyFee, int64_t nModifyCount);
+    void SetAncestorState(uint64_t nCount, uint64_t nSize, CAmount nModFees);
+    void SetDescendantState(uint64_t nCount, uint64_t nSize, CAmount nModFees);
+};
+
+// Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
+struct update_fee_delta {
+    update_fee_delta(CAmount _nFeeDelta) : nFeeDelta(_nFeeDelta) {}
+    void operator()(CTxMemPoolEntry& e) { e.UpdateFeeDelta(nFeeDelta); }
+
+private:
+    CAmount nFeeDelta;
+};
+
+struct update_ancestor_state {
+    update_ancestor_state(int64_t _nModifySize, CAmount _nModifyFee, int64_t _nModifyCount) : nModifySize(_nModifySize), nModifyFee(_nModifyFee), nModifyCount(_nModifyCount) {}
+    void operator()(CTxMemPoolEntry& e) { e.UpdateAncestorState(nModifySize, nModifyFee, nModifyCount); }
+
+private:
+    int64_t nModifySize;
+    CAmount nModifyFee;
+    int64_t nModifyCount;
+};
+
+struct update_descendant_state {
+    update_descendant_state(int64_t _nModifySize, CAmount _nModifyFee, int64_t _nModifyCount) : nModifySize(_nModifySize), nModifyFee(_nModifyFee), nModifyCount(_nModifyCount) {}
+    void operator()(CTxMemPoolEntry& e) { e.UpdateDescendantState(nModifySize, nModifyFee, nModifyCount); }
+
+private:
+    int64_t nModifySize;
+    CAmount nModifyFee;
+    int64_t nModifyCount;
+};
+
+struct set_package_state {
+    set_package_state(bool _fAncestors, uint64_t _nCount, uint64_t _nSize, CAmount _nModFees) : fAncestors(_fAncestors), nCount(_nCount), nSize(_nSize), nModFees(_nModFees) {}
+    void operator()(CTxMemPoolEntry& e)
+    {
+        if (fAncestors)
+            e.SetAncestorState(nCount, nSize, nModFees);
+        else
+            e.SetDescendantState(nCount, nSize, nModFees);
+    }
+
+private:
+    bool fAncestors;
+    uint64_t nCount;
+    uint64_t nSize;
+    CAmount nModFees;
 };
 
+/** Extract the txid of a mempool entry, used as the primary key of CTxMemPool::mapTx */
+struct mempoolentry_txid {
+    typedef uint256 result_type;
+    result_type operator()(const CTxMemPoolEntry& entry) const
+    {
+        return entry.GetTx().GetHash();
+    }
+};
+
+/** Sort by the entry's own modified fee rate (highest last), ties broken by txid */
+class CompareTxMemPoolEntryByFeeRate
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double f1 = (double)a.GetModifiedFee() * b.GetTxSize();
+        double f2 = (double)b.GetModifiedFee() * a.GetTxSize();
+        if (f1 == f2)
+            return b.GetTx().GetHash() < a.GetTx().GetHash();
+        return f1 < f2;
+    }
+};
+
+/** Sort by entry time, oldest first */
+class CompareTxMemPoolEntryByEntryTime
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        return a.GetTime() < b.GetTime();
+    }
+};
+
+/**
+ * Sort by the fee rate of the entry's ancestor package (highest first), so a
+ * block can be filled by taking whole packages off the front of this index.
+ */
+class CompareTxMemPoolEntryByAncestorFee
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double f1 = (double)a.GetModFeesWithAncestors() * b.GetSizeWithAncestors();
+        double f2 = (double)b.GetModFeesWithAncestors() * a.GetSizeWithAncestors();
+        if (f1 == f2)
+            return a.GetTx().GetHash() < b.GetTx().GetHash();
+        return f1 > f2;
+    }
+};
+
+// Multi_index tag names
+struct fee_rate {};
+struct entry_time {};
+struct ancestor_score {};
+
 class CMinerPolicyEstimator;
 
 /** An inpoint - a combination of a transaction and an index n into its vin */
@@ -103,11 +239,58 @@ private:
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
 
 public:
+    typedef boost::multi_index_container<
+        CTxMemPoolEntry,
+        boost::multi_index::indexed_by<
+            // sorted by txid
+            boost::multi_index::ordered_unique<mempoolentry_txid>,
+            // sorted by the entry's own fee rate
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<fee_rate>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByFeeRate
+            >,
+            // sorted by entry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<entry_time>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByEntryTime
+            >,
+            // sorted by ancestor package fee rate
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<ancestor_score>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByAncestorFee
+            >
+        >
+    > indexed_transaction_set;
+
+    typedef indexed_transaction_set::nth_index<0>::type::const_iterator txiter;
+    struct CompareIteratorByHash {
+        bool operator()(const txiter& a, const txiter& b) const
+        {
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        }
+    };
+    typedef std::set<txiter, CompareIteratorByHash> setEntries;
+
     mutable CCriticalSection cs;
-    std::map<uint256, CTxMemPoolEntry> mapTx;
+    indexed_transaction_set mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
+private:
+    struct TxLinks {
+        setEntries parents;
+        setEntries children;
+    };
+    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
+    txlinksMap mapLinks; //! in-mempool parents and children of every entry
+
+    void RecalculatePackageState(txiter entry);
+    void RemoveStaged(const setEntries& stage, std::list<CTransaction>& removed);
+
+public:
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
 
@@ -132,6 +315,14 @@ public:
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
 
+    /** In-mempool parents/children of an entry. Requires cs to be held. */
+    const setEntries& GetMemPoolParents(txiter entry) const;
+    const setEntries& GetMemPoolChildren(txiter entry) const;
+    /** All in-mempool ancestors of an entry, not including the entry itself. Requires cs to be held. */
+    void CalculateMemPoolAncestors(txiter entry, setEntries& setAncestors) const;
+    /** The entry and all of its in-mempool descendants. Requires cs to be held. */
+    void CalculateDescendants(txiter entry, setEntries& setDescendants) const;
+
     /** Affect CreateNewBlock prioritisation of transactions */
     void PrioritiseTransaction(const uint256& hash, const std::string& strHash, double dPriorityDelta, const CAmount& nFeeDelta);
     void ApplyDeltas(const uint256& hash, double& dPriorityDelta, CAmount& nFeeDelta);
@@ -6,7 +6,18 @@
 
 #include "validationinterface.h"
 
+#include "primitives/block.h"
+#include "scheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 static CMainSignals g_signals;
+static std::atomic<int> nBlockDataListeners(0);
 
 CMainSignals& GetMainSignals()
 {
@@ -15,7 +26,7 @@ CMainSignals& GetMainSignals()
 
 void RegisterValidationInterface(CValidationInterface* pwalletIn) {
 // XX42 g_signals.EraseTransaction.connect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
-    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
     g_signals.NotifyTransactionLock.connect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
@@ -37,7 +48,7 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.NotifyTransactionLock.disconnect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
-    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1));
+    g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2));
 // XX42    g_signals.EraseTransaction.disconnect(boost::bind(&CValidationInterface::EraseFromWallet, pwalletIn, _1));
 }
 
@@ -55,6 +66,110 @@ void UnregisterAllValidationInterfaces() {
 // XX42    g_signals.EraseTransaction.disconnect_all_slots();
 }
 
-void SyncWithWallets(const CTransaction &tx, const CBlock *pblock = nullptr) {
-    g_signals.SyncTransaction(tx, pblock);
+void RegisterBlockDataListener()
+{
+    nBlockDataListeners++;
+}
+
+void UnregisterBlockDataListener()
+{
+    nBlockDataListeners--;
+}
+
+bool HaveBlockDataListeners()
+{
+    return nBlockDataListeners > 0;
+}
+
+void CMainSignals::RegisterBackgroundSignalScheduler(CScheduler& scheduler)
+{
+    assert(!m_schedulerClient);
+    m_schedulerClient.reset(new SingleThreadedSchedulerClient(&scheduler));
+}
+
+void CMainSignals::UnregisterBackgroundSignalScheduler()
+{
+    m_schedulerClient.reset();
+}
+
+void CMainSignals::FlushBackgroundCallbacks()
+{
+    if (m_schedulerClient)
+        m_schedulerClient->EmptyQueue();
+}
+
+size_t CMainSignals::CallbacksPending()
+{
+    if (!m_schedulerClient)
+        return 0;
+    return m_schedulerClient->CallbacksPending();
+}
+
+void CMainSignals::CallFunctionInValidationInterfaceQueue(const boost::function<void()>& func)
+{
+    if (m_schedulerClient)
+        m_schedulerClient->AddToProcessQueue(func);
+    else
+        func();
+}
+
+// The queued notifications keep their own reference to the data they carry,
+// since the caller may be done with it before they are delivered
+
+static void FireUpdatedBlockTip(const CBlockIndex* pindex, const std::shared_ptr<const CDataStream>& pblockData)
+{
+    g_signals.UpdatedBlockTip(pindex, pblockData);
+}
+
+static void FireSyncTransaction(const std::shared_ptr<const CTransaction>& ptx, const std::shared_ptr<const CBlock>& pblock)
+{
+    g_signals.SyncTransaction(*ptx, pblock.get());
+}
+
+static void FireNotifyTransactionLock(const std::shared_ptr<const CTransaction>& ptx)
+{
+    g_signals.NotifyTransactionLock(*ptx);
+}
+
+static void FireSetBestChain(const CBlockLocator& locator)
+{
+    g_signals.SetBestChain(locator);
+}
+
+void CMainSignals::QueueUpdatedBlockTip(const CBlockIndex* pindex, const std::shared_ptr<const CDataStream>& pblockData)
+{
+    CallFunctionInValidationInterfaceQueue(boost::bind(&FireUpdatedBlockTip, pindex, pblockData));
+}
+
+void CMainSignals::QueueSyncTransaction(const std::shared_ptr<const CTransaction>& ptx, const std::shared_ptr<const CBlock>& pblock)
+{
+    CallFunctionInValidationInterfaceQueue(boost::bind(&FireSyncTransaction, ptx, pblock));
+}
+
+void CMainSignals::QueueNotifyTransactionLock(const std::shared_ptr<const CTransaction>& ptx)
+{
+    CallFunctionInValidationInterfaceQueue(boost::bind(&FireNotifyTransactionLock, ptx));
+}
+
+void CMainSignals::QueueSetBestChain(const CBlockLocator& locator)
+{
+    CallFunctionInValidationInterfaceQueue(boost::bind(&FireSetBestChain, locator));
+}
+
+void SyncWithWallets(const std::shared_ptr<const CTransaction>& ptx, const std::shared_ptr<const CBlock>& pblock)
+{
+    g_signals.QueueSyncTransaction(ptx, pblock);
+}
+
+void SyncWithValidationInterfaceQueue()
+{
+    // Shared with the queued callback, which still runs after an interrupted
+    // caller has returned
+    std::shared_ptr<std::promise<void> > promise = std::make_shared<std::promise<void> >();
+    std::future<void> future = promise->get_future();
+    g_signals.CallFunctionInValidationInterfaceQueue(boost::bind(&std::promise<void>::set_value, promise));
+    // The scheduler thread stops at shutdown without running what is left,
+    // so the wait has to give way to interrupt_all()
+    while (future.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+        boost::this_thread::interruption_point();
 }
@@ -7,17 +7,25 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include <memory>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
 
 class CBlock;
 struct CBlockLocator;
 class CBlockIndex;
+class CDataStream;
 class CReserveScript;
+class CScheduler;
 class CTransaction;
 class CValidationInterface;
 class CValidationState;
 class uint256;
+class SingleThreadedSchedulerClient;
+
+/** Queued notifications above which ActivateBestChain waits for the listeners to catch up */
+static const size_t MAX_PENDING_VALIDATION_NOTIFICATIONS = 1000;
 
 // These functions dispatch to one or all registered wallets
 
@@ -27,13 +35,27 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn);
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
-/** Push an updated transaction to all registered wallets */
-void SyncWithWallets(const CTransaction& tx, const CBlock* pblock);
+/** Queue an updated transaction, and the block it is found in if any, for all registered wallets */
+void SyncWithWallets(const std::shared_ptr<const CTransaction>& ptx, const std::shared_ptr<const CBlock>& pblock);
+/**
+ * Wait until the notifications queued before the call have been delivered.
+ * Listeners take cs_main, so this must not be called while holding it.
+ * The wait is an interruption point.
+ */
+void SyncWithValidationInterfaceQueue();
+/**
+ * Listeners that use the serialized block passed with UpdatedBlockTip say so
+ * here. Without any, a tip that is not in the block cache is not serialized
+ * just to be passed along.
+ */
+void RegisterBlockDataListener();
+void UnregisterBlockDataListener();
+bool HaveBlockDataListeners();
 
 class CValidationInterface {
 protected:
 // XX42    virtual void EraseFromWallet(const uint256& hash){};
-    virtual void UpdatedBlockTip(const CBlockIndex *pindex) {}
+    virtual void UpdatedBlockTip(const CBlockIndex *pindex, const std::shared_ptr<const CDataStream>& pblockData) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
     virtual void NotifyTransactionLock(const CTransaction &tx) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
@@ -51,8 +73,8 @@ protected:
 
 struct CMainSignals {
 // XX42    boost::signals2::signal<void(const uint256&)> EraseTransaction;
-    /** Notifies listeners of updated block chain tip */
-    boost::signals2::signal<void (const CBlockIndex *)> UpdatedBlockTip;
+    /** Notifies listeners of updated block chain tip, with the serialized tip block if it is at hand */
+    boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CDataStream>&)> UpdatedBlockTip;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
     /** Notifies listeners of an updated transaction lock without new data. */
@@ -72,6 +94,30 @@ struct CMainSignals {
 // XX42    boost::signals2::signal<void (boost::shared_ptr<CReserveScript>&)> ScriptForMining;
     /** Notifies listeners that a block has been successfully mined */
     boost::signals2::signal<void (const uint256 &)> BlockFound;
+
+    /**
+     * UpdatedBlockTip, SyncTransaction, NotifyTransactionLock and SetBestChain
+     * are fired through the Queue* functions below. Once a scheduler is
+     * registered they are delivered on its thread, one at a time and in the
+     * order they were queued; until then they are delivered on the calling
+     * thread. The other signals are always delivered on the calling thread.
+     */
+    void RegisterBackgroundSignalScheduler(CScheduler& scheduler);
+    /** Deliver queued notifications on the calling thread again */
+    void UnregisterBackgroundSignalScheduler();
+    /** Deliver what is left in the queue, once the scheduler threads have stopped */
+    void FlushBackgroundCallbacks();
+    size_t CallbacksPending();
+    /** Run func after the notifications queued before it have been delivered */
+    void CallFunctionInValidationInterfaceQueue(const boost::function<void()>& func);
+
+    void QueueUpdatedBlockTip(const CBlockIndex* pindex, const std::shared_ptr<const CDataStream>& pblockData);
+    void QueueSyncTransaction(const std::shared_ptr<const CTransaction>& ptx, const std::shared_ptr<const CBlock>& pblock);
+    void QueueNotifyTransactionLock(const std::shared_ptr<const CTransaction>& ptx);
+    void QueueSetBestChain(const CBlockLocator& locator);
+
+private:
+    std::unique_ptr<SingleThreadedSchedulerClient> m_schedulerClient;
 };
 
 CMainSignals& GetMainSignals();
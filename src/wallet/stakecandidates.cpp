@@ -0,0 +1,103 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakecandidates.h"
+
+#include "chainparams.h"
+#include "kernel.h"
+#include "main.h"
+#include "util.h"
+#include "wallet/wallet.h"
+
+bool CStakeCandidate::GetModifier(uint64_t& nStakeModifierRet)
+{
+    // The modifier is taken from a block a selection interval after pindexFrom,
+    // so once it can be found it only changes if that block is reorganized away
+    if (!fModifier) {
+        int nStakeModifierHeight = 0;
+        int64_t nStakeModifierTime = 0;
+        if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false))
+            return false;
+        fModifier = true;
+    }
+    nStakeModifierRet = nStakeModifier;
+    return true;
+}
+
+void CStakeCandidateSet::AddOutputs(const CWallet& wallet, const CWalletTx& wtx)
+{
+    if (wtx.hashBlock == 0)
+        return;
+    BlockMap::iterator mi = mapBlockIndex.find(wtx.hashBlock);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+        return;
+    CBlockIndex* pindex = mi->second;
+
+    //if zerocoinspend, then use the block time
+    int64_t nTxTime = wtx.GetTxTime();
+    if (!wtx.vin.empty() && wtx.vin[0].IsZerocoinSpend())
+        nTxTime = pindex->GetBlockTime();
+
+    // Same maturity rules as AvailableCoins followed by SelectStakeCoins
+    int nMinDepth = (wtx.IsCoinBase() || wtx.IsCoinStake()) ? Params().COINBASE_MATURITY() + 1 : 10;
+
+    const uint256 txid = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        const CTxOut& out = wtx.vout[i];
+        if (out.nValue <= 0 || out.IsZerocoinMint())
+            continue;
+        isminetype mine = wallet.IsMine(out);
+        if (mine == ISMINE_NO || mine == ISMINE_WATCH_ONLY)
+            continue;
+        if (wallet.IsSpent(txid, i))
+            continue;
+
+        CStakeCandidate candidate;
+        candidate.txid = txid;
+        candidate.nOut = i;
+        candidate.nValue = out.nValue;
+        candidate.pindexFrom = pindex;
+        candidate.nTxTime = nTxTime;
+        candidate.nMinDepth = nMinDepth;
+        mapCandidates[COutPoint(txid, i)] = candidate;
+    }
+}
+
+void CStakeCandidateSet::UpdateTransaction(const CWallet& wallet, const CWalletTx& wtx)
+{
+    if (fRebuild)
+        return;
+
+    // A conflicted spend gives its inputs back, which is easiest handled by a rebuild
+    if (wtx.GetDepthInMainChain(false) < 0) {
+        fRebuild = true;
+        return;
+    }
+
+    for (const CTxIn& txin : wtx.vin)
+        mapCandidates.erase(txin.prevout);
+
+    // The transaction may have moved into or out of a block
+    const uint256 txid = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++)
+        mapCandidates.erase(COutPoint(txid, i));
+    AddOutputs(wallet, wtx);
+}
+
+CStakeCandidateSet::CandidateMap& CStakeCandidateSet::GetCandidates(const CWallet& wallet)
+{
+    // A reorganization can disconnect the blocks candidates or their modifiers came from
+    if (pindexSynced && !chainActive.Contains(pindexSynced))
+        fRebuild = true;
+
+    if (fRebuild) {
+        mapCandidates.clear();
+        for (std::map<uint256, CWalletTx>::const_iterator it = wallet.mapWallet.begin(); it != wallet.mapWallet.end(); ++it)
+            AddOutputs(wallet, it->second);
+        fRebuild = false;
+        LogPrint("staking", "%s : rebuilt stake candidate set, %u outputs\n", __func__, mapCandidates.size());
+    }
+    pindexSynced = chainActive.Tip();
+    return mapCandidates;
+}
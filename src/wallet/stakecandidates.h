@@ -0,0 +1,74 @@
+// Copyright (c) 2019 The WISPR developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef WISPR_WALLET_STAKECANDIDATES_H
+#define WISPR_WALLET_STAKECANDIDATES_H
+
+#include "amount.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <map>
+
+class CBlockIndex;
+class CWallet;
+class CWalletTx;
+
+/**
+ * A confirmed wallet output that may stake, with the parts of the kernel input
+ * that do not change while its block stays in the active chain.
+ */
+class CStakeCandidate
+{
+public:
+    uint256 txid;
+    unsigned int nOut;
+    CAmount nValue;
+    CBlockIndex* pindexFrom;
+    int64_t nTxTime;
+    //! depth needed before the output is mature enough to stake
+    int nMinDepth;
+
+    CStakeCandidate() : nOut(0), nValue(0), pindexFrom(nullptr), nTxTime(0), nMinDepth(0), fModifier(false), nStakeModifier(0) {}
+
+    /** The kernel stake modifier, computed once the chain is long enough to fix it */
+    bool GetModifier(uint64_t& nStakeModifierRet);
+
+private:
+    bool fModifier;
+    uint64_t nStakeModifier;
+};
+
+/**
+ * Stakable outputs of a wallet, kept up to date as transactions are added
+ * instead of rescanning mapWallet every staking round. Spent and locked
+ * outputs are filtered by the caller. Guarded by cs_wallet.
+ */
+class CStakeCandidateSet
+{
+public:
+    typedef std::map<COutPoint, CStakeCandidate> CandidateMap;
+
+private:
+    CandidateMap mapCandidates;
+    //! chain tip the candidates were last checked against
+    CBlockIndex* pindexSynced;
+    bool fRebuild;
+
+    void AddOutputs(const CWallet& wallet, const CWalletTx& wtx);
+
+public:
+    CStakeCandidateSet() : pindexSynced(nullptr), fRebuild(true) {}
+
+    /** Recreate the set from mapWallet on next use */
+    void MarkDirty() { fRebuild = true; }
+
+    /** Called with a wallet transaction that was added or changed */
+    void UpdateTransaction(const CWallet& wallet, const CWalletTx& wtx);
+
+    /** The current candidates; rebuilt first if the set is dirty or the chain reorganized */
+    CandidateMap& GetCandidates(const CWallet& wallet);
+};
+
+#endif // WISPR_WALLET_STAKECANDIDATES_H
@@ -696,6 +696,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        stakeCandidates.UpdateTransaction(*this, wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -754,8 +755,10 @@ void CWallet::EraseFromWallet(const uint256& hash)
         return;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
             CWalletDB(strWalletFile).EraseTx(hash);
+            stakeCandidates.MarkDirty();
+        }
     }
     return;
 }
@@ -1789,38 +1792,45 @@ bool less_then_denom(const COutput& out1, const COutput& out2)
 
 bool CWallet::SelectStakeCoins(std::list<std::unique_ptr<CStakeInput> >& listInputs, CAmount nTargetAmount, bool fPrecompute)
 {
-    LOCK(cs_main);
+    LOCK2(cs_main, cs_wallet);
     //Add WSP
-    std::vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, NULL, false, STAKABLE_COINS);
     CAmount nAmountSelected = 0;
     if (GetBoolArg("-wspstake", true) && !fPrecompute) {
-        for (const COutput &out : vCoins) {
-            //make sure not to outrun target amount
-            if (nAmountSelected + out.tx->vout[out.i].nValue > nTargetAmount)
+        CStakeCandidateSet::CandidateMap& mapCandidates = stakeCandidates.GetCandidates(*this);
+        CStakeCandidateSet::CandidateMap::iterator it = mapCandidates.begin();
+        while (it != mapCandidates.end()) {
+            CStakeCandidate& candidate = it->second;
+            if (IsSpent(candidate.txid, candidate.nOut)) {
+                mapCandidates.erase(it++);
                 continue;
-
-            //if zerocoinspend, then use the block time
-            int64_t nTxTime = out.tx->GetTxTime();
-            if (out.tx->vin[0].IsZerocoinSpend()) {
-                if (!out.tx->IsInMainChain())
-                    continue;
-                nTxTime = mapBlockIndex.at(out.tx->hashBlock)->GetBlockTime();
             }
+            ++it;
+
+            if (IsLockedCoin(candidate.txid, candidate.nOut))
+                continue;
+
+            //make sure not to outrun target amount
+            if (nAmountSelected + candidate.nValue > nTargetAmount)
+                continue;
 
             //check for min age
-            if (GetAdjustedTime() - nTxTime < GetStakeMinAge() && Params().NetworkID() != CBaseChainParams::REGTEST)
+            if (GetAdjustedTime() - candidate.nTxTime < GetStakeMinAge() && Params().NetworkID() != CBaseChainParams::REGTEST)
                 continue;
 
             //check that it is matured
-            if (out.nDepth < (out.tx->IsCoinStake() ? Params().COINBASE_MATURITY() : 10))
+            if (chainActive.Height() - candidate.pindexFrom->nHeight + 1 < candidate.nMinDepth)
+                continue;
+
+            uint64_t nStakeModifier = 0;
+            if (!candidate.GetModifier(nStakeModifier))
                 continue;
 
             //add to our stake set
-            nAmountSelected += out.tx->vout[out.i].nValue;
+            nAmountSelected += candidate.nValue;
 
             std::unique_ptr<CWspStake> input(new CWspStake());
-            input->SetInput((CTransaction) *out.tx, out.i);
+            input->SetInput((CTransaction) mapWallet.at(candidate.txid), candidate.nOut);
+            input->SetKernelCache(candidate.pindexFrom, nStakeModifier);
             listInputs.emplace_back(std::move(input));
         }
     }
@@ -2375,12 +2385,9 @@ bool CWallet::CreateCoinStake(
         }
     }
 
-    CAmount nCredit;
-    CScript scriptPubKeyKernel;
-    bool fKernelFound = false;
-    int nAttempts = 0;
+    // Prepare the kernel of every input once, then hash them all together
+    std::vector<CStakeKernel> vKernels;
     for (std::unique_ptr<CStakeInput>& stakeInput : listInputs) {
-        nCredit = 0;
         // Make sure the wallet is unlocked and shutdown hasn't been requested
         if (IsLocked() || ShutdownRequested())
             return false;
@@ -2392,13 +2399,33 @@ bool CWallet::CreateCoinStake(
             continue;
         }
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
+        uint64_t nStakeModifier = 0;
+        if (!stakeInput->GetModifier(nStakeModifier)) {
+            LogPrintf("CreateCoinStake(): failed to get kernel stake modifier\n");
+            continue;
+        }
+        vKernels.push_back(CStakeKernel(stakeInput.get(), pindex->GetBlockTime(), nStakeModifier, nBits));
+    }
+
+    CAmount nCredit;
+    CScript scriptPubKeyKernel;
+    bool fKernelFound = false;
+    size_t nNextKernel = 0;
+    while (!fKernelFound) {
+        nCredit = 0;
+        if (IsLocked() || ShutdownRequested())
+            return false;
+
         uint256 hashProofOfStake = 0;
         nTxNewTime = GetAdjustedTime();
-        nAttempts++;
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (Stake(stakeInput.get(), nBits, block.GetBlockTime(), nTxNewTime, hashProofOfStake)) {
+        int nKernel = SearchStakeKernels(vKernels, nNextKernel, nTxNewTime, nStakeThreads, nTxNewTime, hashProofOfStake);
+        mapHashedBlocks.clear();
+        mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+        if (nKernel < 0)
+            break;
+        nNextKernel = nKernel + 1;
+        CStakeInput* stakeInput = vKernels[nKernel].stakeInput;
+        {
             //Double check that this will pass time requirements
             if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast() && Params().NetworkID() != CBaseChainParams::REGTEST) {
                 LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
@@ -2458,18 +2485,15 @@ bool CWallet::CreateCoinStake(
 
             //Mark mints as spent
             if (stakeInput->IsZWSP()) {
-                CZWspStake* z = (CZWspStake*)stakeInput.get();
+                CZWspStake* z = (CZWspStake*)stakeInput;
                 if (!z->MarkSpent(this, txNew.GetHash()))
                     return error("%s: failed to mark mint as used\n", __func__);
             }
 
             fKernelFound = true;
-            break;
         }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
     }
-    LogPrint("staking", "%s: attempted staking %d times\n", __func__, nAttempts);
+    LogPrint("staking", "%s: hashed kernels of %u inputs on %d threads\n", __func__, vKernels.size(), nStakeThreads);
 
     if (!fKernelFound)
         return false;
@@ -2641,6 +2665,11 @@ DBErrors CWallet::ZapWalletTx(std::vector<CWalletTx>& vWtx)
     if (nZapWalletTxRet != DB_LOAD_OK)
         return nZapWalletTxRet;
 
+    {
+        LOCK(cs_wallet);
+        stakeCandidates.MarkDirty();
+    }
+
     return DB_LOAD_OK;
 }
 
@@ -3947,8 +3976,9 @@ bool CWallet::MintsToInputVector(std::map<CBigNum, CZerocoinMint>& mapMintsSelec
             continue;
         }
 
+        std::vector<CWitnessJob> vJobs;
         for (auto &it : mapMintsSelected) {
-            CZerocoinMint mint = it.second;
+            CZerocoinMint& mint = it.second;
             CMintMeta meta = zwspTracker->Get(GetSerialHash(mint.GetSerialNumber()));
             CoinWitnessData *coinWitness = zwspTracker->GetSpendCache(meta.hashStake);
 
@@ -3956,13 +3986,20 @@ bool CWallet::MintsToInputVector(std::map<CBigNum, CZerocoinMint>& mapMintsSelec
                 *coinWitness = CoinWitnessData(mint);
                 coinWitness->SetHeightMintAdded(mint.GetHeight());
             }
+            vJobs.push_back(CWitnessJob(coinWitness, pindexCheckpoint));
+        }
 
-            // Generate the witness for each mint being spent
-            if (!GenerateAccumulatorWitness(coinWitness, mapAccumulators, pindexCheckpoint)) {
-                receipt.SetStatus(_("Couldn't generate the accumulator witness"),
-                                  ZWSP_FAILED_ACCUMULATOR_INITIALIZATION);
-                return error("%s : %s", __func__, receipt.GetStatusMessage());
-            }
+        // Generate the witnesses of all mints being spent in one pass over the chain
+        if (!GenerateAccumulatorWitnesses(vJobs, mapAccumulators)) {
+            receipt.SetStatus(_("Couldn't generate the accumulator witness"),
+                              ZWSP_FAILED_ACCUMULATOR_INITIALIZATION);
+            return error("%s : %s", __func__, receipt.GetStatusMessage());
+        }
+
+        unsigned int nJob = 0;
+        for (auto &it : mapMintsSelected) {
+            CZerocoinMint mint = it.second;
+            CoinWitnessData *coinWitness = vJobs[nJob++].pWitness;
 
             // Construct the CoinSpend object. This acts like a signature on the transaction.
             int64_t nTime1 = GetTimeMicros();
@@ -3986,6 +4023,7 @@ bool CWallet::MintsToInputVector(std::map<CBigNum, CZerocoinMint>& mapMintsSelec
             int64_t nTime3 = GetTimeMicros();
             LogPrint("bench", "        - Signing key set in %.2fms\n", 0.001 * (nTime3 - nTime2));
 
+            // All witnesses were generated for the same checkpoint, whose accumulators the map holds
             libzerocoin::Accumulator accumulator = mapAccumulators.GetAccumulator(coinWitness->denom);
             uint32_t nChecksum = GetChecksum(accumulator.getValue());
             CBigNum bnValue;
@@ -4798,6 +4836,18 @@ void ThreadPrecomputeSpends()
     LogPrintf("ThreadPrecomputeSpends exiting,\n");
 }
 
+/** Stops the precompute witness pass when a spend is waiting for cs_spendcache */
+struct CPrecomputeProgress {
+    const CWallet* pwallet;
+
+    CPrecomputeProgress(const CWallet* pwalletIn) : pwallet(pwalletIn) {}
+
+    bool operator()(const std::vector<CoinWitnessData*>& vWitnesses) const
+    {
+        return !fGlobalUnlockSpendCache && !fClearSpendCache && !ShutdownRequested() && !pwallet->IsLocked();
+    }
+};
+
 void CWallet::PrecomputeSpends()
 {
     LogPrintf("Precomputer started\n");
@@ -4868,150 +4918,155 @@ void CWallet::PrecomputeSpends()
                      item_map.size());
         }
 
-        // Do some precomputing of zerocoin spend knowledge proofs
+        // Do some precomputing of zerocoin spend knowledge proofs. The witnesses of all inputs are
+        // generated in one pass over the chain, which a spend waiting for cs_spendcache interrupts.
         std::set <uint256> setInputHashes;
-        for (std::unique_ptr <CStakeInput>& stakeInput : listInputs) {
-            if (ShutdownRequested() || IsLocked())
-                break;
+        {
+            TRY_LOCK(zwspTracker->cs_spendcache, fLocked);
+
+            // When we see a clear spend cache bool set to true, skip this round
+            // All cache data will be cleared at the beginning of the while loop above
+            if (fLocked && !fGlobalUnlockSpendCache && !fClearSpendCache) {
+                std::vector<CWitnessJob> vJobs;
+                std::vector<uint256> vJobHashes;
+                for (std::unique_ptr <CStakeInput>& stakeInput : listInputs) {
+                    if (fGlobalUnlockSpendCache || fClearSpendCache || ShutdownRequested() || IsLocked())
+                        break;
 
-            CoinWitnessCacheData tempDataHolder;
+                    CoinWitnessCacheData tempDataHolder;
+                    uint256 serialHash = stakeInput->GetSerialHash();
+                    setInputHashes.insert(serialHash);
+                    CoinWitnessData* witnessData = zwspTracker->GetSpendCache(serialHash);
+
+                    // Initialize nHeightStop so it can be set below
+                    int nHeightStop = 0;
+
+                    if (witnessData->nHeightAccStart) { // Witness is already valid
+                        nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
+                                               (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd
+                                                                           : witnessData->nHeightAccStart) +
+                                               nAdjustableCacheLength);
+                    } else if (item_map.count(serialHash)) { // Check Database cache
+                        // Get the witness data from the cache
+                        auto it = item_map.find(serialHash);
+                        item_list.splice(item_list.begin(), item_list, it->second);
+
+                        *witnessData = CoinWitnessData(it->second->second);
+
+                        // Set the stop height from the variables received from the database cache
+                        nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
+                                               (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd
+                                                                           : witnessData->nHeightAccStart) +
+                                               nAdjustableCacheLength);
+
+                        LogPrint("precompute", "%s: Got Witness Data from lru cache: %s\n", __func__,
+                                 witnessData->ToString());
+                    } else if (mapDirtyWitnessData.count(serialHash) || walletdb.ReadPrecompute(serialHash, tempDataHolder)) {
+                        if (mapDirtyWitnessData.count(serialHash)) {
+                            // Get the witness data from the dirty cache if it exists
+                            *witnessData = CoinWitnessData(mapDirtyWitnessData.at(serialHash));
+                            LogPrint("precompute", "%s: Got Witness Data from mapDirtyWitnessData: %s\n", __func__,
+                                     witnessData->ToString());
+                        } else {
+                            // Get the witness data from the database
+                            *witnessData = CoinWitnessData(tempDataHolder);
+                            LogPrint("precompute", "%s: Got Witness Data from precompute database: %s\n", __func__,
+                                     witnessData->ToString());
+                        }
 
-            {
-                TRY_LOCK(zwspTracker->cs_spendcache, fLocked);
-                if (!fLocked)
-                    continue;
+                        // Set the stop height from the variables received from the database cache
+                        nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
+                                               (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd
+                                                                           : witnessData->nHeightAccStart) +
+                                               nAdjustableCacheLength);
+
+                        // Add the serialHash found into the cache
+                        item_list.push_front(std::make_pair(serialHash, tempDataHolder));
+                        item_map.insert(std::make_pair(serialHash, item_list.begin()));
+
+                        // We just added a new hash into our LRU cache, so remove it if we also have it in the dirty map
+                        mapDirtyWitnessData.erase(serialHash);
+
+                        if (item_map.size() > PRECOMPUTE_LRU_CACHE_SIZE) {
+                            auto last_it = item_list.end(); last_it --;
+                            item_map.erase(last_it->first);
+                            CoinWitnessCacheData removedData = item_list.back().second;
+                            mapDirtyWitnessData[serialHash] = removedData;
+                            item_list.pop_back();
+                        }
+                    } else { // This has no cache, so initialize it
+                        CZerocoinMint mint;
+                        if (!GetMintFromStakeHash(serialHash, mint))
+                            continue;
+                        *witnessData = CoinWitnessData(mint);
+                        nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
+                                               mint.GetHeight() + nAdjustableCacheLength);
+                    }
 
-                if (fGlobalUnlockSpendCache) {
-                    break;
-                }
+                    if (nHeightStop - (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd : witnessData->nHeightAccStart) < 20)
+                        continue;
 
-                // When we see a clear spend cache bool set to true, break out of the loop
-                // All cache data will be cleared at the beginning of the while loop above
-                if (fClearSpendCache) {
-                    break;
+                    LogPrint("precompute","%s: caching mint %s of denom %d start=%d stop=%d end=%s\n", __func__,
+                              witnessData->coin->getValue().GetHex().substr(0, 6),
+                              ZerocoinDenominationToInt(witnessData->denom),
+                              witnessData->nHeightAccStart, nHeightStop, witnessData->nHeightAccEnd);
+                    vJobs.push_back(CWitnessJob(witnessData, chainActive[nHeightStop]));
+                    vJobHashes.push_back(serialHash);
                 }
 
-                uint256 serialHash = stakeInput->GetSerialHash();
-                setInputHashes.insert(serialHash);
-                CoinWitnessData* witnessData = zwspTracker->GetSpendCache(serialHash);
+                AccumulatorMap mapAccumulators(Params().Zerocoin_Params(false));
+                if (!vJobs.empty())
+                    GenerateAccumulatorWitnesses(vJobs, mapAccumulators, CPrecomputeProgress(this));
+
+                for (unsigned int i = 0; i < vJobs.size(); i++) {
+                    const uint256& serialHash = vJobHashes[i];
+                    if (!vJobs[i].strError.empty()) {
+                        LogPrintf("%s: Generate witness failed!\n", __func__);
+
+                        // If we fail this check, we need to make sure we remove this from the LRU cache
+                        auto it = item_map.find(serialHash);
+                        if (it != item_map.end())
+                        {
+                            item_list.erase(it->second);
+                            item_map.erase(it);
+                        }
+                        mapDirtyWitnessData.erase(serialHash);
+                        walletdb.ErasePrecompute(serialHash);
+                        continue;
+                    }
+
+                    // The pass was stopped before this witness was set up, there is nothing new to cache
+                    if (!vJobs[i].pWitness->pAccumulator)
+                        continue;
 
-                // Initialize nHeightStop so it can be set below
-                int nHeightStop = 0;
+                    // A witness the pass was stopped on is cached as far as it got, and continued next round
+                    CoinWitnessCacheData serialData(vJobs[i].pWitness);
 
-                if (witnessData->nHeightAccStart) { // Witness is already valid
-                    nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
-                                           (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd
-                                                                       : witnessData->nHeightAccStart) +
-                                           nAdjustableCacheLength);
-                } else if (item_map.count(serialHash)) { // Check Database cache
-                    // Get the witness data from the cache
+                    // If the LRU cache already has a entry for it, update the entry and move it to the front of the list
                     auto it = item_map.find(serialHash);
-                    item_list.splice(item_list.begin(), item_list, it->second);
-
-                    *witnessData = CoinWitnessData(it->second->second);
-
-                    // Set the stop height from the variables received from the database cache
-                    nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
-                                           (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd
-                                                                       : witnessData->nHeightAccStart) +
-                                           nAdjustableCacheLength);
-
-                    LogPrint("precompute", "%s: Got Witness Data from lru cache: %s\n", __func__,
-                             witnessData->ToString());
-                } else if (mapDirtyWitnessData.count(serialHash) || walletdb.ReadPrecompute(serialHash, tempDataHolder)) {
-                    if (mapDirtyWitnessData.count(serialHash)) {
-                        // Get the witness data from the dirty cache if it exists
-                        *witnessData = CoinWitnessData(mapDirtyWitnessData.at(serialHash));
-                        LogPrint("precompute", "%s: Got Witness Data from mapDirtyWitnessData: %s\n", __func__,
-                                 witnessData->ToString());
+                    if (it != item_map.end()) {
+                        item_list.splice(item_list.begin(), item_list, it->second);
+                        item_list.begin()->second = serialData;
                     } else {
-                        // Get the witness data from the database
-                        *witnessData = CoinWitnessData(tempDataHolder);
-                        LogPrint("precompute", "%s: Got Witness Data from precompute database: %s\n", __func__,
-                                 witnessData->ToString());
+                        item_list.push_front(std::make_pair(serialHash, serialData));
+                        item_map.insert(std::make_pair(serialHash, item_list.begin()));
                     }
 
-                    // Set the stop height from the variables received from the database cache
-                    nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
-                                           (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd
-                                                                       : witnessData->nHeightAccStart) +
-                                           nAdjustableCacheLength);
-
-                    // Add the serialHash found into the cache
-                    item_list.push_front(std::make_pair(serialHash, tempDataHolder));
-                    item_map.insert(std::make_pair(serialHash, item_list.begin()));
-
                     // We just added a new hash into our LRU cache, so remove it if we also have it in the dirty map
                     mapDirtyWitnessData.erase(serialHash);
 
-                    if (item_map.size() > PRECOMPUTE_LRU_CACHE_SIZE) {
+                    // Clean up the LRU cache to the max size
+                    while (item_map.size() > PRECOMPUTE_LRU_CACHE_SIZE) {
                         auto last_it = item_list.end(); last_it --;
                         item_map.erase(last_it->first);
-                        CoinWitnessCacheData removedData = item_list.back().second;
-                        mapDirtyWitnessData[serialHash] = removedData;
+                        mapDirtyWitnessData[serialHash] = item_list.back().second;
                         item_list.pop_back();
                     }
-                } else { // This has no cache, so initialize it
-                    CZerocoinMint mint;
-                    if (!GetMintFromStakeHash(serialHash, mint))
-                        continue;
-                    *witnessData = CoinWitnessData(mint);
-                    nHeightStop = std::min(chainActive.Height() - nRequiredStakeDepthBuffer,
-                                           mint.GetHeight() + nAdjustableCacheLength);
-                }
-
-                if (nHeightStop - (witnessData->nHeightAccEnd ? witnessData->nHeightAccEnd : witnessData->nHeightAccStart) < 20)
-                    continue;
-
-                CBlockIndex* pindexStop = chainActive[nHeightStop];
-                AccumulatorMap mapAccumulators(Params().Zerocoin_Params(false));
-                LogPrint("precompute","%s: caching mint %s of denom %d start=%d stop=%d end=%s\n", __func__,
-                          witnessData->coin->getValue().GetHex().substr(0, 6),
-                          ZerocoinDenominationToInt(witnessData->denom),
-                          witnessData->nHeightAccStart, nHeightStop, witnessData->nHeightAccEnd);
-
-                if (!GenerateAccumulatorWitness(witnessData, mapAccumulators, pindexStop)) {
-                    LogPrintf("%s: Generate witness failed!\n", __func__);
-
-                    // If we fail this check, we need to make sure we remove this from the LRU cache
-                    auto it = item_map.find(serialHash);
-                    if (it != item_map.end())
-                    {
-                        item_list.erase(it->second);
-                        item_map.erase(it);
-                    }
-                    mapDirtyWitnessData.erase(serialHash);
-                    walletdb.ErasePrecompute(serialHash);
-                    continue;
-                }
-
-
-                CoinWitnessCacheData serialData(witnessData);
-
-                // If the LRU cache already has a entry for it, update the entry and move it to the front of the list
-                auto it = item_map.find(serialHash);
-                if (it != item_map.end()) {
-                    item_list.splice(item_list.begin(), item_list, it->second);
-                    item_list.begin()->second = serialData;
-                } else {
-                    item_list.push_front(std::make_pair(serialHash, serialData));
-                    item_map.insert(std::make_pair(serialHash, item_list.begin()));
-                }
-
-                // We just added a new hash into our LRU cache, so remove it if we also have it in the dirty map
-                mapDirtyWitnessData.erase(serialHash);
-
-                // Clean up the LRU cache to the max size
-                while (item_map.size() > PRECOMPUTE_LRU_CACHE_SIZE) {
-                    auto last_it = item_list.end(); last_it --;
-                    item_map.erase(last_it->first);
-                    mapDirtyWitnessData[serialHash] = item_list.back().second;
-                    item_list.pop_back();
                 }
             }
-            // Sleep for 150ms to allow any potential spend attempt
-            MilliSleep(150);
         }
+        // Sleep for 150ms to allow any potential spend attempt
+        MilliSleep(150);
 
         if (fGlobalUnlockSpendCache) {
             fGlobalUnlockSpendCache = false;
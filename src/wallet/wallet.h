@@ -21,6 +21,7 @@
 #include "guiinterface.h"
 #include "util.h"
 #include "validationinterface.h"
+#include "wallet/stakecandidates.h"
 #include "wallet/wallet_ismine.h"
 #include "wallet/walletdb.h"
 #include "zpiv/zwspmodule.h"
@@ -265,6 +266,7 @@ public:
     unsigned int nHashInterval;
     uint64_t nStakeSplitThreshold;
     int nStakeSetUpdateTime;
+    CStakeCandidateSet stakeCandidates;
 
     //MultiSend
     std::vector<std::pair<std::string, int> > vMultiSend;
@@ -7,7 +7,10 @@
 
 #include "zmqconfig.h"
 
+#include <memory>
+
 class CBlockIndex;
+class CDataStream;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
@@ -32,8 +35,8 @@ public:
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CDataStream>& pblockData);
+    virtual bool NotifyTransaction(const CTransaction &transaction, const CBlock *pblock);
     virtual bool NotifyTransactionLock(const CTransaction &transaction);
 
 protected:
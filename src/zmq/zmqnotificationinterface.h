@@ -12,6 +12,9 @@
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+/** Default for -zmqpubhwm, the messages queued for sending before new ones are dropped */
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+
 class CZMQNotificationInterface : public CValidationInterface
 {
 public:
@@ -25,7 +28,7 @@ protected:
 
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
-    void UpdatedBlockTip(const CBlockIndex *pindex);
+    void UpdatedBlockTip(const CBlockIndex *pindex, const std::shared_ptr<const CDataStream>& pblockData);
     void NotifyTransactionLock(const CTransaction &tx);
 
 private:
@@ -4,10 +4,17 @@
 
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
+#include "zmqnotificationinterface.h"
 #include "main.h"
+#include "streams.h"
 #include "util.h"
+#include "validationinterface.h"
 #include "crypto/common.h"
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK  = "hashblock";
@@ -16,6 +23,7 @@ static const char *MSG_HASHTXLOCK = "hashtxlock";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_SEQUENCE  = "sequence";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -57,6 +65,126 @@ static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
     return 0;
 }
 
+bool CZMQMessageQueue::Push(const CZMQOutgoingMessage& msg)
+{
+    if (queue.size() >= nMaxMessages || nBytes + msg.pdata->size() > nMaxBytes)
+    {
+        nDropped++;
+        return false;
+    }
+    nBytes += msg.pdata->size();
+    queue.push_back(msg);
+    return true;
+}
+
+bool CZMQMessageQueue::Pop(CZMQOutgoingMessage& msg)
+{
+    if (queue.empty())
+        return false;
+    msg = queue.front();
+    queue.pop_front();
+    nBytes -= msg.pdata->size();
+    return true;
+}
+
+void CZMQMessageQueue::EraseSocket(void *psocket)
+{
+    for (std::deque<CZMQOutgoingMessage>::iterator it = queue.begin(); it != queue.end(); )
+    {
+        if (it->psocket == psocket)
+        {
+            nBytes -= it->pdata->size();
+            it = queue.erase(it);
+        }
+        else
+            it++;
+    }
+}
+
+/** State shared between the notifiers and the sender thread */
+struct CZMQSendQueue {
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    //! signalled when the sender is done with a message
+    boost::condition_variable condSent;
+    CZMQMessageQueue messages;
+    //! socket of the message being sent, if any
+    void *psending;
+    bool fStop;
+    boost::thread *pthread;
+
+    CZMQSendQueue() : messages(DEFAULT_ZMQ_SNDHWM, MAX_ZMQ_QUEUE_BYTES), psending(nullptr), fStop(false), pthread(nullptr) {}
+};
+
+static CZMQSendQueue sendQueue;
+
+static void ThreadZMQSender()
+{
+    RenameThread("wispr-zmqsend");
+    while (true)
+    {
+        CZMQOutgoingMessage msg;
+        {
+            boost::unique_lock<boost::mutex> lock(sendQueue.mutex);
+            while (!sendQueue.fStop && sendQueue.messages.Empty())
+                sendQueue.cond.wait(lock);
+            // Once stopped, keep going until the queue is empty
+            if (!sendQueue.messages.Pop(msg))
+                return;
+            sendQueue.psending = msg.psocket;
+        }
+
+        /* send three parts, command & data & a LE 4byte sequence number */
+        unsigned char msgseq[sizeof(uint32_t)];
+        WriteLE32(&msgseq[0], msg.nSequence);
+        // Errors are logged by zmq_send_multipart; the subscriber sees the gap
+        zmq_send_multipart(msg.psocket, msg.command, strlen(msg.command), &(*msg.pdata->begin()), msg.pdata->size(), msgseq, (size_t)sizeof(uint32_t), (void*) nullptr);
+
+        {
+            boost::unique_lock<boost::mutex> lock(sendQueue.mutex);
+            sendQueue.psending = nullptr;
+        }
+        sendQueue.condSent.notify_all();
+    }
+}
+
+// Forget the queued messages for a socket about to be closed
+static void DropQueuedMessages(void *psocket)
+{
+    boost::unique_lock<boost::mutex> lock(sendQueue.mutex);
+    sendQueue.messages.EraseSocket(psocket);
+    while (sendQueue.psending == psocket)
+        sendQueue.condSent.wait(lock);
+}
+
+void StartZMQSender(int nHighWaterMark)
+{
+    boost::unique_lock<boost::mutex> lock(sendQueue.mutex);
+    assert(!sendQueue.pthread);
+    sendQueue.messages.SetMaxMessages(std::max(nHighWaterMark, 1));
+    sendQueue.messages.ResetDropped();
+    sendQueue.fStop = false;
+    sendQueue.pthread = new boost::thread(&ThreadZMQSender);
+}
+
+void StopZMQSender()
+{
+    boost::thread *pthread;
+    {
+        boost::unique_lock<boost::mutex> lock(sendQueue.mutex);
+        pthread = sendQueue.pthread;
+        sendQueue.pthread = nullptr;
+        sendQueue.fStop = true;
+    }
+    if (!pthread)
+        return;
+    sendQueue.cond.notify_all();
+    pthread->join();
+    delete pthread;
+    if (sendQueue.messages.Dropped())
+        LogPrintf("zmq: %u messages dropped because the send queue was full\n", sendQueue.messages.Dropped());
+}
+
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 {
     assert(!psocket);
@@ -73,7 +201,16 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        int hwm = std::max((int)GetArg("-zmqpubhwm", DEFAULT_ZMQ_SNDHWM), 1);
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &hwm, sizeof(hwm));
+        if (rc!=0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -118,6 +255,7 @@ void CZMQAbstractPublishNotifier::Shutdown()
     if (count == 1)
     {
         LogPrint("zmq", "Close socket at address %s\n", address);
+        DropQueuedMessages(psocket);
         int linger = 0;
         zmq_setsockopt(psocket, ZMQ_LINGER, &linger, sizeof(linger));
         zmq_close(psocket);
@@ -126,40 +264,59 @@ void CZMQAbstractPublishNotifier::Shutdown()
     psocket = nullptr;
 }
 
-bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const std::shared_ptr<const CDataStream>& pdata)
 {
     assert(psocket);
 
-    /* send three parts, command & data & a LE 4byte sequence number */
-    unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*) nullptr);
-    if (rc == -1)
-        return false;
+    CZMQOutgoingMessage msg;
+    msg.psocket = psocket;
+    msg.command = command;
+    msg.pdata = pdata;
+    /* increment memory only sequence number, whether or not the message is sent */
+    msg.nSequence = nSequence++;
 
-    /* increment memory only sequence number after sending */
-    nSequence++;
+    {
+        boost::unique_lock<boost::mutex> lock(sendQueue.mutex);
+        if (!sendQueue.pthread)
+            return false;
+        if (!sendQueue.messages.Push(msg))
+        {
+            LogPrint("zmq", "zmq: Send queue full, dropped %s message %u\n", command, msg.nSequence);
+            return true;
+        }
+    }
+    sendQueue.cond.notify_one();
 
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+{
+    const char *pbegin = (const char*)data;
+    return SendMessage(command, std::make_shared<const CDataStream>(pbegin, pbegin + size, SER_NETWORK, PROTOCOL_VERSION));
+}
+
+static void HashToData(const uint256 &hash, char *data)
+{
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+}
+
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CDataStream>& /*pblockData*/)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
     char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
+    HashToData(hash, data);
     return SendMessage(MSG_HASHBLOCK, data, 32);
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction, const CBlock * /*pblock*/)
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish hashtx %s\n", hash.GetHex());
     char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
+    HashToData(hash, data);
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
@@ -168,17 +325,35 @@ bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransa
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish hashtxlock %s\n", hash.GetHex());
     char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
+    HashToData(hash, data);
     return SendMessage(MSG_HASHTXLOCK, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::Initialize(void *pcontext)
+{
+    if (!CZMQAbstractPublishNotifier::Initialize(pcontext))
+        return false;
+    RegisterBlockDataListener();
+    return true;
+}
+
+void CZMQPublishRawBlockNotifier::Shutdown()
+{
+    UnregisterBlockDataListener();
+    CZMQAbstractPublishNotifier::Shutdown();
+}
+
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CDataStream>& pblockData)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
+    // The connect path hands over the serialized block when it has it at
+    // hand; only a tip connected from disk and not cached is read back here
+    if (pblockData)
+        return SendMessage(MSG_RAWBLOCK, pblockData);
+
 // XX42    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    std::shared_ptr<CDataStream> ss = std::make_shared<CDataStream>(SER_NETWORK, PROTOCOL_VERSION);
     {
         LOCK(cs_main);
         CBlock block;
@@ -189,26 +364,50 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
             return false;
         }
 
-        ss << block;
+        *ss << block;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, ss);
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction, const CBlock * /*pblock*/)
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    std::shared_ptr<CDataStream> ss = std::make_shared<CDataStream>(SER_NETWORK, PROTOCOL_VERSION);
+    *ss << transaction;
+    return SendMessage(MSG_RAWTX, ss);
 }
 
 bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
 {
     uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish rawtxlock %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
+    std::shared_ptr<CDataStream> ss = std::make_shared<CDataStream>(SER_NETWORK, PROTOCOL_VERSION);
+    *ss << transaction;
+    return SendMessage(MSG_RAWTXLOCK, ss);
+}
+
+static bool SendSequence(CZMQAbstractPublishNotifier *notifier, const uint256 &hash, char label)
+{
+    LogPrint("zmq", "zmq: Publish sequence %s %c\n", hash.GetHex(), label);
+    char data[33];
+    HashToData(hash, data);
+    data[32] = label;
+    return notifier->SendMessage(MSG_SEQUENCE, data, sizeof(data));
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CDataStream>& /*pblockData*/)
+{
+    return SendSequence(this, pindex->GetBlockHash(), 'C');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransaction(const CTransaction &transaction, const CBlock *pblock)
+{
+    return SendSequence(this, transaction.GetHash(), pblock ? 'B' : 'A');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionLock(const CTransaction &transaction)
+{
+    return SendSequence(this, transaction.GetHash(), 'L');
 }
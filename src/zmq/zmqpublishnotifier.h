@@ -7,21 +7,78 @@
 
 #include "zmqabstractnotifier.h"
 
+#include <deque>
+
 class CBlockIndex;
 
+/** Bytes queued for sending before new messages are dropped */
+static const size_t MAX_ZMQ_QUEUE_BYTES = 64 << 20;
+
+/** A message waiting for the sender thread */
+struct CZMQOutgoingMessage {
+    void *psocket;
+    const char *command;
+    std::shared_ptr<const CDataStream> pdata;
+    uint32_t nSequence;
+};
+
+/**
+ * Messages waiting for the sender thread. A message that would take the
+ * queue past nMaxMessages messages or nMaxBytes bytes is dropped. Not
+ * thread safe; the sender's queue is used under its mutex.
+ */
+class CZMQMessageQueue
+{
+private:
+    std::deque<CZMQOutgoingMessage> queue;
+    size_t nBytes;
+    size_t nMaxMessages;
+    size_t nMaxBytes;
+    uint64_t nDropped;
+
+public:
+    CZMQMessageQueue(size_t nMaxMessagesIn, size_t nMaxBytesIn) : nBytes(0), nMaxMessages(nMaxMessagesIn), nMaxBytes(nMaxBytesIn), nDropped(0) {}
+
+    void SetMaxMessages(size_t nMaxMessagesIn) { nMaxMessages = nMaxMessagesIn; }
+    //! Queue msg, or drop it and return false if the queue is full
+    bool Push(const CZMQOutgoingMessage& msg);
+    //! Take the oldest message, false if there is none
+    bool Pop(CZMQOutgoingMessage& msg);
+    //! Forget the messages for psocket
+    void EraseSocket(void *psocket);
+
+    bool Empty() const { return queue.empty(); }
+    size_t Size() const { return queue.size(); }
+    size_t Bytes() const { return nBytes; }
+    uint64_t Dropped() const { return nDropped; }
+    void ResetDropped() { nDropped = 0; }
+};
+
+/**
+ * Messages are published by a dedicated thread, so a slow subscriber or a
+ * large block never holds up the notification queue. Start it once the
+ * sockets are bound; stopping it sends what is still queued.
+ */
+void StartZMQSender(int nHighWaterMark);
+void StopZMQSender();
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
     uint32_t nSequence; // upcounting per message sequence number
 
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0) {}
 
-    /* send zmq multipart message
+    /* queue zmq multipart message for the sender thread
        parts:
           * command
           * data
           * message sequence number
+       The sequence number is taken even if the queue is full and the
+       message is dropped, so subscribers see the gap.
     */
+    bool SendMessage(const char *command, const std::shared_ptr<const CDataStream>& pdata);
     bool SendMessage(const char *command, const void* data, size_t size);
 
     bool Initialize(void *pcontext);
@@ -31,13 +88,13 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CDataStream>& pblockData);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(const CTransaction &transaction, const CBlock *pblock);
 };
 
 class CZMQPublishHashTransactionLockNotifier : public CZMQAbstractPublishNotifier
@@ -49,13 +106,17 @@ public:
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    /** Asks for the serialized tip block while the socket is open */
+    bool Initialize(void *pcontext);
+    void Shutdown();
+
+    bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CDataStream>& pblockData);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransaction(const CTransaction &transaction, const CBlock *pblock);
 };
 
 class CZMQPublishRawTransactionLockNotifier : public CZMQAbstractPublishNotifier
@@ -64,4 +125,19 @@ public:
     bool NotifyTransactionLock(const CTransaction &transaction);
 };
 
+/**
+ * Publishes the hash of every block tip, transaction and transaction lock
+ * the other topics are about, followed by a one byte label: 'C' for a new
+ * tip, 'A' for a transaction outside a block, 'B' for one in a connected
+ * block and 'L' for a lock. Its sequence number tells subscribers of the
+ * raw topics what they missed.
+ */
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlock(const CBlockIndex *pindex, const std::shared_ptr<const CDataStream>& pblockData);
+    bool NotifyTransaction(const CTransaction &transaction, const CBlock *pblock);
+    bool NotifyTransactionLock(const CTransaction &transaction);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
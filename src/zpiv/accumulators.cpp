@@ -13,6 +13,8 @@
 #include "zwspchain.h"
 #include "tinyformat.h"
 
+#include <limits>
+
 
 std::map<uint32_t, CBigNum> mapAccumulatorValues;
 std::list<uint256> listAccCheckpointsNoDB;
@@ -355,7 +357,7 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
     CBlockIndex* pindex = chainActive[GetZerocoinStartHeight()];
     int n = 0;
     while (pindex->nHeight < nHeightEnd) {
-        n += count(pindex->vMintDenominationsInBlock.begin(), pindex->vMintDenominationsInBlock.end(), denom);
+        n += pindex->mintsInBlock.Count(denom);
         pindex = chainActive.Next(pindex);
     }
 
@@ -364,13 +366,18 @@ int ComputeAccumulatedCoins(int nHeightEnd, libzerocoin::CoinDenomination denom)
 
 
 std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex){
-    //grab mints from this block
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    if (zerocoinDB->ReadBlockMints(pindex->GetBlockHash(), listPubcoins))
+        return listPubcoins;
+
+    //grab mints from this block, it was connected before the mints were indexed
     CBlock block;
     if(!ReadBlockFromDisk(block, pindex))
         throw GetPubcoinException("GetPubcoinFromBlock: failed to read block from disk while adding pubcoins to witness");
-    std::list<libzerocoin::PublicCoin> listPubcoins;
     if(!BlockToPubcoinList(block, listPubcoins, true))
         throw GetPubcoinException("GetPubcoinFromBlock: failed to get zerocoin mintlist from block "+std::to_string(pindex->nHeight)+"\n");
+    if (!zerocoinDB->WriteBlockMints(pindex->GetBlockHash(), listPubcoins))
+        LogPrintf("%s: failed to index the mints of block %s\n", __func__, pindex->GetBlockHash().GetHex());
     return listPubcoins;
 }
 
@@ -424,19 +431,6 @@ int AddBlockMintsToAccumulator(const libzerocoin::PublicCoin& coin, const int nH
 }
 
 
-int AddBlockMintsToAccumulator(CoinWitnessData* coinWitness, const CBlockIndex* pindex, bool isWitness)
-{
-    // TODO: This should be the witness..
-    return AddBlockMintsToAccumulator(
-            *coinWitness->coin.get(),
-            coinWitness->nHeightMintAdded,
-            pindex,
-            coinWitness->pAccumulator.get(),
-            isWitness
-    );
-}
-
-
 bool GetAccumulatorValue(int& nHeight, const libzerocoin::CoinDenomination denom, CBigNum& bnAccValue)
 {
     if (nHeight > chainActive.Height())
@@ -506,103 +500,229 @@ int SearchMintHeightOf(CBigNum value){
 }
 
 
-void AccumulateRange(CoinWitnessData* coinWitness, int nHeightEnd)
+// Add the mints of a block to the witnesses of coins of any denomination, reading them at most once
+static void AddBlockMintsToWitnesses(const std::vector<CoinWitnessData*>& vWitnesses, const CBlockIndex* pindex)
 {
-    bool fDoubleCounted = false;
-    int64_t nTimeStart = GetTimeMicros();
-    int nHeightStart = std::max(coinWitness->nHeightAccStart, coinWitness->nHeightAccEnd + 1);
-    CBlockIndex* pindex = chainActive[nHeightStart];
+    bool fMinted = false;
+    for (const CoinWitnessData* coinWitness : vWitnesses) {
+        if (pindex->MintedDenomination(coinWitness->denom)) {
+            fMinted = true;
+            break;
+        }
+    }
 
-    LogPrint("zero", "%s: start=%d end=%d\n", __func__, nHeightStart, nHeightEnd);
-    while (pindex && pindex->nHeight <= nHeightEnd) {
-        coinWitness->nMintsAdded += AddBlockMintsToAccumulator(coinWitness, pindex, true);
+    std::list<libzerocoin::PublicCoin> listPubcoins;
+    if (fMinted)
+        listPubcoins = GetPubcoinFromBlock(pindex);
+
+    for (CoinWitnessData* coinWitness : vWitnesses) {
+        const libzerocoin::PublicCoin& coin = *coinWitness->coin;
+        for (const libzerocoin::PublicCoin& pubcoin : listPubcoins) {
+            if (pubcoin.getDenomination() != coin.getDenomination())
+                continue;
+
+            if (pindex->nHeight == coinWitness->nHeightMintAdded && pubcoin.getValue() == coin.getValue())
+                continue;
+
+            coinWitness->pAccumulator->increment(pubcoin.getValue());
+            ++coinWitness->nMintsAdded;
+        }
         coinWitness->nHeightAccEnd = pindex->nHeight;
+    }
+}
+
+
+bool AccumulateWitnesses(const std::vector<std::pair<CoinWitnessData*, int> >& vRanges, const WitnessProgressFn& fnProgress)
+{
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<int> vHeightFrom(vRanges.size());
+    int nHeightStart = std::numeric_limits<int>::max();
+    int nHeightEnd = -1;
+    for (unsigned int i = 0; i < vRanges.size(); i++) {
+        vHeightFrom[i] = std::max(vRanges[i].first->nHeightAccStart, vRanges[i].first->nHeightAccEnd + 1);
+        if (vHeightFrom[i] <= vRanges[i].second) {
+            nHeightStart = std::min(nHeightStart, vHeightFrom[i]);
+            nHeightEnd = std::max(nHeightEnd, vRanges[i].second);
+        }
+    }
+
+    LogPrint("zero", "%s: %u witnesses start=%d end=%d\n", __func__, vRanges.size(), nHeightStart, nHeightEnd);
+    const int nHeightDoubleAccumulated = Params().Zerocoin_Block_Double_Accumulated();
+    std::vector<CoinWitnessData*> vActive;
+    int nBlocks = 0;
+    for (int nHeight = nHeightStart; nHeight <= nHeightEnd; nHeight++) {
+        CBlockIndex* pindex = chainActive[nHeight];
+        if (!pindex)
+            break;
+
+        vActive.clear();
+        for (unsigned int i = 0; i < vRanges.size(); i++) {
+            if (vHeightFrom[i] <= nHeight && nHeight <= vRanges[i].second)
+                vActive.push_back(vRanges[i].first);
+        }
+        AddBlockMintsToWitnesses(vActive, pindex);
 
         // 10 blocks were accumulated twice when zWSP v2 was activated
-        if (pindex->nHeight == Params().Zerocoin_Block_Double_Accumulated() + 10 && !fDoubleCounted) {
-            pindex = chainActive[Params().Zerocoin_Block_Double_Accumulated()];
-            fDoubleCounted = true;
-            continue;
+        if (nHeight == nHeightDoubleAccumulated + 10) {
+            for (int nHeightAgain = nHeightDoubleAccumulated; nHeightAgain <= nHeight; nHeightAgain++)
+                AddBlockMintsToWitnesses(vActive, chainActive[nHeightAgain]);
         }
 
-        pindex = chainActive.Next(pindex);
+        if (fnProgress && ++nBlocks % WITNESS_PROGRESS_INTERVAL == 0 && !fnProgress(vActive)) {
+            LogPrint("zero", "%s: stopped at height %d\n", __func__, nHeight);
+            return false;
+        }
     }
     int64_t nTimeEnd = GetTimeMicros();
     LogPrint("bench", "        - Range accumulation completed in %.2fms\n", 0.001 * (nTimeEnd - nTimeStart));
+    return true;
 }
 
 
-bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& mapAccumulators, CBlockIndex* pindexCheckpoint)
+// Set up the accumulator of a coin and return the height its witness is generated up to
+static int PrepareWitness(CoinWitnessData* coinWitness, CBlockIndex* pindexCheckpoint, int nHeightMax)
 {
-    try {
-        // Lock
-        LogPrint("zero", "%s: generating\n", __func__);
-        if (!LockMethod()) return false;
-        LogPrint("zero", "%s: after lock\n", __func__);
+    //If there is a Acc End height filled in, then this has already been partially accumulated.
+    if (!coinWitness->nHeightAccEnd) {
+        LogPrintf("RESET ACC\n");
+        coinWitness->pAccumulator = std::unique_ptr<libzerocoin::Accumulator>(new libzerocoin::Accumulator(Params().Zerocoin_Params(false), coinWitness->denom));
+        coinWitness->pWitness = std::unique_ptr<libzerocoin::AccumulatorWitness>(new libzerocoin::AccumulatorWitness(Params().Zerocoin_Params(false), *coinWitness->pAccumulator, *coinWitness->coin));
+    }
 
-        int64_t nTimeStart = GetTimeMicros();
+    // Mint added height
+    coinWitness->SetHeightMintAdded(SearchMintHeightOf(coinWitness->coin->getValue()));
 
-        //If there is a Acc End height filled in, then this has already been partially accumulated.
-        if (!coinWitness->nHeightAccEnd) {
-            LogPrintf("RESET ACC\n");
-            coinWitness->pAccumulator = std::unique_ptr<libzerocoin::Accumulator>(new libzerocoin::Accumulator(Params().Zerocoin_Params(false), coinWitness->denom));
-            coinWitness->pWitness = std::unique_ptr<libzerocoin::AccumulatorWitness>(new libzerocoin::AccumulatorWitness(Params().Zerocoin_Params(false), *coinWitness->pAccumulator, *coinWitness->coin));
-        }
+    // Set the initial state of the witness accumulator for this coin.
+    CBigNum bnAccValue = 0;
+    if (!coinWitness->nHeightAccEnd && GetAccumulatorValue(coinWitness->nHeightCheckpoint, coinWitness->coin->getDenomination(), bnAccValue)) {
+        libzerocoin::Accumulator witnessAccumulator(Params().Zerocoin_Params(false), coinWitness->denom, bnAccValue);
+        coinWitness->pAccumulator->setValue(witnessAccumulator.getValue());
+    }
 
-        // Mint added height
-        coinWitness->SetHeightMintAdded(SearchMintHeightOf(coinWitness->coin->getValue()));
+    // Determine the height to stop at
+    if (!pindexCheckpoint)
+        return nHeightMax;
 
-        // Set the initial state of the witness accumulator for this coin.
-        CBigNum bnAccValue = 0;
-        if (!coinWitness->nHeightAccEnd && GetAccumulatorValue(coinWitness->nHeightCheckpoint, coinWitness->coin->getDenomination(), bnAccValue)) {
-            libzerocoin::Accumulator witnessAccumulator(Params().Zerocoin_Params(false), coinWitness->denom, bnAccValue);
-            coinWitness->pAccumulator->setValue(witnessAccumulator.getValue());
-        }
+    int nHeightStop = pindexCheckpoint->nHeight - 10;
+    nHeightStop -= nHeightStop % 10;
+    LogPrint("zero", "%s: using checkpoint height %d\n", __func__, pindexCheckpoint->nHeight);
+    return nHeightStop;
+}
 
-        //add the pubcoins from the blockchain up to the next checksum starting from the block
-        int nChainHeight = chainActive.Height();
-        int nHeightMax = nChainHeight % 10;
-        nHeightMax = nChainHeight - nHeightMax - 20; // at least two checkpoints deep
 
-        // Determine the height to stop at
-        int nHeightStop;
-        if (pindexCheckpoint) {
-            nHeightStop = pindexCheckpoint->nHeight - 10;
-            nHeightStop -= nHeightStop % 10;
-            LogPrint("zero", "%s: using checkpoint height %d\n", __func__, pindexCheckpoint->nHeight);
-        } else {
-            nHeightStop = nHeightMax;
-        }
+// Check an accumulated witness against the checkpoint it was generated for
+static bool FinishWitness(CoinWitnessData* coinWitness, int nHeightStop, AccumulatorMap& mapAccumulators, std::string& strError)
+{
+    mapAccumulators.Load(chainActive[nHeightStop + 10]->nAccumulatorCheckpoint);
+    coinWitness->pWitness->resetValue(*coinWitness->pAccumulator, *coinWitness->coin);
+    if (!coinWitness->pWitness->VerifyWitness(mapAccumulators.GetAccumulator(coinWitness->denom), *coinWitness->coin)) {
+        strError = "failed to verify witness";
+        return error("%s: %s", __func__, strError);
+    }
 
-        if (nHeightStop > coinWitness->nHeightAccEnd)
-            AccumulateRange(coinWitness, nHeightStop - 1);
+    // A certain amount of accumulated coins are required
+    if (coinWitness->nMintsAdded < Params().Zerocoin_RequiredAccumulation()) {
+        strError = strprintf("Less than %d mints added, unable to create spend", Params().Zerocoin_RequiredAccumulation());
+        return error("%s : %s. %s", __func__, strError, coinWitness->ToString());
+    }
 
-        mapAccumulators.Load(chainActive[nHeightStop + 10]->nAccumulatorCheckpoint);
-        coinWitness->pWitness->resetValue(*coinWitness->pAccumulator, *coinWitness->coin);
-        if(!coinWitness->pWitness->VerifyWitness(mapAccumulators.GetAccumulator(coinWitness->denom), *coinWitness->coin))
-            return error("%s: failed to verify witness", __func__);
+    // calculate how many mints of this denomination existed in the accumulator we initialized
+    coinWitness->nMintsAdded += ComputeAccumulatedCoins(coinWitness->nHeightAccStart, coinWitness->denom);
+    LogPrint("zero", "%s : %d mints added to witness\n", __func__, coinWitness->nMintsAdded);
+    return true;
+}
 
-        // A certain amount of accumulated coins are required
-        if (coinWitness->nMintsAdded < Params().Zerocoin_RequiredAccumulation())
-            return error("%s : Less than %d mints added, unable to create spend. %s", __func__, Params().Zerocoin_RequiredAccumulation(), coinWitness->ToString());
 
-        // calculate how many mints of this denomination existed in the accumulator we initialized
-        coinWitness->nMintsAdded += ComputeAccumulatedCoins(coinWitness->nHeightAccStart, coinWitness->denom);
-        LogPrint("zero", "%s : %d mints added to witness\n", __func__, coinWitness->nMintsAdded);
+bool GenerateAccumulatorWitnesses(std::vector<CWitnessJob>& vJobs, AccumulatorMap& mapAccumulators, const WitnessProgressFn& fnProgress)
+{
+    // Lock
+    LogPrint("zero", "%s: generating %u witnesses\n", __func__, vJobs.size());
+    if (!LockMethod()) return false;
+    LogPrint("zero", "%s: after lock\n", __func__);
 
-        int64_t nTime1 = GetTimeMicros();
-        LogPrint("bench", "        - Witness generated in %.2fms\n", 0.001 * (nTime1 - nTimeStart));
+    int64_t nTimeStart = GetTimeMicros();
 
-        return true;
+    //add the pubcoins from the blockchain up to the next checksum starting from the block
+    int nChainHeight = chainActive.Height();
+    int nHeightMax = nChainHeight % 10;
+    nHeightMax = nChainHeight - nHeightMax - 20; // at least two checkpoints deep
 
-        // TODO: I know that could merge all of this exception but maybe it's not really good.. think if we should have a different treatment for each one
-    } catch (searchMintHeightException e) {
-        return error("%s: searchMintHeightException: %s", __func__, e.message);
-    } catch (ChecksumInDbNotFoundException e) {
-        return error("%s: ChecksumInDbNotFoundException: %s", __func__, e.message);
-    } catch (GetPubcoinException e) {
+    for (CWitnessJob& job : vJobs) {
+        job.fDone = false;
+        job.strError.clear();
+    }
+
+    std::vector<int> vHeightStop(vJobs.size());
+    std::vector<std::pair<CoinWitnessData*, int> > vRanges;
+    for (unsigned int i = 0; i < vJobs.size(); i++) {
+        CWitnessJob& job = vJobs[i];
+        if (fnProgress && !fnProgress(std::vector<CoinWitnessData*>(1, job.pWitness))) {
+            LogPrint("zero", "%s: stopped before preparing witness %u\n", __func__, i);
+            return false;
+        }
+        try {
+            vHeightStop[i] = PrepareWitness(job.pWitness, job.pindexCheckpoint, nHeightMax);
+        } catch (const searchMintHeightException& e) {
+            job.strError = e.message;
+            error("%s: searchMintHeightException: %s", __func__, e.message);
+            continue;
+        } catch (const ChecksumInDbNotFoundException& e) {
+            job.strError = e.message;
+            error("%s: ChecksumInDbNotFoundException: %s", __func__, e.message);
+            continue;
+        }
+        if (vHeightStop[i] > job.pWitness->nHeightAccEnd)
+            vRanges.emplace_back(job.pWitness, vHeightStop[i] - 1);
+    }
+
+    // All coins share one pass over the blocks, so each block's mints are read once
+    bool fComplete;
+    try {
+        fComplete = AccumulateWitnesses(vRanges, fnProgress);
+    } catch (const GetPubcoinException& e) {
+        for (CWitnessJob& job : vJobs) {
+            if (job.strError.empty())
+                job.strError = e.message;
+        }
         return error("%s: GetPubcoinException: %s", __func__, e.message);
     }
+
+    bool fAllDone = true;
+    for (unsigned int i = 0; i < vJobs.size(); i++) {
+        CWitnessJob& job = vJobs[i];
+        if (!job.strError.empty()) {
+            fAllDone = false;
+            continue;
+        }
+        // Stopped before this coin was accumulated to the end, it continues from nHeightAccEnd next time
+        if (!fComplete && job.pWitness->nHeightAccEnd < vHeightStop[i] - 1) {
+            fAllDone = false;
+            continue;
+        }
+        if (fnProgress && !fnProgress(std::vector<CoinWitnessData*>(1, job.pWitness))) {
+            LogPrint("zero", "%s: stopped before checking witness %u\n", __func__, i);
+            return false;
+        }
+        try {
+            job.fDone = FinishWitness(job.pWitness, vHeightStop[i], mapAccumulators, job.strError);
+        } catch (const ChecksumInDbNotFoundException& e) {
+            job.strError = e.message;
+            error("%s: ChecksumInDbNotFoundException: %s", __func__, e.message);
+        }
+        fAllDone &= job.fDone;
+    }
+
+    int64_t nTime1 = GetTimeMicros();
+    LogPrint("bench", "        - %u witnesses generated in %.2fms\n", vJobs.size(), 0.001 * (nTime1 - nTimeStart));
+
+    return fAllDone;
+}
+
+
+bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& mapAccumulators, CBlockIndex* pindexCheckpoint)
+{
+    std::vector<CWitnessJob> vJobs(1, CWitnessJob(coinWitness, pindexCheckpoint));
+    return GenerateAccumulatorWitnesses(vJobs, mapAccumulators);
 }
 
 bool calculateAccumulatedBlocksFor(
@@ -909,8 +1029,7 @@ std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight()
         for (auto denom : libzerocoin::zerocoinDenomList) {
             //If the denom has not already had a mint added to it, then see if it has a mint added on this block
             if (mapDenomMaturity.at(denom).first < Params().Zerocoin_RequiredAccumulation()) {
-                mapDenomMaturity.at(denom).first += count(pindex->vMintDenominationsInBlock.begin(),
-                                                          pindex->vMintDenominationsInBlock.end(), denom);
+                mapDenomMaturity.at(denom).first += pindex->mintsInBlock.Count(denom);
 
                 //if mint was found then record this block as the first block that maturity occurs.
                 if (mapDenomMaturity.at(denom).first >= Params().Zerocoin_RequiredAccumulation())
@@ -15,6 +15,8 @@
 #include "bloom.h"
 #include "witness.h"
 
+#include <boost/function.hpp>
+
 class CBlockIndex;
 
 std::map<libzerocoin::CoinDenomination, int> GetMintMaturityHeight();
@@ -47,6 +49,40 @@ bool GenerateAccumulatorWitness(
         CBlockIndex* pindexCheckpoint = nullptr);
 
 
+/** A coin whose witness is brought up to date by GenerateAccumulatorWitnesses */
+struct CWitnessJob {
+    CoinWitnessData* pWitness;
+    //! generate the witness for this checkpoint, or for the latest one two checkpoints deep if null
+    CBlockIndex* pindexCheckpoint;
+    //! the witness verifies against the checkpoint
+    bool fDone;
+    //! why the witness could not be generated, empty if the pass was stopped before it was done
+    std::string strError;
+
+    CWitnessJob(CoinWitnessData* pWitnessIn, CBlockIndex* pindexCheckpointIn) : pWitness(pWitnessIn), pindexCheckpoint(pindexCheckpointIn), fDone(false) {}
+};
+
+/**
+ * Called before each witness is set up and before each is checked, and with
+ * the witnesses being accumulated every WITNESS_PROGRESS_INTERVAL blocks.
+ * Return false to stop the pass.
+ */
+typedef boost::function<bool(const std::vector<CoinWitnessData*>&)> WitnessProgressFn;
+
+/**
+ * Add the mints of the blocks up to each coin's end height to its witness
+ * accumulator, in one pass over the chain that reads the mints of a block
+ * once for all coins.
+ * @return false if fnProgress stopped the pass
+ */
+bool AccumulateWitnesses(const std::vector<std::pair<CoinWitnessData*, int> >& vRanges, const WitnessProgressFn& fnProgress);
+
+/**
+ * Generate the witnesses of several coins. Each witness continues from where
+ * its last accumulation ended, so a stopped pass can be resumed later.
+ * @return true if every witness was generated
+ */
+bool GenerateAccumulatorWitnesses(std::vector<CWitnessJob>& vJobs, AccumulatorMap& mapAccumulators, const WitnessProgressFn& fnProgress = WitnessProgressFn());
 bool GenerateAccumulatorWitness(CoinWitnessData* coinWitness, AccumulatorMap& mapAccumulators, CBlockIndex* pindexCheckpoint);
 std::list<libzerocoin::PublicCoin> GetPubcoinFromBlock(const CBlockIndex* pindex);
 bool GetAccumulatorValueFromDB(uint256 nCheckpoint, libzerocoin::CoinDenomination denom, CBigNum& bnAccValue);
@@ -14,6 +14,7 @@
 #define PRECOMPUTE_LRU_CACHE_SIZE 1000
 #define PRECOMPUTE_MAX_DIRTY_CACHE_SIZE 100
 #define PRECOMPUTE_FLUSH_TIME 300 // 5 minutes
+#define WITNESS_PROGRESS_INTERVAL 10 // blocks between progress callbacks of a witness pass
 
 class CoinWitnessCacheData;
 
@@ -105,8 +105,7 @@ namespace ZWSPModule {
         return true;
     }
 
-    bool validateInput(const CTxIn &in, const CTxOut &prevOut, const CTransaction &tx, PublicCoinSpend &publicSpend) {
-        // Now prove that the commitment value opens to the input
+    bool checkInput(const CTxIn &in, const CTxOut &prevOut, const CTransaction &tx, PublicCoinSpend &publicSpend) {
         if (!parseCoinSpend(in, tx, prevOut, publicSpend)) {
             return false;
         }
@@ -114,7 +113,15 @@ namespace ZWSPModule {
                 libzerocoin::IntToZerocoinDenomination(in.nSequence)) != prevOut.nValue) {
             return error("PublicCoinSpend validateInput :: input nSequence different to prevout value");
         }
+        return true;
+    }
 
+    bool validateInput(const CTxIn &in, const CTxOut &prevOut, const CTransaction &tx, PublicCoinSpend &publicSpend) {
+        if (!checkInput(in, prevOut, tx, publicSpend)) {
+            return false;
+        }
+
+        // Now prove that the commitment value opens to the input
         return publicSpend.validate();
     }
 
@@ -78,6 +78,8 @@ namespace ZWSPModule {
     bool createInput(CTxIn &in, CZerocoinMint& mint, uint256 hashTxOut);
     PublicCoinSpend parseCoinSpend(const CTxIn &in);
     bool parseCoinSpend(const CTxIn &in, const CTransaction& tx, const CTxOut &prevOut, PublicCoinSpend& publicCoinSpend);
+    // Parse the spend and check its denomination, without validating the commitment and signature
+    bool checkInput(const CTxIn &in, const CTxOut &prevOut, const CTransaction& tx, PublicCoinSpend& ret);
     bool validateInput(const CTxIn &in, const CTxOut &prevOut, const CTransaction& tx, PublicCoinSpend& ret);
 
     // Public zc spend parse